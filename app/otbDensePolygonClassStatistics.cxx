@@ -22,6 +22,13 @@
 
 #include "otbOGR.h"
 
+// Fused statistics
+#include "otbRAMDrivenStrippedStreamingManager.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkMultiThreader.h"
+#include <unordered_map>
+#include <thread>
+
 namespace otb
 {
 namespace Wrapper
@@ -50,6 +57,9 @@ public:
   typedef UInt32ImageType                           LabelImageType;
   typedef UInt8ImageType                            MaskImageType;
   typedef VectorData<>                              VectorDataType;
+  typedef VectorDataType::DataTreeType              DataTreeType;
+  typedef itk::PreOrderTreeIterator<DataTreeType>   TreeIteratorType;
+  typedef VectorDataType::DataNodeType              DataNodeType;
 
   /** ProcessObjects typedef */
   typedef otb::VectorDataIntoImageProjectionFilter<VectorDataType,
@@ -66,6 +76,9 @@ public:
 
   typedef otb::StatisticsXMLFileWriter<FloatVectorImageType::PixelType>           StatWriterType;
 
+  typedef otb::RAMDrivenStrippedStreamingManager<LabelImageType>                  StreamingManagerType;
+  typedef std::unordered_map<LabelImageType::ValueType, unsigned long long>       CountMapType;
+
 
 private:
   DensePolygonClassStatistics()
@@ -105,6 +118,10 @@ private:
     SetParameterDescription("field","Name of the field carrying the class number in the input vectors.");
     SetListViewSingleSelectionMode("field",true);
 
+    AddParameter(ParameterType_Bool, "fused", "Rasterize the geometries once, and deduce the number of samples "
+        "per class from the number of samples per geometry (one single pass)");
+    MandatoryOff("fused");
+
     ElevationParametersHandler::AddElevationParameters(this, "elev");
 
     AddRAMParameter();
@@ -164,6 +181,102 @@ private:
        }
   }
 
+  /*
+   * Compute the number of samples per geometry and per class in one single
+   * pass over the rasterized geometries IDs. Each stream region is
+   * rasterized once, and its pixels are counted by multiple threads in
+   * thread-local maps. The geometries IDs are written in a field of the
+   * vector data, which is burnt by the rasterization, and the class of each
+   * geometry is read at the same time. As in the statistics filter, the population of a label is the number of
+   * its pixels.
+   */
+  void ComputeFusedStatistics(RasterizeFilterType * rasterizeFIDFilter, VectorDataType * vectorData,
+      const std::string & fieldName, LabelImageType::ValueType intNoData,
+      StatsFilterType::LabelPopulationMapType & fidMap, StatsFilterType::LabelPopulationMapType & classMap)
+  {
+    // Geometry ID and class of each geometry
+    const std::string fidFieldName = "otbtf_fid";
+    std::vector<LabelImageType::ValueType> fidToClass;
+    TreeIteratorType itVector(vectorData->GetDataTree());
+    for (itVector.GoToBegin(); !itVector.IsAtEnd(); ++itVector)
+      {
+      DataNodeType * node = itVector.Get();
+      if (node->IsPointFeature() || node->IsLineFeature() || node->IsPolygonFeature())
+        {
+        if (node->HasField(fidFieldName))
+          {
+          otbAppLogFATAL("The input vectors already have a field named " << fidFieldName <<
+              ". Please disable the fused mode.");
+          }
+        node->SetFieldAsInt(fidFieldName, static_cast<int>(fidToClass.size()));
+        fidToClass.push_back(static_cast<LabelImageType::ValueType>(node->GetFieldAsDouble(fieldName)));
+        }
+      }
+    rasterizeFIDFilter->SetBurnAttribute(fidFieldName);
+
+    // Streaming over the rasterized geometries IDs
+    LabelImageType::Pointer fidImage = rasterizeFIDFilter->GetOutput();
+    fidImage->UpdateOutputInformation();
+    StreamingManagerType::Pointer streamingManager = StreamingManagerType::New();
+    streamingManager->SetAvailableRAMInMB(GetParameterInt("ram"));
+    streamingManager->PrepareStreaming(fidImage, fidImage->GetLargestPossibleRegion());
+
+    const unsigned int nThreads = std::max(1u, static_cast<unsigned int>(itk::MultiThreader::GetGlobalDefaultNumberOfThreads()));
+    std::vector<CountMapType> counts(nThreads);
+
+    const unsigned int nDivisions = streamingManager->GetNumberOfSplits();
+    for (unsigned int division = 0 ; division < nDivisions ; division++)
+      {
+      const LabelImageType::RegionType streamRegion = streamingManager->GetSplit(division);
+      fidImage->SetRequestedRegion(streamRegion);
+      fidImage->PropagateRequestedRegion();
+      fidImage->UpdateOutputData();
+
+      // Each thread counts a part of the rows
+      const unsigned int nRegionThreads = std::min<unsigned int>(nThreads, streamRegion.GetSize(1));
+      auto count = [&](unsigned int threadId)
+        {
+        const LabelImageType::SizeValueType nRows = streamRegion.GetSize(1);
+        LabelImageType::RegionType threadRegion(streamRegion);
+        threadRegion.SetIndex(1, streamRegion.GetIndex(1) + threadId * nRows / nRegionThreads);
+        threadRegion.SetSize(1, (threadId + 1) * nRows / nRegionThreads - threadId * nRows / nRegionThreads);
+
+        CountMapType & threadCounts = counts[threadId];
+        itk::ImageRegionConstIterator<LabelImageType> it(fidImage, threadRegion);
+        for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+          threadCounts[it.Get()]++;
+        };
+      std::vector<std::thread> threads;
+      for (unsigned int t = 1 ; t < nRegionThreads ; t++)
+        threads.push_back(std::thread(count, t));
+      count(0);
+      for (auto & thread: threads)
+        thread.join();
+
+      otbAppLogINFO("Computing number of samples per vector and per class: " <<
+          (100 * (division + 1) / nDivisions) << "%");
+      }
+
+    // Reduce the thread-local maps
+    fidMap.clear();
+    classMap.clear();
+    for (auto const& threadCounts: counts)
+      {
+      for (auto const& entry: threadCounts)
+        {
+        if (entry.first == intNoData)
+          continue;
+        if (entry.first >= fidToClass.size())
+          {
+          otbAppLogFATAL("The geometry ID " << entry.first << " has no class (" << fidToClass.size() <<
+              " geometries). Please disable the fused mode.");
+          }
+        fidMap[entry.first] += entry.second;
+        classMap[fidToClass[entry.first]] += entry.second;
+        }
+      }
+  }
+
   void DoExecute() override
   {
 
@@ -215,6 +328,21 @@ private:
   m_RasterizeFIDFilter->SetBackgroundValue(intNoData);
   m_RasterizeFIDFilter->SetDefaultBurnValue(0);
 
+  // Fused mode: one single rasterization
+  if (GetParameterInt("fused") == 1)
+    {
+    StatsFilterType::LabelPopulationMapType fidMap, classMap;
+    ComputeFusedStatistics(m_RasterizeFIDFilter, m_VectorDataReprojectionFilter->GetOutput(), fieldName, intNoData,
+        fidMap, classMap);
+
+    StatWriterType::Pointer statWriter = StatWriterType::New();
+    statWriter->SetFileName(this->GetParameterString("out"));
+    statWriter->AddInputMap<StatsFilterType::LabelPopulationMapType>("samplesPerClass",classMap);
+    statWriter->AddInputMap<StatsFilterType::LabelPopulationMapType>("samplesPerVector",fidMap);
+    statWriter->Update();
+    return;
+    }
+
   // Rasterize vector data (geometry class)
   m_RasterizeClassFilter = RasterizeFilterType::New();
   m_RasterizeClassFilter->AddVectorData(m_VectorDataReprojectionFilter->GetOutput());
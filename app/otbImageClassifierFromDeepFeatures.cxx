@@ -20,6 +20,9 @@
 #include "otbStandardFilterWatcher.h"
 #include "itkFixedArray.h"
 
+// Bands of the fused output (labels and confidences)
+#include "otbMultiChannelExtractROI.h"
+
 // TF (used to get the environment variable for the number of inputs)
 #include "otbTensorflowCommon.h"
 
@@ -42,6 +45,10 @@ public:
   itkNewMacro(Self);
   itkTypeMacro(ImageClassifierFromDeepFeatures, otb::Wrapper::CompositeApplication);
 
+  /** Filter extracting one band of the fused output */
+  typedef otb::MultiChannelExtractROI<FloatVectorImageType::InternalPixelType,
+      FloatVectorImageType::InternalPixelType>     ExtractChannelFilterType;
+
 private:
 
   //
@@ -72,8 +79,12 @@ private:
 
     // Documentation
     SetDocName("ImageClassifierFromDeepFeatures");
-    SetDocLongDescription("See ImageClassifier application");
-    SetDocLimitations("None");
+    SetDocLongDescription("See ImageClassifier application. In fused mode, the deep features "
+        "are classified from the output tensors of the deep net, in one single pass: the "
+        "features image is never produced. The confidence map is the second band of the "
+        "output of the deep net application.");
+    SetDocLimitations("In fused mode, the deep net is run once for each output image (i.e. "
+        "twice when the confidence map is produced).");
     SetDocAuthors("Remi Cresson");
     SetDocSeeAlso(" ");
 
@@ -104,6 +115,10 @@ private:
     ShareParameter("confmap"    , "classif.confmap"    , "Confidence map image", "Confidence map image");
     ShareParameter("ram"        , "classif.ram"        , "Ram"                 , "Ram"                 );
 
+    // Fused mode
+    AddParameter(ParameterType_Bool, "fused", "Classify the deep features in one single pass, without producing the features image");
+    MandatoryOff                    ("fused");
+
   }
 
 
@@ -114,16 +129,66 @@ private:
 
   void DoExecute()
   {
+    if (GetParameterInt("fused") == 1)
+    {
+      ExecuteFused();
+      return;
+    }
+
     ExecuteInternal("tfmodel");
     GetInternalApplication("classif")->SetParameterInputImage("in", GetInternalApplication("tfmodel")->GetParameterOutputImage("out"));
     UpdateInternalParameters("classif");
     ExecuteInternal("classif");
   }   // DOExecute()
 
+  //
+  // The deep net application classifies its output values with the machine
+  // learning model, and its output image is the labels image
+  //
+  void ExecuteFused()
+  {
+    const bool confidence = HasValue("confmap");
+
+    Application * tfmodel = GetInternalApplication("tfmodel");
+    tfmodel->SetParameterString("output.classifier", GetParameterString("model"));
+    if (HasValue("imstat"))
+    {
+      tfmodel->SetParameterString("output.imstat", GetParameterString("imstat"));
+    }
+    tfmodel->SetParameterFloat("output.fill", GetParameterInt("nodatalabel"));
+    tfmodel->SetParameterInt("output.confidence", confidence ? 1 : 0);
+    ExecuteInternal("tfmodel");
+
+    Application * classif = GetInternalApplication("classif");
+    if (!confidence)
+    {
+      classif->SetParameterOutputImage("out", tfmodel->GetParameterOutputImage("out"));
+      return;
+    }
+
+    // The labels and the confidences are the two bands of the output
+    FloatVectorImageType * output = dynamic_cast<FloatVectorImageType*>(tfmodel->GetParameterOutputImage("out"));
+    if (output == nullptr)
+    {
+      otbAppLogFATAL("The output of the deep net application is not a float image");
+    }
+    m_LabelFilter = ExtractChannelFilterType::New();
+    m_LabelFilter->SetInput(output);
+    m_LabelFilter->SetChannel(1);
+    m_ConfidenceFilter = ExtractChannelFilterType::New();
+    m_ConfidenceFilter->SetInput(output);
+    m_ConfidenceFilter->SetChannel(2);
+    classif->SetParameterOutputImage("out", m_LabelFilter->GetOutput());
+    classif->SetParameterOutputImage("confmap", m_ConfidenceFilter->GetOutput());
+  }
+
   void AfterExecuteAndWriteOutputs()
   {
     // Nothing to do
   }
+
+  ExtractChannelFilterType::Pointer m_LabelFilter;
+  ExtractChannelFilterType::Pointer m_ConfidenceFilter;
 };
 }
 }
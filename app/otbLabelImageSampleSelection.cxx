@@ -19,6 +19,12 @@
 #include "vnl/vnl_vector.h"
 #include "itkImageRegionIterator.h"
 #include "itkImageRegionConstIterator.h"
+#include "itkMultiThreader.h"
+
+// Multi-threaded count, reservoir sampling
+#include <thread>
+#include <random>
+#include <algorithm>
 
 // image utils
 #include "otbTensorflowCommon.h"
@@ -51,6 +57,15 @@ public:
   /** typedefs */
   typedef Int16ImageType                               LabelImageType;
   typedef unsigned int                                 IndexValueType;
+  typedef std::vector<IndexValueType>                  HistogramType;
+
+  /** A sample kept in a reservoir */
+  struct SampleType
+  {
+    LabelImageType::IndexType         m_Index;
+    LabelImageType::InternalPixelType m_Label;
+  };
+  typedef std::vector<SampleType>                      ReservoirType;
 
   void DoUpdateParameters()
   {
@@ -86,7 +101,10 @@ public:
         "a set of points centered on the pixels of the input label image. "
         "The user can control the number of points. The default strategy consists "
         "in producing the same number of points in each class. If one class has a "
-        "smaller number of points than requested, this one is adjusted.");
+        "smaller number of points than requested, this one is adjusted. "
+        "The pixels of each class are counted with multiple threads. With the "
+        "constant and total strategies, the points can also be randomly selected "
+        "in one single pass over the label image, with reservoir sampling.");
 
     SetDocAuthors("Remi Cresson");
 
@@ -130,6 +148,14 @@ public:
     SetDefaultParameterInt         ("pad", 0);
     MandatoryOff                   ("pad");
 
+    // Reservoir sampling
+    AddParameter(ParameterType_Bool, "reservoir", "Select the samples in one single pass with reservoir sampling "
+        "(constant and total strategies only). The samples are randomly drawn instead of regularly spaced.");
+    MandatoryOff                    ("reservoir");
+    AddParameter(ParameterType_Int,  "seed", "Seed of the random generator used for the reservoir sampling");
+    SetDefaultParameterInt          ("seed", 0);
+    MandatoryOff                    ("seed");
+
     // Output points
     AddParameter(ParameterType_OutputVectorData, "outvec", "output set of points");
 
@@ -142,6 +168,215 @@ public:
   }
 
 
+  /*
+   * Count the pixels of each class in the region, with multiple threads.
+   * Each thread counts the pixels of a part of the rows in its own
+   * histogram, and the histograms are summed at the end.
+   */
+  void CountClasses(const LabelImageType * image, const LabelImageType::RegionType & region,
+      LabelImageType::InternalPixelType nodata, std::vector<HistogramType> & histograms)
+  {
+    const unsigned int nThreads = std::max(1u, std::min<unsigned int>(histograms.size(), region.GetSize(1)));
+    auto count = [&](unsigned int threadId)
+    {
+      // Rows of the thread
+      const LabelImageType::SizeValueType nRows = region.GetSize(1);
+      LabelImageType::RegionType threadRegion(region);
+      threadRegion.SetIndex(1, region.GetIndex(1) + threadId * nRows / nThreads);
+      threadRegion.SetSize(1, (threadId + 1) * nRows / nThreads - threadId * nRows / nThreads);
+
+      HistogramType & histogram = histograms[threadId];
+      itk::ImageRegionConstIterator<LabelImageType> inIt (image, threadRegion);
+      for (inIt.GoToBegin(); !inIt.IsAtEnd(); ++inIt)
+      {
+        const LabelImageType::InternalPixelType pixVal = inIt.Get();
+        if (pixVal != nodata && pixVal >= 0)
+          histogram[pixVal]++;
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1 ; t < nThreads ; t++)
+    {
+      threads.push_back(std::thread(count, t));
+    }
+    count(0);
+    for (auto & thread: threads)
+    {
+      thread.join();
+    }
+  }
+
+  /*
+   * Add a sample to a reservoir of the given capacity (algorithm R).
+   * "seen" is the number of samples that have been candidates so far.
+   */
+  static void AddToReservoir(ReservoirType & reservoir, unsigned long long seen, unsigned int capacity,
+      const SampleType & sample, std::mt19937_64 & generator)
+  {
+    if (reservoir.size() < capacity)
+    {
+      reservoir.push_back(sample);
+    }
+    else
+    {
+      const unsigned long long k = std::uniform_int_distribution<unsigned long long>(0, seen)(generator);
+      if (k < capacity)
+        reservoir[k] = sample;
+    }
+  }
+
+  /*
+   * Create the output vector data
+   */
+  void CreateVectorData(const LabelImageType * inputImage)
+  {
+    // TODO: how to pre-allocate the datatree?
+    m_OutVectorData = VectorDataType::New();
+    DataTreeType::Pointer tree = m_OutVectorData->GetDataTree();
+    DataNodePointer root = tree->GetRoot()->Get();
+    m_Document = DataNodeType::New();
+    m_Document->SetNodeType(DOCUMENT);
+    tree->Add(m_Document, root);
+
+    // Duno if this makes sense?
+    m_OutVectorData->SetProjectionRef(inputImage->GetProjectionRef());
+    m_OutVectorData->SetOrigin(inputImage->GetOrigin());
+    m_OutVectorData->SetSpacing(inputImage->GetSpacing());
+  }
+
+  /*
+   * Add one point, centered on the given pixel, to the output vector data
+   */
+  void AddPoint(const LabelImageType * inputImage, const LabelImageType::IndexType & index, int classVal)
+  {
+    // Create a point
+    LabelImageType::PointType geo;
+    inputImage->TransformIndexToPhysicalPoint(index, geo);
+    DataNodeType::PointType point;
+    point[0] = geo[0];
+    point[1] = geo[1];
+
+    // Add point to the VectorData tree
+    DataNodePointer newDataNode = DataNodeType::New();
+    newDataNode->SetPoint(point);
+    newDataNode->SetFieldAsInt("class", classVal);
+    m_OutVectorData->GetDataTree()->Add(newDataNode, m_Document);
+  }
+
+  /*
+   * Select the samples in one single pass, with reservoir sampling:
+   * -constant strategy: one reservoir per class,
+   * -total strategy: one reservoir for all the classes, so that the classes
+   *  proportions are kept (in expectation).
+   */
+  void SelectWithReservoirs(LabelImageType::Pointer inputImage, const std::vector<LabelImageType::RegionType> & streamRegions,
+      LabelImageType::InternalPixelType nodata)
+  {
+    const bool perClass = (GetParameterInt("strategy") == 0);
+    const unsigned int capacity = perClass ? GetParameterInt("strategy.constant.nb") : GetParameterInt("strategy.total.v");
+    const unsigned int nLabels = itk::NumericTraits<LabelImageType::InternalPixelType>::max() + 1;
+    std::vector<ReservoirType> reservoirs(perClass ? nLabels : 1);
+    std::vector<unsigned long long> seen(nLabels, 0);
+    unsigned long long totalSeen = 0;
+    std::mt19937_64 generator(GetParameterInt("seed"));
+
+    otbAppLogINFO("Selecting the samples with reservoir sampling");
+
+    for (unsigned int division = 0 ; division < streamRegions.size() ; division++)
+    {
+      tf::PropagateRequestedRegion<LabelImageType>(inputImage, streamRegions[division]);
+      itk::ImageRegionConstIterator<LabelImageType> inIt (inputImage, streamRegions[division]);
+      for (inIt.GoToBegin(); !inIt.IsAtEnd(); ++inIt)
+      {
+        const LabelImageType::InternalPixelType pixVal = inIt.Get();
+        if (pixVal != nodata && pixVal >= 0)
+        {
+          SampleType sample;
+          sample.m_Index = inIt.GetIndex();
+          sample.m_Label = pixVal;
+          if (perClass)
+            AddToReservoir(reservoirs[pixVal], seen[pixVal], capacity, sample, generator);
+          else
+            AddToReservoir(reservoirs[0], totalSeen, capacity, sample, generator);
+          seen[pixVal]++;
+          totalSeen++;
+        }
+      }
+      ShowProgress(division, streamRegions.size(), 1);
+    }
+    ShowProgressDone();
+
+    // Classes
+    const auto firstClass = std::find_if(seen.begin(), seen.end(), [](unsigned long long n) { return n > 0; });
+    if (firstClass == seen.end())
+    {
+      otbAppLogFATAL("There is no sample!");
+    }
+    const LabelImageType::InternalPixelType class_begin = firstClass - seen.begin();
+    const LabelImageType::InternalPixelType class_end =
+        std::find_if(seen.rbegin(), seen.rend(), [](unsigned long long n) { return n > 0; }).base() - seen.begin() - 1;
+    const LabelImageType::InternalPixelType number_of_classes = class_end - class_begin + 1;
+    vnl_vector<IndexValueType> number_of_samples(number_of_classes, 0);
+    IndexValueType min_elem_in_class = itk::NumericTraits<IndexValueType>::max();
+    for (LabelImageType::InternalPixelType classIdx = 0 ; classIdx < number_of_classes ; classIdx++)
+    {
+      number_of_samples[classIdx] = seen[classIdx + class_begin];
+      min_elem_in_class = vcl_min(min_elem_in_class, number_of_samples[classIdx]);
+    }
+    otbAppLogINFO( "Number of classes: " << number_of_classes <<
+        " starting from " << class_begin <<
+        " to " << class_end << " (no-data is " << nodata << ")");
+    otbAppLogINFO( "Number of pixels in each class: " << number_of_samples );
+    if (min_elem_in_class == 0)
+    {
+      otbAppLogFATAL("There is at least one class with no sample!")
+    }
+
+    // Gather the selected samples. In constant mode, when the smallest class
+    // has less samples than requested, the same number of samples is kept in
+    // each class (the reservoirs are shuffled, so that the kept samples are
+    // still uniformly drawn).
+    ReservoirType selection;
+    if (perClass)
+    {
+      unsigned int target = capacity;
+      if (min_elem_in_class < target)
+      {
+        otbAppLogWARNING("Smallest class has " << min_elem_in_class <<
+            " samples but a number of " << target <<
+            " is given. Using " << min_elem_in_class);
+        target = min_elem_in_class;
+      }
+      for (LabelImageType::InternalPixelType classIdx = class_begin ; classIdx <= class_end ; classIdx++)
+      {
+        ReservoirType & reservoir = reservoirs[classIdx];
+        std::shuffle(reservoir.begin(), reservoir.end(), generator);
+        selection.insert(selection.end(), reservoir.begin(), reservoir.begin() + std::min<std::size_t>(target, reservoir.size()));
+      }
+    }
+    else
+    {
+      selection = reservoirs[0];
+    }
+
+    // Write the points in raster order
+    std::sort(selection.begin(), selection.end(), [](const SampleType & a, const SampleType & b)
+    {
+      return a.m_Index[1] < b.m_Index[1] || (a.m_Index[1] == b.m_Index[1] && a.m_Index[0] < b.m_Index[0]);
+    });
+    CreateVectorData(inputImage);
+    vnl_vector<IndexValueType> sampledCount(number_of_classes, 0);
+    for (auto const& sample: selection)
+    {
+      const int classVal = sample.m_Label - class_begin;
+      sampledCount[classVal]++;
+      AddPoint(inputImage, sample.m_Index, classVal);
+    }
+
+    otbAppLogINFO( "Number of samples in each class: " << sampledCount );
+  }
+
   void DoExecute()
   {
 
@@ -150,9 +385,7 @@ public:
         itk::NumericTraits<LabelImageType::InternalPixelType>::max();;
     LabelImageType::InternalPixelType class_begin = MAX_NB_OF_CLASSES;
     LabelImageType::InternalPixelType class_end = 0;
-    vnl_vector<IndexValueType> tmp_number_of_samples(MAX_NB_OF_CLASSES, 0);
-
-    otbAppLogINFO("Computing number of pixels in each class");
+    vnl_vector<IndexValueType> tmp_number_of_samples(MAX_NB_OF_CLASSES + 1, 0);
 
     // Explicit streaming over the input target image, based on the RAM parameter
     typedef otb::RAMDrivenStrippedStreamingManager<FloatVectorImageType> StreamingManagerType;
@@ -168,32 +401,60 @@ public:
     // Get nodata value
     const LabelImageType::InternalPixelType nodata = GetParameterInt("nodata");
 
-    // First iteration to count the objects in each class
+    // Stream regions
     int m_NumberOfDivisions = m_StreamingManager->GetNumberOfSplits();
+    std::vector<LabelImageType::RegionType> streamRegions;
     for (int m_CurrentDivision = 0; m_CurrentDivision < m_NumberOfDivisions; m_CurrentDivision++)
+      streamRegions.push_back(m_StreamingManager->GetSplit(m_CurrentDivision));
+
+    // Single pass selection
+    if (GetParameterInt("reservoir") == 1)
     {
-      LabelImageType::RegionType streamRegion = m_StreamingManager->GetSplit(m_CurrentDivision);
-      tf::PropagateRequestedRegion<LabelImageType>(inputImage, streamRegion);
-      itk::ImageRegionConstIterator<LabelImageType> inIt (inputImage, streamRegion);
-      for (inIt.GoToBegin(); !inIt.IsAtEnd(); ++inIt)
+      if (GetParameterInt("strategy") == 0 || GetParameterInt("strategy") == 1)
       {
-        LabelImageType::InternalPixelType pixVal = inIt.Get();
-        if (pixVal != nodata)
-        {
-          // Update min and max value
-          if (pixVal > class_end)
-            class_end = pixVal;
-          if (pixVal < class_begin)
-            class_begin = pixVal;
-
-          tmp_number_of_samples(pixVal)++;
-        }
+        SelectWithReservoirs(inputImage, streamRegions, nodata);
+        otbAppLogINFO( "Writing output vector data");
+        SetParameterOutputVectorData("outvec", m_OutVectorData);
+        return;
       }
+      otbAppLogWARNING("Reservoir sampling is only available with the constant and total strategies. "
+          "Using two passes.");
+    }
+
+    otbAppLogINFO("Computing number of pixels in each class");
+
+    // First iteration to count the objects in each class
+    const unsigned int nThreads = std::max(1u, static_cast<unsigned int>(itk::MultiThreader::GetGlobalDefaultNumberOfThreads()));
+    std::vector<HistogramType> histograms(nThreads, HistogramType(MAX_NB_OF_CLASSES + 1, 0));
+    for (int m_CurrentDivision = 0; m_CurrentDivision < m_NumberOfDivisions; m_CurrentDivision++)
+    {
+      tf::PropagateRequestedRegion<LabelImageType>(inputImage, streamRegions[m_CurrentDivision]);
+      CountClasses(inputImage, streamRegions[m_CurrentDivision], nodata, histograms);
 
       ShowProgress(m_CurrentDivision, m_NumberOfDivisions, 1);
     }
     ShowProgressDone();
 
+    // Reduce the histograms of the threads
+    for (auto const& histogram: histograms)
+      for (unsigned int pixVal = 0 ; pixVal <= MAX_NB_OF_CLASSES ; pixVal++)
+        tmp_number_of_samples(pixVal) += histogram[pixVal];
+    for (unsigned int pixVal = 0 ; pixVal <= MAX_NB_OF_CLASSES ; pixVal++)
+    {
+      if (tmp_number_of_samples(pixVal) > 0)
+      {
+        // Update min and max value
+        if (pixVal > class_end)
+          class_end = pixVal;
+        if (pixVal < class_begin)
+          class_begin = pixVal;
+      }
+    }
+    if (class_begin > class_end)
+    {
+      otbAppLogFATAL("There is no sample!");
+    }
+
     // Number of classes
     const LabelImageType::InternalPixelType number_of_classes = class_end - class_begin + 1;
 
@@ -305,18 +566,7 @@ public:
     }
 
     // Create a new vector data
-    // TODO: how to pre-allocate the datatree?
-    m_OutVectorData = VectorDataType::New();
-    DataTreeType::Pointer tree = m_OutVectorData->GetDataTree();
-    DataNodePointer root = tree->GetRoot()->Get();
-    DataNodePointer document = DataNodeType::New();
-    document->SetNodeType(DOCUMENT);
-    tree->Add(document, root);
-
-    // Duno if this makes sense?
-    m_OutVectorData->SetProjectionRef(inputImage->GetProjectionRef());
-    m_OutVectorData->SetOrigin(inputImage->GetOrigin());
-    m_OutVectorData->SetSpacing(inputImage->GetSpacing());
+    CreateVectorData(inputImage);
 
     // Second iteration, to prepare the samples
     vnl_vector<IndexValueType> sampledCount(number_of_classes, 0);
@@ -325,7 +575,7 @@ public:
     const IndexValueType target_n_tot = target_number_of_samples.sum();
     for (int m_CurrentDivision = 0; m_CurrentDivision < m_NumberOfDivisions; m_CurrentDivision++)
     {
-      LabelImageType::RegionType streamRegion = m_StreamingManager->GetSplit(m_CurrentDivision);
+      LabelImageType::RegionType streamRegion = streamRegions[m_CurrentDivision];
       tf::PropagateRequestedRegion<LabelImageType>(inputImage, streamRegion);
       itk::ImageRegionConstIterator<LabelImageType> inIt (inputImage, streamRegion);
 
@@ -333,7 +583,7 @@ public:
       {
         LabelImageType::InternalPixelType classVal = inIt.Get();
 
-        if (classVal != nodata)
+        if (classVal != nodata && classVal >= 0)
         {
           classVal -= class_begin;
 
@@ -349,18 +599,8 @@ public:
             n_tot++;
             ShowProgress(n_tot, target_n_tot);
 
-            // Create a point
-            LabelImageType::PointType geo;
-            inputImage->TransformIndexToPhysicalPoint(inIt.GetIndex(), geo);
-            DataNodeType::PointType point;
-            point[0] = geo[0];
-            point[1] = geo[1];
-
-            // Add point to the VectorData tree
-            DataNodePointer newDataNode = DataNodeType::New();
-            newDataNode->SetPoint(point);
-            newDataNode->SetFieldAsInt("class", static_cast<int>(classVal));
-            tree->Add(newDataNode, document);
+            // Add a point
+            AddPoint(inputImage, inIt.GetIndex(), static_cast<int>(classVal));
 
           } // sample this one
         }
@@ -378,6 +618,7 @@ public:
 
 private:
   VectorDataType::Pointer m_OutVectorData;
+  DataNodePointer         m_Document;
 
 }; // end of class
 
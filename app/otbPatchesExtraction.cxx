@@ -22,6 +22,9 @@
 // Stack
 #include "otbTensorflowSource.h"
 
+// Samples dataset
+#include "otbTensorflowPatchesDataset.h"
+
 namespace otb
 {
 
@@ -47,6 +50,9 @@ public:
   /** Typedefs for image concatenation */
   typedef TensorflowSource<FloatVectorImageType>                       TFSourceType;
 
+  /** Typedefs for samples dataset */
+  typedef tf::PatchesDataset<FloatVectorImageType>                     DatasetType;
+
   //
   // Store stuff related to one source
   //
@@ -93,6 +99,7 @@ public:
     AddParameter(ParameterType_Group,          ss_group_key.str(),  ss_desc_group.str());
     AddParameter(ParameterType_InputImageList, ss_key_in.str(),     ss_desc_in.str() );
     AddParameter(ParameterType_OutputImage,    ss_key_out.str(),    ss_desc_out.str());
+    MandatoryOff                              (ss_key_out.str());
     AddParameter(ParameterType_Int,            ss_key_dims_x.str(), ss_desc_dims_x.str());
     SetMinimumParameterIntValue               (ss_key_dims_x.str(), 1);
     AddParameter(ParameterType_Int,            ss_key_dims_y.str(), ss_desc_dims_y.str());
@@ -167,9 +174,22 @@ public:
     SetDefaultOutputPixelType              ("outlabels", ImagePixelType_uint8);
     MandatoryOff                           ("outlabels");
 
+    // Samples dataset
+    AddParameter(ParameterType_OutputFilename, "outdataset", "Output samples dataset (patches of all sources, then labels)");
+    MandatoryOff                              ("outdataset");
+
     // Class field
     AddParameter(ParameterType_String, "field", "field of class in the vector data");
 
+    // Reading tiles
+    AddParameter(ParameterType_Int,    "tilesize", "Size of the tiles used to read the input images (0: computed from the available RAM)");
+    SetMinimumParameterIntValue       ("tilesize", 0);
+    SetDefaultParameterInt            ("tilesize", 0);
+    MandatoryOff                      ("tilesize");
+    AddParameter(ParameterType_Bool,   "streaming", "Stream the patches to the output images (patches images are not held in memory)");
+    MandatoryOff                      ("streaming");
+    AddRAMParameter();
+
     // Examples values
     SetDocExampleParameterValue("vec",                "points.sqlite");
     SetDocExampleParameterValue("source1.il",         "$s2_list");
@@ -181,44 +201,112 @@ public:
 
   }
 
+  //
+  // Compute the size of the tiles used to read the input images.
+  // Points are grouped by tiles of the first source, and the regions of all
+  // the sources covering the patches of one tile are read at once: the tile
+  // size is chosen so that these regions fit in the available RAM.
+  //
+  unsigned int ComputeTileSize()
+  {
+    if (GetParameterInt("tilesize") > 0)
+    {
+      return GetParameterInt("tilesize");
+    }
+
+    // Size of one pixel of the first source, for all sources (in bytes)
+    float bytesPerPixel = 0;
+    unsigned int margin = 0;
+    FloatVectorImageType::Pointer reference = m_Bundles[0].m_ImageSource.Get();
+    reference->UpdateOutputInformation();
+    for (auto& bundle: m_Bundles)
+    {
+      FloatVectorImageType::Pointer image = bundle.m_ImageSource.Get();
+      image->UpdateOutputInformation();
+      const float ratio = vcl_abs(reference->GetSignedSpacing()[0] * reference->GetSignedSpacing()[1] /
+          (image->GetSignedSpacing()[0] * image->GetSignedSpacing()[1]));
+      bytesPerPixel += ratio * image->GetNumberOfComponentsPerPixel() * sizeof(FloatVectorImageType::InternalPixelType);
+      margin = std::max(margin, (unsigned int) std::max(bundle.m_PatchSize[0], bundle.m_PatchSize[1]));
+    }
+
+    const float availableBytes = 1024.0 * 1024.0 * GetParameterInt("ram");
+    const int side = vcl_floor(vcl_sqrt(availableBytes / bytesPerPixel)) - margin;
+    return std::max(side, 1);
+  }
+
   void DoExecute()
   {
 
     PrepareInputs();
 
     // Setup the filter
-    SamplerType::Pointer sampler = SamplerType::New();
-    sampler->SetInputVectorData(GetParameterVectorData("vec"));
-    sampler->SetField(GetParameterAsString("field"));
+    m_Sampler = SamplerType::New();
+    m_Sampler->SetInputVectorData(GetParameterVectorData("vec"));
+    m_Sampler->SetField(GetParameterAsString("field"));
     for (auto& bundle: m_Bundles)
     {
-      sampler->PushBackInputWithPatchSize(bundle.m_ImageSource.Get(), bundle.m_PatchSize);
+      m_Sampler->PushBackInputWithPatchSize(bundle.m_ImageSource.Get(), bundle.m_PatchSize);
+    }
+
+    // Tiles used to read the input images
+    SamplerType::SizeType tileSize;
+    tileSize.Fill(ComputeTileSize());
+    m_Sampler->SetTileSize(tileSize);
+    otbAppLogINFO("Input images are read by tiles of " << tileSize);
+
+    // Streaming mode
+    if (GetParameterInt("streaming")==1)
+    {
+      otbAppLogINFO("Patches are streamed to the output images");
+      m_Sampler->StreamingOn();
     }
 
     // Run the filter
-    AddProcess(sampler, "Sampling patches");
-    sampler->Update();
+    AddProcess(m_Sampler, "Sampling patches");
+    m_Sampler->Update();
 
     // Show numbers
-    otbAppLogINFO("Number of samples collected: " << sampler->GetNumberOfAcceptedSamples());
-    otbAppLogINFO("Number of samples rejected : " << sampler->GetNumberOfRejectedSamples());
+    otbAppLogINFO("Number of samples collected: " << m_Sampler->GetNumberOfAcceptedSamples());
+    otbAppLogINFO("Number of samples rejected : " << m_Sampler->GetNumberOfRejectedSamples());
+
+    // Save the samples dataset (if needed)
+    if (HasValue("outdataset"))
+    {
+      SamplerType::ImagePointerListType images = m_Sampler->GetOutputPatchImages();
+      SamplerType::SizeListType patchSizes;
+      for (auto& bundle: m_Bundles)
+      {
+        patchSizes.push_back(bundle.m_PatchSize);
+      }
+      SamplerType::SizeType labelPatchSize;
+      labelPatchSize.Fill(1);
+      images.push_back(m_Sampler->GetOutputLabelImage());
+      patchSizes.push_back(labelPatchSize);
+
+      otbAppLogINFO("Writing samples dataset " << GetParameterString("outdataset"));
+      DatasetType::Write(GetParameterString("outdataset"), images, patchSizes);
+    }
 
     // Save patches image
     for (unsigned int i = 0 ; i < m_Bundles.size() ; i++)
     {
-      SetParameterOutputImage(m_Bundles[i].m_KeyOut, sampler->GetOutputPatchImages()[i]);
+      if (HasValue(m_Bundles[i].m_KeyOut))
+      {
+        SetParameterOutputImage(m_Bundles[i].m_KeyOut, m_Sampler->GetOutputPatchImages()[i]);
+      }
     }
 
 
     // Save label image (if needed)
     if (HasValue("outlabels"))
     {
-      SetParameterOutputImage("outlabels", sampler->GetOutputLabelImage());
+      SetParameterOutputImage("outlabels", m_Sampler->GetOutputLabelImage());
     }
 
   }
 private:
   std::vector<SourceBundle> m_Bundles;
+  SamplerType::Pointer      m_Sampler;
 
 }; // end of class
 
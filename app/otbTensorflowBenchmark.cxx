@@ -0,0 +1,359 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include "itkFixedArray.h"
+#include "itkObjectFactory.h"
+#include "otbWrapperApplicationFactory.h"
+
+// Application engine
+#include "otbStandardFilterWatcher.h"
+
+// Tensorflow stuff
+#include "tensorflow/core/public/session.h"
+#include "tensorflow/cc/framework/scope.h"
+#include "tensorflow/cc/ops/standard_ops.h"
+
+// Tensorflow model filter
+#include "otbTensorflowMultisourceModelFilter.h"
+
+// Tensorflow helpers
+#include "otbTensorflowCopyUtils.h"
+#include "otbTensorflowProfiler.h"
+
+// Random values
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+
+namespace otb
+{
+
+namespace Wrapper
+{
+
+/*
+ * This application measures the performance of the copy utilities and of
+ * the model filter over synthetic images. The model is a trivial graph built
+ * in memory (an average pooling of the input over the field of view), so
+ * that no SavedModel is needed: the timings are dominated by the copies.
+ */
+class TensorflowBenchmark : public Application
+{
+public:
+  /** Standard class typedefs. */
+  typedef TensorflowBenchmark                        Self;
+  typedef Application                                Superclass;
+  typedef itk::SmartPointer<Self>                    Pointer;
+  typedef itk::SmartPointer<const Self>              ConstPointer;
+
+  /** Standard macro */
+  itkNewMacro(Self);
+  itkTypeMacro(TensorflowBenchmark, Application);
+
+  /** Typedefs */
+  typedef otb::TensorflowMultisourceModelFilter<FloatVectorImageType, FloatVectorImageType> TFModelFilterType;
+  typedef FloatVectorImageType::RegionType                                                  RegionType;
+  typedef FloatVectorImageType::SizeType                                                    SizeType;
+  typedef FloatVectorImageType::IndexType                                                   IndexType;
+  typedef itk::Statistics::MersenneTwisterRandomVariateGenerator                           RandomGeneratorType;
+
+  void DoUpdateParameters()
+  {
+  }
+
+  void DoInit()
+  {
+
+    // Documentation
+    SetName("TensorflowBenchmark");
+    SetDescription("Measure the performance of the copies between images and tensors, "
+        "and of the model filter");
+    SetDocLongDescription("The application runs the copy utilities (region to tensor, "
+        "centered patches sampling, tensor to region) or the model filter (patch-based "
+        "or fully convolutional) over a synthetic image. The model is an average pooling "
+        "over the field of view, built in memory. Run the application with different "
+        "numbers of bands, data types and patch sizes to compare the timings.");
+    SetDocAuthors("Remi Cresson");
+
+    // Benchmark
+    AddParameter(ParameterType_Choice,        "mode",            "Benchmark");
+    AddChoice                                ("mode.copy",       "Copy utilities");
+    AddChoice                                ("mode.patch",      "Model filter in patch-based mode");
+    AddChoice                                ("mode.fcn",        "Model filter in fully convolutional mode");
+    AddParameter(ParameterType_Int,           "size",            "Size of the synthetic image");
+    SetMinimumParameterIntValue              ("size",            1);
+    SetDefaultParameterInt                   ("size",            256);
+    AddParameter(ParameterType_Int,           "bands",           "Number of bands of the synthetic image");
+    SetMinimumParameterIntValue              ("bands",           1);
+    SetDefaultParameterInt                   ("bands",           4);
+    AddParameter(ParameterType_Int,           "patch",           "Patch size (field of view)");
+    SetMinimumParameterIntValue              ("patch",           1);
+    SetDefaultParameterInt                   ("patch",           16);
+    AddParameter(ParameterType_Choice,        "dtype",           "Datatype of the tensors");
+    AddChoice                                ("dtype.float",     "float");
+    AddChoice                                ("dtype.double",    "double");
+    AddChoice                                ("dtype.int32",     "int32 (copy utilities only)");
+    AddChoice                                ("dtype.int64",     "int64 (copy utilities only)");
+    AddChoice                                ("dtype.uint8",     "uint8 (copy utilities only)");
+    AddChoice                                ("dtype.int16",     "int16 (copy utilities only)");
+    AddChoice                                ("dtype.uint16",    "uint16 (copy utilities only)");
+    AddChoice                                ("dtype.half",      "half (copy utilities only)");
+    AddParameter(ParameterType_Int,           "iterations",      "Number of iterations");
+    SetMinimumParameterIntValue              ("iterations",      1);
+    SetDefaultParameterInt                   ("iterations",      10);
+    AddParameter(ParameterType_Int,           "samples",         "Number of patches sampled at each iteration (copy utilities)");
+    SetMinimumParameterIntValue              ("samples",         1);
+    SetDefaultParameterInt                   ("samples",         1000);
+
+    // Model filter settings
+    AddParameter(ParameterType_Int,           "tilesize",        "Size of the tiles processed by the model filter");
+    SetMinimumParameterIntValue              ("tilesize",        1);
+    SetDefaultParameterInt                   ("tilesize",        64);
+    AddParameter(ParameterType_Int,           "pipeline",        "Depth of the asynchronous tiles pipeline (0 to disable)");
+    SetMinimumParameterIntValue              ("pipeline",        0);
+    SetDefaultParameterInt                   ("pipeline",        0);
+    AddParameter(ParameterType_Int,           "batchsize",       "Target batch size (0 to disable batching)");
+    SetMinimumParameterIntValue              ("batchsize",       0);
+    SetDefaultParameterInt                   ("batchsize",       0);
+    AddParameter(ParameterType_Bool,          "patchesingraph",  "Extract the patches with tensorflow (patch-based mode)");
+    MandatoryOff                             ("patchesingraph");
+
+    AddParameter(ParameterType_OutputFilename, "profile",        "Profile file (JSON if the extension is .json, CSV else)");
+    MandatoryOff                             ("profile");
+
+    // Example
+    SetDocExampleParameterValue("mode",  "patch");
+    SetDocExampleParameterValue("bands", "8");
+    SetDocExampleParameterValue("patch", "32");
+
+  }
+
+  //
+  // Create a synthetic image filled with random values
+  //
+  FloatVectorImageType::Pointer CreateImage(unsigned int size, unsigned int bands)
+  {
+    FloatVectorImageType::Pointer image = FloatVectorImageType::New();
+    IndexType start;
+    start.Fill(0);
+    SizeType imageSize;
+    imageSize.Fill(size);
+    image->SetRegions(RegionType(start, imageSize));
+    image->SetNumberOfComponentsPerPixel(bands);
+    image->Allocate();
+
+    RandomGeneratorType::Pointer generator = RandomGeneratorType::GetInstance();
+    generator->SetSeed(0);
+    float * values = image->GetBufferPointer();
+    const std::size_t nValues = image->GetBufferedRegion().GetNumberOfPixels() * bands;
+    for (std::size_t i = 0 ; i < nValues ; i++)
+      {
+      values[i] = generator->GetUniformVariate(0, 255);
+      }
+    return image;
+  }
+
+  //
+  // Datatype of the tensors
+  //
+  tensorflow::DataType GetDataType()
+  {
+    switch (GetParameterInt("dtype"))
+      {
+      case 1:
+        return tensorflow::DT_DOUBLE;
+      case 2:
+        return tensorflow::DT_INT32;
+      case 3:
+        return tensorflow::DT_INT64;
+      case 4:
+        return tensorflow::DT_UINT8;
+      case 5:
+        return tensorflow::DT_INT16;
+      case 6:
+        return tensorflow::DT_UINT16;
+      case 7:
+        return tensorflow::DT_HALF;
+      default:
+        return tensorflow::DT_FLOAT;
+      }
+  }
+
+  //
+  // Benchmark of the copy utilities
+  //
+  void RunCopyBenchmark(FloatVectorImageType::Pointer image, tensorflow::DataType dt)
+  {
+    const RegionType region = image->GetLargestPossibleRegion();
+    const unsigned int bands = image->GetNumberOfComponentsPerPixel();
+    const unsigned int iterations = GetParameterInt("iterations");
+    const tensorflow::int64 nSamples = GetParameterInt("samples");
+    SizeType patchSize;
+    patchSize.Fill(GetParameterInt("patch"));
+
+    // Tensors
+    tensorflow::Tensor regionTensor(dt, tensorflow::TensorShape({1,
+      (tensorflow::int64) region.GetSize(1), (tensorflow::int64) region.GetSize(0), bands}));
+    tensorflow::Tensor patchesTensor(dt, tensorflow::TensorShape({nSamples,
+      (tensorflow::int64) patchSize[1], (tensorflow::int64) patchSize[0], bands}));
+
+    // Patches centers (the patches lie inside the image)
+    if (region.GetSize(0) <= patchSize[0])
+      {
+      otbAppLogFATAL("The image must be larger than the patches");
+      }
+    RandomGeneratorType::Pointer generator = RandomGeneratorType::GetInstance();
+    std::vector<IndexType> centers;
+    for (tensorflow::int64 i = 0 ; i < nSamples ; i++)
+      {
+      IndexType center;
+      for (unsigned int dim = 0 ; dim < 2 ; dim++)
+        center[dim] = patchSize[dim] / 2 + generator->GetIntegerVariate(region.GetSize(dim) - patchSize[dim] - 1);
+      centers.push_back(center);
+      }
+
+    FloatVectorImageType::Pointer outputImage = CreateImage(region.GetSize(0), bands);
+
+    for (unsigned int it = 0 ; it < iterations ; it++)
+      {
+        {
+        tf::ScopedStageTimer timer(m_Profiler.get(), "RecopyImageRegionToTensorWithCast", it, regionTensor.TotalBytes());
+        tf::RecopyImageRegionToTensorWithCast<FloatVectorImageType>(image, region, regionTensor, 0);
+        }
+        {
+        tf::ScopedStageTimer timer(m_Profiler.get(), "SampleCenteredPatch", it, patchesTensor.TotalBytes());
+        for (tensorflow::int64 i = 0 ; i < nSamples ; i++)
+          {
+          tf::SampleCenteredPatch<FloatVectorImageType>(image, centers[i], patchSize, patchesTensor, i);
+          }
+        }
+        {
+        tf::ScopedStageTimer timer(m_Profiler.get(), "CopyTensorToImageRegion", it, regionTensor.TotalBytes());
+        int channelOffset = 0;
+        tf::CopyTensorToImageRegion<FloatVectorImageType>(regionTensor, region, outputImage, region, channelOffset);
+        }
+      }
+  }
+
+  //
+  // Create the graph of the trivial model: y = avgpool(x) over the field of view
+  //
+  void CreateModel(tensorflow::DataType dt, unsigned int bands, tensorflow::GraphDef & graph)
+  {
+    const int patch = GetParameterInt("patch");
+    tensorflow::Scope root = tensorflow::Scope::NewRootScope();
+    auto x = tensorflow::ops::Placeholder(root.WithOpName("x"), dt);
+    tensorflow::ops::AvgPool(root.WithOpName("y"), x, {1, patch, patch, 1}, {1, 1, 1, 1}, "VALID");
+    auto status = root.ToGraphDef(&graph);
+    if (!status.ok())
+      {
+      otbAppLogFATAL("Can't build the model graph: " << status.ToString());
+      }
+
+    // The filters read the shapes of the tensors in the "_output_shapes" attribute
+    for (int i = 0 ; i < graph.node_size() ; i++)
+      {
+      tensorflow::NodeDef * node = graph.mutable_node(i);
+      if (node->name() == "x" || node->name() == "y")
+        {
+        tensorflow::TensorShapeProto shape;
+        shape.add_dim()->set_size(-1);
+        shape.add_dim()->set_size(-1);
+        shape.add_dim()->set_size(-1);
+        shape.add_dim()->set_size(bands);
+        *(*node->mutable_attr())["_output_shapes"].mutable_list()->add_shape() = shape;
+        }
+      }
+  }
+
+  //
+  // Benchmark of the model filter
+  //
+  void RunModelBenchmark(FloatVectorImageType::Pointer image, tensorflow::DataType dt, bool fullyConvolutional)
+  {
+    if (dt != tensorflow::DT_FLOAT && dt != tensorflow::DT_DOUBLE)
+      {
+      otbAppLogFATAL("The model filter benchmark supports only float and double tensors");
+      }
+
+    // Model
+    tensorflow::GraphDef graph;
+    CreateModel(dt, image->GetNumberOfComponentsPerPixel(), graph);
+    m_Session.reset(tensorflow::NewSession(tensorflow::SessionOptions()));
+    auto status = m_Session->Create(graph);
+    if (!status.ok())
+      {
+      otbAppLogFATAL("Can't create the session: " << status.ToString());
+      }
+
+    // Filter
+    SizeType fov, foe, tileSize;
+    fov.Fill(GetParameterInt("patch"));
+    foe.Fill(1);
+    tileSize.Fill(GetParameterInt("tilesize"));
+    m_TFFilter = TFModelFilterType::New();
+    m_TFFilter->SetGraph(graph);
+    m_TFFilter->SetSession(m_Session.get());
+    m_TFFilter->SetOutputTensorsNames({"y"});
+    m_TFFilter->PushBackInputBundle("x", fov, image);
+    m_TFFilter->SetOutputFOESize(foe);
+    m_TFFilter->SetFullyConvolutional(fullyConvolutional);
+    m_TFFilter->SetInGraphPatchExtraction(GetParameterInt("patchesingraph") == 1);
+    m_TFFilter->SetInternalTileSize(tileSize);
+    m_TFFilter->SetPipelineDepth(GetParameterInt("pipeline"));
+    m_TFFilter->SetTargetBatchSize(GetParameterInt("batchsize"));
+    m_TFFilter->SetProfiler(m_Profiler.get());
+
+    for (int it = 0 ; it < GetParameterInt("iterations") ; it++)
+      {
+      m_TFFilter->Modified();
+      m_TFFilter->Update();
+      }
+  }
+
+  void DoExecute()
+  {
+    const tensorflow::DataType dt = GetDataType();
+    FloatVectorImageType::Pointer image = CreateImage(GetParameterInt("size"), GetParameterInt("bands"));
+
+    otbAppLogINFO("Synthetic image: " << GetParameterInt("size") << "x" << GetParameterInt("size") <<
+        " pixels, " << GetParameterInt("bands") << " bands, patch size: " << GetParameterInt("patch") <<
+        ", datatype: " << tensorflow::DataTypeString(dt));
+
+    m_Profiler.reset(new tf::Profiler());
+    if (GetParameterInt("mode") == 0)
+      {
+      RunCopyBenchmark(image, dt);
+      }
+    else
+      {
+      RunModelBenchmark(image, dt, GetParameterInt("mode") == 2);
+      }
+
+    // Report
+    std::stringstream report;
+    m_Profiler->Report(report);
+    otbAppLogINFO("Timings:\n" << report.str());
+    if (HasValue("profile"))
+      {
+      m_Profiler->Write(GetParameterString("profile"));
+      }
+  }
+
+private:
+
+  TFModelFilterType::Pointer           m_TFFilter;
+  std::unique_ptr<tensorflow::Session> m_Session;  // Session of the trivial model
+  std::unique_ptr<tf::Profiler>        m_Profiler; // Timings
+
+}; // end of class
+
+} // namespace wrapper
+} // namespace otb
+
+OTB_APPLICATION_EXPORT( otb::Wrapper::TensorflowBenchmark )
@@ -22,17 +22,38 @@
 
 // Tensorflow model filter
 #include "otbTensorflowMultisourceModelFilter.h"
+#include "otbTensorflowMultisourceModelClassifier.h"
+
+// Classification of the deep features
+#include "otbMachineLearningModelFactory.h"
+#include "otbStatisticsXMLFileReader.h"
 
 // Tensorflow graph load
 #include "otbTensorflowGraphOperations.h"
+#include "otbTensorflowModelRegistry.h"
 
 // Layerstack
 #include "otbTensorflowSource.h"
 
+// Profiling
+#include "otbTensorflowProfiler.h"
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+
 // Streaming
 #include "otbImageRegionSquareTileSplitter.h"
 #include "itkStreamingImageFilter.h"
 
+// Distributed processing
+#include "otbTensorflowTileScheduler.h"
+#include "otbTensorflowTileJournal.h"
+#include "otbTensorflowTileWriter.h"
+#include "otbMultiChannelExtractROI.h"
+#include "otbImageFileReader.h"
+#include "otbGdalDataTypeBridge.h"
+#include "itksys/SystemTools.hxx"
+
 namespace otb
 {
 
@@ -52,16 +73,21 @@ public:
   itkNewMacro(Self);
   itkTypeMacro(TensorflowModelServe, Application);
 
-  /** Typedefs for tensorflow */
-  typedef otb::TensorflowMultisourceModelFilter<FloatVectorImageType, FloatVectorImageType> TFModelFilterType;
-  typedef otb::TensorflowSource<FloatVectorImageType> InputImageSource;
+  /** Typedefs for the classification of the deep features */
+  typedef otb::TensorflowMultisourceModelClassifier<FloatVectorImageType, FloatVectorImageType> TFClassifierFilterType;
+  typedef TFClassifierFilterType::ModelType                 ClassifierModelType;
+  typedef TFClassifierFilterType::SampleType                FeaturesType;
+  typedef otb::MachineLearningModelFactory<TFClassifierFilterType::ValueType,
+      TFClassifierFilterType::LabelType>                    ClassifierModelFactoryType;
+  typedef otb::StatisticsXMLFileReader<FeaturesType>        StatisticsReaderType;
 
   /** Typedef for streaming */
   typedef otb::ImageRegionSquareTileSplitter<FloatVectorImageType::ImageDimension> TileSplitterType;
-  typedef itk::StreamingImageFilter<FloatVectorImageType, FloatVectorImageType> StreamingFilterType;
 
   /** Typedefs for images */
-  typedef FloatVectorImageType::SizeType SizeType;
+  typedef FloatVectorImageType::SizeType   SizeType;
+  typedef FloatVectorImageType::IndexType  IndexType;
+  typedef FloatVectorImageType::RegionType RegionType;
 
   void DoUpdateParameters()
   {
@@ -72,7 +98,6 @@ public:
   //
   struct ProcessObjectsBundle
   {
-    InputImageSource m_ImageSource;
     SizeType         m_PatchSize;
     std::string      m_Placeholder;
 
@@ -81,6 +106,31 @@ public:
     std::string m_KeyPszX;   // Key for samples sizes X
     std::string m_KeyPszY;   // Key for samples sizes Y
     std::string m_KeyPHName; // Key for placeholder name in the tensorflow model
+    std::string m_KeyNoData; // Key for the nodata value
+  };
+
+  //
+  // Process objects for the pixel types of the sources and of the output.
+  // They must be alive during all the execution of the application.
+  //
+  struct PipelineBase
+  {
+    virtual ~PipelineBase() {}
+  };
+
+  template<class TInputImage, class TOutputImage>
+  struct Pipeline : public PipelineBase
+  {
+    typedef otb::ImageFileReader<TInputImage>                                    ReaderType;
+    typedef otb::TensorflowSource<TInputImage>                                   SourceType;
+    typedef otb::TensorflowMultisourceModelFilter<TInputImage, TOutputImage>     FilterType;
+    typedef otb::TensorflowMultisourceModelClassifier<TInputImage, TOutputImage> ClassifierFilterType;
+    typedef itk::StreamingImageFilter<TOutputImage, TOutputImage>                StreamingFilterType;
+
+    std::vector<typename ReaderType::Pointer> m_Readers;      // Readers of the images of the sources
+    std::vector<SourceType>                   m_Sources;      // Stacks of the images of the sources
+    typename FilterType::Pointer              m_Filter;       // Model filter
+    typename StreamingFilterType::Pointer     m_StreamFilter; // Streaming of the model filter output
   };
 
   //
@@ -98,7 +148,8 @@ public:
     ss_key_in, ss_desc_in,
     ss_key_dims_x, ss_desc_dims_x,
     ss_key_dims_y, ss_desc_dims_y,
-    ss_key_ph, ss_desc_ph;
+    ss_key_ph, ss_desc_ph,
+    ss_key_nodata, ss_desc_nodata;
 
     // Parameter group key/description
     ss_key_group  << "source"                  << inputNumber;
@@ -109,12 +160,15 @@ public:
     ss_key_dims_x  << ss_key_group.str() << ".fovx";
     ss_key_dims_y  << ss_key_group.str() << ".fovy";
     ss_key_ph      << ss_key_group.str() << ".placeholder";
+    ss_key_nodata  << ss_key_group.str() << ".nodata";
 
     // Parameter group descriptions
     ss_desc_in     << "Input image (or list to stack) for source #" << inputNumber;
     ss_desc_dims_x << "Field of view width for source #"            << inputNumber;
     ss_desc_dims_y << "Field of view height for source #"           << inputNumber;
     ss_desc_ph     << "Name of the input placeholder for source #"  << inputNumber;
+    ss_desc_nodata << "Nodata value of source #"                    << inputNumber <<
+        " (the output pixels whose input pixels are all nodata, on all the bands, are not computed)";
 
     // Populate group
     AddParameter(ParameterType_Group,          ss_key_group.str(),  ss_desc_group.str());
@@ -124,6 +178,8 @@ public:
     AddParameter(ParameterType_Int,            ss_key_dims_y.str(), ss_desc_dims_y.str());
     SetMinimumParameterIntValue               (ss_key_dims_y.str(), 1);
     AddParameter(ParameterType_String,         ss_key_ph.str(),     ss_desc_ph.str());
+    AddParameter(ParameterType_Float,          ss_key_nodata.str(), ss_desc_nodata.str());
+    MandatoryOff                              (ss_key_nodata.str());
 
     // Add a new bundle
     ProcessObjectsBundle bundle;
@@ -131,6 +187,7 @@ public:
     bundle.m_KeyPszX   = ss_key_dims_x.str();
     bundle.m_KeyPszY   = ss_key_dims_y.str();
     bundle.m_KeyPHName = ss_key_ph.str();
+    bundle.m_KeyNoData = ss_key_nodata.str();
 
     m_Bundles.push_back(bundle);
 
@@ -149,6 +206,8 @@ public:
         "system environment variable " + tf::ENV_VAR_NAME_NSOURCES + ". "
         "For each source, you have to set (1) the tensor placeholder name, as named in "
         "the tensorflow model, (2) the patch size and (3) the image(s) source. "
+        "When all the image files of the sources have the same pixel type (uint8, "
+        "int16, uint16 or uint32), they are read with this type, else as float. "
         "The output is a multiband image, stacking all outputs "
         "tensors together: you have to specify the names of the output tensors, as "
         "named in the tensorflow model (typically, an operator's output). The output "
@@ -157,7 +216,11 @@ public:
         "Last but not least, consider using extended filename to bypass the automatic "
         "memory footprint calculator of the otb application engine, and set a good "
         "splitting strategy (I would recommend using small square tiles) or use the "
-        "finetuning parameter group to impose your squared tiles sizes");
+        "finetuning parameter group to impose your squared tiles sizes. "
+        "The output values can be scaled and shifted (\"output.scale\" and \"output.shift\"). "
+        "With an integer output pixel type, they are also rounded and clamped to the "
+        "range of the type. With an uint8 or int16 output pixel type, the output "
+        "tiles are computed with this type, which reduces their memory footprint.");
     SetDocAuthors("Remi Cresson");
 
     // Input/output images
@@ -173,6 +236,32 @@ public:
     MandatoryOff                             ("model.userplaceholders");
     AddParameter(ParameterType_Bool,          "model.fullyconv", "Fully convolutional");
     MandatoryOff                             ("model.fullyconv");
+    AddParameter(ParameterType_Bool,          "model.patchesingraph", "Extract the patches with tensorflow (patch-based mode)");
+    MandatoryOff                             ("model.patchesingraph");
+    AddParameter(ParameterType_Int,           "model.intraop",   "Number of threads of the tensorflow intra-op pool (0: tensorflow default)");
+    SetMinimumParameterIntValue              ("model.intraop",   0);
+    SetDefaultParameterInt                   ("model.intraop",   0);
+    AddParameter(ParameterType_Int,           "model.interop",   "Number of threads of the tensorflow inter-op pool (0: tensorflow default)");
+    SetMinimumParameterIntValue              ("model.interop",   0);
+    SetDefaultParameterInt                   ("model.interop",   0);
+    AddParameter(ParameterType_Bool,          "model.allowgrowth", "Allocate the GPU memory on demand");
+    MandatoryOff                             ("model.allowgrowth");
+    AddParameter(ParameterType_Float,         "model.memfraction", "Fraction of the GPU memory that can be allocated (0: tensorflow default)");
+    SetMinimumParameterFloatValue            ("model.memfraction", 0.0);
+    SetMaximumParameterFloatValue            ("model.memfraction", 1.0);
+    SetDefaultParameterFloat                 ("model.memfraction", 0.0);
+    AddParameter(ParameterType_Bool,          "model.xla",       "Enable the XLA JIT compilation");
+    MandatoryOff                             ("model.xla");
+    AddParameter(ParameterType_Int,           "model.optlevel",  "Level of the graph optimizer (0: no optimization, 1: default)");
+    SetMinimumParameterIntValue              ("model.optlevel",  0);
+    SetMaximumParameterIntValue              ("model.optlevel",  1);
+    SetDefaultParameterInt                   ("model.optlevel",  1);
+    AddParameter(ParameterType_Bool,          "model.trace",     "Trace the runs used to load the model");
+    MandatoryOff                             ("model.trace");
+    AddParameter(ParameterType_StringList,    "model.devices",   "Devices running the model, one session per device (e.g. /gpu:0 /gpu:1)");
+    MandatoryOff                             ("model.devices");
+    AddParameter(ParameterType_Bool,          "model.resident",  "Keep the model and its sessions loaded in the process, for the next executions of the application (e.g. from python)");
+    MandatoryOff                             ("model.resident");
 
     // Output tensors parameters
     AddParameter(ParameterType_Group,         "output",          "Output tensors parameters");
@@ -191,6 +280,26 @@ public:
     SetDefaultParameterInt                   ("output.foey", 1);
     MandatoryOn                              ("output.foey");
 
+    // Masking
+    AddParameter(ParameterType_InputImage,    "output.mask", "Mask of the output pixels to compute (the pixels where the mask is 0 are not computed)");
+    MandatoryOff                             ("output.mask");
+    AddParameter(ParameterType_Float,         "output.fill", "Value of the output pixels which are not computed (mask or nodata)");
+    SetDefaultParameterFloat                 ("output.fill", 0.0);
+
+    // Quantization
+    AddParameter(ParameterType_Float,         "output.scale", "Scale of the output values (e.g. 255 to write probabilities in 8 bits)");
+    SetDefaultParameterFloat                 ("output.scale", 1.0);
+    AddParameter(ParameterType_Float,         "output.shift", "Shift of the output values, added after the scale");
+    SetDefaultParameterFloat                 ("output.shift", 0.0);
+
+    // Classification of the deep features
+    AddParameter(ParameterType_InputFilename, "output.classifier", "Machine learning model which classifies the output values (the output image is the label)");
+    MandatoryOff                             ("output.classifier");
+    AddParameter(ParameterType_InputFilename, "output.imstat", "Statistics file (mean and standard deviation) used to normalize the output values before their classification");
+    MandatoryOff                             ("output.imstat");
+    AddParameter(ParameterType_Bool,          "output.confidence", "Add the confidence of the classification as a second output band");
+    MandatoryOff                             ("output.confidence");
+
     // Fine tuning
     AddParameter(ParameterType_Group,         "finetuning" , "Fine tuning performance or consistency parameters");
     AddParameter(ParameterType_Bool,          "finetuning.disabletiling", "Disable tiling");
@@ -198,6 +307,51 @@ public:
     AddParameter(ParameterType_Int,           "finetuning.tilesize", "Tile width used to stream the filter output");
     SetMinimumParameterIntValue              ("finetuning.tilesize", 1);
     SetDefaultParameterInt                   ("finetuning.tilesize", 16);
+    AddParameter(ParameterType_Int,           "finetuning.pipeline", "Depth of the asynchronous tiles pipeline (0 to disable)");
+    SetMinimumParameterIntValue              ("finetuning.pipeline", 0);
+    SetDefaultParameterInt                   ("finetuning.pipeline", 0);
+    AddParameter(ParameterType_Int,           "finetuning.batchsize", "Target number of patches (patch-based mode) or tiles (fully convolutional mode) in one batch (0 to disable batching)");
+    SetMinimumParameterIntValue              ("finetuning.batchsize", 0);
+    SetDefaultParameterInt                   ("finetuning.batchsize", 0);
+    AddParameter(ParameterType_Int,           "finetuning.batchram", "Memory budget (MB) for the input tensors of one batch (0 to disable)");
+    SetMinimumParameterIntValue              ("finetuning.batchram", 0);
+    SetDefaultParameterInt                   ("finetuning.batchram", 0);
+    AddParameter(ParameterType_Bool,          "finetuning.autotilesize", "Compute the tile size from the memory budget of one tile (ignores finetuning.tilesize)");
+    MandatoryOff                             ("finetuning.autotilesize");
+    AddParameter(ParameterType_Int,           "finetuning.tileram", "Memory budget (MB) for the tensors of one tile, used with finetuning.autotilesize");
+    SetMinimumParameterIntValue              ("finetuning.tileram", 1);
+    SetDefaultParameterInt                   ("finetuning.tileram", 512);
+    AddParameter(ParameterType_Int,           "finetuning.calibrate", "Number of warm-up runs used to pick the fastest tile size, up to the size computed from the memory budget (0 to disable)");
+    SetMinimumParameterIntValue              ("finetuning.calibrate", 0);
+    SetDefaultParameterInt                   ("finetuning.calibrate", 0);
+    AddParameter(ParameterType_Bool,          "finetuning.halocache", "Keep the input halos of the previous tiles, so that they are not read again");
+    MandatoryOff                             ("finetuning.halocache");
+
+    // Profiling
+    AddParameter(ParameterType_Group,         "profiling",           "Profiling parameters");
+    AddParameter(ParameterType_Bool,          "profiling.enable",    "Report the timings of the processing stages");
+    MandatoryOff                             ("profiling.enable");
+    AddParameter(ParameterType_OutputFilename, "profiling.out",      "Profile file (JSON if the extension is .json, CSV else)");
+    MandatoryOff                             ("profiling.out");
+    AddParameter(ParameterType_OutputFilename, "profiling.stepstats", "File of the tensorflow step stats of each session run (slows down the runs)");
+    MandatoryOff                             ("profiling.stepstats");
+
+    // Distributed processing
+    AddParameter(ParameterType_Group,         "distrib",         "Distributed processing parameters");
+    AddParameter(ParameterType_Bool,          "distrib.enable",  "Process the tiles of the output grid on multiple nodes, each node writing its tiles in place in the output image (which must be a GeoTIFF file, written uncompressed)");
+    MandatoryOff                             ("distrib.enable");
+    AddParameter(ParameterType_Int,           "distrib.nodes",   "Number of nodes, when not running with MPI (e.g. number of tasks of a job array)");
+    SetMinimumParameterIntValue              ("distrib.nodes",   1);
+    SetDefaultParameterInt                   ("distrib.nodes",   1);
+    AddParameter(ParameterType_Int,           "distrib.rank",    "Rank of this node, when not running with MPI (e.g. index of the task of a job array)");
+    SetMinimumParameterIntValue              ("distrib.rank",    0);
+    SetDefaultParameterInt                   ("distrib.rank",    0);
+    AddParameter(ParameterType_String,        "distrib.jobid",   "Identifier of the job shared by the nodes, when not running with MPI (e.g. the ID of the job array): the nodes claim the tiles dynamically. Use a new identifier for each run");
+    MandatoryOff                             ("distrib.jobid");
+    AddParameter(ParameterType_Bool,          "distrib.resume",  "Resume an interrupted distributed processing: the tiles recorded in the journal of the output by the same run (model, output grid and tiles) are not computed again");
+    MandatoryOff                             ("distrib.resume");
+    AddParameter(ParameterType_InputImageList, "distrib.update", "Images covering the areas whose inputs changed: only the tiles over these areas are computed again (distributed processing)");
+    MandatoryOff                             ("distrib.update");
 
     // Output image
     AddParameter(ParameterType_OutputImage, "out", "output image");
@@ -222,9 +376,6 @@ public:
 
     for (auto& bundle: m_Bundles)
     {
-      // Setting the image source
-      FloatVectorImageListType::Pointer list = GetParameterImageList(bundle.m_KeyIn);
-      bundle.m_ImageSource.Set(list);
       bundle.m_Placeholder = GetParameterAsString(bundle.m_KeyPHName);
       bundle.m_PatchSize[0] = GetParameterInt(bundle.m_KeyPszX);
       bundle.m_PatchSize[1] = GetParameterInt(bundle.m_KeyPszY);
@@ -235,93 +386,924 @@ public:
     }
   }
 
+  //
+  // Pixel type of the images of the sources: the component type shared by
+  // all the image files when the model filter is instantiated for it, float
+  // else (mixed or unsupported types, in-memory images)
+  //
+  ImagePixelType GetSourcesPixelType()
+  {
+    bool first = true;
+    ImagePixelType type = ImagePixelType_float;
+    for (auto& bundle: m_Bundles)
+    {
+      for (auto& fileName: GetParameterStringList(bundle.m_KeyIn))
+      {
+        if (fileName.empty())
+          return ImagePixelType_float;
+
+        otb::ImageFileReader<FloatVectorImageType>::Pointer reader = otb::ImageFileReader<FloatVectorImageType>::New();
+        reader->SetFileName(fileName);
+        reader->UpdateOutputInformation();
+        ImagePixelType imageType;
+        switch (reader->GetImageIO()->GetComponentType())
+        {
+        case otb::ImageIOBase::UCHAR:  imageType = ImagePixelType_uint8;  break;
+        case otb::ImageIOBase::SHORT:  imageType = ImagePixelType_int16;  break;
+        case otb::ImageIOBase::USHORT: imageType = ImagePixelType_uint16; break;
+        case otb::ImageIOBase::UINT:   imageType = ImagePixelType_uint32; break;
+        default:                       return ImagePixelType_float;
+        }
+        if (!first && imageType != type)
+          return ImagePixelType_float;
+        type = imageType;
+        first = false;
+      }
+    }
+    return type;
+  }
+
+  //
+  // Images of one source, read with their pixel type
+  //
+  template<class TInputImage, class TOutputImage>
+  typename otb::ObjectList<TInputImage>::Pointer GetSourceImages(const ProcessObjectsBundle & bundle,
+      Pipeline<TInputImage, TOutputImage> & pipeline)
+  {
+    typedef Pipeline<TInputImage, TOutputImage> PipelineType;
+    typename otb::ObjectList<TInputImage>::Pointer list = otb::ObjectList<TInputImage>::New();
+    for (auto& fileName: GetParameterStringList(bundle.m_KeyIn))
+    {
+      typename PipelineType::ReaderType::Pointer reader = PipelineType::ReaderType::New();
+      reader->SetFileName(fileName);
+      list->PushBack(reader->GetOutput());
+      pipeline.m_Readers.push_back(reader);
+    }
+    return list;
+  }
+
+  // Float images: the images of the parameter (they can be in-memory images)
+  template<class TOutputImage>
+  FloatVectorImageListType::Pointer GetSourceImages(const ProcessObjectsBundle & bundle,
+      Pipeline<FloatVectorImageType, TOutputImage> & pipeline)
+  {
+    return GetParameterImageList(bundle.m_KeyIn);
+  }
+
+  //
+  // Setup the instrumentation of the filter
+  //
+  template<class TFilter>
+  void SetupProfiling(TFilter * filter)
+  {
+    m_Profiler.reset();
+    if (GetParameterInt("profiling.enable") == 1 || HasValue("profiling.out"))
+    {
+      m_Profiler.reset(new tf::Profiler());
+      filter->SetProfiler(m_Profiler.get());
+    }
+    if (HasValue("profiling.stepstats"))
+    {
+      m_StepStatsFile.close();
+      m_StepStatsFile.open(GetParameterString("profiling.stepstats"));
+      if (!m_StepStatsFile.is_open())
+      {
+        otbAppLogFATAL("Unable to open the step stats file " << GetParameterString("profiling.stepstats"));
+      }
+      filter->SetRunMetadataCallback([this](const tensorflow::RunMetadata & metadata)
+      {
+        std::lock_guard<std::mutex> lock(m_StepStatsMutex);
+        m_StepStatsFile << metadata.step_stats().DebugString() << "---" << std::endl;
+      });
+    }
+  }
+
+  //
+  // Report the timings of the processing stages
+  //
+  void ReportProfiling()
+  {
+    if (m_Profiler)
+    {
+      std::stringstream report;
+      m_Profiler->Report(report);
+      otbAppLogINFO("Timings of the processing stages:\n" << report.str());
+      if (HasValue("profiling.out"))
+      {
+        otbAppLogINFO("Writing the profile in " << GetParameterString("profiling.out"));
+        m_Profiler->Write(GetParameterString("profiling.out"));
+      }
+    }
+    m_StepStatsFile.close();
+  }
+
+  //
+  // Pick the tile size which gives the best throughput, among the largest
+  // size, its half and its quarter, by running the filter over a region at the center
+  // of the output image. The first run of each size is a warm-up run, and is
+  // not timed unless a single run is requested.
+  //
+  template<class TFilter>
+  unsigned int CalibrateTileSize(TFilter * filter, unsigned int maxTileSize, bool useInternalTiles, unsigned int nRuns)
+  {
+    const RegionType largestRegion = filter->GetOutput()->GetLargestPossibleRegion();
+    const SizeType grid = filter->GetOutputGridSize();
+    const unsigned int minTileSize = vnl_math_max(grid[0], grid[1]);
+
+    unsigned int bestTileSize = maxTileSize;
+    double bestThroughput = 0;
+    for (unsigned int tileSize = maxTileSize ; tileSize >= minTileSize && tileSize * 4 >= maxTileSize ; tileSize /= 2)
+    {
+      // Region of one tile at the center of the output image
+      SizeType size;
+      size.Fill(tileSize);
+      IndexType index;
+      for (unsigned int dim = 0 ; dim < FloatVectorImageType::ImageDimension ; dim++)
+      {
+        const unsigned int start = largestRegion.GetSize(dim) > tileSize ? (largestRegion.GetSize(dim) - tileSize) / 2 : 0;
+        index[dim] = largestRegion.GetIndex(dim) + start - start % grid[dim];
+      }
+      RegionType region(index, size);
+      region.Crop(largestRegion);
+
+      if (useInternalTiles)
+      {
+        filter->SetInternalTileSize(size);
+      }
+
+      double seconds = 0;
+      for (unsigned int run = 0 ; run < nRuns ; run++)
+      {
+        filter->Modified();
+        filter->GetOutput()->SetRequestedRegion(region);
+        const tf::Profiler::TimePointType start = tf::Profiler::Now();
+        filter->GetOutput()->Update();
+        if (run > 0 || nRuns == 1)
+        {
+          seconds += std::chrono::duration<double>(tf::Profiler::Now() - start).count();
+        }
+      }
+      const double throughput = (nRuns > 1 ? nRuns - 1 : 1) * region.GetNumberOfPixels() / vnl_math_max(seconds, 1e-9);
+      otbAppLogINFO("Tile size " << tileSize << ": " << throughput << " pixels/s");
+      if (throughput > bestThroughput)
+      {
+        bestThroughput = throughput;
+        bestTileSize = tileSize;
+      }
+    }
+
+    // Release the calibration results
+    filter->Modified();
+    filter->GetOutput()->ReleaseData();
+    if (m_Profiler)
+    {
+      m_Profiler->Reset();
+    }
+
+    return bestTileSize;
+  }
+
+  //
+  // Round and clamp the output values to the range of the pixel type of the output image
+  //
+  template<class TFilter>
+  void SetOutputQuantizationRange(TFilter * filter)
+  {
+    double minimum, maximum;
+    switch (GetParameterOutputImagePixelType("out"))
+    {
+    case ImagePixelType_uint8:
+      minimum = itk::NumericTraits<uint8_t>::min();
+      maximum = itk::NumericTraits<uint8_t>::max();
+      break;
+    case ImagePixelType_int16:
+      minimum = itk::NumericTraits<int16_t>::min();
+      maximum = itk::NumericTraits<int16_t>::max();
+      break;
+    case ImagePixelType_uint16:
+      minimum = itk::NumericTraits<uint16_t>::min();
+      maximum = itk::NumericTraits<uint16_t>::max();
+      break;
+    case ImagePixelType_int32:
+      minimum = itk::NumericTraits<int32_t>::min();
+      maximum = itk::NumericTraits<int32_t>::max();
+      break;
+    case ImagePixelType_uint32:
+      minimum = itk::NumericTraits<uint32_t>::min();
+      maximum = itk::NumericTraits<uint32_t>::max();
+      break;
+    default:
+      // Floating point output
+      return;
+    }
+    filter->SetOutputRound(true);
+    filter->SetOutputMinimum(minimum);
+    filter->SetOutputMaximum(maximum);
+    otbAppLogINFO("Output values rounded and clamped to [" << minimum << ", " << maximum << "]");
+  }
+
+  //
+  // Create the filter which classifies the output values with the machine
+  // learning model of "output.classifier"
+  //
+  template<class TInputImage, class TOutputImage>
+  typename Pipeline<TInputImage, TOutputImage>::FilterType::Pointer CreateClassifierFilter()
+  {
+    typedef typename Pipeline<TInputImage, TOutputImage>::FilterType           FilterType;
+    typedef typename Pipeline<TInputImage, TOutputImage>::ClassifierFilterType ClassifierFilterType;
+
+    const std::string modelFile = GetParameterString("output.classifier");
+    otbAppLogINFO("Loading the machine learning model " << modelFile);
+    m_ClassifierModel = ClassifierModelFactoryType::CreateMachineLearningModel(modelFile,
+        ClassifierModelFactoryType::ReadMode);
+    if (m_ClassifierModel.IsNull())
+    {
+      otbAppLogFATAL("Unable to create a machine learning model from " << modelFile);
+    }
+    m_ClassifierModel->Load(modelFile);
+
+    typename ClassifierFilterType::Pointer classifier = ClassifierFilterType::New();
+    classifier->SetModel(m_ClassifierModel);
+
+    if (HasValue("output.imstat"))
+    {
+      otbAppLogINFO("Normalizing the features with the statistics of " << GetParameterString("output.imstat"));
+      StatisticsReaderType::Pointer statisticsReader = StatisticsReaderType::New();
+      statisticsReader->SetFileName(GetParameterString("output.imstat"));
+      classifier->SetFeaturesShifts(statisticsReader->GetStatisticVectorByName("mean"));
+      classifier->SetFeaturesScales(statisticsReader->GetStatisticVectorByName("stddev"));
+    }
+
+    if (GetParameterInt("output.confidence") == 1)
+    {
+      if (!m_ClassifierModel->HasConfidenceIndex())
+      {
+        otbAppLogFATAL("The machine learning model does not support the confidence index");
+      }
+      classifier->SetComputeConfidence(true);
+    }
+
+    return typename FilterType::Pointer(classifier.GetPointer());
+  }
+
+  //
+  // Get the configuration of the tensorflow sessions
+  //
+  tf::SessionConfig GetSessionConfig()
+  {
+    tf::SessionConfig config;
+    config.m_IntraOpThreads = GetParameterInt("model.intraop");
+    config.m_InterOpThreads = GetParameterInt("model.interop");
+    config.m_AllowGrowth    = (GetParameterInt("model.allowgrowth") == 1);
+    config.m_MemoryFraction = GetParameterFloat("model.memfraction");
+    config.m_XLA            = (GetParameterInt("model.xla") == 1);
+    config.m_OptimizerLevel = GetParameterInt("model.optlevel");
+    config.m_Trace          = (GetParameterInt("model.trace") == 1);
+    if (HasValue("model.devices"))
+      config.m_VisibleDevices = tf::GetVisibleDevices(GetParameterStringList("model.devices"));
+    return config;
+  }
+
   void DoExecute()
   {
 
+    // The journal of the written tiles is only kept in distributed mode
+    if (GetParameterInt("distrib.enable") != 1 && (GetParameterInt("distrib.resume") == 1 || HasValue("distrib.update")))
+    {
+      otbAppLogFATAL("distrib.resume and distrib.update require the distributed processing (distrib.enable)");
+    }
+
     // Load the Tensorflow bundle
-    tf::LoadModel(GetParameterAsString("model.dir"), m_SavedModel);
+    // A resident model is loaded once, and kept in the process for the next
+    // executions of the application with the same model and session configuration
+    const tf::SessionConfig sessionConfig = GetSessionConfig();
+    const std::string modelDir = GetParameterAsString("model.dir");
+    if (GetParameterInt("model.resident") == 1)
+    {
+      tf::ModelRegistry & registry = tf::ModelRegistry::GetInstance();
+      if (registry.IsResident(modelDir, sessionConfig))
+      {
+        otbAppLogINFO("Using the resident model " << modelDir);
+      }
+      m_ResidentModel = registry.Get(modelDir, sessionConfig);
+    }
+    else
+    {
+      m_ResidentModel.reset();
+      tf::LoadModel(modelDir, m_SavedModel, sessionConfig);
+    }
 
     // Prepare inputs
     PrepareInputs();
 
+    // The images of the sources are read with their own pixel type, and
+    // copied to the input tensors without an intermediate float image
+    switch (GetSourcesPixelType())
+    {
+    case ImagePixelType_uint8:
+      otbAppLogINFO("Sources pixel type: uint8");
+      ExecuteWithSources<UInt8VectorImageType>(sessionConfig, modelDir);
+      break;
+    case ImagePixelType_int16:
+      otbAppLogINFO("Sources pixel type: int16");
+      ExecuteWithSources<Int16VectorImageType>(sessionConfig, modelDir);
+      break;
+    case ImagePixelType_uint16:
+      otbAppLogINFO("Sources pixel type: uint16");
+      ExecuteWithSources<UInt16VectorImageType>(sessionConfig, modelDir);
+      break;
+    case ImagePixelType_uint32:
+      otbAppLogINFO("Sources pixel type: uint32");
+      ExecuteWithSources<UInt32VectorImageType>(sessionConfig, modelDir);
+      break;
+    default:
+      ExecuteWithSources<FloatVectorImageType>(sessionConfig, modelDir);
+      break;
+    }
+  }
+
+  //
+  // Setup and run the pipeline for the pixel type of the sources. With an
+  // uint8 or int16 output pixel type, the filter produces the output image
+  // with this type, so that the output tiles take 1 or 2 bytes per value.
+  // Else, it produces a float image, which is cast by the writer.
+  //
+  template<class TInputImage>
+  void ExecuteWithSources(const tf::SessionConfig & sessionConfig, const std::string & modelDir)
+  {
+    switch (GetParameterOutputImagePixelType("out"))
+    {
+    case ImagePixelType_uint8:
+      Execute<TInputImage, UInt8VectorImageType>(sessionConfig, modelDir);
+      break;
+    case ImagePixelType_int16:
+      Execute<TInputImage, Int16VectorImageType>(sessionConfig, modelDir);
+      break;
+    default:
+      Execute<TInputImage, FloatVectorImageType>(sessionConfig, modelDir);
+      break;
+    }
+  }
+
+  //
+  // Setup and run the pipeline, for the pixel types of the sources and of the output
+  //
+  template<class TInputImage, class TOutputImage>
+  void Execute(const tf::SessionConfig & sessionConfig, const std::string & modelDir)
+  {
+    typedef Pipeline<TInputImage, TOutputImage>          PipelineType;
+    typedef typename PipelineType::FilterType            FilterType;
+    typedef typename PipelineType::StreamingFilterType   StreamingFilterType;
+
+    PipelineType * pipeline = new PipelineType();
+    m_Pipeline.reset(pipeline);
+    const tensorflow::SavedModelBundle & savedModel = m_ResidentModel ? m_ResidentModel->m_Bundle : m_SavedModel;
+
     // Setup filter
-    m_TFFilter = TFModelFilterType::New();
-    m_TFFilter->SetGraph(m_SavedModel.meta_graph_def.graph_def());
-    m_TFFilter->SetSession(m_SavedModel.session.get());
-    m_TFFilter->SetOutputTensorsNames(GetParameterStringList("output.names"));
-    m_TFFilter->SetOutputSpacingScale(GetParameterFloat("output.spcscale"));
-    otbAppLogINFO("Output spacing ratio: " << m_TFFilter->GetOutputSpacingScale());
+    // With a classifier, the output values are the features of the pixels,
+    // which are classified from the output tensors. The features image is
+    // never produced.
+    if (HasValue("output.classifier"))
+    {
+      pipeline->m_Filter = CreateClassifierFilter<TInputImage, TOutputImage>();
+    }
+    else
+    {
+      pipeline->m_Filter = FilterType::New();
+    }
+    FilterType * filter = pipeline->m_Filter.GetPointer();
+    filter->SetGraph(savedModel.meta_graph_def.graph_def());
+    filter->SetSession(savedModel.session.get());
+    filter->SetOutputTensorsNames(GetParameterStringList("output.names"));
+    filter->SetOutputSpacingScale(GetParameterFloat("output.spcscale"));
+    otbAppLogINFO("Output spacing ratio: " << filter->GetOutputSpacingScale());
 
     // Get user placeholders
-    TFModelFilterType::DictListType dict;
-    TFModelFilterType::StringList expressions = GetParameterStringList("model.userplaceholders");
+    typename FilterType::DictListType dict;
+    typename FilterType::StringList expressions = GetParameterStringList("model.userplaceholders");
     for (auto& exp: expressions)
     {
-      TFModelFilterType::DictType entry = tf::ExpressionToTensor(exp);
+      typename FilterType::DictType entry = tf::ExpressionToTensor(exp);
       dict.push_back(entry);
 
       otbAppLogINFO("Using placeholder " << entry.first << " with " << tf::PrintTensorInfos(entry.second));
     }
-    m_TFFilter->SetUserPlaceholders(dict);
+    filter->SetUserPlaceholders(dict);
+
+    // Instrumentation
+    SetupProfiling(filter);
 
     // Input sources
-    for (auto& bundle: m_Bundles)
+    pipeline->m_Sources.resize(m_Bundles.size());
+    for (unsigned int i = 0 ; i < m_Bundles.size() ; i++)
+    {
+      pipeline->m_Sources[i].Set(GetSourceImages(m_Bundles[i], *pipeline));
+      filter->PushBackInputBundle(m_Bundles[i].m_Placeholder, m_Bundles[i].m_PatchSize, pipeline->m_Sources[i].Get());
+    }
+
+    // Masking
+    // The tiles whose pixels are all masked, or nodata in one source, are
+    // not run in the session, and the patches of the masked pixels are
+    // dropped from the batches
+    for (unsigned int i = 0 ; i < m_Bundles.size() ; i++)
     {
-      m_TFFilter->PushBackInputBundle(bundle.m_Placeholder, bundle.m_PatchSize, bundle.m_ImageSource.Get());
+      if (HasValue(m_Bundles[i].m_KeyNoData))
+      {
+        filter->SetInputNoData(i, GetParameterFloat(m_Bundles[i].m_KeyNoData));
+        otbAppLogINFO("Nodata value of source #" << (i + 1) << ": " << GetParameterFloat(m_Bundles[i].m_KeyNoData));
+      }
     }
+    if (HasValue("output.mask"))
+    {
+      filter->SetMask(GetParameterImage<TInputImage>("output.mask"));
+      otbAppLogINFO("Using the mask " << GetParameterAsString("output.mask"));
+    }
+    filter->SetFillValue(GetParameterFloat("output.fill"));
+
+    // Quantization
+    // The output values are scaled and shifted while they are copied from
+    // the output tensors. With an integer output pixel type, they are also
+    // rounded and clamped to the range of the type, so that the output image
+    // (or the image writer, for the types without a filter instance) only has
+    // to cast them.
+    filter->SetOutputScale(GetParameterFloat("output.scale"));
+    filter->SetOutputShift(GetParameterFloat("output.shift"));
+    SetOutputQuantizationRange(filter);
 
     // Fully convolutional mode on/off
     if (GetParameterInt("model.fullyconv")==1)
     {
       otbAppLogINFO("The tensorflow model is used in fully convolutional mode");
-      m_TFFilter->SetFullyConvolutional(true);
+      filter->SetFullyConvolutional(true);
+    }
+    else if (GetParameterInt("model.patchesingraph")==1)
+    {
+      otbAppLogINFO("The patches are extracted with tensorflow");
+      filter->SetInGraphPatchExtraction(true);
     }
 
     // Output field of expression
-    FloatVectorImageType::SizeType foe;
+    SizeType foe;
     foe[0] = GetParameterInt("output.foex");
     foe[1] = GetParameterInt("output.foey");
-    m_TFFilter->SetOutputFOESize(foe);
+    filter->SetOutputFOESize(foe);
+
+    // Halo cache
+    // The streamed tiles overlap by the receptive field of the model. The
+    // square tiles splitter produces the tiles in raster order, so the
+    // overlapping parts can be kept from the previous tile (left) and from
+    // the previous row of tiles (top).
+    if (GetParameterInt("finetuning.halocache") == 1)
+    {
+      filter->SetHaloCache(true);
+      otbAppLogINFO("Input halos are kept between adjacent tiles");
+    }
+
+    otbAppLogINFO("Output field of expression: " << filter->GetOutputFOESize());
+
+    // Multiple devices: one session per device. The tiles of each streamed
+    // region are dispatched to the sessions. All the sessions (and the session
+    // of the bundle) only see the GPUs of the devices. The session of the
+    // bundle is then not used anymore, and is closed unless the model is
+    // resident. The sessions of a resident model on the devices are kept in
+    // the registry, and reused by the next executions.
+    m_DevicesSessions.clear();
+    typename FilterType::SessionListType sessions;
+    if (HasValue("model.devices"))
+    {
+      for (auto& device: GetParameterStringList("model.devices"))
+      {
+        if (m_ResidentModel)
+        {
+          otbAppLogINFO("Session of the resident model on device " << device);
+          sessions.push_back(tf::ModelRegistry::GetInstance().GetSession(modelDir, device, sessionConfig));
+        }
+        else
+        {
+          otbAppLogINFO("Creating a session on device " << device);
+          std::unique_ptr<tensorflow::Session> session;
+          tf::CreateSessionOnDevice(modelDir, savedModel, device, session, sessionConfig);
+          sessions.push_back(session.get());
+          m_DevicesSessions.push_back(std::move(session));
+        }
+      }
+      filter->SetSession(sessions[0]);
+      filter->SetSessions(sessions);
+      if (!m_ResidentModel)
+      {
+        m_SavedModel.session->Close();
+        m_SavedModel.session.reset();
+      }
+    }
+    const unsigned int nSessions = vnl_math_max(static_cast<std::size_t>(1), sessions.size());
+
+    // Tile size
+    // When "finetuning.autotilesize" is on, the tile size is the largest one
+    // whose input and output tensors fit in "finetuning.tileram". It can then
+    // be refined with a few warm-up runs.
+    unsigned int tileSize = GetParameterInt("finetuning.tilesize");
+    if (GetParameterInt("finetuning.autotilesize") == 1)
+    {
+      filter->UpdateOutputInformation();
+      const SizeType autoSize = filter->ComputeTileSizeFromMemoryBudget(GetParameterInt("finetuning.tileram"));
+      tileSize = vnl_math_max(autoSize[0], autoSize[1]);
+      otbAppLogINFO("Tile size computed from the memory budget: " << tileSize);
+    }
 
-    otbAppLogINFO("Output field of expression: " << m_TFFilter->GetOutputFOESize());
+    // Asynchronous tiles pipeline and batching
+    // The filter processes each requested region as a set of tiles of
+    // "finetuning.tilesize". Tiles can be grouped in batches to run the session
+    // once for multiple tiles, and the next batches can be prepared and the
+    // previous ones written while the current batch runs in the session.
+    const unsigned int pipelineDepth = GetParameterInt("finetuning.pipeline");
+    const unsigned int batchSize = GetParameterInt("finetuning.batchsize");
+    const unsigned int batchRAM = GetParameterInt("finetuning.batchram");
+    const bool useInternalTiles = (pipelineDepth > 0 || batchSize > 0 || batchRAM > 0 || nSessions > 1);
+    if (useInternalTiles)
+    {
+      filter->SetPipelineDepth(pipelineDepth);
+      filter->SetTargetBatchSize(batchSize);
+      filter->SetBatchMemoryBudget(batchRAM);
+    }
+    if (GetParameterInt("finetuning.autotilesize") == 1 && GetParameterInt("finetuning.calibrate") > 0)
+    {
+      tileSize = CalibrateTileSize(filter, tileSize, useInternalTiles, GetParameterInt("finetuning.calibrate"));
+      otbAppLogINFO("Tile size after calibration: " << tileSize);
+    }
+    SizeType internalTileSize;
+    internalTileSize.Fill(tileSize);
+    if (useInternalTiles)
+    {
+      filter->SetInternalTileSize(internalTileSize);
+      otbAppLogINFO("Processing tiles of " << internalTileSize <<
+          " (pipeline depth: " << pipelineDepth <<
+          ", batch size: " << batchSize <<
+          ", batch memory budget: " << batchRAM << " MB" <<
+          ", sessions: " << nSessions << ")");
+    }
 
+    // Distributed processing
+    if (GetParameterInt("distrib.enable") == 1)
+    {
+      ExecuteDistributed(filter, tileSize, useInternalTiles, pipelineDepth, nSessions);
+    }
     // Streaming
-    if (GetParameterInt("finetuning.disabletiling")!=1)
+    else if (GetParameterInt("finetuning.disabletiling")!=1)
     {
-      // Get the tile size
-      const unsigned int tileSize = GetParameterInt("finetuning.tilesize");
-      otbAppLogINFO("Force tiling with squared tiles of " << tileSize)
-
       // Update the TF filter to get the output image size
-      m_TFFilter->UpdateOutputInformation();
+      filter->UpdateOutputInformation();
+
+      tileSize = GetStreamedTileSize(filter, tileSize, useInternalTiles, pipelineDepth, nSessions);
+      otbAppLogINFO("Force tiling with squared tiles of " << tileSize)
 
       // Splitting using square tiles
       TileSplitterType::Pointer splitter = TileSplitterType::New();
       splitter->SetTileSizeAlignment(tileSize);
       unsigned int nbDesiredTiles = itk::Math::Ceil<unsigned int>(
-          double(m_TFFilter->GetOutput()->GetLargestPossibleRegion().GetNumberOfPixels() ) / (tileSize * tileSize) );
+          double(filter->GetOutput()->GetLargestPossibleRegion().GetNumberOfPixels() ) / (tileSize * tileSize) );
 
       // Use an itk::StreamingImageFilter to force the computation on tiles
-      m_StreamFilter = StreamingFilterType::New();
-      m_StreamFilter->SetRegionSplitter(splitter);
-      m_StreamFilter->SetNumberOfStreamDivisions(nbDesiredTiles);
-      m_StreamFilter->SetInput(m_TFFilter->GetOutput());
+      pipeline->m_StreamFilter = StreamingFilterType::New();
+      pipeline->m_StreamFilter->SetRegionSplitter(splitter);
+      pipeline->m_StreamFilter->SetNumberOfStreamDivisions(nbDesiredTiles);
+      pipeline->m_StreamFilter->SetInput(filter->GetOutput());
 
-      SetParameterOutputImage("out", m_StreamFilter->GetOutput());
+      SetParameterOutputImage("out", pipeline->m_StreamFilter->GetOutput());
     }
     else
     {
       otbAppLogINFO("Tiling disabled");
-      SetParameterOutputImage("out", m_TFFilter->GetOutput());
+      SetParameterOutputImage("out", filter->GetOutput());
+
+    }
+  }
+
+  //
+  // Size of the regions requested to the filter (streaming and distributed
+  // modes). When the tiles are processed internally by the filter, each
+  // region must contain enough tiles to fill one batch, and to keep all the
+  // sessions (two jobs each) or all the pipeline stages busy.
+  //
+  template<class TFilter>
+  unsigned int GetStreamedTileSize(TFilter * filter, unsigned int tileSize, bool useInternalTiles,
+      unsigned int pipelineDepth, unsigned int nSessions)
+  {
+    if (!useInternalTiles)
+      return tileSize;
+    const unsigned int tilesPerBatch = filter->GetNumberOfTilesPerBatch(filter->GetInternalTileSize());
+    unsigned int nJobs = 1;
+    if (nSessions > 1)
+      nJobs = 2 * nSessions;
+    else if (pipelineDepth > 0)
+      nJobs = pipelineDepth + 2;
+    otbAppLogINFO("Number of tiles per batch: " << tilesPerBatch << ", jobs per region: " << nJobs);
+    return tileSize * itk::Math::Ceil<unsigned int>(std::sqrt(double(tilesPerBatch * nJobs)));
+  }
+
+  //
+  // Write one tile of the output image in place, in the output file
+  //
+  template<class TFilter>
+  void WriteTile(TFilter * filter, const RegionType & region, tf::TileWriter & writer)
+  {
+    typedef typename TFilter::OutputImageType::InternalPixelType                         OutputInternalPixelType;
+    typedef otb::MultiChannelExtractROI<OutputInternalPixelType, OutputInternalPixelType> ExtractFilterType;
+
+    // The tile is computed in one request, the filter splits it in internal tiles
+    typename ExtractFilterType::Pointer extractFilter = ExtractFilterType::New();
+    extractFilter->SetInput(filter->GetOutput());
+    extractFilter->SetExtractionRegion(region);
+    extractFilter->Update();
+
+    // Region of the tile in the output file
+    const RegionType largestRegion = filter->GetOutput()->GetLargestPossibleRegion();
+    RegionType fileRegion = region;
+    for (unsigned int dim = 0 ; dim < FloatVectorImageType::ImageDimension ; dim++)
+    {
+      fileRegion.SetIndex(dim, region.GetIndex(dim) - largestRegion.GetIndex(dim));
+    }
+    writer.Write(fileRegion, extractFilter->GetOutput()->GetBufferPointer(),
+        GdalDataTypeBridge::GetGDALDataType<OutputInternalPixelType>());
+  }
 
+  //
+  // GDAL pixel type of the output image
+  //
+  GDALDataType GetOutputGDALDataType()
+  {
+    switch (GetParameterOutputImagePixelType("out"))
+    {
+    case ImagePixelType_uint8:  return GDT_Byte;
+    case ImagePixelType_int16:  return GDT_Int16;
+    case ImagePixelType_uint16: return GDT_UInt16;
+    case ImagePixelType_int32:  return GDT_Int32;
+    case ImagePixelType_uint32: return GDT_UInt32;
+    case ImagePixelType_double: return GDT_Float64;
+    default:                    return GDT_Float32;
     }
   }
 
+  //
+  // Layout of the output file
+  //
+  template<class TImage>
+  tf::TileWriter::LayoutType GetOutputLayout(const TImage * output, unsigned int blockSize)
+  {
+    const typename TImage::SpacingType spacing = output->GetSignedSpacing();
+    const typename TImage::PointType origin = output->GetOrigin();
+
+    tf::TileWriter::LayoutType layout;
+    layout.m_Size = output->GetLargestPossibleRegion().GetSize();
+    layout.m_NumberOfBands = output->GetNumberOfComponentsPerPixel();
+    layout.m_DataType = GetOutputGDALDataType();
+    layout.m_BlockSize = blockSize;
+    layout.m_GeoTransform[0] = origin[0] - 0.5 * spacing[0];
+    layout.m_GeoTransform[1] = spacing[0];
+    layout.m_GeoTransform[2] = 0;
+    layout.m_GeoTransform[3] = origin[1] - 0.5 * spacing[1];
+    layout.m_GeoTransform[4] = 0;
+    layout.m_GeoTransform[5] = spacing[1];
+    layout.m_Projection = output->GetProjectionRef();
+    return layout;
+  }
+
+  //
+  // Region of the output image over which the input image changes the
+  // output pixels (the extent of the input image, padded with the receptive
+  // field of the model)
+  //
+  template<class TFilter>
+  RegionType GetChangedRegion(TFilter * filter, FloatVectorImageType * image)
+  {
+    image->UpdateOutputInformation();
+    const typename TFilter::OutputImageType * output = filter->GetOutput();
+    const RegionType largestRegion = output->GetLargestPossibleRegion();
+    const RegionType imageRegion = image->GetLargestPossibleRegion();
+
+    // Extent of the image, in the output grid
+    itk::ContinuousIndex<double, 2> lower, upper;
+    for (unsigned int corner = 0 ; corner < 4 ; corner++)
+    {
+      itk::ContinuousIndex<double, 2> imageIndex, outputIndex;
+      imageIndex[0] = imageRegion.GetIndex(0) - 0.5 + (corner % 2) * imageRegion.GetSize(0);
+      imageIndex[1] = imageRegion.GetIndex(1) - 0.5 + (corner / 2) * imageRegion.GetSize(1);
+      FloatVectorImageType::PointType point;
+      image->TransformContinuousIndexToPhysicalPoint(imageIndex, point);
+      output->TransformPhysicalPointToContinuousIndex(point, outputIndex);
+      for (unsigned int dim = 0 ; dim < 2 ; dim++)
+      {
+        lower[dim] = (corner == 0 ? outputIndex[dim] : std::min(lower[dim], outputIndex[dim]));
+        upper[dim] = (corner == 0 ? outputIndex[dim] : std::max(upper[dim], outputIndex[dim]));
+      }
+    }
+
+    // Receptive field of the model, in output pixels
+    SizeType margin;
+    margin.Fill(0);
+    for (unsigned int i = 0 ; i < m_Bundles.size() ; i++)
+    {
+      const typename TFilter::SpacingType inputSpacing = filter->GetInput(i)->GetSignedSpacing();
+      for (unsigned int dim = 0 ; dim < 2 ; dim++)
+      {
+        const double fov = 0.5 * m_Bundles[i].m_PatchSize[dim] * std::abs(inputSpacing[dim] / output->GetSignedSpacing()[dim]);
+        margin[dim] = std::max<SizeType::SizeValueType>(margin[dim], itk::Math::Ceil<unsigned int>(fov));
+      }
+    }
+
+    RegionType region;
+    for (unsigned int dim = 0 ; dim < 2 ; dim++)
+    {
+      const long first = itk::Math::Floor<long>(lower[dim] + 0.5) - margin[dim];
+      const long last = itk::Math::Ceil<long>(upper[dim] - 0.5) + margin[dim];
+      region.SetIndex(dim, first);
+      region.SetSize(dim, last >= first ? last - first + 1 : 0);
+    }
+    if (!region.Crop(largestRegion))
+    {
+      region.GetModifiableSize().Fill(0);
+    }
+    return region;
+  }
+
+  //
+  // Distributed processing
+  // The output grid is split in tiles, which are handed to the nodes. With
+  // MPI, or when the nodes share a job identifier ("distrib.jobid"), the
+  // tiles are taken dynamically by the nodes, so that the load is balanced
+  // when some areas are cheaper (nodata, mask). Else, each node (e.g. each
+  // task of a job array) processes its interleaved share of the tiles. Each
+  // node has its own sessions, and writes its tiles in place in the output
+  // GeoTIFF, whose blocks are aligned on the tiles.
+  // The written tiles are recorded in a journal, so that an interrupted
+  // processing can be resumed, or only the tiles whose inputs changed can be
+  // computed again.
+  //
+  template<class TFilter>
+  void ExecuteDistributed(TFilter * filter, unsigned int tileSize, bool useInternalTiles, unsigned int pipelineDepth,
+      unsigned int nSessions)
+  {
+    filter->UpdateOutputInformation();
+    const typename TFilter::OutputImageType * output = filter->GetOutput();
+    const RegionType largestRegion = output->GetLargestPossibleRegion();
+
+    // Tiles aligned on the output grid, and on the blocks of the output file
+    const SizeType grid = filter->GetOutputGridSize();
+    tileSize = GetStreamedTileSize(filter, tileSize, useInternalTiles, pipelineDepth, nSessions);
+    SizeType::SizeValueType blockSize = 256;
+    while (blockSize > 16 && blockSize > tileSize)
+      blockSize /= 2;
+    SizeType size;
+    for (unsigned int dim = 0 ; dim < FloatVectorImageType::ImageDimension ; dim++)
+    {
+      const SizeType::SizeValueType step = grid[dim] / itk::Math::GreatestCommonDivisor(grid[dim], blockSize) * blockSize;
+      size[dim] = step * itk::Math::Ceil<unsigned int>(double(tileSize) / step);
+    }
+
+    // Output file
+    std::string outputFile = GetParameterString("out");
+    if (outputFile.find('?') != std::string::npos)
+    {
+      otbAppLogWARNING("The extended filename of the output image is ignored in distributed mode");
+      outputFile = outputFile.substr(0, outputFile.find('?'));
+    }
+    const std::string extension = itksys::SystemTools::LowerCase(itksys::SystemTools::GetFilenameLastExtension(outputFile));
+    if (extension != ".tif" && extension != ".tiff")
+    {
+      otbAppLogFATAL("The output image must be a GeoTIFF file in distributed mode (" << outputFile << ")");
+    }
+
+#ifdef OTB_USE_MPI
+    std::unique_ptr<tf::TileScheduler> scheduler;
+    if (otb::MPIConfig::Instance()->GetNbProcs() > 1)
+    {
+      scheduler.reset(new tf::MPITileScheduler());
+      otbAppLogINFO("Tiles scheduled dynamically among the MPI processes");
+    }
+    else
+    {
+      scheduler = CreateNodesScheduler(outputFile);
+    }
+#else
+    std::unique_ptr<tf::TileScheduler> scheduler = CreateNodesScheduler(outputFile);
+#endif
+    scheduler->SetTiles(largestRegion, size);
+    otbAppLogINFO("Node " << scheduler->GetRank() << " of " << scheduler->GetNumberOfNodes() << ": " <<
+        scheduler->GetTiles().size() << " tiles of " << size);
+
+    // Identifier of the run: the tiles recorded in the journal are only
+    // reused by a run with the same model, output grid and tiles
+    std::stringstream runId;
+    runId << std::setprecision(17) << itksys::SystemTools::CollapseFullPath(GetParameterAsString("model.dir"));
+    for (auto& name: GetParameterStringList("output.names"))
+      runId << " " << name;
+    if (HasValue("output.classifier"))
+      runId << " " << itksys::SystemTools::CollapseFullPath(GetParameterString("output.classifier"));
+    for (auto& bundle: m_Bundles)
+      runId << " " << bundle.m_Placeholder << " " << bundle.m_PatchSize;
+    runId << " " << largestRegion.GetIndex() << " " << largestRegion.GetSize() << " " << output->GetOrigin() <<
+        " " << output->GetSignedSpacing() << " " << grid << " " << size << " " <<
+        output->GetNumberOfComponentsPerPixel() << " " << GetOutputGDALDataType();
+
+    // Tiles already written
+    // Each node opens its own journal, which is truncated when a new
+    // processing starts: the nodes don't wait for each other. When resuming,
+    // the journals of another run are ignored, and the recorded tiles are
+    // checked against the tiles of the current grid
+    tf::TileJournal journal;
+    const bool resume = (GetParameterInt("distrib.resume") == 1 || HasValue("distrib.update"));
+    journal.Open(outputFile, scheduler->GetRank(), scheduler->GetNumberOfNodes(), resume, runId.str());
+    if (journal.GetNumberOfStaleJournals() > 0)
+    {
+      otbAppLogWARNING(journal.GetNumberOfStaleJournals() << " journals of another run (model, output grid or tiles) are ignored");
+    }
+    std::vector<bool> done(scheduler->GetTiles().size(), false);
+    if (resume)
+    {
+      for (std::size_t k = 0 ; k < done.size() ; k++)
+      {
+        done[k] = journal.IsDone(k, scheduler->GetTiles()[k]);
+      }
+    }
+
+    // Tiles whose inputs changed
+    if (HasValue("distrib.update"))
+    {
+      FloatVectorImageListType::Pointer updates = GetParameterImageList("distrib.update");
+      for (unsigned int i = 0 ; i < updates->Size() ; i++)
+      {
+        const RegionType changedRegion = GetChangedRegion(filter, updates->GetNthElement(i));
+        otbAppLogINFO("Output region changed by update #" << i << ": " << changedRegion.GetIndex() << ", " << changedRegion.GetSize());
+        for (std::size_t k = 0 ; k < done.size() ; k++)
+        {
+          RegionType tile = scheduler->GetTiles()[k];
+          if (changedRegion.GetNumberOfPixels() > 0 && tile.Crop(changedRegion))
+          {
+            done[k] = false;
+          }
+        }
+      }
+    }
+    scheduler->SetDoneTiles(done);
+    otbAppLogINFO(scheduler->GetNumberOfPendingTiles() << " tiles to compute");
+
+    // The output file is created by the first node which opens it. When
+    // tiles are reused, it must already exist with the layout of the output.
+    tf::TileWriter writer;
+    writer.Open(outputFile, GetOutputLayout(output, blockSize), !resume || journal.GetNumberOfDoneTiles() == 0);
+
+    // Process the tiles
+    std::size_t tileIndex;
+    unsigned int nTiles = 0;
+    while (scheduler->Next(tileIndex))
+    {
+      const RegionType & tile = scheduler->GetTiles()[tileIndex];
+      otbAppLogINFO("Processing tile " << tileIndex << " (" << tile.GetIndex() << ", " << tile.GetSize() << ")");
+      WriteTile(filter, tile, writer);
+      journal.MarkDone(tileIndex, tile);
+      filter->GetOutput()->ReleaseData();
+      nTiles++;
+    }
+    writer.Close();
+    otbAppLogINFO("Node " << scheduler->GetRank() << " processed " << nTiles << " tiles");
+
+    // The output image is written by the nodes
+    DisableParameter("out");
+  }
+
+  //
+  // Scheduler of the nodes which are not MPI processes
+  //
+  std::unique_ptr<tf::TileScheduler> CreateNodesScheduler(const std::string & outputFile)
+  {
+    std::unique_ptr<tf::TileScheduler> scheduler;
+    if (HasValue("distrib.jobid"))
+    {
+      scheduler.reset(new tf::ClaimTileScheduler(outputFile + ".claims." + GetParameterString("distrib.jobid")));
+      otbAppLogINFO("Tiles claimed dynamically by the nodes of the job " << GetParameterString("distrib.jobid"));
+    }
+    else
+    {
+      scheduler.reset(new tf::TileScheduler());
+    }
+    scheduler->SetNode(GetParameterInt("distrib.rank"), GetParameterInt("distrib.nodes"));
+    return scheduler;
+  }
+
+  void AfterExecuteAndWriteOutputs()
+  {
+    ReportProfiling();
+  }
+
 private:
 
-  TFModelFilterType::Pointer   m_TFFilter;
-  StreamingFilterType::Pointer m_StreamFilter;
+  std::unique_ptr<PipelineBase> m_Pipeline;       // Sources, model filter and streaming
+  ClassifierModelType::Pointer m_ClassifierModel; // Classifier of the output values
   tensorflow::SavedModelBundle m_SavedModel; // must be alive during all the execution of the application !
+  tf::ModelRegistry::ModelPointerType m_ResidentModel; // Resident model (used instead of m_SavedModel)
+  std::vector<std::unique_ptr<tensorflow::Session>> m_DevicesSessions; // Sessions of the model on the devices
+  std::unique_ptr<tf::Profiler> m_Profiler;    // Timings of the processing stages
+  std::ofstream                 m_StepStatsFile; // Step stats of the session runs
+  std::mutex                    m_StepStatsMutex;
 
   std::vector<ProcessObjectsBundle>           m_Bundles;
 
@@ -30,9 +30,18 @@
 // Layerstack
 #include "otbTensorflowSource.h"
 
+// Samples datasets
+#include "otbTensorflowMappedPatchesDataset.h"
+#include "otbTensorflowPatchesDatasetSource.h"
+
 // Metrics
 #include "otbConfusionMatrixMeasurements.h"
 
+// Profiling
+#include "otbTensorflowProfiler.h"
+#include <fstream>
+#include <mutex>
+
 namespace otb
 {
 
@@ -57,6 +66,11 @@ public:
   typedef otb::TensorflowMultisourceModelTrain<FloatVectorImageType>    TrainModelFilterType;
   typedef otb::TensorflowMultisourceModelValidate<FloatVectorImageType> ValidateModelFilterType;
   typedef otb::TensorflowSource<FloatVectorImageType>                   TFSource;
+  typedef TrainModelFilterType::PatchesCacheType                        PatchesCacheType;
+
+  /** Typedefs for samples datasets */
+  typedef tf::MappedPatchesDataset<FloatVectorImageType>                DatasetType;
+  typedef otb::TensorflowPatchesDatasetSource<FloatVectorImageType>     DatasetSourceType;
 
   /* Typedefs for evaluation metrics */
   typedef ValidateModelFilterType::ConfMatType                          ConfMatType;
@@ -71,6 +85,8 @@ public:
   {
     TFSource tfSource;
     TFSource tfSourceForValidation;
+    DatasetSourceType::Pointer m_DatasetSource;              // Source of the training dataset
+    DatasetSourceType::Pointer m_DatasetSourceForValidation; // Source of the validation dataset
 
     // Parameters keys
     std::string m_KeyInForTrain;     // Key of input image list (training)
@@ -138,6 +154,7 @@ public:
     // Populate group
     AddParameter(ParameterType_Group,          ss_key_tr_group.str(),  ss_desc_tr_group.str());
     AddParameter(ParameterType_InputImageList, ss_key_tr_in.str(),     ss_desc_tr_in.str() );
+    MandatoryOff                              (ss_key_tr_in.str());
     AddParameter(ParameterType_Int,            ss_key_dims_x.str(),    ss_desc_dims_x.str());
     SetMinimumParameterIntValue               (ss_key_dims_x.str(),    1);
     AddParameter(ParameterType_Int,            ss_key_dims_y.str(),    ss_desc_dims_y.str());
@@ -145,6 +162,7 @@ public:
     AddParameter(ParameterType_String,         ss_key_tr_ph.str(),     ss_desc_tr_ph.str());
     AddParameter(ParameterType_Group,          ss_key_val_group.str(), ss_desc_val_group.str());
     AddParameter(ParameterType_InputImageList, ss_key_val_in.str(),    ss_desc_val_in.str() );
+    MandatoryOff                              (ss_key_val_in.str());
     AddParameter(ParameterType_String,         ss_key_val_ph.str(),    ss_desc_val_ph.str());
 
     // Add a new bundle
@@ -171,7 +189,9 @@ public:
         "The number of input sources can be changed at runtime by setting the "
         "system environment variable " + tf::ENV_VAR_NAME_NSOURCES + ". "
         "For each source, you have to set (1) the tensor placeholder name, as named in "
-        "the tensorflow model, (2) the patch size and (3) the image(s) source. ");
+        "the tensorflow model, (2) the patch size and (3) the image(s) source. "
+        "Instead of the images, a samples dataset written by PatchesExtraction can be "
+        "used: the source #k is then the array #k of the dataset.");
     SetDocAuthors("Remi Cresson");
 
     // Input model
@@ -182,6 +202,26 @@ public:
     MandatoryOff                           ("model.restorefrom");
     AddParameter(ParameterType_String,      "model.saveto",       "Save model to path");
     MandatoryOff                           ("model.saveto");
+    AddParameter(ParameterType_Int,         "model.intraop",      "Number of threads of the tensorflow intra-op pool (0: tensorflow default)");
+    SetMinimumParameterIntValue            ("model.intraop",      0);
+    SetDefaultParameterInt                 ("model.intraop",      0);
+    AddParameter(ParameterType_Int,         "model.interop",      "Number of threads of the tensorflow inter-op pool (0: tensorflow default)");
+    SetMinimumParameterIntValue            ("model.interop",      0);
+    SetDefaultParameterInt                 ("model.interop",      0);
+    AddParameter(ParameterType_Bool,        "model.allowgrowth",  "Allocate the GPU memory on demand");
+    MandatoryOff                           ("model.allowgrowth");
+    AddParameter(ParameterType_Float,       "model.memfraction",  "Fraction of the GPU memory that can be allocated (0: tensorflow default)");
+    SetMinimumParameterFloatValue          ("model.memfraction",  0.0);
+    SetMaximumParameterFloatValue          ("model.memfraction",  1.0);
+    SetDefaultParameterFloat               ("model.memfraction",  0.0);
+    AddParameter(ParameterType_Bool,        "model.xla",          "Enable the XLA JIT compilation");
+    MandatoryOff                           ("model.xla");
+    AddParameter(ParameterType_Int,         "model.optlevel",     "Level of the graph optimizer (0: no optimization, 1: default)");
+    SetMinimumParameterIntValue            ("model.optlevel",     0);
+    SetMaximumParameterIntValue            ("model.optlevel",     1);
+    SetDefaultParameterInt                 ("model.optlevel",     1);
+    AddParameter(ParameterType_Bool,        "model.trace",        "Trace the runs used to load the model");
+    MandatoryOff                           ("model.trace");
 
     // Training parameters group
     AddParameter(ParameterType_Group,       "training",           "Training parameters");
@@ -191,6 +231,27 @@ public:
     AddParameter(ParameterType_Int,         "training.epochs",    "Number of epochs");
     SetMinimumParameterIntValue            ("training.epochs",    1);
     SetDefaultParameterInt                 ("training.epochs",    10);
+    AddParameter(ParameterType_Int,         "training.prefetch",  "Number of batches prepared in advance (0 to disable prefetching)");
+    SetMinimumParameterIntValue            ("training.prefetch",  0);
+    SetDefaultParameterInt                 ("training.prefetch",  0);
+    AddParameter(ParameterType_Int,         "training.loaders",   "Number of threads preparing the batches (when prefetching is enabled)");
+    SetMinimumParameterIntValue            ("training.loaders",   1);
+    SetDefaultParameterInt                 ("training.loaders",   1);
+    AddParameter(ParameterType_Int,         "training.shufflechunk",  "Number of contiguous samples shuffled together (1: the samples are shuffled individually)");
+    SetMinimumParameterIntValue            ("training.shufflechunk",  1);
+    SetDefaultParameterInt                 ("training.shufflechunk",  1);
+    AddParameter(ParameterType_Int,         "training.shufflebuffer", "Number of samples of the shuffle buffer which mixes the chunks (0 to disable)");
+    SetMinimumParameterIntValue            ("training.shufflebuffer", 0);
+    SetDefaultParameterInt                 ("training.shufflebuffer", 0);
+    AddParameter(ParameterType_Int,         "training.readheight", "Max. height (in rows) of the regions of the patches images read at once, including the rows between the samples (0: contiguous samples only)");
+    SetMinimumParameterIntValue            ("training.readheight", 0);
+    SetDefaultParameterInt                 ("training.readheight", 0);
+    AddParameter(ParameterType_Bool,        "training.cache",     "Keep the training patches in a cache (patches images are read only once)");
+    MandatoryOff                           ("training.cache");
+    AddParameter(ParameterType_Directory,   "training.cachedir",  "Directory of the memory-mapped cache files (if not set, the cache is in memory)");
+    MandatoryOff                           ("training.cachedir");
+    AddParameter(ParameterType_InputFilename, "training.dataset", "Samples dataset (from PatchesExtraction) used instead of the sources images");
+    MandatoryOff                           ("training.dataset");
     AddParameter(ParameterType_StringList,  "training.userplaceholders",
                  "Additional single-valued placeholders for training. Supported types: int, float, bool.");
     MandatoryOff                           ("training.userplaceholders");
@@ -206,9 +267,29 @@ public:
     AddChoice                              ("validation.mode.none",  "No validation step");
     AddChoice                              ("validation.mode.class", "Classification metrics");
     AddChoice                              ("validation.mode.rmse",  "Root mean square error");
+    AddParameter(ParameterType_InputFilename, "validation.dataset", "Samples dataset (from PatchesExtraction) used instead of the sources images");
+    MandatoryOff                           ("validation.dataset");
     AddParameter(ParameterType_StringList,  "validation.userplaceholders",
                  "Additional single-valued placeholders for validation. Supported types: int, float, bool.");
     MandatoryOff                           ("validation.userplaceholders");
+    AddParameter(ParameterType_Int,         "validation.step",       "Evaluate the model every k epochs (0: only after the training)");
+    SetMinimumParameterIntValue            ("validation.step",       0);
+    SetDefaultParameterInt                 ("validation.step",       0);
+    AddParameter(ParameterType_Int,         "validation.subset",     "Number of samples of the fixed random subset used to evaluate the model (0: all the samples)");
+    SetMinimumParameterIntValue            ("validation.subset",     0);
+    SetDefaultParameterInt                 ("validation.subset",     0);
+    AddParameter(ParameterType_Int,         "validation.threads",    "Number of threads evaluating the batches (when prefetching is enabled)");
+    SetMinimumParameterIntValue            ("validation.threads",    1);
+    SetDefaultParameterInt                 ("validation.threads",    1);
+
+    // Profiling
+    AddParameter(ParameterType_Group,       "profiling",           "Profiling parameters");
+    AddParameter(ParameterType_Bool,        "profiling.enable",    "Report the timings of the processing stages");
+    MandatoryOff                           ("profiling.enable");
+    AddParameter(ParameterType_OutputFilename, "profiling.out",    "Profile file (JSON if the extension is .json, CSV else)");
+    MandatoryOff                           ("profiling.out");
+    AddParameter(ParameterType_OutputFilename, "profiling.stepstats", "File of the tensorflow step stats of each session run (slows down the runs)");
+    MandatoryOff                           ("profiling.stepstats");
 
     // Input/output images
     AddAnInputImage();
@@ -270,17 +351,22 @@ public:
     m_InputTargetsForTest.clear();
 
 
-    // Prepare the bundles
-    for (auto& bundle: m_Bundles)
+    // Open the samples datasets
+    m_TrainingDataset.reset();
+    if (HasValue("training.dataset"))
       {
-      // Source
-      FloatVectorImageListType::Pointer trainStack = GetParameterImageList(bundle.m_KeyInForTrain);
-      bundle.tfSource.Set(trainStack);
-      m_InputSourcesForTraining.push_back(bundle.tfSource.Get());
+      m_TrainingDataset = OpenDataset(GetParameterAsString("training.dataset"));
+      }
+    m_ValidationDataset.reset();
+    if (GetParameterInt("validation.mode") != 0 && HasValue("validation.dataset"))
+      {
+      m_ValidationDataset = OpenDataset(GetParameterAsString("validation.dataset"));
+      }
 
-      // Placeholder
-      std::string placeholderForTraining = GetParameterAsString(bundle.m_KeyPHNameForTrain);
-      m_InputPlaceholdersForTraining.push_back(placeholderForTraining);
+    // Prepare the bundles
+    for (unsigned int k = 0 ; k < m_Bundles.size() ; k++)
+      {
+      ProcessObjectsBundle & bundle = m_Bundles[k];
 
       // Patch size
       FloatVectorImageType::SizeType patchSize;
@@ -288,6 +374,29 @@ public:
       patchSize[1] = GetParameterInt(bundle.m_KeyPszY);
       m_InputPatchesSizeForTraining.push_back(patchSize);
 
+      // Source
+      FloatVectorImageType::Pointer trainSource;
+      if (m_TrainingDataset)
+        {
+        bundle.m_DatasetSource = CreateDatasetSource(m_TrainingDataset.get(), k, patchSize);
+        trainSource = bundle.m_DatasetSource->GetOutput();
+        }
+      else
+        {
+        if (!HasValue(bundle.m_KeyInForTrain))
+          {
+          otbAppLogFATAL("No training input is set for this source");
+          }
+        FloatVectorImageListType::Pointer trainStack = GetParameterImageList(bundle.m_KeyInForTrain);
+        bundle.tfSource.Set(trainStack);
+        trainSource = bundle.tfSource.Get();
+        }
+      m_InputSourcesForTraining.push_back(trainSource);
+
+      // Placeholder
+      std::string placeholderForTraining = GetParameterAsString(bundle.m_KeyPHNameForTrain);
+      m_InputPlaceholdersForTraining.push_back(placeholderForTraining);
+
       otbAppLogINFO("New source:");
       otbAppLogINFO("Field of view            : "<< patchSize);
       otbAppLogINFO("Placeholder (training)   : "<< placeholderForTraining);
@@ -296,12 +405,22 @@ public:
       if (GetParameterInt("validation.mode") != 0)
         {
         // Get the stack
-        if (!HasValue(bundle.m_KeyInForValid))
+        FloatVectorImageType::Pointer validSource;
+        if (m_ValidationDataset)
+          {
+          bundle.m_DatasetSourceForValidation = CreateDatasetSource(m_ValidationDataset.get(), k, patchSize);
+          validSource = bundle.m_DatasetSourceForValidation->GetOutput();
+          }
+        else
           {
-          otbAppLogFATAL("No validation input is set for this source");
+          if (!HasValue(bundle.m_KeyInForValid))
+            {
+            otbAppLogFATAL("No validation input is set for this source");
+            }
+          FloatVectorImageListType::Pointer validStack = GetParameterImageList(bundle.m_KeyInForValid);
+          bundle.tfSourceForValidation.Set(validStack);
+          validSource = bundle.tfSourceForValidation.Get();
           }
-        FloatVectorImageListType::Pointer validStack = GetParameterImageList(bundle.m_KeyInForValid);
-        bundle.tfSourceForValidation.Set(validStack);
 
         // We check if the placeholder is the same for training and for validation
         // If yes, it means that its not an output tensor on which perform the validation
@@ -314,8 +433,8 @@ public:
         if (placeholderForValidation.compare(placeholderForTraining) == 0)
           {
           // Source
-          m_InputSourcesForValidation.push_back(bundle.tfSourceForValidation.Get());
-          m_InputSourcesForTest.push_back(bundle.tfSource.Get());
+          m_InputSourcesForValidation.push_back(validSource);
+          m_InputSourcesForTest.push_back(trainSource);
 
           // Placeholder
           m_InputPlaceholdersForValidation.push_back(placeholderForValidation);
@@ -330,8 +449,8 @@ public:
         else
           {
           // Source
-          m_InputTargetsForValidation.push_back(bundle.tfSourceForValidation.Get());
-          m_InputTargetsForTest.push_back(bundle.tfSource.Get());
+          m_InputTargetsForValidation.push_back(validSource);
+          m_InputTargetsForTest.push_back(trainSource);
 
           // Placeholder
           m_TargetTensorsNames.push_back(placeholderForValidation);
@@ -347,6 +466,125 @@ public:
       }
   }
 
+  //
+  // Open a samples dataset
+  //
+  std::unique_ptr<DatasetType> OpenDataset(const std::string & fileName)
+  {
+    std::unique_ptr<DatasetType> dataset(new DatasetType());
+    dataset->Open(fileName);
+    if (dataset->GetNumberOfArrays() != m_Bundles.size())
+      {
+      otbAppLogFATAL("Dataset " << fileName << " has " << dataset->GetNumberOfArrays() <<
+          " arrays but there is " << m_Bundles.size() << " sources");
+      }
+    otbAppLogINFO("Dataset " << fileName << ": " << dataset->GetNumberOfSamples() << " samples");
+    return dataset;
+  }
+
+  //
+  // Create the source of the array #k of a samples dataset
+  //
+  DatasetSourceType::Pointer CreateDatasetSource(const DatasetType * dataset, unsigned int k,
+      const FloatVectorImageType::SizeType & patchSize)
+  {
+    if (dataset->GetPatchSize(k) != patchSize)
+      {
+      otbAppLogFATAL("Field of view of source #" << (k+1) << " is " << patchSize <<
+          " but patches of the dataset array are " << dataset->GetPatchSize(k));
+      }
+    DatasetSourceType::Pointer source = DatasetSourceType::New();
+    source->SetDataset(dataset);
+    source->SetArrayIndex(k);
+    source->UpdateOutputInformation();
+    return source;
+  }
+
+  //
+  // Put the patches of the dataset sources in a cache (the patches are read
+  // from the mapped file, without any copy)
+  //
+  void AddDatasetToCache(const DatasetType * dataset, PatchesCacheType * cache, bool validation)
+  {
+    for (unsigned int k = 0 ; k < m_Bundles.size() ; k++)
+      {
+      DatasetSourceType::Pointer source =
+          validation ? m_Bundles[k].m_DatasetSourceForValidation : m_Bundles[k].m_DatasetSource;
+      if (source.IsNotNull())
+        {
+        cache->AddExternal(source->GetOutput(), dataset->GetArray(k), dataset->GetNumberOfSamples());
+        }
+      }
+  }
+
+  //
+  // Setup the instrumentation of the filter
+  // (the training and the validation filters share the same profiler)
+  //
+  template<class TFilter>
+  void SetupProfiling(TFilter * filter)
+  {
+    if (GetParameterInt("profiling.enable") == 1 || HasValue("profiling.out"))
+      {
+      if (!m_Profiler)
+        {
+        m_Profiler.reset(new tf::Profiler());
+        }
+      filter->SetProfiler(m_Profiler.get());
+      }
+    if (HasValue("profiling.stepstats"))
+      {
+      if (!m_StepStatsFile.is_open())
+        {
+        m_StepStatsFile.open(GetParameterString("profiling.stepstats"));
+        }
+      if (!m_StepStatsFile.is_open())
+        {
+        otbAppLogFATAL("Unable to open the step stats file " << GetParameterString("profiling.stepstats"));
+        }
+      filter->SetRunMetadataCallback([this](const tensorflow::RunMetadata & metadata)
+        {
+        std::lock_guard<std::mutex> lock(m_StepStatsMutex);
+        m_StepStatsFile << metadata.step_stats().DebugString() << "---" << std::endl;
+        });
+      }
+  }
+
+  //
+  // Report the timings of the processing stages
+  //
+  void ReportProfiling()
+  {
+    if (m_Profiler)
+      {
+      std::stringstream report;
+      m_Profiler->Report(report);
+      otbAppLogINFO("Timings of the processing stages:\n" << report.str());
+      if (HasValue("profiling.out"))
+        {
+        otbAppLogINFO("Writing the profile in " << GetParameterString("profiling.out"));
+        m_Profiler->Write(GetParameterString("profiling.out"));
+        }
+      }
+    m_StepStatsFile.close();
+  }
+
+  //
+  // Get the configuration of the tensorflow sessions
+  //
+  tf::SessionConfig GetSessionConfig()
+  {
+    tf::SessionConfig config;
+    config.m_IntraOpThreads = GetParameterInt("model.intraop");
+    config.m_InterOpThreads = GetParameterInt("model.interop");
+    config.m_AllowGrowth    = (GetParameterInt("model.allowgrowth") == 1);
+    config.m_MemoryFraction = GetParameterFloat("model.memfraction");
+    config.m_XLA            = (GetParameterInt("model.xla") == 1);
+    config.m_OptimizerLevel = GetParameterInt("model.optlevel");
+    config.m_Trace          = (GetParameterInt("model.trace") == 1);
+    return config;
+  }
+
   //
   // Get user placeholders
   //
@@ -393,11 +631,77 @@ public:
     otbAppLogINFO("Confusion matrix:\n" << confMat);
   }
 
+  //
+  // Create the validation filter (classification metrics)
+  // The batches are prepared like the training batches, and evaluated by
+  // "validation.threads" threads
+  //
+  void SetupValidation()
+  {
+    m_ValidateModelFilter = ValidateModelFilterType::New();
+    m_ValidateModelFilter->SetGraph(m_SavedModel.meta_graph_def.graph_def());
+    m_ValidateModelFilter->SetSession(m_SavedModel.session.get());
+    m_ValidateModelFilter->SetOutputTensorsNames(m_TargetTensorsNames);
+    m_ValidateModelFilter->SetBatchSize(GetParameterInt("training.batchsize"));
+    m_ValidateModelFilter->SetUserPlaceholders(GetUserPlaceholders("validation.userplaceholders"));
+    m_ValidateModelFilter->SetPrefetchQueueDepth(GetParameterInt("training.prefetch"));
+    m_ValidateModelFilter->SetNumberOfLoaders(GetParameterInt("training.loaders"));
+    m_ValidateModelFilter->SetNumberOfEvaluators(GetParameterInt("validation.threads"));
+    m_ValidateModelFilter->SetNumberOfSubsetSamples(GetParameterInt("validation.subset"));
+    SetupProfiling(m_ValidateModelFilter.GetPointer());
+
+    for (unsigned int i = 0 ; i < m_InputSourcesForTest.size() ; i++)
+      {
+      m_ValidateModelFilter->PushBackInputBundle(m_InputPlaceholdersForValidation[i],
+          m_InputPatchesSizeForValidation[i], m_InputSourcesForTest[i]);
+      }
+  }
+
+  //
+  // Evaluate the model over the given sources and targets, and print the metrics
+  //
+  void EvaluateModel(const std::string & name, const std::vector<FloatVectorImageType::Pointer> & sources,
+      const std::vector<FloatVectorImageType::Pointer> & targets, PatchesCacheType * cache)
+  {
+    for (unsigned int i = 0 ; i < sources.size() ; i++)
+      {
+      m_ValidateModelFilter->SetInput(i, sources[i]);
+      }
+    m_ValidateModelFilter->ClearInputReferences();
+    for (unsigned int i = 0 ; i < m_TargetTensorsNames.size() ; i++)
+      {
+      m_ValidateModelFilter->PushBackInputReference(targets[i], m_TargetPatchesSize[i]);
+      }
+    m_ValidateModelFilter->SetPatchesCache(cache);
+
+    // Evaluate the model
+    AddProcess(m_ValidateModelFilter, "Evaluate model (" + name + ")");
+    m_ValidateModelFilter->Modified();
+    m_ValidateModelFilter->Update();
+
+    // Print some metrics
+    for (unsigned int i = 0 ; i < m_TargetTensorsNames.size() ; i++)
+      {
+      otbAppLogINFO("Metrics for target \"" << m_TargetTensorsNames[i] << "\" (" << name << "):");
+      PrintClassificationMetrics(m_ValidateModelFilter->GetConfusionMatrix(i), m_ValidateModelFilter->GetMapOfClasses(i));
+      }
+  }
+
+  //
+  // Evaluate the model over the training samples (test) and the validation samples
+  //
+  void EvaluateModel()
+  {
+    EvaluateModel("Test", m_InputSourcesForTest, m_InputTargetsForTest, m_PatchesCache.get());
+    EvaluateModel("Validation", m_InputSourcesForValidation, m_InputTargetsForValidation,
+        m_ValidationPatchesCache.get()); // validation patches are read once
+  }
+
   void DoExecute()
   {
 
     // Load the Tensorflow bundle
-    tf::LoadModel(GetParameterAsString("model.dir"), m_SavedModel);
+    tf::LoadModel(GetParameterAsString("model.dir"), m_SavedModel, GetSessionConfig());
 
     // Check if we have to restore variables from somewhere
     if (HasValue("model.restorefrom"))
@@ -411,6 +715,7 @@ public:
     PrepareInputs();
 
     // Setup filter
+    m_Profiler.reset();
     m_TrainModelFilter = TrainModelFilterType::New();
     m_TrainModelFilter->SetGraph(m_SavedModel.meta_graph_def.graph_def());
     m_TrainModelFilter->SetSession(m_SavedModel.session.get());
@@ -418,6 +723,43 @@ public:
     m_TrainModelFilter->SetTargetNodesNames(GetParameterStringList("training.targetnodesnames"));
     m_TrainModelFilter->SetBatchSize(GetParameterInt("training.batchsize"));
     m_TrainModelFilter->SetUserPlaceholders(GetUserPlaceholders("training.userplaceholders"));
+    m_TrainModelFilter->SetPrefetchQueueDepth(GetParameterInt("training.prefetch"));
+    m_TrainModelFilter->SetNumberOfLoaders(GetParameterInt("training.loaders"));
+    m_TrainModelFilter->SetShuffleChunkSize(GetParameterInt("training.shufflechunk"));
+    m_TrainModelFilter->SetShuffleBufferSize(GetParameterInt("training.shufflebuffer"));
+    m_TrainModelFilter->SetReadBlockHeight(GetParameterInt("training.readheight"));
+    SetupProfiling(m_TrainModelFilter.GetPointer());
+
+    // Patches cache
+    m_PatchesCache.reset();
+    if (GetParameterInt("training.cache")==1)
+      {
+      m_PatchesCache.reset(new PatchesCacheType());
+      if (HasValue("training.cachedir"))
+        {
+        m_PatchesCache->SetDirectory(GetParameterAsString("training.cachedir"));
+        otbAppLogINFO("Training patches are cached in " << m_PatchesCache->GetDirectory());
+        }
+      else
+        {
+        otbAppLogINFO("Training patches are cached in memory");
+        }
+      }
+    if (m_TrainingDataset)
+      {
+      if (!m_PatchesCache)
+        {
+        m_PatchesCache.reset(new PatchesCacheType());
+        }
+      AddDatasetToCache(m_TrainingDataset.get(), m_PatchesCache.get(), false);
+      }
+    m_ValidationPatchesCache.reset();
+    if (m_ValidationDataset)
+      {
+      m_ValidationPatchesCache.reset(new PatchesCacheType());
+      AddDatasetToCache(m_ValidationDataset.get(), m_ValidationPatchesCache.get(), true);
+      }
+    m_TrainModelFilter->SetPatchesCache(m_PatchesCache.get());
 
     // Set input bundles
     for (unsigned int i = 0 ; i < m_InputSourcesForTraining.size() ; i++)
@@ -426,11 +768,36 @@ public:
           m_InputPatchesSizeForTraining[i], m_InputSourcesForTraining[i]);
       }
 
+    // Setup the validation filter
+    m_ValidateModelFilter = nullptr;
+    if (GetParameterInt("validation.mode")==1) // class
+      {
+      otbAppLogINFO("Set validation mode to classification validation");
+      SetupValidation();
+      }
+    else if (GetParameterInt("validation.mode")==2) // rmse)
+      {
+      otbAppLogINFO("Set validation mode to classification RMSE evaluation");
+
+      // TODO
+
+      }
+
     // Train the model
-    for (int epoch = 0 ; epoch < GetParameterInt("training.epochs") ; epoch++)
+    // The model can be evaluated every "validation.step" epochs, and is
+    // evaluated after the training
+    const int nEpochs = GetParameterInt("training.epochs");
+    const int validationStep = GetParameterInt("validation.step");
+    for (int epoch = 0 ; epoch < nEpochs ; epoch++)
       {
       AddProcess(m_TrainModelFilter, "Training epoch #" + std::to_string(epoch));
       m_TrainModelFilter->Update();
+
+      if (m_ValidateModelFilter && validationStep > 0 && (epoch + 1) % validationStep == 0 && epoch + 1 < nEpochs)
+        {
+        otbAppLogINFO("Evaluating the model after epoch #" << epoch);
+        EvaluateModel();
+        }
       }
 
     // Check if we have to save variables to somewhere
@@ -441,71 +808,14 @@ public:
       tf::SaveModel(path, m_SavedModel);
       }
 
-    // Setup the validation filter
-    if (GetParameterInt("validation.mode")==1) // class
+    // Evaluate the trained model
+    if (m_ValidateModelFilter)
       {
-      otbAppLogINFO("Set validation mode to classification validation");
-
-      m_ValidateModelFilter = ValidateModelFilterType::New();
-      m_ValidateModelFilter->SetGraph(m_SavedModel.meta_graph_def.graph_def());
-      m_ValidateModelFilter->SetSession(m_SavedModel.session.get());
-      m_ValidateModelFilter->SetOutputTensorsNames(m_TargetTensorsNames);
-      m_ValidateModelFilter->SetBatchSize(GetParameterInt("training.batchsize"));
-      m_ValidateModelFilter->SetUserPlaceholders(GetUserPlaceholders("validation.userplaceholders"));
-
-      // Test
-      for (unsigned int i = 0 ; i < m_InputSourcesForTraining.size() ; i++)
-        {
-        m_TrainModelFilter->PushBackInputBundle(m_InputPlaceholdersForValidation[i],
-            m_InputPatchesSizeForValidation[i], m_InputSourcesForTest[i]);
-        }
-      for (unsigned int i = 0 ; i < m_TargetTensorsNames.size() ; i++)
-        {
-        m_ValidateModelFilter->PushBackInputReference(m_InputTargetsForTest[i], m_TargetPatchesSize[i]);
-        }
-
-      // Evaluate the model (test)
-      AddProcess(m_ValidateModelFilter, "Evaluate model (Test)");
-      m_ValidateModelFilter->Update();
-
-      // Print some metrics
-      for (unsigned int i = 0 ; i < m_TargetTensorsNames.size() ; i++)
-        {
-        otbAppLogINFO("Metrics for target \"" << m_TargetTensorsNames[i] << "\":");
-        PrintClassificationMetrics(m_ValidateModelFilter->GetConfusionMatrix(i), m_ValidateModelFilter->GetMapOfClasses(i));
-        }
-
-      // Validation
-      for (unsigned int i = 0 ; i < m_InputSourcesForTest.size() ; i++)
-        {
-        m_ValidateModelFilter->SetInput(i, m_InputSourcesForTest[i]);
-        }
-      m_ValidateModelFilter->ClearInputReferences();
-      for (unsigned int i = 0 ; i < m_TargetTensorsNames.size() ; i++)
-        {
-        m_ValidateModelFilter->PushBackInputReference(m_InputTargetsForValidation[i], m_TargetPatchesSize[i]);
-        }
-
-      // Evaluate the model (validation)
-      AddProcess(m_ValidateModelFilter, "Evaluate model (Validation)");
-      m_ValidateModelFilter->Update();
-
-      // Print some metrics
-      for (unsigned int i = 0 ; i < m_TargetTensorsNames.size() ; i++)
-        {
-        otbAppLogINFO("Metrics for target \"" << m_TargetTensorsNames[i] << "\":");
-        PrintClassificationMetrics(m_ValidateModelFilter->GetConfusionMatrix(i), m_ValidateModelFilter->GetMapOfClasses(i));
-        }
-
-
+      EvaluateModel();
       }
-    else if (GetParameterInt("validation.mode")==2) // rmse)
-      {
-      otbAppLogINFO("Set validation mode to classification RMSE evaluation");
 
-      // TODO
-
-      }
+    // Timings of the training and validation
+    ReportProfiling();
 
   }
 
@@ -514,6 +824,13 @@ private:
   TrainModelFilterType::Pointer    m_TrainModelFilter;
   ValidateModelFilterType::Pointer m_ValidateModelFilter;
   tensorflow::SavedModelBundle     m_SavedModel; // must be alive during all the execution of the application !
+  std::unique_ptr<PatchesCacheType> m_PatchesCache; // Training patches cache
+  std::unique_ptr<PatchesCacheType> m_ValidationPatchesCache; // Validation dataset patches
+  std::unique_ptr<DatasetType>      m_TrainingDataset;   // Training samples dataset
+  std::unique_ptr<DatasetType>      m_ValidationDataset; // Validation samples dataset
+  std::unique_ptr<tf::Profiler>     m_Profiler;          // Timings of the processing stages
+  std::ofstream                     m_StepStatsFile;     // Step stats of the session runs
+  std::mutex                        m_StepStatsMutex;
 
   BundleList m_Bundles;
   SizeList   m_InputPatchesSizeForTraining;
@@ -23,6 +23,10 @@
 // TF (used to get the environment variable for the number of inputs)
 #include "otbTensorflowCommon.h"
 
+// Mask of the training areas (fused mode)
+#include "otbVectorDataIntoImageProjectionFilter.h"
+#include "otbVectorDataToLabelImageFilter.h"
+
 namespace otb
 {
 
@@ -42,6 +46,12 @@ public:
   itkNewMacro(Self);
   itkTypeMacro(TrainClassifierFromDeepFeatures, otb::Wrapper::CompositeApplication);
 
+  /** Mask of the training areas */
+  typedef VectorData<>                                                        VectorDataType;
+  typedef otb::VectorDataIntoImageProjectionFilter<VectorDataType,
+      FloatVectorImageType>                                                   VectorDataReprojFilterType;
+  typedef otb::VectorDataToLabelImageFilter<VectorDataType, UInt8ImageType>   RasterizeFilterType;
+
 private:
 
   //
@@ -72,7 +82,10 @@ private:
 
   // Documentation
   SetDocName("TrainClassifierFromDeepFeatures");
-  SetDocLongDescription("See TrainImagesClassifier application");
+  SetDocLongDescription("See TrainImagesClassifier application. In fused mode, the deep "
+      "features are only computed over the tiles which intersect the training and validation "
+      "vector data, where the samples are extracted: the output.mask of the deep net is the "
+      "rasterized vector data.");
   SetDocLimitations("None");
   SetDocAuthors("Remi Cresson");
   SetDocSeeAlso(" ");
@@ -105,6 +118,10 @@ private:
   ShareParameter("classifier"    , "train.classifier"       , "Classifier" , "Classifier" );
   ShareParameter("rand"    , "train.rand"       , "User defined rand seed" , "User defined rand seed" );
 
+  // Fused mode
+  AddParameter(ParameterType_Bool, "fused", "Compute the deep features only over the training and validation vector data");
+  MandatoryOff                    ("fused");
+
   }
 
 
@@ -115,17 +132,84 @@ private:
 
   void DoExecute()
   {
+    if (GetParameterInt("fused") == 1)
+    {
+      SetupTrainingAreasMask();
+    }
+
     ExecuteInternal("tfmodel");
     GetInternalApplication("train")->AddImageToParameterInputImageList("io.il", GetInternalApplication("tfmodel")->GetParameterOutputImage("out"));
     UpdateInternalParameters("train");
     ExecuteInternal("train");
   }   // DOExecute()
 
+  //
+  // Rasterize the vector data over the grid of the deep features, and use it
+  // as the mask of the deep net: the samples are only extracted inside the
+  // geometries, hence the features are not computed elsewhere. The deep net
+  // application is executed once first, to get the grid of its output.
+  //
+  void SetupTrainingAreasMask()
+  {
+    // The mask set by a previous execution is replaced
+    if (HasValue("output.mask") &&
+        (m_RasterizeFilter.IsNull() || GetParameterImageBase("output.mask") != m_RasterizeFilter->GetOutput()))
+    {
+      otbAppLogFATAL("The output.mask of the deep net can not be used in fused mode");
+    }
+
+    ExecuteInternal("tfmodel");
+    FloatVectorImageType * features = dynamic_cast<FloatVectorImageType*>(
+        GetInternalApplication("tfmodel")->GetParameterOutputImage("out"));
+    if (features == nullptr)
+    {
+      otbAppLogFATAL("The output of the deep net application is not a float image");
+    }
+    features->UpdateOutputInformation();
+
+    otb::Wrapper::ElevationParametersHandler::SetupDEMHandlerFromElevationParameters(this, "elev");
+
+    m_RasterizeFilter = RasterizeFilterType::New();
+    m_ReprojectionFilters.clear();
+    std::vector<std::string> keys = {"vd"};
+    if (HasValue("valid"))
+    {
+      keys.push_back("valid");
+    }
+    for (auto const& key: keys)
+    {
+      VectorDataListType * vectorDataList = GetParameterVectorDataList(key);
+      for (unsigned int i = 0 ; i < vectorDataList->Size() ; i++)
+      {
+        VectorDataReprojFilterType::Pointer reprojection = VectorDataReprojFilterType::New();
+        reprojection->SetInputVectorData(vectorDataList->GetNthElement(i));
+        reprojection->SetInputImage(features);
+        reprojection->Update();
+        m_RasterizeFilter->AddVectorData(reprojection->GetOutput());
+        m_ReprojectionFilters.push_back(reprojection);
+      }
+    }
+    m_RasterizeFilter->SetOutputOrigin(features->GetOrigin());
+    m_RasterizeFilter->SetOutputSpacing(features->GetSignedSpacing());
+    m_RasterizeFilter->SetOutputSize(features->GetLargestPossibleRegion().GetSize());
+    m_RasterizeFilter->SetOutputProjectionRef(features->GetProjectionRef());
+    m_RasterizeFilter->SetBurnAttribute("________"); // No field: all the geometries are burnt with 1
+    m_RasterizeFilter->SetGlobalWarningDisplay(false);
+    m_RasterizeFilter->SetBackgroundValue(0);
+    m_RasterizeFilter->SetDefaultBurnValue(1);
+
+    GetInternalApplication("tfmodel")->SetParameterInputImage("output.mask", m_RasterizeFilter->GetOutput());
+    otbAppLogINFO("The deep features are computed over the vector data only");
+  }
+
   void AfterExecuteAndWriteOutputs()
   {
     // Nothing to do
   }
 
+  std::vector<VectorDataReprojFilterType::Pointer> m_ReprojectionFilters;
+  RasterizeFilterType::Pointer                     m_RasterizeFilter;
+
 };
 }
 }
@@ -0,0 +1,50 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWBATCHLOADER_H_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWBATCHLOADER_H_
+
+// Queue of the batches
+#include "otbTensorflowBoundedQueue.h"
+
+// STD
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace otb {
+namespace tf {
+
+/*
+ * Process batches with a prefetching loader.
+ * A set of loader threads fills the batches (fill(batchIndex, batch)) and
+ * pushes them in a bounded queue of depth queueDepth. A set of consumer
+ * threads pops the batches and processes them (process(batch, consumerIndex)).
+ * With one single consumer, the batches are processed by the calling thread.
+ * With multiple loaders, batches can be processed in a slightly different
+ * order than their number.
+ * The first error raised in any thread stops all the threads, and is
+ * rethrown in the calling thread.
+ */
+template<class TBatch>
+void ProcessPrefetchedBatches(std::uint64_t nBatches, unsigned int queueDepth, unsigned int nLoaders,
+    unsigned int nConsumers, std::function<void(std::uint64_t, TBatch &)> fill,
+    std::function<void(TBatch &, unsigned int)> process);
+
+} // end namespace tf
+} // end namespace otb
+
+#include "otbTensorflowBatchLoader.hxx"
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWBATCHLOADER_H_ */
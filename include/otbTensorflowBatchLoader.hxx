@@ -0,0 +1,104 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWBATCHLOADER_HXX_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWBATCHLOADER_HXX_
+
+#include "otbTensorflowBatchLoader.h"
+
+namespace otb {
+namespace tf {
+
+template<class TBatch>
+void ProcessPrefetchedBatches(std::uint64_t nBatches, unsigned int queueDepth, unsigned int nLoaders,
+    unsigned int nConsumers, std::function<void(std::uint64_t, TBatch &)> fill,
+    std::function<void(TBatch &, unsigned int)> process)
+{
+  tf::BoundedQueue<TBatch> batchesQueue(queueDepth);
+  std::atomic<std::uint64_t> nextBatch(0);
+  nLoaders = std::max(1u, static_cast<unsigned int>(std::min<std::uint64_t>(nLoaders, nBatches)));
+  nConsumers = std::max(1u, static_cast<unsigned int>(std::min<std::uint64_t>(nConsumers, nBatches)));
+  std::atomic<unsigned int> activeLoaders(nLoaders);
+
+  // The first error raised stops all the threads
+  std::exception_ptr error = nullptr;
+  std::mutex errorMutex;
+  auto abort = [&](std::exception_ptr e)
+    {
+    std::lock_guard<std::mutex> lock(errorMutex);
+    if (!error)
+      error = e;
+    batchesQueue.Close();
+    };
+
+  // Loaders
+  auto loader = [&]()
+    {
+    try
+      {
+      for (std::uint64_t batch = nextBatch++ ; batch < nBatches ; batch = nextBatch++)
+        {
+        TBatch newBatch;
+        fill(batch, newBatch);
+        if (!batchesQueue.Push(std::move(newBatch)))
+          break;
+        }
+      }
+    catch(...)
+      {
+      abort(std::current_exception());
+      }
+
+    // The last loader closes the queue
+    if (--activeLoaders == 0)
+      batchesQueue.Close();
+    };
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0 ; t < nLoaders ; t++)
+    {
+    threads.push_back(std::thread(loader));
+    }
+
+  // Consumers
+  auto consumer = [&](unsigned int consumerIndex)
+    {
+    try
+      {
+      TBatch batch;
+      while (batchesQueue.Pop(batch))
+        {
+        process(batch, consumerIndex);
+        }
+      }
+    catch(...)
+      {
+      abort(std::current_exception());
+      }
+    };
+  for (unsigned int t = 1 ; t < nConsumers ; t++)
+    {
+    threads.push_back(std::thread(consumer, t));
+    }
+  consumer(0);
+
+  for (auto & thread: threads)
+    {
+    thread.join();
+    }
+  if (error)
+    {
+    std::rethrow_exception(error);
+    }
+}
+
+} // end namespace tf
+} // end namespace otb
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWBATCHLOADER_HXX_ */
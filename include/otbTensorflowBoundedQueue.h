@@ -0,0 +1,65 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWBOUNDEDQUEUE_H_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWBOUNDEDQUEUE_H_
+
+// STD
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace otb {
+namespace tf {
+
+/*
+ * This is a simple thread-safe FIFO with a maximum number of elements.
+ * It is used to connect the stages (producers/consumers) of the
+ * asynchronous processing pipelines.
+ * Push() blocks while the queue is full, Pop() blocks while the queue is
+ * empty. Once Close() has been called, Push() returns false and Pop()
+ * returns false when no element is left.
+ */
+template<class T>
+class BoundedQueue
+{
+public:
+
+  BoundedQueue(std::size_t capacity);
+  virtual ~BoundedQueue (){};
+
+  // Push an element at the end of the queue (blocks while the queue is full)
+  bool Push(T && element);
+
+  // Pop the first element of the queue (blocks while the queue is empty)
+  bool Pop(T & element);
+
+  // Close the queue: wake up all the waiting producers and consumers
+  void Close();
+
+private:
+  BoundedQueue(const BoundedQueue&); //purposely not implemented
+  void operator=(const BoundedQueue&); //purposely not implemented
+
+  std::size_t             m_Capacity;  // Maximum number of elements
+  bool                    m_Closed;    // True when no more element can be pushed
+  std::deque<T>           m_Elements;  // Elements
+  std::mutex              m_Mutex;
+  std::condition_variable m_NotEmpty;
+  std::condition_variable m_NotFull;
+
+};
+
+} // end namespace tf
+} // end namespace otb
+
+#include "otbTensorflowBoundedQueue.hxx"
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWBOUNDEDQUEUE_H_ */
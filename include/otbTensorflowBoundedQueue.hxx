@@ -0,0 +1,81 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWBOUNDEDQUEUE_HXX_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWBOUNDEDQUEUE_HXX_
+
+#include "otbTensorflowBoundedQueue.h"
+
+namespace otb {
+namespace tf {
+
+template<class T>
+BoundedQueue<T>::BoundedQueue(std::size_t capacity)
+{
+  m_Capacity = (capacity > 0 ? capacity : 1);
+  m_Closed = false;
+}
+
+//
+// Push an element at the end of the queue
+// Returns false if the queue has been closed
+//
+template<class T>
+bool
+BoundedQueue<T>::Push(T && element)
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_NotFull.wait(lock, [this]{ return m_Closed || m_Elements.size() < m_Capacity; });
+  if (m_Closed)
+  {
+    return false;
+  }
+  m_Elements.push_back(std::move(element));
+  m_NotEmpty.notify_one();
+  return true;
+}
+
+//
+// Pop the first element of the queue
+// Returns false if the queue is closed and empty
+//
+template<class T>
+bool
+BoundedQueue<T>::Pop(T & element)
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_NotEmpty.wait(lock, [this]{ return m_Closed || !m_Elements.empty(); });
+  if (m_Elements.empty())
+  {
+    return false;
+  }
+  element = std::move(m_Elements.front());
+  m_Elements.pop_front();
+  m_NotFull.notify_one();
+  return true;
+}
+
+//
+// Close the queue
+//
+template<class T>
+void
+BoundedQueue<T>::Close()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Closed = true;
+  m_NotEmpty.notify_all();
+  m_NotFull.notify_all();
+}
+
+} // end namespace tf
+} // end namespace otb
+
+#endif
@@ -67,15 +67,115 @@ void PopulateTensorFromBufferedVectorImage(const typename TImage::Pointer buffer
       out_tensor.flat<typename TImage::InternalPixelType>().data());
 }
 
+//
+// Copy (and convert) a contiguous run of values
+// The loop is kept trivial so that the compiler can vectorize the conversion.
+// When no conversion is needed, a plain memcpy is used.
+//
+template<class TInputValueType, class TOutputValueType>
+void ConvertValues(const TInputValueType * in, TOutputValueType * out, std::size_t n)
+{
+  if (std::is_same<TInputValueType, TOutputValueType>::value)
+  {
+    std::memcpy(out, in, n * sizeof(TOutputValueType));
+  }
+  else
+  {
+    for (std::size_t i = 0 ; i < n ; i++)
+      out[i] = static_cast<TOutputValueType>(in[i]);
+  }
+}
+
+//
+// Quantize one value
+//
+template<class TOutputValueType, class TInputValueType>
+TOutputValueType QuantizeValue(const TInputValueType & in, const QuantizationType & quantization)
+{
+  double value = static_cast<double>(in) * quantization.m_Scale + quantization.m_Shift;
+  if (std::isnan(value))
+    return static_cast<TOutputValueType>(std::numeric_limits<TOutputValueType>::is_integer ? 0 : value);
+  if (quantization.m_Round)
+    value = std::floor(value + 0.5);
+  value = std::min(std::max(value, quantization.m_Minimum), quantization.m_Maximum);
+  return static_cast<TOutputValueType>(value);
+}
+
+//
+// Copy (and quantize) a contiguous run of values
+//
+template<class TInputValueType, class TOutputValueType>
+void ConvertValues(const TInputValueType * in, TOutputValueType * out, std::size_t n, const QuantizationType & quantization)
+{
+  if (quantization.IsIdentity())
+  {
+    ConvertValues(in, out, n);
+  }
+  else
+  {
+    for (std::size_t i = 0 ; i < n ; i++)
+      out[i] = QuantizeValue<TOutputValueType>(in[i], quantization);
+  }
+}
+
+//
+// Functor for DispatchDataType (copy of contiguous values into a tensor,
+// starting at its value #offset)
+//
+struct ConvertValuesToTensorFunctor
+{
+  template<class TValueType, class TInputValueType>
+  static void Run(const TInputValueType * in, tensorflow::Tensor & tensor, std::size_t offset, std::size_t n)
+  {
+    ConvertValues(in, tensor.flat<TValueType>().data() + offset, n);
+  }
+};
+
 //
 // Recopy an VectorImage region into a 4D-shaped tensorflow::Tensor ({-1, sz_y, sz_x, sz_bands})
 //
+// When the region lies in the buffered region of the image and the tensor
+// shape matches the region, the pixels rows are copied directly from the
+// image buffer (pixels of a VectorImage are interleaved, like the tensor
+// values). Else, we fall back on the image iterator.
+//
 template<class TImage, class TValueType=typename TImage::InternalPixelType>
 void RecopyImageRegionToTensor(const typename TImage::Pointer inputPtr, const typename TImage::RegionType & region,
     tensorflow::Tensor & tensor, unsigned int elemIdx) // element position along the 1st dimension
 {
+  const unsigned int nBands = inputPtr->GetNumberOfComponentsPerPixel();
+  const typename TImage::RegionType bufferedRegion = inputPtr->GetBufferedRegion();
+  const tensorflow::TensorShape shape = tensor.shape();
+  if (bufferedRegion.IsInside(region) &&
+      shape.dims() == 4 &&
+      shape.dim_size(0) > elemIdx &&
+      shape.dim_size(1) == region.GetSize(1) &&
+      shape.dim_size(2) == region.GetSize(0) &&
+      shape.dim_size(3) == nBands)
+  {
+    // Rows lengths (in number of values)
+    const std::size_t rowLength = region.GetSize(0) * nBands;
+    const std::size_t bufferedRowLength = bufferedRegion.GetSize(0) * nBands;
+
+    // Start of the region in the image buffer
+    const typename TImage::InternalPixelType * inPtr = inputPtr->GetBufferPointer() +
+        ((region.GetIndex(1) - bufferedRegion.GetIndex(1)) * bufferedRegion.GetSize(0) +
+         (region.GetIndex(0) - bufferedRegion.GetIndex(0))) * nBands;
+
+    // Start of the element in the tensor
+    TValueType * outPtr = tensor.flat<TValueType>().data() + elemIdx * rowLength * region.GetSize(1);
+
+    // Copy rows
+    for (unsigned int y = 0 ; y < region.GetSize(1) ; y++)
+    {
+      ConvertValues(inPtr, outPtr, rowLength);
+      inPtr += bufferedRowLength;
+      outPtr += rowLength;
+    }
+    return;
+  }
+
   typename itk::ImageRegionConstIterator<TImage> inIt(inputPtr, region);
-  unsigned int nBands = inputPtr->GetNumberOfComponentsPerPixel();
   auto tMap = tensor.tensor<TValueType, 4>();
   for (inIt.GoToBegin(); !inIt.IsAtEnd(); ++inIt)
   {
@@ -83,29 +183,143 @@ void RecopyImageRegionToTensor(const typename TImage::Pointer inputPtr, const ty
     const int x = inIt.GetIndex()[0] - region.GetIndex()[0];
 
     for (unsigned int band = 0 ; band < nBands ; band++)
-      tMap(elemIdx, y, x, band) = inIt.Get()[band];
+      tMap(elemIdx, y, x, band) = static_cast<TValueType>(inIt.Get()[band]);
   }
 }
 
+//
+// Functor for DispatchDataType (recopy of an image region into a tensor)
+//
+template<class TImage>
+struct RecopyImageRegionToTensorFunctor
+{
+  template<class TValueType>
+  static void Run(const typename TImage::Pointer & inputPtr, const typename TImage::RegionType & region,
+      tensorflow::Tensor & tensor, unsigned int elemIdx)
+  {
+    RecopyImageRegionToTensor<TImage, TValueType>(inputPtr, region, tensor, elemIdx);
+  }
+};
+
 //
 // Type-agnostic version of the 'RecopyImageRegionToTensor' function
-// TODO: add some numeric types
 //
 template<class TImage>
 void RecopyImageRegionToTensorWithCast(const typename TImage::Pointer inputPtr, const typename TImage::RegionType & region,
     tensorflow::Tensor & tensor, unsigned int elemIdx) // element position along the 1st dimension
 {
-  tensorflow::DataType dt = tensor.dtype();
-  if (dt == tensorflow::DT_FLOAT)
-    RecopyImageRegionToTensor<TImage, float>        (inputPtr, region, tensor, elemIdx);
-  else if (dt == tensorflow::DT_DOUBLE)
-    RecopyImageRegionToTensor<TImage, double>       (inputPtr, region, tensor, elemIdx);
-  else if (dt == tensorflow::DT_INT64)
-    RecopyImageRegionToTensor<TImage, long long int>(inputPtr, region, tensor, elemIdx);
-  else if (dt == tensorflow::DT_INT32)
-    RecopyImageRegionToTensor<TImage, int>          (inputPtr, region, tensor, elemIdx);
-  else
-    itkGenericExceptionMacro("TF DataType "<< dt << " not currently implemented !");
+  DispatchDataType<RecopyImageRegionToTensorFunctor<TImage>>(tensor.dtype(), inputPtr, region, tensor, elemIdx);
+}
+
+//
+// Recopy the part subRegion of the region into the element #elemIdx of the
+// tensor, which holds the whole region ({-1, sz_y, sz_x, sz_bands}).
+// The sub region must lie in the region, and in the buffered region of the
+// image. This enables to fill a tensor from multiple images (e.g. parts of
+// the region kept in a cache).
+//
+template<class TImage, class TValueType>
+void RecopyImageSubRegionToTensor(const typename TImage::Pointer inputPtr, const typename TImage::RegionType & region,
+    const typename TImage::RegionType & subRegion, tensorflow::Tensor & tensor, unsigned int elemIdx)
+{
+  const unsigned int nBands = inputPtr->GetNumberOfComponentsPerPixel();
+  const typename TImage::RegionType bufferedRegion = inputPtr->GetBufferedRegion();
+  if (!bufferedRegion.IsInside(subRegion) || !region.IsInside(subRegion))
+  {
+    itkGenericExceptionMacro("Region " << subRegion << " must be inside the buffered region " << bufferedRegion
+                             << " and inside the region " << region);
+  }
+
+  // Rows lengths (in number of values)
+  const std::size_t rowLength = subRegion.GetSize(0) * nBands;
+  const std::size_t bufferedRowLength = bufferedRegion.GetSize(0) * nBands;
+  const std::size_t tensorRowLength = region.GetSize(0) * nBands;
+
+  // Start of the sub region in the image buffer
+  const typename TImage::InternalPixelType * inPtr = inputPtr->GetBufferPointer() +
+      ((subRegion.GetIndex(1) - bufferedRegion.GetIndex(1)) * bufferedRegion.GetSize(0) +
+       (subRegion.GetIndex(0) - bufferedRegion.GetIndex(0))) * nBands;
+
+  // Start of the sub region in the element of the tensor
+  TValueType * outPtr = tensor.flat<TValueType>().data() + elemIdx * tensorRowLength * region.GetSize(1) +
+      ((subRegion.GetIndex(1) - region.GetIndex(1)) * region.GetSize(0) +
+       (subRegion.GetIndex(0) - region.GetIndex(0))) * nBands;
+
+  // Copy rows
+  for (unsigned int y = 0 ; y < subRegion.GetSize(1) ; y++)
+  {
+    ConvertValues(inPtr, outPtr, rowLength);
+    inPtr += bufferedRowLength;
+    outPtr += tensorRowLength;
+  }
+}
+
+//
+// Functor for DispatchDataType (recopy of a part of an image region into a tensor)
+//
+template<class TImage>
+struct RecopyImageSubRegionToTensorFunctor
+{
+  template<class TValueType>
+  static void Run(const typename TImage::Pointer & inputPtr, const typename TImage::RegionType & region,
+      const typename TImage::RegionType & subRegion, tensorflow::Tensor & tensor, unsigned int elemIdx)
+  {
+    RecopyImageSubRegionToTensor<TImage, TValueType>(inputPtr, region, subRegion, tensor, elemIdx);
+  }
+};
+
+//
+// Type-agnostic version of the 'RecopyImageSubRegionToTensor' function
+//
+template<class TImage>
+void RecopyImageSubRegionToTensorWithCast(const typename TImage::Pointer inputPtr, const typename TImage::RegionType & region,
+    const typename TImage::RegionType & subRegion, tensorflow::Tensor & tensor, unsigned int elemIdx)
+{
+  DispatchDataType<RecopyImageSubRegionToTensorFunctor<TImage>>(tensor.dtype(), inputPtr, region, subRegion, tensor, elemIdx);
+}
+
+//
+// Create a 4D-shaped tensor ({1, sz_y, sz_x, sz_bands}) which uses the
+// image buffer as storage.
+// This is possible only when:
+// -the tensor datatype is the image internal pixel type,
+// -the region is inside the buffered region, and its pixels are contiguous
+//  in the buffer (i.e. it spans the whole buffered region width, or one row),
+// -the start of the region is aligned as tensorflow expects.
+// Returns false if the tensor can't be created, in that case the image
+// region must be recopied in a new tensor.
+//
+template<class TImage>
+bool WrapImageRegionIntoTensor(const typename TImage::Pointer inputPtr, const typename TImage::RegionType & region,
+    const tensorflow::DataType & dt, tensorflow::Tensor & tensor)
+{
+  typedef typename TImage::InternalPixelType ValueType;
+
+  if (dt != GetTensorflowDataType<ValueType>())
+    return false;
+
+  const typename TImage::RegionType bufferedRegion = inputPtr->GetBufferedRegion();
+  if (!bufferedRegion.IsInside(region))
+    return false;
+  if (region.GetSize(0) != bufferedRegion.GetSize(0) && region.GetSize(1) != 1)
+    return false;
+
+  const tensorflow::int64 nBands = inputPtr->GetNumberOfComponentsPerPixel();
+  ValueType * data = inputPtr->GetBufferPointer() +
+      ((region.GetIndex(1) - bufferedRegion.GetIndex(1)) * bufferedRegion.GetSize(0) +
+       (region.GetIndex(0) - bufferedRegion.GetIndex(0))) * nBands;
+  if (reinterpret_cast<std::uintptr_t>(data) % EIGEN_MAX_ALIGN_BYTES != 0)
+    return false;
+
+  const tensorflow::TensorShape shape({1, region.GetSize(1), region.GetSize(0), nBands});
+  const std::size_t size = shape.num_elements() * sizeof(ValueType);
+  ImageTensorBuffer<TImage> * buffer = new ImageTensorBuffer<TImage>(inputPtr, data, size);
+  tensor = tensorflow::Tensor(dt, shape, buffer);
+
+  // The tensor holds its own reference on the buffer
+  buffer->Unref();
+
+  return true;
 }
 
 //
@@ -136,6 +350,76 @@ void SampleCenteredPatch(const typename TImage::Pointer inputPtr, const typename
   SampleCenteredPatch<TImage>(inputPtr, centerIndex, patchSize, tensor, elemIdx);
 }
 
+//
+// Functor for DispatchDataType (patches of the blocks of regions)
+//
+template<class TImage, class TReferenceImage>
+struct SampleBlocksPatchesFunctor
+{
+  template<class TValueType>
+  static void Run(const typename TImage::Pointer & inputPtr, const TReferenceImage * referencePtr,
+      const std::vector<typename TReferenceImage::RegionType> & regions, const typename TImage::SizeType & patchSize,
+      const typename TReferenceImage::SizeType & blockSize, const typename TImage::OffsetType & patchOffset,
+      tensorflow::Tensor & tensor)
+  {
+    unsigned int elemIdx = 0;
+    for (auto const& region: regions)
+    {
+      const typename TReferenceImage::IndexType start = region.GetIndex();
+      const typename TReferenceImage::IndexType end = region.GetUpperIndex();
+      typename TReferenceImage::IndexType blockIndex;
+      for (blockIndex[1] = start[1] ; blockIndex[1] <= end[1] ; blockIndex[1] += blockSize[1])
+      {
+        for (blockIndex[0] = start[0] ; blockIndex[0] <= end[0] ; blockIndex[0] += blockSize[0])
+        {
+          // First pixel of the block, in the input image
+          typename TReferenceImage::PointType point;
+          referencePtr->TransformIndexToPhysicalPoint(blockIndex, point);
+          typename TImage::IndexType firstIndex;
+          inputPtr->TransformPhysicalPointToIndex(point, firstIndex);
+
+          typename TImage::RegionType patchRegion(firstIndex + patchOffset, patchSize);
+          RecopyImageRegionToTensor<TImage, TValueType>(inputPtr, patchRegion, tensor, elemIdx);
+          elemIdx++;
+        }
+      }
+    }
+  }
+};
+
+//
+// Sample one patch for each block of the regions of the reference image.
+// The blocks tile the regions in raster order, and the patch of a block
+// starts at patchOffset from the input pixel of the first pixel of the block.
+// The datatype of the tensor is resolved once for all the patches.
+//
+template<class TImage, class TReferenceImage>
+void SampleBlocksPatches(const typename TImage::Pointer inputPtr, const TReferenceImage * referencePtr,
+    const std::vector<typename TReferenceImage::RegionType> & regions, const typename TImage::SizeType & patchSize,
+    const typename TReferenceImage::SizeType & blockSize, const typename TImage::OffsetType & patchOffset,
+    tensorflow::Tensor & tensor)
+{
+  DispatchDataType<SampleBlocksPatchesFunctor<TImage, TReferenceImage>>(tensor.dtype(), inputPtr, referencePtr,
+      regions, patchSize, blockSize, patchOffset, tensor);
+}
+
+//
+// Sample the patches centered on the pixels of the regions of the reference
+// image (i.e. blocks of one pixel).
+//
+template<class TImage, class TReferenceImage>
+void SampleCenteredPatches(const typename TImage::Pointer inputPtr, const TReferenceImage * referencePtr,
+    const std::vector<typename TReferenceImage::RegionType> & regions, const typename TImage::SizeType & patchSize,
+    tensorflow::Tensor & tensor)
+{
+  typename TReferenceImage::SizeType blockSize;
+  blockSize.Fill(1);
+  typename TImage::OffsetType patchOffset;
+  patchOffset[0] = - static_cast<typename TImage::OffsetValueType>(patchSize[0] / 2);
+  patchOffset[1] = - static_cast<typename TImage::OffsetValueType>(patchSize[1] / 2);
+  SampleBlocksPatches<TImage, TReferenceImage>(inputPtr, referencePtr, regions, patchSize, blockSize, patchOffset, tensor);
+}
+
 // Return the number of channels that the output tensor will occupy in the output image
 //
 // shape {n}          --> 1 (e.g. a label)
@@ -152,6 +436,26 @@ tensorflow::int64 GetNumberOfChannelsForOutputTensor(const tensorflow::Tensor &
   return shape.dim_size(nDims - 1);
 }
 
+//
+// Check that the number of elements in the tensor fits the given number of pixels
+//
+void CheckTensorNumberOfElements(const tensorflow::Tensor & tensor, tensorflow::int64 nPixels, const std::string & description)
+{
+  const tensorflow::int64 nElmT = tensor.NumElements();
+  const tensorflow::int64 nElmI = nPixels * GetNumberOfChannelsForOutputTensor(tensor);
+  if (nElmI != nElmT)
+  {
+    itkGenericExceptionMacro("Number of elements in the tensor is " << nElmT <<
+        " but image outputRegion has " << nElmI <<
+        " values to fill.\n" << description <<
+        "Tensor shape:\n " << PrintTensorShape(tensor.shape()) <<
+        "\nPlease check the input(s) field of view (FOV), " <<
+        "the output field of expression (FOE), and the  " <<
+        "output spacing scale if you run the model in fully " <<
+        "convolutional mode (how many strides in your model?)");
+  }
+}
+
 //
 // Copy a tensor into the image region
 // TODO: Enable to change mapping from source tensor to image to make it more generic
@@ -161,9 +465,14 @@ tensorflow::int64 GetNumberOfChannelsForOutputTensor(const tensorflow::Tensor &
 // shape {n, c}       --> c (e.g. a vector)
 // shape {x, y, c}    --> c (e.g. a multichannel image)
 //
+// The buffer region starts at the bufferOffset-th pixel of the tensor. This
+// is used to scatter a batch tensor (i.e. computed from multiple regions
+// stacked along the first dimension) into the image.
+//
 template<class TImage, class TValueType>
 void CopyTensorToImageRegion(const tensorflow::Tensor & tensor, const typename TImage::RegionType & bufferRegion,
-                             typename TImage::Pointer outputPtr, const typename TImage::RegionType & outputRegion, int & channelOffset)
+                             typename TImage::Pointer outputPtr, const typename TImage::RegionType & outputRegion, int & channelOffset,
+                             tensorflow::int64 bufferOffset, const QuantizationType & quantization)
 {
 
   // Flatten the tensor
@@ -175,19 +484,53 @@ void CopyTensorToImageRegion(const tensorflow::Tensor & tensor, const typename T
   // Number of columns (size x of the buffer)
   const tensorflow::int64 nCols = bufferRegion.GetSize(0);
 
-  // Check the tensor size vs the outputRegion size
+  // Check that the tensor contains the buffer region
   const tensorflow::int64 nElmT = tensor.NumElements();
-  const tensorflow::int64 nElmI = bufferRegion.GetNumberOfPixels() * outputDimSize_C;
-  if (nElmI != nElmT)
+  const tensorflow::int64 nElmI = (bufferOffset + bufferRegion.GetNumberOfPixels()) * outputDimSize_C;
+  if (nElmI > nElmT)
   {
     itkGenericExceptionMacro("Number of elements in the tensor is " << nElmT <<
-        " but image outputRegion has " << nElmI <<
-        " values to fill.\nBuffer region:\n" << bufferRegion <<
-        "Tensor shape:\n " << PrintTensorShape(tensor.shape()) <<
-        "\nPlease check the input(s) field of view (FOV), " <<
-        "the output field of expression (FOE), and the  " <<
-        "output spacing scale if you run the model in fully " <<
-        "convolutional mode (how many strides in your model?)");
+        " but at least " << nElmI << " values are needed to fill the " <<
+        "buffer region:\n" << bufferRegion << "starting at pixel " << bufferOffset <<
+        " of the tensor of shape " << PrintTensorShape(tensor.shape()));
+  }
+
+  // Offset of the buffer region in the tensor
+  const tensorflow::int64 startPos = bufferOffset * outputDimSize_C;
+
+  // When the output region lies in the buffered region of the image, the
+  // values are copied row by row directly into the image buffer
+  const typename TImage::RegionType outputBufferedRegion = outputPtr->GetBufferedRegion();
+  if (outputBufferedRegion.IsInside(outputRegion) && bufferRegion.IsInside(outputRegion))
+  {
+    const tensorflow::int64 nComponents = outputPtr->GetNumberOfComponentsPerPixel();
+    const tensorflow::int64 outputBufferedRowLength = outputBufferedRegion.GetSize(0) * nComponents;
+    const tensorflow::int64 width = outputRegion.GetSize(0);
+    const TValueType * tensorPtr = tFlat.data() + startPos;
+    typename TImage::InternalPixelType * outPtr = outputPtr->GetBufferPointer() +
+        ((outputRegion.GetIndex(1) - outputBufferedRegion.GetIndex(1)) * outputBufferedRegion.GetSize(0) +
+         (outputRegion.GetIndex(0) - outputBufferedRegion.GetIndex(0))) * nComponents + channelOffset;
+    const tensorflow::int64 x0 = outputRegion.GetIndex(0) - bufferRegion.GetIndex(0);
+    const tensorflow::int64 y0 = outputRegion.GetIndex(1) - bufferRegion.GetIndex(1);
+    for (tensorflow::int64 y = y0 ; y < y0 + (tensorflow::int64) outputRegion.GetSize(1) ; y++)
+    {
+      const TValueType * inPtr = tensorPtr + outputDimSize_C * (y * nCols + x0);
+      if (outputDimSize_C == nComponents)
+      {
+        // The tensor fills all the channels: the whole row is contiguous
+        ConvertValues(inPtr, outPtr, width * nComponents, quantization);
+      }
+      else
+      {
+        for (tensorflow::int64 x = 0 ; x < width ; x++)
+          ConvertValues(inPtr + x * outputDimSize_C, outPtr + x * nComponents, outputDimSize_C, quantization);
+      }
+      outPtr += outputBufferedRowLength;
+    }
+
+    // Update the offset
+    channelOffset += outputDimSize_C;
+    return;
   }
 
   // Iterate over the image
@@ -199,9 +542,9 @@ void CopyTensorToImageRegion(const tensorflow::Tensor & tensor, const typename T
 
     // TODO: it could be useful to change the tensor-->image mapping here.
     // e.g use a lambda for "pos" calculation
-    const int pos = outputDimSize_C * (y * nCols + x);
+    const int pos = startPos + outputDimSize_C * (y * nCols + x);
     for (unsigned int c = 0 ; c < outputDimSize_C ; c++)
-      outIt.Get()[channelOffset + c] = tFlat( pos + c);
+      outIt.Get()[channelOffset + c] = QuantizeValue<typename TImage::InternalPixelType>(tFlat( pos + c), quantization);
   }
 
   // Update the offset
@@ -211,24 +554,218 @@ void CopyTensorToImageRegion(const tensorflow::Tensor & tensor, const typename T
 
 //
 // Type-agnostic version of the 'CopyTensorToImageRegion' function
-// TODO: add some numeric types
+// The tensor must contains exactly the buffer region
 //
 template<class TImage>
 void CopyTensorToImageRegion(const tensorflow::Tensor & tensor, const typename TImage::RegionType & bufferRegion,
                              typename TImage::Pointer outputPtr, const typename TImage::RegionType & region, int & channelOffset)
 {
-  tensorflow::DataType dt = tensor.dtype();
-  if (dt == tensorflow::DT_FLOAT)
-    CopyTensorToImageRegion<TImage, float>        (tensor, bufferRegion, outputPtr, region, channelOffset);
-  else if (dt == tensorflow::DT_DOUBLE)
-    CopyTensorToImageRegion<TImage, double>       (tensor, bufferRegion, outputPtr, region, channelOffset);
-  else if (dt == tensorflow::DT_INT64)
-    CopyTensorToImageRegion<TImage, long long int>(tensor, bufferRegion, outputPtr, region, channelOffset);
-  else if (dt == tensorflow::DT_INT32)
-    CopyTensorToImageRegion<TImage, int>          (tensor, bufferRegion, outputPtr, region, channelOffset);
-  else
-    itkGenericExceptionMacro("TF DataType "<< dt << " not currently implemented !");
+  std::stringstream description;
+  description << "Buffer region:\n" << bufferRegion;
+  CheckTensorNumberOfElements(tensor, bufferRegion.GetNumberOfPixels(), description.str());
+
+  CopyTensorToImageRegion<TImage>(tensor, bufferRegion, outputPtr, region, channelOffset, 0);
+}
+
+//
+// Functor for DispatchDataType (copy of a tensor into an image region)
+//
+template<class TImage>
+struct CopyTensorToImageRegionFunctor
+{
+  template<class TValueType>
+  static void Run(const tensorflow::Tensor & tensor, const typename TImage::RegionType & bufferRegion,
+      typename TImage::Pointer & outputPtr, const typename TImage::RegionType & region, int & channelOffset,
+      tensorflow::int64 bufferOffset, const QuantizationType & quantization)
+  {
+    CopyTensorToImageRegion<TImage, TValueType>(tensor, bufferRegion, outputPtr, region, channelOffset, bufferOffset,
+        quantization);
+  }
+};
+
+//
+// Type-agnostic version of the 'CopyTensorToImageRegion' function (batch version)
+//
+template<class TImage>
+void CopyTensorToImageRegion(const tensorflow::Tensor & tensor, const typename TImage::RegionType & bufferRegion,
+                             typename TImage::Pointer outputPtr, const typename TImage::RegionType & region, int & channelOffset,
+                             tensorflow::int64 bufferOffset, const QuantizationType & quantization)
+{
+  DispatchDataType<CopyTensorToImageRegionFunctor<TImage>>(tensor.dtype(), tensor, bufferRegion, outputPtr, region,
+      channelOffset, bufferOffset, quantization);
+}
+
+//
+// Copy a tensor of blocks into the image region.
+// The tensor has the shape {n, block_y, block_x, c}: each element is one
+// block of the buffer region, the blocks tiling the buffer region in raster
+// order. The buffer region starts at the bufferOffset-th block of the tensor.
+//
+template<class TImage, class TValueType>
+void CopyBlocksTensorToImageRegion(const tensorflow::Tensor & tensor, const typename TImage::RegionType & bufferRegion,
+                                   const typename TImage::SizeType & blockSize, typename TImage::Pointer outputPtr,
+                                   const typename TImage::RegionType & outputRegion, int & channelOffset,
+                                   tensorflow::int64 bufferOffset, const QuantizationType & quantization)
+{
+  // Check the shape of the tensor
+  const tensorflow::TensorShape shape = tensor.shape();
+  if (shape.dims() != 4 || shape.dim_size(1) != (tensorflow::int64) blockSize[1] ||
+      shape.dim_size(2) != (tensorflow::int64) blockSize[0])
+  {
+    itkGenericExceptionMacro("The output tensor must have the shape {n, " << blockSize[1] << ", " << blockSize[0] <<
+        ", c} (i.e. one output block of " << blockSize << " for each patch), but its shape is " << PrintTensorShape(shape));
+  }
+  if (bufferRegion.GetSize(0) % blockSize[0] != 0 || bufferRegion.GetSize(1) % blockSize[1] != 0)
+  {
+    itkGenericExceptionMacro("The buffer region:\n" << bufferRegion << "is not a multiple of the block size " << blockSize);
+  }
+
+  // Flatten the tensor
+  auto tFlat = tensor.flat<TValueType>();
+
+  // Number of values of one pixel and of one block
+  const tensorflow::int64 outputDimSize_C = GetNumberOfChannelsForOutputTensor(tensor);
+  const tensorflow::int64 blockLength = blockSize[0] * blockSize[1] * outputDimSize_C;
+
+  // Number of blocks in one row of the buffer
+  const tensorflow::int64 nBlockCols = bufferRegion.GetSize(0) / blockSize[0];
+
+  // Check that the tensor contains the buffer region
+  const tensorflow::int64 nElmT = tensor.NumElements();
+  const tensorflow::int64 nElmI = bufferOffset * blockLength + bufferRegion.GetNumberOfPixels() * outputDimSize_C;
+  if (nElmI > nElmT)
+  {
+    itkGenericExceptionMacro("Number of elements in the tensor is " << nElmT <<
+        " but at least " << nElmI << " values are needed to fill the " <<
+        "buffer region:\n" << bufferRegion << "starting at block " << bufferOffset <<
+        " of the tensor of shape " << PrintTensorShape(tensor.shape()));
+  }
+
+  // Position of the values of one pixel of the buffer region in the tensor
+  auto pos = [&](tensorflow::int64 x, tensorflow::int64 y)
+    {
+    const tensorflow::int64 block = bufferOffset + (y / blockSize[1]) * nBlockCols + x / blockSize[0];
+    return block * blockLength + ((y % blockSize[1]) * blockSize[0] + x % blockSize[0]) * outputDimSize_C;
+    };
+
+  // When the output region lies in the buffered region of the image, the
+  // values are copied directly into the image buffer
+  const typename TImage::RegionType outputBufferedRegion = outputPtr->GetBufferedRegion();
+  if (outputBufferedRegion.IsInside(outputRegion) && bufferRegion.IsInside(outputRegion))
+  {
+    const tensorflow::int64 nComponents = outputPtr->GetNumberOfComponentsPerPixel();
+    const tensorflow::int64 outputBufferedRowLength = outputBufferedRegion.GetSize(0) * nComponents;
+    const tensorflow::int64 width = outputRegion.GetSize(0);
+    typename TImage::InternalPixelType * outPtr = outputPtr->GetBufferPointer() +
+        ((outputRegion.GetIndex(1) - outputBufferedRegion.GetIndex(1)) * outputBufferedRegion.GetSize(0) +
+         (outputRegion.GetIndex(0) - outputBufferedRegion.GetIndex(0))) * nComponents + channelOffset;
+    const tensorflow::int64 x0 = outputRegion.GetIndex(0) - bufferRegion.GetIndex(0);
+    const tensorflow::int64 y0 = outputRegion.GetIndex(1) - bufferRegion.GetIndex(1);
+    for (tensorflow::int64 y = y0 ; y < y0 + (tensorflow::int64) outputRegion.GetSize(1) ; y++)
+    {
+      // The values of one row of a block are contiguous
+      tensorflow::int64 x = x0;
+      while (x < x0 + width)
+      {
+        const tensorflow::int64 run = std::min<tensorflow::int64>(blockSize[0] - x % blockSize[0], x0 + width - x);
+        const TValueType * inPtr = tFlat.data() + pos(x, y);
+        typename TImage::InternalPixelType * rowPtr = outPtr + (x - x0) * nComponents;
+        if (outputDimSize_C == nComponents)
+        {
+          ConvertValues(inPtr, rowPtr, run * nComponents, quantization);
+        }
+        else
+        {
+          for (tensorflow::int64 i = 0 ; i < run ; i++)
+            ConvertValues(inPtr + i * outputDimSize_C, rowPtr + i * nComponents, outputDimSize_C, quantization);
+        }
+        x += run;
+      }
+      outPtr += outputBufferedRowLength;
+    }
 
+    // Update the offset
+    channelOffset += outputDimSize_C;
+    return;
+  }
+
+  // Iterate over the image
+  typename itk::ImageRegionIterator<TImage> outIt(outputPtr, outputRegion);
+  for (outIt.GoToBegin(); !outIt.IsAtEnd(); ++outIt)
+  {
+    const tensorflow::int64 p = pos(outIt.GetIndex()[0] - bufferRegion.GetIndex(0), outIt.GetIndex()[1] - bufferRegion.GetIndex(1));
+    for (unsigned int c = 0 ; c < outputDimSize_C ; c++)
+      outIt.Get()[channelOffset + c] = QuantizeValue<typename TImage::InternalPixelType>(tFlat(p + c), quantization);
+  }
+
+  // Update the offset
+  channelOffset += outputDimSize_C;
+
+}
+
+//
+// Functor for DispatchDataType (copy of a tensor of blocks into an image region)
+//
+template<class TImage>
+struct CopyBlocksTensorToImageRegionFunctor
+{
+  template<class TValueType>
+  static void Run(const tensorflow::Tensor & tensor, const typename TImage::RegionType & bufferRegion,
+      const typename TImage::SizeType & blockSize, typename TImage::Pointer & outputPtr,
+      const typename TImage::RegionType & region, int & channelOffset, tensorflow::int64 bufferOffset,
+      const QuantizationType & quantization)
+  {
+    CopyBlocksTensorToImageRegion<TImage, TValueType>(tensor, bufferRegion, blockSize, outputPtr, region,
+        channelOffset, bufferOffset, quantization);
+  }
+};
+
+//
+// Type-agnostic version of the 'CopyBlocksTensorToImageRegion' function
+//
+template<class TImage>
+void CopyBlocksTensorToImageRegion(const tensorflow::Tensor & tensor, const typename TImage::RegionType & bufferRegion,
+                                   const typename TImage::SizeType & blockSize, typename TImage::Pointer outputPtr,
+                                   const typename TImage::RegionType & region, int & channelOffset,
+                                   tensorflow::int64 bufferOffset, const QuantizationType & quantization)
+{
+  DispatchDataType<CopyBlocksTensorToImageRegionFunctor<TImage>>(tensor.dtype(), tensor, bufferRegion, blockSize,
+      outputPtr, region, channelOffset, bufferOffset, quantization);
+}
+
+//
+// Functor for DispatchDataType (values of some pixels of a tensor)
+//
+struct GatherPixelsValuesFunctor
+{
+  template<class TValueType>
+  static void Run(const tensorflow::Tensor & tensor, const std::vector<tensorflow::int64> & pixels, float * features,
+      std::size_t stride)
+  {
+    const tensorflow::int64 nChannels = GetNumberOfChannelsForOutputTensor(tensor);
+    const TValueType * data = tensor.flat<TValueType>().data();
+    for (std::size_t k = 0 ; k < pixels.size() ; k++)
+      ConvertValues(data + pixels[k] * nChannels, features + k * stride, nChannels);
+  }
+};
+
+//
+// Copy the values of some pixels of a tensor into a buffer of features.
+// The pixels are given by their position in the tensor (i.e. the position of
+// their first value divided by the number of channels).
+//
+void GatherPixelsValues(const tensorflow::Tensor & tensor, const std::vector<tensorflow::int64> & pixels, float * features,
+    std::size_t stride)
+{
+  const tensorflow::int64 nChannels = GetNumberOfChannelsForOutputTensor(tensor);
+  for (auto const& pixel: pixels)
+  {
+    if ((pixel + 1) * nChannels > tensor.NumElements())
+    {
+      itkGenericExceptionMacro("Pixel " << pixel << " is outside of the tensor of shape " << PrintTensorShape(tensor.shape()));
+    }
+  }
+  DispatchDataType<GatherPixelsValuesFunctor>(tensor.dtype(), tensor, pixels, features, stride);
 }
 
 //
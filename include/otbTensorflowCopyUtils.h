@@ -24,8 +24,18 @@
 // tensorflow::datatype <--> ImageType::InternalPixelType
 #include "otbTensorflowDataTypeBridge.h"
 
+// Tensor buffer over an image buffer
+#include "otbTensorflowImageTensorBuffer.h"
+
 // STD
+#include <algorithm>
 #include <string>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include <cmath>
+#include <limits>
 
 namespace otb {
 namespace tf {
@@ -48,6 +58,35 @@ void PopulateTensorFromBufferedVectorImage(const typename TImage::Pointer buffer
 template<class TImage>
 void TensorToImageBuffer(const tensorflow::Tensor & tensor, typename TImage::Pointer & image);
 
+// Copy (and convert) a contiguous run of values
+template<class TInputValueType, class TOutputValueType>
+void ConvertValues(const TInputValueType * in, TOutputValueType * out, std::size_t n);
+
+// Quantization of the output values: out = in * scale + shift, rounded
+// (optional) and clamped to [min, max]
+struct QuantizationType
+{
+  double m_Scale   = 1.0;
+  double m_Shift   = 0.0;
+  bool   m_Round   = false;
+  double m_Minimum = -std::numeric_limits<double>::infinity();
+  double m_Maximum = std::numeric_limits<double>::infinity();
+
+  bool IsIdentity() const
+  {
+    return m_Scale == 1.0 && m_Shift == 0.0 && !m_Round &&
+        m_Minimum == -std::numeric_limits<double>::infinity() && m_Maximum == std::numeric_limits<double>::infinity();
+  }
+};
+
+// Quantize one value
+template<class TOutputValueType, class TInputValueType>
+TOutputValueType QuantizeValue(const TInputValueType & in, const QuantizationType & quantization);
+
+// Copy (and quantize) a contiguous run of values
+template<class TInputValueType, class TOutputValueType>
+void ConvertValues(const TInputValueType * in, TOutputValueType * out, std::size_t n, const QuantizationType & quantization);
+
 // Recopy an VectorImage region into a 4D-shaped tensorflow::Tensor ({-1, sz_y, sz_x, sz_bands})
 template<class TImage, class TValueType=typename TImage::InternalPixelType>
 void RecopyImageRegionToTensor(const typename TImage::Pointer inputPtr,  const typename TImage::RegionType & region, tensorflow::Tensor & tensor, unsigned int elemIdx);
@@ -56,23 +95,66 @@ void RecopyImageRegionToTensor(const typename TImage::Pointer inputPtr,  const t
 template<class TImage>
 void RecopyImageRegionToTensorWithCast(const typename TImage::Pointer inputPtr,  const typename TImage::RegionType & region, tensorflow::Tensor & tensor, unsigned int elemIdx);
 
+// Recopy the part subRegion of an VectorImage region into the element of a 4D-shaped tensorflow::Tensor holding the region
+template<class TImage, class TValueType=typename TImage::InternalPixelType>
+void RecopyImageSubRegionToTensor(const typename TImage::Pointer inputPtr, const typename TImage::RegionType & region,
+    const typename TImage::RegionType & subRegion, tensorflow::Tensor & tensor, unsigned int elemIdx);
+
+// Recopy the part subRegion of an VectorImage region into a 4D-shaped tensorflow::Tensor (TValueType-agnostic function)
+template<class TImage>
+void RecopyImageSubRegionToTensorWithCast(const typename TImage::Pointer inputPtr, const typename TImage::RegionType & region,
+    const typename TImage::RegionType & subRegion, tensorflow::Tensor & tensor, unsigned int elemIdx);
+
+// Create a 4D-shaped tensor ({1, sz_y, sz_x, sz_bands}) over the image buffer, without copy.
+// Returns false when the image region can't be wrapped (datatype, contiguity or alignment mismatch)
+template<class TImage>
+bool WrapImageRegionIntoTensor(const typename TImage::Pointer inputPtr, const typename TImage::RegionType & region, const tensorflow::DataType & dt, tensorflow::Tensor & tensor);
+
 // Sample a centered patch
 template<class TImage>
 void SampleCenteredPatch(const typename TImage::Pointer inputPtr, const typename TImage::IndexType & centerIndex, const typename TImage::SizeType & patchSize, tensorflow::Tensor & tensor, unsigned int elemIdx);
 template<class TImage>
 void SampleCenteredPatch(const typename TImage::Pointer inputPtr, const typename TImage::PointType & centerCoord, const typename TImage::SizeType & patchSize, tensorflow::Tensor & tensor, unsigned int elemIdx);
 
+// Sample one patch for each block of the regions of the reference image, in consecutive elements of the tensor
+// (the patch of a block starts at patchOffset from the input pixel of the first pixel of the block)
+template<class TImage, class TReferenceImage>
+void SampleBlocksPatches(const typename TImage::Pointer inputPtr, const TReferenceImage * referencePtr, const std::vector<typename TReferenceImage::RegionType> & regions, const typename TImage::SizeType & patchSize, const typename TReferenceImage::SizeType & blockSize, const typename TImage::OffsetType & patchOffset, tensorflow::Tensor & tensor);
+
+// Sample the patches centered on the pixels of the regions of the reference image, in consecutive elements of the tensor
+template<class TImage, class TReferenceImage>
+void SampleCenteredPatches(const typename TImage::Pointer inputPtr, const TReferenceImage * referencePtr, const std::vector<typename TReferenceImage::RegionType> & regions, const typename TImage::SizeType & patchSize, tensorflow::Tensor & tensor);
+
 // Return the number of channels that the output tensor will occupy in the output image
 tensorflow::int64 GetNumberOfChannelsForOutputTensor(const tensorflow::Tensor & tensor);
 
-// Copy a tensor into the image region
+// Copy a tensor into the image region (the buffer region starts at the bufferOffset-th pixel of the tensor)
 template<class TImage, class TValueType>
-void CopyTensorToImageRegion(const tensorflow::Tensor & tensor, typename TImage::Pointer outputPtr, const typename TImage::RegionType & region, int & channelOffset);
+void CopyTensorToImageRegion(const tensorflow::Tensor & tensor, const typename TImage::RegionType & bufferRegion, typename TImage::Pointer outputPtr, const typename TImage::RegionType & outputRegion, int & channelOffset, tensorflow::int64 bufferOffset, const QuantizationType & quantization = QuantizationType());
 
 // Copy a tensor into the image region (TValueType-agnostic version)
 template<class TImage>
 void CopyTensorToImageRegion(const tensorflow::Tensor & tensor, const typename TImage::RegionType & bufferRegion, typename TImage::Pointer outputPtr, const typename TImage::RegionType & outputRegion, int & channelOffset);
 
+// Copy a part of a batch tensor into the image region (TValueType-agnostic version)
+template<class TImage>
+void CopyTensorToImageRegion(const tensorflow::Tensor & tensor, const typename TImage::RegionType & bufferRegion, typename TImage::Pointer outputPtr, const typename TImage::RegionType & outputRegion, int & channelOffset, tensorflow::int64 bufferOffset, const QuantizationType & quantization = QuantizationType());
+
+// Copy a tensor of blocks ({n, block_y, block_x, c}) into the image region (the buffer region starts at the bufferOffset-th block of the tensor)
+template<class TImage, class TValueType>
+void CopyBlocksTensorToImageRegion(const tensorflow::Tensor & tensor, const typename TImage::RegionType & bufferRegion, const typename TImage::SizeType & blockSize, typename TImage::Pointer outputPtr, const typename TImage::RegionType & outputRegion, int & channelOffset, tensorflow::int64 bufferOffset, const QuantizationType & quantization = QuantizationType());
+
+// Copy a tensor of blocks into the image region (TValueType-agnostic version)
+template<class TImage>
+void CopyBlocksTensorToImageRegion(const tensorflow::Tensor & tensor, const typename TImage::RegionType & bufferRegion, const typename TImage::SizeType & blockSize, typename TImage::Pointer outputPtr, const typename TImage::RegionType & outputRegion, int & channelOffset, tensorflow::int64 bufferOffset, const QuantizationType & quantization = QuantizationType());
+
+// Copy the values of some pixels of a tensor (given by their position in the tensor, in pixels) into a buffer of
+// features, where the values of two consecutive pixels are stride values apart
+void GatherPixelsValues(const tensorflow::Tensor & tensor, const std::vector<tensorflow::int64> & pixels, float * features, std::size_t stride);
+
+// Check that the number of elements in the tensor fits the given number of pixels
+void CheckTensorNumberOfElements(const tensorflow::Tensor & tensor, tensorflow::int64 nPixels, const std::string & description);
+
 // Convert an expression into a dict
 std::pair<std::string, tensorflow::Tensor> ExpressionToTensor(std::string expression);
 
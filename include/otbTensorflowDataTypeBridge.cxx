@@ -13,57 +13,30 @@
 namespace otb {
 namespace tf {
 
+//
+// C++ type --> tensorflow datatype
+//
+template<> struct DataTypeTraits<char>                   { static constexpr tensorflow::DataType value = tensorflow::DT_INT8; };
+template<> struct DataTypeTraits<signed char>            { static constexpr tensorflow::DataType value = tensorflow::DT_INT8; };
+template<> struct DataTypeTraits<unsigned char>          { static constexpr tensorflow::DataType value = tensorflow::DT_UINT8; };
+template<> struct DataTypeTraits<short>                  { static constexpr tensorflow::DataType value = tensorflow::DT_INT16; };
+template<> struct DataTypeTraits<unsigned short>         { static constexpr tensorflow::DataType value = tensorflow::DT_UINT16; };
+template<> struct DataTypeTraits<int>                    { static constexpr tensorflow::DataType value = tensorflow::DT_INT32; };
+template<> struct DataTypeTraits<unsigned int>           { static constexpr tensorflow::DataType value = tensorflow::DT_UINT32; };
+template<> struct DataTypeTraits<tensorflow::int64>      { static constexpr tensorflow::DataType value = tensorflow::DT_INT64; };
+template<> struct DataTypeTraits<tensorflow::uint64>     { static constexpr tensorflow::DataType value = tensorflow::DT_UINT64; };
+template<> struct DataTypeTraits<float>                  { static constexpr tensorflow::DataType value = tensorflow::DT_FLOAT; };
+template<> struct DataTypeTraits<double>                 { static constexpr tensorflow::DataType value = tensorflow::DT_DOUBLE; };
+template<> struct DataTypeTraits<Eigen::half>            { static constexpr tensorflow::DataType value = tensorflow::DT_HALF; };
+template<> struct DataTypeTraits<tensorflow::bfloat16>   { static constexpr tensorflow::DataType value = tensorflow::DT_BFLOAT16; };
+
 //
 // returns the datatype used by tensorflow
 //
 template<class Type>
-tensorflow::DataType GetTensorflowDataType()
+constexpr tensorflow::DataType GetTensorflowDataType()
 {
-  if (typeid(Type) == typeid(char))
-  {
-    return tensorflow::DT_INT8;
-  }
-  else if (typeid(Type) == typeid(unsigned char))
-  {
-    return tensorflow::DT_UINT8;
-  }
-  else if (typeid(Type) == typeid(unsigned short))
-  {
-    return tensorflow::DT_UINT16;
-  }
-  else if (typeid(Type) == typeid(short))
-  {
-    return tensorflow::DT_INT16;
-  }
-  else if (typeid(Type) == typeid(int))
-  {
-    return tensorflow::DT_INT32;
-  }
-  else if (typeid(Type) == typeid(unsigned int))
-  {
-    return tensorflow::DT_UINT32;
-  }
-  else if (typeid(Type) == typeid(long long int))
-  {
-    return tensorflow::DT_INT64;
-  }
-  else if (typeid(Type) == typeid(unsigned long long int))
-  {
-    return tensorflow::DT_UINT64;
-  }
-  else if (typeid(Type) == typeid(float))
-  {
-    return tensorflow::DT_FLOAT;
-  }
-  else if (typeid(Type) == typeid(double))
-  {
-    return tensorflow::DT_DOUBLE;
-  }
-  else
-  {
-    return tensorflow::DT_INVALID;
-    //    itkGenericExceptionMacro("Unknown data type");
-  }
+  return DataTypeTraits<Type>::value;
 }
 
 //
@@ -75,5 +48,57 @@ bool HasSameDataType(const tensorflow::Tensor & tensor)
   return GetTensorflowDataType<Type>() == tensor.dtype();
 }
 
+//
+// tensorflow datatype --> C++ type
+// The datatype is resolved once, then the typed code runs (e.g. the copy of
+// a whole tensor). The datatypes which can be stored in images are
+// supported: float, double, int8/16/32/64, uint8/16/32/64, half and bfloat16.
+//
+template<class TFunctor, class... TArgs>
+void DispatchDataType(tensorflow::DataType dt, TArgs&&... args)
+{
+  switch (dt)
+  {
+  case tensorflow::DT_FLOAT:
+    TFunctor::template Run<float>(std::forward<TArgs>(args)...);
+    break;
+  case tensorflow::DT_DOUBLE:
+    TFunctor::template Run<double>(std::forward<TArgs>(args)...);
+    break;
+  case tensorflow::DT_INT8:
+    TFunctor::template Run<tensorflow::int8>(std::forward<TArgs>(args)...);
+    break;
+  case tensorflow::DT_UINT8:
+    TFunctor::template Run<tensorflow::uint8>(std::forward<TArgs>(args)...);
+    break;
+  case tensorflow::DT_INT16:
+    TFunctor::template Run<tensorflow::int16>(std::forward<TArgs>(args)...);
+    break;
+  case tensorflow::DT_UINT16:
+    TFunctor::template Run<tensorflow::uint16>(std::forward<TArgs>(args)...);
+    break;
+  case tensorflow::DT_INT32:
+    TFunctor::template Run<tensorflow::int32>(std::forward<TArgs>(args)...);
+    break;
+  case tensorflow::DT_INT64:
+    TFunctor::template Run<tensorflow::int64>(std::forward<TArgs>(args)...);
+    break;
+  case tensorflow::DT_UINT32:
+    TFunctor::template Run<tensorflow::uint32>(std::forward<TArgs>(args)...);
+    break;
+  case tensorflow::DT_UINT64:
+    TFunctor::template Run<tensorflow::uint64>(std::forward<TArgs>(args)...);
+    break;
+  case tensorflow::DT_HALF:
+    TFunctor::template Run<Eigen::half>(std::forward<TArgs>(args)...);
+    break;
+  case tensorflow::DT_BFLOAT16:
+    TFunctor::template Run<tensorflow::bfloat16>(std::forward<TArgs>(args)...);
+    break;
+  default:
+    itkGenericExceptionMacro("TF DataType "<< dt << " not currently implemented !");
+  }
+}
+
 } // end namespace tf
 } // end namespace otb
@@ -11,20 +11,37 @@
 #ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWDATATYPEBRIDGE_H_
 #define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWDATATYPEBRIDGE_H_
 
-#include <typeinfo>
 #include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/framework/tensor.h"
+
+// ITK exception
+#include "itkMacro.h"
+
+// STD
+#include <utility>
 
 namespace otb {
 namespace tf {
 
+// Datatype used by tensorflow for a C++ type (DT_INVALID if the type has no tensorflow counterpart)
+template<class Type>
+struct DataTypeTraits
+{
+  static constexpr tensorflow::DataType value = tensorflow::DT_INVALID;
+};
+
 // returns the datatype used by tensorflow
 template<class Type>
-tensorflow::DataType GetTensorflowDataType();
+constexpr tensorflow::DataType GetTensorflowDataType();
 
 // Return true if the tensor data type is correct
 template<class Type>
 bool HasSameDataType(const tensorflow::Tensor & tensor);
 
+// Call TFunctor::Run<Type>(args...), with Type the C++ type of the tensorflow datatype
+template<class TFunctor, class... TArgs>
+void DispatchDataType(tensorflow::DataType dt, TArgs&&... args);
+
 } // end namespace tf
 } // end namespace otb
 
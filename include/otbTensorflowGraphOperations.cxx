@@ -45,15 +45,47 @@ void SaveModel(const std::string path, tensorflow::SavedModelBundle & bundle)
     }
 }
 
+//
+// Create the session options from a session configuration
+//
+tensorflow::SessionOptions CreateSessionOptions(const SessionConfig & config)
+{
+  tensorflow::SessionOptions options;
+  tensorflow::ConfigProto & proto = options.config;
+
+  // Threads pools
+  if (config.m_IntraOpThreads > 0)
+    proto.set_intra_op_parallelism_threads(config.m_IntraOpThreads);
+  if (config.m_InterOpThreads > 0)
+    proto.set_inter_op_parallelism_threads(config.m_InterOpThreads);
+
+  // GPU memory
+  proto.mutable_gpu_options()->set_allow_growth(config.m_AllowGrowth);
+  if (config.m_MemoryFraction > 0)
+    proto.mutable_gpu_options()->set_per_process_gpu_memory_fraction(config.m_MemoryFraction);
+  if (!config.m_VisibleDevices.empty())
+    proto.mutable_gpu_options()->set_visible_device_list(config.m_VisibleDevices);
+
+  // Graph optimizations
+  tensorflow::OptimizerOptions * optimizer = proto.mutable_graph_options()->mutable_optimizer_options();
+  optimizer->set_opt_level(config.m_OptimizerLevel == 0 ?
+      tensorflow::OptimizerOptions_Level_L0 : tensorflow::OptimizerOptions_Level_L1);
+  if (config.m_XLA)
+    optimizer->set_global_jit_level(tensorflow::OptimizerOptions_GlobalJitLevel_ON_1);
+
+  return options;
+}
+
 //
 // Load a session and a graph from a folder
 //
-void LoadModel(const std::string path, tensorflow::SavedModelBundle & bundle)
+void LoadModel(const std::string path, tensorflow::SavedModelBundle & bundle, const SessionConfig & config)
 {
 
   tensorflow::RunOptions runoptions;
-  runoptions.set_trace_level(tensorflow::RunOptions_TraceLevel_FULL_TRACE);
-  auto status = tensorflow::LoadSavedModel(tensorflow::SessionOptions(), runoptions,
+  if (config.m_Trace)
+    runoptions.set_trace_level(tensorflow::RunOptions_TraceLevel_FULL_TRACE);
+  auto status = tensorflow::LoadSavedModel(CreateSessionOptions(config), runoptions,
       path, {tensorflow::kSavedModelTagServe}, &bundle);
   if (!status.ok())
     {
@@ -62,6 +94,158 @@ void LoadModel(const std::string path, tensorflow::SavedModelBundle & bundle)
 
 }
 
+//
+// Index of the GPU of a device name ("/gpu:1", "/device:GPU:1")
+//
+int GetGPUIndex(const std::string & device)
+{
+  std::string name = device;
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+  const std::size_t pos = name.find("gpu:");
+  if (pos == std::string::npos)
+    return -1;
+  std::stringstream ss(name.substr(pos + 4));
+  int index;
+  if (!(ss >> index) || index < 0)
+    return -1;
+  return index;
+}
+
+//
+// List of the GPUs of some device names (e.g. "0,2" for "/gpu:0 /cpu:0 /gpu:2")
+//
+std::string GetVisibleDevices(const std::vector<std::string> & devices)
+{
+  std::stringstream ss;
+  for (auto& device: devices)
+    {
+    const int index = GetGPUIndex(device);
+    if (index >= 0)
+      {
+      if (ss.tellp() > 0)
+        ss << ",";
+      ss << index;
+      }
+    }
+  return ss.str();
+}
+
+//
+// Create a new session of a loaded model, on the given device.
+// All the nodes which are not explicitly placed on a CPU are placed on the
+// device, and soft placement allows the ops without kernel on the device to
+// run on the CPU. The variables are restored from the model folder, then the
+// initialization op of the model is run (like the SavedModel loader does), so
+// the session is in the same state as the session of the SavedModel bundle.
+// When the visible GPUs are restricted (config.m_VisibleDevices), tensorflow
+// renumbers them in the order of the list: a GPU device is placed on its
+// position in the list. All the sessions of the process must share the same
+// list, since tensorflow can't map one GPU id to different physical GPUs.
+//
+void CreateSessionOnDevice(const std::string path, const tensorflow::SavedModelBundle & bundle,
+    const std::string device, std::unique_ptr<tensorflow::Session> & session,
+    const SessionConfig & config)
+{
+  // Device of the session
+  std::string sessionDevice = device;
+  const int gpuIndex = GetGPUIndex(device);
+  if (gpuIndex >= 0 && !config.m_VisibleDevices.empty())
+    {
+    std::stringstream visibleDevices(config.m_VisibleDevices);
+    std::string visibleDevice;
+    int virtualIndex = -1;
+    for (int i = 0 ; std::getline(visibleDevices, visibleDevice, ',') ; i++)
+      {
+      if (std::stoi(visibleDevice) == gpuIndex)
+        virtualIndex = i;
+      }
+    if (virtualIndex < 0)
+      {
+      itkGenericExceptionMacro("Device " << device << " is not in the visible devices (" << config.m_VisibleDevices << ")");
+      }
+    sessionDevice = "/device:GPU:" + std::to_string(virtualIndex);
+    }
+
+  // Place the graph on the device
+  tensorflow::GraphDef graph = bundle.meta_graph_def.graph_def();
+  for (int i = 0 ; i < graph.node_size() ; i++)
+    {
+    tensorflow::NodeDef * node = graph.mutable_node(i);
+    if (node->device().find("CPU") == std::string::npos && node->device().find("cpu") == std::string::npos)
+      {
+      node->set_device(sessionDevice);
+      }
+    }
+
+  // Create the session
+  tensorflow::SessionOptions options = CreateSessionOptions(config);
+  options.config.set_allow_soft_placement(true);
+  session.reset(tensorflow::NewSession(options));
+  auto status = session->Create(graph);
+  if (!status.ok())
+    {
+    session.reset();
+    itkGenericExceptionMacro("Can't create the session on device " << device << ": " << status.ToString() );
+    }
+
+  // Restore the variables
+  const std::string variablesPath = tensorflow::io::JoinPath(path,
+      tensorflow::kSavedModelVariablesDirectory, tensorflow::kSavedModelVariablesFilename);
+  tensorflow::Tensor checkpointPathTensor(tensorflow::DT_STRING, tensorflow::TensorShape());
+  checkpointPathTensor.scalar<std::string>()() = variablesPath;
+  std::vector<std::pair<std::string, tensorflow::Tensor>> feed_dict =
+  {{bundle.meta_graph_def.saver_def().filename_tensor_name(), checkpointPathTensor}};
+  status = session->Run(feed_dict, {}, {bundle.meta_graph_def.saver_def().restore_op_name()}, nullptr);
+  if (!status.ok())
+    {
+    session.reset();
+    itkGenericExceptionMacro("Can't restore the model variables on device " << device << ": " << status.ToString() );
+    }
+
+  // Initialization op: the op of the "__saved_model_init_op" signature, else
+  // the main op, else the legacy init op (e.g. the initialization of the tables)
+  std::string initOpName;
+  const auto & signatures = bundle.meta_graph_def.signature_def();
+  const auto & collections = bundle.meta_graph_def.collection_def();
+  auto initSignature = signatures.find("__saved_model_init_op");
+  auto mainOp = collections.find(tensorflow::kSavedModelMainOpKey);
+  auto legacyInitOp = collections.find(tensorflow::kSavedModelLegacyInitOpKey);
+  if (initSignature != signatures.end() && initSignature->second.outputs().count("__saved_model_init_op") > 0)
+    initOpName = initSignature->second.outputs().at("__saved_model_init_op").name();
+  else if (mainOp != collections.end() && mainOp->second.node_list().value_size() == 1)
+    initOpName = mainOp->second.node_list().value(0);
+  else if (legacyInitOp != collections.end() && legacyInitOp->second.node_list().value_size() == 1)
+    initOpName = legacyInitOp->second.node_list().value(0);
+  if (initOpName.empty())
+    return;
+
+  // The assets of the model are fed to the initialization op
+  std::vector<std::pair<std::string, tensorflow::Tensor>> assets;
+  auto assetsCollection = collections.find(tensorflow::kSavedModelAssetsKey);
+  if (assetsCollection != collections.end())
+    {
+    for (auto& any: assetsCollection->second.any_list().value())
+      {
+      tensorflow::AssetFileDef asset;
+      if (!any.UnpackTo(&asset))
+        {
+        session.reset();
+        itkGenericExceptionMacro("Can't read the assets of the model");
+        }
+      tensorflow::Tensor assetPathTensor(tensorflow::DT_STRING, tensorflow::TensorShape());
+      assetPathTensor.scalar<std::string>()() = tensorflow::io::JoinPath(path,
+          tensorflow::kSavedModelAssetsDirectory, asset.filename());
+      assets.push_back({asset.tensor_info().name(), assetPathTensor});
+      }
+    }
+  status = session->Run(assets, {}, {initOpName}, nullptr);
+  if (!status.ok())
+    {
+    session.reset();
+    itkGenericExceptionMacro("Can't run the initialization op of the model on device " << device << ": " << status.ToString() );
+    }
+}
+
 //
 // Load a graph from a .meta file
 //
@@ -77,6 +261,20 @@ tensorflow::GraphDef LoadGraph(std::string filename)
   return meta_graph_def.graph_def();
 }
 
+//
+// Build the index of the nodes of a graph
+//
+NodesIndexType IndexNodes(const tensorflow::GraphDef & graph)
+{
+  NodesIndexType index;
+  index.reserve(graph.node_size());
+  for (int i = 0 ; i < graph.node_size() ; i++)
+  {
+    index.emplace(graph.node(i).name(), i);
+  }
+  return index;
+}
+
 //
 // Get the following attributes of the specified tensors (by name) of a graph:
 // - shape
@@ -85,6 +283,17 @@ tensorflow::GraphDef LoadGraph(std::string filename)
 //
 void GetTensorAttributes(const tensorflow::GraphDef & graph, std::vector<std::string> & tensorsNames,
     std::vector<tensorflow::TensorShapeProto> & shapes, std::vector<tensorflow::DataType> & dataTypes)
+{
+  GetTensorAttributes(graph, IndexNodes(graph), tensorsNames, shapes, dataTypes);
+}
+
+//
+// Get the attributes of the specified tensors (by name) of a graph, using
+// an index of its nodes: the nodes are not scanned for each tensor.
+//
+void GetTensorAttributes(const tensorflow::GraphDef & graph, const NodesIndexType & index,
+    std::vector<std::string> & tensorsNames, std::vector<tensorflow::TensorShapeProto> & shapes,
+    std::vector<tensorflow::DataType> & dataTypes)
 {
   // Allocation
   shapes.clear();
@@ -96,49 +305,38 @@ void GetTensorAttributes(const tensorflow::GraphDef & graph, std::vector<std::st
   for (std::vector<std::string>::iterator nameIt = tensorsNames.begin();
       nameIt != tensorsNames.end(); ++nameIt)
   {
-    bool found = false;
-    for (int i = 0 ; i < graph.node_size() ; i++)
+    auto entry = index.find(*nameIt);
+    if (entry == index.end())
     {
-      tensorflow::NodeDef node = graph.node(i);
-
-
-      if (node.name().compare((*nameIt)) == 0)
-      {
-        found = true;
-        tensorflow::DataType ts_dt;
-
-        // Default (input?) tensor type
-        auto test_is_output = node.attr().find("T");
-        if (test_is_output != node.attr().end())
-        {
-          ts_dt = node.attr().at("T").type();
-        }
-        auto test_has_dtype = node.attr().find("dtype");
-        if (test_has_dtype != node.attr().end())
-        {
-          ts_dt = node.attr().at("dtype").type();
-        }
-        auto test_output_type = node.attr().find("output_type");
-        if (test_output_type != node.attr().end())
-        {
-          // if there is an output type, we take it instead of the
-          // datatype of the input tensor
-          ts_dt = node.attr().at("output_type").type();
-        }
-        dataTypes.push_back(ts_dt);
-
-        // Get the tensor's shape
-        // Here we assure it's a tensor, with 1 shape
-        tensorflow::TensorShapeProto ts_shp = node.attr().at("_output_shapes").list().shape(0);
-        shapes.push_back(ts_shp);
-      }
+      itkGenericExceptionMacro("Tensor name \"" << (*nameIt) << "\" not found" );
     }
+    const tensorflow::NodeDef & node = graph.node(entry->second);
+    tensorflow::DataType ts_dt = tensorflow::DT_INVALID;
 
-    if (!found)
+    // Default (input?) tensor type
+    auto test_is_output = node.attr().find("T");
+    if (test_is_output != node.attr().end())
     {
-      itkGenericExceptionMacro("Tensor name \"" << (*nameIt) << "\" not found" );
+      ts_dt = test_is_output->second.type();
+    }
+    auto test_has_dtype = node.attr().find("dtype");
+    if (test_has_dtype != node.attr().end())
+    {
+      ts_dt = test_has_dtype->second.type();
+    }
+    auto test_output_type = node.attr().find("output_type");
+    if (test_output_type != node.attr().end())
+    {
+      // if there is an output type, we take it instead of the
+      // datatype of the input tensor
+      ts_dt = test_output_type->second.type();
     }
+    dataTypes.push_back(ts_dt);
 
+    // Get the tensor's shape
+    // Here we assure it's a tensor, with 1 shape
+    tensorflow::TensorShapeProto ts_shp = node.attr().at("_output_shapes").list().shape(0);
+    shapes.push_back(ts_shp);
   }
 
 }
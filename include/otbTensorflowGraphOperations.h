@@ -19,6 +19,17 @@
 // Tensorflow SavedModel
 #include "tensorflow/cc/saved_model/loader.h"
 #include "tensorflow/cc/saved_model/tag_constants.h"
+#include "tensorflow/cc/saved_model/constants.h"
+#include "tensorflow/core/lib/io/path.h"
+
+// STD
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 // ITK exception
 #include "itkMacro.h"
@@ -26,6 +37,23 @@
 namespace otb {
 namespace tf {
 
+// Configuration of the tensorflow sessions
+// (zero or empty values keep the tensorflow defaults)
+struct SessionConfig
+{
+  int         m_IntraOpThreads = 0;      // Threads of the intra-op pool
+  int         m_InterOpThreads = 0;      // Threads of the inter-op pool
+  bool        m_AllowGrowth    = false;  // Allocate the GPU memory on demand
+  float       m_MemoryFraction = 0;      // Fraction of the GPU memory that can be allocated
+  bool        m_XLA            = false;  // XLA JIT compilation
+  int         m_OptimizerLevel = 1;      // Graph optimizer level (0: L0, 1: L1)
+  bool        m_Trace          = false;  // Full trace of the runs used to load the model
+  std::string m_VisibleDevices;          // GPUs visible to the sessions (e.g. "0,2", empty: all)
+};
+
+// Create the session options from a session configuration
+tensorflow::SessionOptions CreateSessionOptions(const SessionConfig & config);
+
 // Restore a model from a path
 void RestoreModel(const std::string path, tensorflow::SavedModelBundle & bundle);
 
@@ -33,11 +61,30 @@ void RestoreModel(const std::string path, tensorflow::SavedModelBundle & bundle)
 void SaveModel(const std::string path, tensorflow::SavedModelBundle & bundle);
 
 // Load a session and a graph from a folder
-void LoadModel(const std::string path, tensorflow::SavedModelBundle & bundle);
+void LoadModel(const std::string path, tensorflow::SavedModelBundle & bundle,
+    const SessionConfig & config = SessionConfig());
+
+// Index of the GPU of a device name (e.g. 1 for "/gpu:1"), -1 if the device is not a GPU
+int GetGPUIndex(const std::string & device);
+
+// List of the GPUs of some device names, for the visible devices of the sessions
+std::string GetVisibleDevices(const std::vector<std::string> & devices);
+
+// Create a new session of a loaded model, with the graph placed on the given device,
+// restore its variables from the model folder and run its initialization op
+void CreateSessionOnDevice(const std::string path, const tensorflow::SavedModelBundle & bundle,
+    const std::string device, std::unique_ptr<tensorflow::Session> & session,
+    const SessionConfig & config = SessionConfig());
 
 // Load a graph from a .meta file
 tensorflow::GraphDef LoadGraph(std::string filename);
 
+// Index of the nodes of a graph (node name -> position of the node in the graph)
+typedef std::unordered_map<std::string, int> NodesIndexType;
+
+// Build the index of the nodes of a graph
+NodesIndexType IndexNodes(const tensorflow::GraphDef & graph);
+
 // Get the following attributes of the specified tensors (by name) of a graph:
 // - shape
 // - datatype
@@ -45,6 +92,11 @@ tensorflow::GraphDef LoadGraph(std::string filename);
 void GetTensorAttributes(const tensorflow::GraphDef & graph, std::vector<std::string> & tensorsNames,
     std::vector<tensorflow::TensorShapeProto> & shapes, std::vector<tensorflow::DataType> & dataTypes);
 
+// Same, using an index of the nodes of the graph (see IndexNodes())
+void GetTensorAttributes(const tensorflow::GraphDef & graph, const NodesIndexType & index,
+    std::vector<std::string> & tensorsNames, std::vector<tensorflow::TensorShapeProto> & shapes,
+    std::vector<tensorflow::DataType> & dataTypes);
+
 // Print a lot of stuff about the specified nodes of the graph
 void PrintNodeAttributes(const tensorflow::GraphDef & graph, std::vector<std::string> & nodesNames);
 
@@ -0,0 +1,139 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWHALOCACHE_H_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWHALOCACHE_H_
+
+// ITK
+#include "itkMacro.h"
+#include "itkIntTypes.h"
+#include "itkImageRegionConstIterator.h"
+
+// Tensorflow
+#include "tensorflow/core/framework/tensor.h"
+
+// Tensorflow helpers
+#include "otbTensorflowCopyUtils.h"
+
+// STD
+#include <vector>
+
+namespace otb {
+namespace tf {
+
+/*
+ * Cache of the input halos of one input image, for the output regions
+ * requested in raster order.
+ * The input regions of adjacent output regions overlap (receptive field of
+ * the model). The cache keeps the right strip of the input region of the
+ * previous output region, and the bottom strips of the input regions of the
+ * previous row of output regions. Then, only the remaining part of the next
+ * input region is requested to the upstream pipeline, and the tensors are
+ * filled from the pieces of the input region: the upstream buffer and the
+ * cached strips.
+ *
+ * The cache is cleared when the modification time of the pipeline changes.
+ */
+template<class TImage>
+class HaloCache
+{
+public:
+
+  typedef typename TImage::Pointer                 ImagePointerType;
+  typedef typename TImage::PixelType               PixelType;
+  typedef typename TImage::RegionType              RegionType;
+  typedef typename TImage::SizeType                SizeType;
+  typedef typename TImage::IndexType               IndexType;
+  typedef typename TImage::OffsetType              OffsetType;
+  typedef typename TImage::IndexValueType          IndexValueType;
+
+  /* How the input region of one output region is assembled */
+  struct PlanType
+  {
+    itk::ModifiedTimeType    m_ModifiedTime = 0; // Modification time of the pipeline
+    RegionType               m_OutputRegion;     // Aligned output region
+    RegionType               m_Region;           // Whole input region
+    RegionType               m_RequestedRegion;  // Part requested to the upstream pipeline
+    RegionType               m_LeftRegion;       // Part copied from the left strip (can be empty)
+    RegionType               m_TopRegion;        // Part copied from the top strip (can be empty)
+  };
+
+  HaloCache();
+  virtual ~HaloCache() {};
+
+  // Drop the cached strips
+  void Reset();
+
+  // Find which parts of the input region are in the cache (without modifying the cache)
+  PlanType Plan(const RegionType & outputRegion, const RegionType & inputRegion, itk::ModifiedTimeType mtime) const;
+
+  // Set the pieces of the planned input region, and keep the strips of the next input regions
+  // (the right strip overlaps the input region of the next output region, the bottom strip the
+  // input region of the output region below)
+  void Apply(const PlanType & plan, ImagePointerType input, const RegionType & rightStrip, const RegionType & bottomStrip);
+
+  // Use the buffered region of the input, without cache
+  void Bypass(ImagePointerType input);
+
+  // Upstream input image
+  ImagePointerType GetInput() const { return m_Input; }
+
+  // Return true if the region is covered by the pieces
+  bool IsInside(const RegionType & region) const { return m_Region.IsInside(region); }
+
+  // Flag (1) the pixels of the region whose bands are all equal to the value. The pixels
+  // which are not covered by the pieces are not flagged.
+  void ComputeNoDataFlags(const RegionType & region, double value, std::vector<char> & flags) const;
+
+  // Recopy the region into the element #elemIdx of the 4D-shaped tensor
+  void RecopyRegionToTensor(const RegionType & region, tensorflow::Tensor & tensor, unsigned int elemIdx) const;
+
+  // Sample one patch for each block of the regions of the reference image (see tf::SampleBlocksPatches)
+  template<class TReferenceImage>
+  void SampleBlocksPatches(const TReferenceImage * referencePtr, const std::vector<typename TReferenceImage::RegionType> & regions,
+      const SizeType & patchSize, const typename TReferenceImage::SizeType & blockSize, const OffsetType & patchOffset,
+      tensorflow::Tensor & tensor) const;
+
+private:
+
+  /* One piece of the input region */
+  struct PieceType
+  {
+    ImagePointerType         m_Image;
+    RegionType               m_Region;
+  };
+
+  void AddPiece(ImagePointerType image, const RegionType & region);
+  ImagePointerType NewStrip(const RegionType & bufferedRegion) const;
+  void CopyRegion(TImage * destination, const RegionType & region) const;
+  static void CopyImageRegion(const TImage * source, TImage * destination, const RegionType & region);
+
+  itk::ModifiedTimeType      m_ModifiedTime;    // Modification time of the pipeline of the cached strips
+  bool                       m_HasRow;          // True when a row of output regions is started
+  IndexValueType             m_RowY;            // First output row of the current row of output regions
+  IndexValueType             m_RowEndY;         // Last output row of the current row of output regions
+  ImagePointerType           m_LeftStrip;       // Right strip of the previous input region
+  ImagePointerType           m_RowStrip;        // Bottom strips of the current row (for the next row)
+  RegionType                 m_RowStripRegion;  // Valid region of m_RowStrip
+  ImagePointerType           m_TopStrip;        // Bottom strips of the previous row
+  RegionType                 m_TopStripRegion;  // Valid region of m_TopStrip
+
+  ImagePointerType           m_Input;           // Upstream input image
+  RegionType                 m_Region;          // Input region covered by the pieces
+  std::vector<PieceType>     m_Pieces;          // Pieces of the input region
+
+};
+
+} // end namespace tf
+} // end namespace otb
+
+#include "otbTensorflowHaloCache.hxx"
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWHALOCACHE_H_ */
@@ -0,0 +1,370 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWHALOCACHE_HXX_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWHALOCACHE_HXX_
+
+#include "otbTensorflowHaloCache.h"
+
+// std::copy, std::max
+#include <algorithm>
+
+namespace otb {
+namespace tf {
+
+template<class TImage>
+HaloCache<TImage>::HaloCache()
+{
+  m_ModifiedTime = 0;
+  Reset();
+}
+
+//
+// Drop the cached strips
+//
+template<class TImage>
+void
+HaloCache<TImage>::Reset()
+{
+  m_HasRow = false;
+  m_RowY = 0;
+  m_RowEndY = 0;
+  m_LeftStrip = ImagePointerType();
+  m_RowStrip = ImagePointerType();
+  m_RowStripRegion = RegionType();
+  m_TopStrip = ImagePointerType();
+  m_TopStripRegion = RegionType();
+  m_Pieces.clear();
+  m_Region = RegionType();
+}
+
+//
+// Find which parts of the input region can be copied from the cache:
+// -the left part, from the right strip of the previous input region, when the
+//  output region is in the same row of output regions,
+// -the top part, from the bottom strips of the input regions of the previous
+//  row of output regions.
+// The remaining part (bottom-right) is requested to the upstream pipeline.
+// Nothing is taken from the cache when the pipeline has been modified.
+//
+template<class TImage>
+typename HaloCache<TImage>::PlanType
+HaloCache<TImage>::Plan(const RegionType & outputRegion, const RegionType & inputRegion, itk::ModifiedTimeType mtime) const
+{
+  PlanType plan;
+  plan.m_ModifiedTime = mtime;
+  plan.m_OutputRegion = outputRegion;
+  plan.m_Region = inputRegion;
+  plan.m_RequestedRegion = inputRegion;
+  if (inputRegion.GetNumberOfPixels() == 0 || mtime != m_ModifiedTime)
+    return plan;
+
+  const bool sameRow = m_HasRow && outputRegion.GetIndex(1) == m_RowY;
+  const bool nextRow = m_HasRow && outputRegion.GetIndex(1) == m_RowEndY + 1;
+  const IndexType first = inputRegion.GetIndex();
+  const IndexType last = inputRegion.GetUpperIndex();
+  IndexType requestedFirst = first;
+
+  // Left part
+  if (sameRow && m_LeftStrip)
+  {
+    const RegionType left = m_LeftStrip->GetBufferedRegion();
+    const IndexType leftFirst = left.GetIndex();
+    const IndexType leftLast = left.GetUpperIndex();
+    if (leftFirst[0] <= first[0] && first[0] <= leftLast[0] && leftLast[0] < last[0] &&
+        leftFirst[1] <= first[1] && last[1] <= leftLast[1])
+    {
+      plan.m_LeftRegion = inputRegion;
+      plan.m_LeftRegion.SetSize(0, leftLast[0] - first[0] + 1);
+      requestedFirst[0] = leftLast[0] + 1;
+    }
+  }
+
+  // Top part
+  const ImagePointerType topStrip = sameRow ? m_TopStrip : (nextRow ? m_RowStrip : ImagePointerType());
+  if (topStrip)
+  {
+    const RegionType top = sameRow ? m_TopStripRegion : m_RowStripRegion;
+    const IndexType topFirst = top.GetIndex();
+    const IndexType topLast = top.GetUpperIndex();
+    if (topFirst[0] <= first[0] && last[0] <= topLast[0] &&
+        topFirst[1] <= first[1] && first[1] <= topLast[1] && topLast[1] < last[1])
+    {
+      plan.m_TopRegion = inputRegion;
+      plan.m_TopRegion.SetSize(1, topLast[1] - first[1] + 1);
+      requestedFirst[1] = topLast[1] + 1;
+    }
+  }
+
+  plan.m_RequestedRegion.SetIndex(requestedFirst);
+  for (unsigned int dim = 0 ; dim < TImage::ImageDimension ; dim++)
+  {
+    plan.m_RequestedRegion.SetSize(dim, last[dim] - requestedFirst[dim] + 1);
+  }
+  return plan;
+}
+
+//
+// Set the pieces of the planned input region (the upstream buffer, and the
+// parts of the cached strips), then keep the strips of the input region which
+// overlap the next input regions. Only the strips are copied.
+//
+template<class TImage>
+void
+HaloCache<TImage>::Apply(const PlanType & plan, ImagePointerType input, const RegionType & rightStrip,
+    const RegionType & bottomStrip)
+{
+  if (plan.m_ModifiedTime != m_ModifiedTime)
+  {
+    Reset();
+    m_ModifiedTime = plan.m_ModifiedTime;
+  }
+  if (!input->GetBufferedRegion().IsInside(plan.m_RequestedRegion))
+  {
+    itkGenericExceptionMacro("The buffered region of the input:\n" << input->GetBufferedRegion() <<
+                             "does not contain its requested region:\n" << plan.m_RequestedRegion);
+  }
+
+  // A new row of output regions: the bottom strips of the current row become the top strips
+  const IndexValueType outputY = plan.m_OutputRegion.GetIndex(1);
+  if (!m_HasRow || outputY != m_RowY)
+  {
+    const bool nextRow = m_HasRow && outputY == m_RowEndY + 1;
+    m_TopStrip = nextRow ? m_RowStrip : ImagePointerType();
+    m_TopStripRegion = nextRow ? m_RowStripRegion : RegionType();
+    m_RowStrip = ImagePointerType();
+    m_RowStripRegion = RegionType();
+    m_LeftStrip = ImagePointerType();
+    m_HasRow = true;
+    m_RowY = outputY;
+  }
+  m_RowEndY = plan.m_OutputRegion.GetUpperIndex()[1];
+
+  // Pieces of the input region
+  m_Input = input;
+  m_Region = plan.m_Region;
+  m_Pieces.clear();
+  AddPiece(input, plan.m_RequestedRegion);
+  AddPiece(m_LeftStrip, plan.m_LeftRegion);
+  AddPiece(m_TopStrip, plan.m_TopRegion);
+
+  // Keep the right strip, for the next output region of the row
+  ImagePointerType leftStrip;
+  if (rightStrip.GetNumberOfPixels() > 0)
+  {
+    leftStrip = NewStrip(rightStrip);
+    CopyRegion(leftStrip, rightStrip);
+  }
+  m_LeftStrip = leftStrip;
+
+  // Keep the bottom strip, for the next row of output regions
+  if (bottomStrip.GetNumberOfPixels() == 0)
+    return;
+  const RegionType & valid = m_RowStripRegion;
+  const bool contiguous = m_RowStrip &&
+      valid.GetIndex(1) == bottomStrip.GetIndex(1) && valid.GetSize(1) == bottomStrip.GetSize(1) &&
+      valid.GetIndex(0) <= bottomStrip.GetIndex(0) && bottomStrip.GetIndex(0) <= valid.GetUpperIndex()[0] + 1;
+  if (contiguous)
+  {
+    const IndexValueType validLast = std::max(valid.GetUpperIndex()[0], bottomStrip.GetUpperIndex()[0]);
+    m_RowStripRegion.SetSize(0, validLast - valid.GetIndex(0) + 1);
+  }
+  else
+  {
+    // The strip spans the whole width of the input image
+    RegionType stripBuffer(bottomStrip);
+    stripBuffer.SetIndex(0, input->GetLargestPossibleRegion().GetIndex(0));
+    stripBuffer.SetSize(0, input->GetLargestPossibleRegion().GetSize(0));
+    m_RowStrip = NewStrip(stripBuffer);
+    m_RowStripRegion = bottomStrip;
+  }
+  CopyRegion(m_RowStrip, bottomStrip);
+}
+
+//
+// Use the whole buffered region of the input, without cache
+//
+template<class TImage>
+void
+HaloCache<TImage>::Bypass(ImagePointerType input)
+{
+  m_Input = input;
+  m_Region = input->GetBufferedRegion();
+  m_Pieces.clear();
+  AddPiece(input, m_Region);
+}
+
+//
+// Flag the nodata pixels of the region, piece by piece
+//
+template<class TImage>
+void
+HaloCache<TImage>::ComputeNoDataFlags(const RegionType & region, double value, std::vector<char> & flags) const
+{
+  flags.assign(region.GetNumberOfPixels(), 0);
+  for (auto const& piece: m_Pieces)
+  {
+    RegionType pieceRegion = piece.m_Region;
+    if (!pieceRegion.Crop(region))
+      continue;
+
+    const unsigned int nBands = piece.m_Image->GetNumberOfComponentsPerPixel();
+    itk::ImageRegionConstIterator<TImage> it(piece.m_Image, pieceRegion);
+    for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+    {
+      const PixelType pixel = it.Get();
+      bool nodata = true;
+      for (unsigned int band = 0 ; band < nBands && nodata ; band++)
+        nodata = (pixel[band] == value);
+      if (nodata)
+      {
+        const IndexType index = it.GetIndex();
+        flags[(index[1] - region.GetIndex(1)) * region.GetSize(0) + (index[0] - region.GetIndex(0))] = 1;
+      }
+    }
+  }
+}
+
+//
+// Recopy the region into the element #elemIdx of the tensor, piece by piece
+//
+template<class TImage>
+void
+HaloCache<TImage>::RecopyRegionToTensor(const RegionType & region, tensorflow::Tensor & tensor, unsigned int elemIdx) const
+{
+  if (m_Pieces.size() == 1)
+  {
+    RecopyImageRegionToTensorWithCast<TImage>(m_Pieces[0].m_Image, region, tensor, elemIdx);
+    return;
+  }
+  if (!m_Region.IsInside(region))
+  {
+    itkGenericExceptionMacro("The region:\n" << region << "is not inside the cached input region:\n" << m_Region);
+  }
+  for (auto const& piece: m_Pieces)
+  {
+    RegionType subRegion(region);
+    if (subRegion.Crop(piece.m_Region))
+      RecopyImageSubRegionToTensorWithCast<TImage>(piece.m_Image, region, subRegion, tensor, elemIdx);
+  }
+}
+
+//
+// Sample one patch for each block of the regions of the reference image.
+// The blocks tile the regions in raster order, and the patch of a block
+// starts at patchOffset from the input pixel of the first pixel of the block.
+//
+template<class TImage>
+template<class TReferenceImage>
+void
+HaloCache<TImage>::SampleBlocksPatches(const TReferenceImage * referencePtr,
+    const std::vector<typename TReferenceImage::RegionType> & regions, const SizeType & patchSize,
+    const typename TReferenceImage::SizeType & blockSize, const OffsetType & patchOffset,
+    tensorflow::Tensor & tensor) const
+{
+  if (m_Pieces.size() == 1)
+  {
+    tf::SampleBlocksPatches<TImage, TReferenceImage>(m_Pieces[0].m_Image, referencePtr, regions, patchSize,
+        blockSize, patchOffset, tensor);
+    return;
+  }
+
+  unsigned int elemIdx = 0;
+  for (auto const& region: regions)
+  {
+    const typename TReferenceImage::IndexType start = region.GetIndex();
+    const typename TReferenceImage::IndexType end = region.GetUpperIndex();
+    typename TReferenceImage::IndexType blockIndex;
+    for (blockIndex[1] = start[1] ; blockIndex[1] <= end[1] ; blockIndex[1] += blockSize[1])
+    {
+      for (blockIndex[0] = start[0] ; blockIndex[0] <= end[0] ; blockIndex[0] += blockSize[0])
+      {
+        // First pixel of the block, in the input image
+        typename TReferenceImage::PointType point;
+        referencePtr->TransformIndexToPhysicalPoint(blockIndex, point);
+        IndexType firstIndex;
+        m_Input->TransformPhysicalPointToIndex(point, firstIndex);
+
+        RecopyRegionToTensor(RegionType(firstIndex + patchOffset, patchSize), tensor, elemIdx);
+        elemIdx++;
+      }
+    }
+  }
+}
+
+//
+// Add a piece of the input region (empty pieces are skipped)
+//
+template<class TImage>
+void
+HaloCache<TImage>::AddPiece(ImagePointerType image, const RegionType & region)
+{
+  if (!image || region.GetNumberOfPixels() == 0)
+    return;
+  PieceType piece;
+  piece.m_Image = image;
+  piece.m_Region = region;
+  m_Pieces.push_back(piece);
+}
+
+//
+// Allocate a strip image, with the information of the input image
+//
+template<class TImage>
+typename HaloCache<TImage>::ImagePointerType
+HaloCache<TImage>::NewStrip(const RegionType & bufferedRegion) const
+{
+  ImagePointerType strip = TImage::New();
+  strip->CopyInformation(m_Input);
+  strip->SetNumberOfComponentsPerPixel(m_Input->GetNumberOfComponentsPerPixel());
+  strip->SetBufferedRegion(bufferedRegion);
+  strip->Allocate();
+  return strip;
+}
+
+//
+// Copy a region of the pieces into the destination image
+//
+template<class TImage>
+void
+HaloCache<TImage>::CopyRegion(TImage * destination, const RegionType & region) const
+{
+  for (auto const& piece: m_Pieces)
+  {
+    RegionType subRegion(region);
+    if (subRegion.Crop(piece.m_Region))
+      CopyImageRegion(piece.m_Image, destination, subRegion);
+  }
+}
+
+//
+// Copy a region between the buffers of two images, row by row
+//
+template<class TImage>
+void
+HaloCache<TImage>::CopyImageRegion(const TImage * source, TImage * destination, const RegionType & region)
+{
+  typedef typename TImage::InternalPixelType InternalPixelType;
+  const unsigned int nComponents = source->GetNumberOfComponentsPerPixel();
+  const std::size_t rowLength = region.GetSize(0) * nComponents;
+  IndexType index = region.GetIndex();
+  for (typename SizeType::SizeValueType y = 0 ; y < region.GetSize(1) ; y++)
+  {
+    index[1] = region.GetIndex(1) + y;
+    const InternalPixelType * src = source->GetBufferPointer() + source->ComputeOffset(index) * nComponents;
+    InternalPixelType * dst = destination->GetBufferPointer() + destination->ComputeOffset(index) * nComponents;
+    std::copy(src, src + rowLength, dst);
+  }
+}
+
+} // end namespace tf
+} // end namespace otb
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWHALOCACHE_HXX_ */
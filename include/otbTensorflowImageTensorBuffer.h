@@ -0,0 +1,61 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWIMAGETENSORBUFFER_H_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWIMAGETENSORBUFFER_H_
+
+// tensorflow::TensorBuffer
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/allocation_description.pb.h"
+
+namespace otb {
+namespace tf {
+
+/*
+ * This is a tensorflow::TensorBuffer which does not own its memory: it
+ * points into the pixel buffer of an image.
+ * A reference to the image is kept as long as the buffer lives, so that the
+ * pixels buffer can't be released while the tensor is used.
+ * The buffer must not be modified by the graph: OwnsMemory() returns false,
+ * and the tensors keep a reference on the buffer while the session runs, so
+ * that tensorflow never forwards it to the outputs of an op.
+ */
+template<class TImage>
+class ImageTensorBuffer : public tensorflow::TensorBuffer
+{
+public:
+
+  ImageTensorBuffer(typename TImage::Pointer image, void * data, std::size_t size)
+  : tensorflow::TensorBuffer(data), m_Image(image), m_Size(size) {}
+
+  std::size_t size() const override { return m_Size; }
+
+  tensorflow::TensorBuffer* root_buffer() override { return this; }
+
+  void FillAllocationDescription(tensorflow::AllocationDescription* proto) const override
+  {
+    proto->set_requested_bytes(m_Size);
+    proto->set_allocator_name("otb_image_buffer");
+  }
+
+  bool OwnsMemory() const override { return false; }
+
+private:
+  ~ImageTensorBuffer() override {}
+
+  typename TImage::Pointer m_Image; // The image which holds the pixels buffer
+  std::size_t              m_Size;  // Size of the buffer (in bytes)
+
+};
+
+} // end namespace tf
+} // end namespace otb
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWIMAGETENSORBUFFER_H_ */
@@ -0,0 +1,84 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTensorflowImagesStackFilter_h
+#define otbTensorflowImagesStackFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkNumericTraits.h"
+
+namespace otb
+{
+
+/**
+ * \class TensorflowImagesStackFilter
+ * \brief This filter stacks the channels of multiple vector images.
+ *
+ * The output pixel is the concatenation of the pixels of the inputs, in the
+ * order of the inputs. The channels of each input are copied in a single
+ * pass, directly from the input buffer to their slice of the interleaved
+ * output buffer.
+ * Like the ImageListToVectorImageFilter, only the sizes of the inputs must
+ * match: the geometry of the output is the one of the first input.
+ *
+ * \ingroup OTBTensorflow
+ */
+template <class TImage>
+class ITK_EXPORT TensorflowImagesStackFilter :
+public itk::ImageToImageFilter<TImage, TImage>
+{
+public:
+
+  /** Standard class typedefs. */
+  typedef TensorflowImagesStackFilter             Self;
+  typedef itk::ImageToImageFilter<TImage, TImage> Superclass;
+  typedef itk::SmartPointer<Self>                 Pointer;
+  typedef itk::SmartPointer<const Self>           ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(TensorflowImagesStackFilter, itk::ImageToImageFilter);
+
+  /** Images typedefs */
+  typedef TImage                                  ImageType;
+  typedef typename TImage::Pointer                ImagePointerType;
+  typedef typename TImage::RegionType             RegionType;
+  typedef typename TImage::IndexType              IndexType;
+  typedef typename TImage::OffsetType             OffsetType;
+  typedef typename TImage::InternalPixelType      InternalPixelType;
+
+  /** Add an image at the end of the stack */
+  void PushBackInput(const ImageType * image) { this->SetNthInput(this->GetNumberOfInputs(), const_cast<ImageType*>(image)); }
+
+protected:
+  TensorflowImagesStackFilter();
+  virtual ~TensorflowImagesStackFilter() {};
+
+  virtual void GenerateOutputInformation();
+
+  virtual void GenerateInputRequestedRegion();
+
+  virtual void ThreadedGenerateData(const RegionType& outputRegionForThread, itk::ThreadIdType threadId);
+
+  OffsetType GetInputShift(unsigned int inputIndex) const;
+
+private:
+  TensorflowImagesStackFilter(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+}; // end class
+
+} // end namespace otb
+
+#include "otbTensorflowImagesStackFilter.hxx"
+
+#endif
@@ -0,0 +1,148 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTensorflowImagesStackFilter_txx
+#define otbTensorflowImagesStackFilter_txx
+
+#include "otbTensorflowImagesStackFilter.h"
+
+namespace otb
+{
+
+template <class TImage>
+TensorflowImagesStackFilter<TImage>
+::TensorflowImagesStackFilter()
+ {
+  // Only the sizes of the inputs must match
+  Superclass::SetCoordinateTolerance(itk::NumericTraits<double>::max() );
+  Superclass::SetDirectionTolerance(itk::NumericTraits<double>::max() );
+ }
+
+/**
+ * The output has the geometry of the first input, and the channels of all
+ * the inputs
+ */
+template <class TImage>
+void
+TensorflowImagesStackFilter<TImage>
+::GenerateOutputInformation()
+ {
+  Superclass::GenerateOutputInformation();
+
+  if (this->GetNumberOfInputs() == 0)
+    {
+    itkExceptionMacro("No input image to stack");
+    }
+
+  const RegionType largestRegion = this->GetInput(0)->GetLargestPossibleRegion();
+  unsigned int nComponents = 0;
+  for (unsigned int i = 0 ; i < this->GetNumberOfInputs() ; i++)
+    {
+    const ImageType * inputPtr = this->GetInput(i);
+    if (inputPtr->GetLargestPossibleRegion().GetSize() != largestRegion.GetSize())
+      {
+      itkExceptionMacro("Input image size number " << i << " mismatch");
+      }
+    nComponents += inputPtr->GetNumberOfComponentsPerPixel();
+    }
+
+  this->GetOutput()->SetNumberOfComponentsPerPixel(nComponents);
+ }
+
+/**
+ * The requested region of each input is the output requested region, in
+ * the indices of the input
+ */
+template <class TImage>
+void
+TensorflowImagesStackFilter<TImage>
+::GenerateInputRequestedRegion()
+ {
+  const RegionType outputRequestedRegion = this->GetOutput()->GetRequestedRegion();
+  for (unsigned int i = 0 ; i < this->GetNumberOfInputs() ; i++)
+    {
+    ImageType * inputPtr = const_cast<ImageType*>(this->GetInput(i));
+    RegionType inputRequestedRegion(outputRequestedRegion);
+    inputRequestedRegion.SetIndex(outputRequestedRegion.GetIndex() + GetInputShift(i));
+    inputPtr->SetRequestedRegion(inputRequestedRegion);
+    }
+ }
+
+/**
+ * Offset between the indices of the first input and the input #inputIndex
+ */
+template <class TImage>
+typename TensorflowImagesStackFilter<TImage>::OffsetType
+TensorflowImagesStackFilter<TImage>
+::GetInputShift(unsigned int inputIndex) const
+ {
+  return this->GetInput(inputIndex)->GetLargestPossibleRegion().GetIndex() -
+      this->GetInput(0)->GetLargestPossibleRegion().GetIndex();
+ }
+
+/**
+ * Copy the channels of each input in its slice of the output pixels,
+ * row by row
+ */
+template <class TImage>
+void
+TensorflowImagesStackFilter<TImage>
+::ThreadedGenerateData(const RegionType& outputRegionForThread, itk::ThreadIdType itkNotUsed(threadId))
+ {
+  ImageType * outputPtr = this->GetOutput();
+  const RegionType outputBufferedRegion = outputPtr->GetBufferedRegion();
+  const unsigned int nOutputComponents = outputPtr->GetNumberOfComponentsPerPixel();
+  const unsigned int width = outputRegionForThread.GetSize(0);
+
+  unsigned int channelOffset = 0;
+  for (unsigned int i = 0 ; i < this->GetNumberOfInputs() ; i++)
+    {
+    const ImageType * inputPtr = this->GetInput(i);
+    const RegionType inputBufferedRegion = inputPtr->GetBufferedRegion();
+    const unsigned int nComponents = inputPtr->GetNumberOfComponentsPerPixel();
+
+    // The input and the first input have the same sizes
+    const OffsetType inputShift = GetInputShift(i);
+
+    for (unsigned int y = 0 ; y < outputRegionForThread.GetSize(1) ; y++)
+      {
+      IndexType outIndex = outputRegionForThread.GetIndex();
+      outIndex[1] += y;
+      IndexType inIndex = outIndex + inputShift;
+
+      const InternalPixelType * inPtr = inputPtr->GetBufferPointer() +
+          ((inIndex[1] - inputBufferedRegion.GetIndex(1)) * inputBufferedRegion.GetSize(0) +
+           (inIndex[0] - inputBufferedRegion.GetIndex(0))) * nComponents;
+      InternalPixelType * outPtr = outputPtr->GetBufferPointer() +
+          ((outIndex[1] - outputBufferedRegion.GetIndex(1)) * outputBufferedRegion.GetSize(0) +
+           (outIndex[0] - outputBufferedRegion.GetIndex(0))) * nOutputComponents + channelOffset;
+
+      if (nComponents == nOutputComponents)
+        {
+        std::copy(inPtr, inPtr + width * nComponents, outPtr);
+        }
+      else
+        {
+        for (unsigned int x = 0 ; x < width ; x++)
+          {
+          std::copy(inPtr, inPtr + nComponents, outPtr);
+          inPtr += nComponents;
+          outPtr += nOutputComponents;
+          }
+        }
+      }
+
+    channelOffset += nComponents;
+    }
+ }
+
+} // end namespace otb
+
+#endif
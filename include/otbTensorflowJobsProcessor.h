@@ -0,0 +1,74 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWJOBSPROCESSOR_H_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWJOBSPROCESSOR_H_
+
+// Queues of the pipeline
+#include "otbTensorflowBoundedQueue.h"
+
+// STD
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace otb {
+namespace tf {
+
+/*
+ * Process a list of jobs in three stages: fill (prepare the inputs), run
+ * (on the runner #k, e.g. a session) and copy (write the outputs). The
+ * progress function is called from the calling thread after each job: the
+ * exception it raises (e.g. an abort of the user) stops the processing.
+ * Each job is released (reset to TJob()) once its outputs are written.
+ * The first error raised in any thread stops all the threads, and is
+ * rethrown in the calling thread.
+ */
+template<class TJob>
+class JobsProcessor
+{
+public:
+
+  typedef std::vector<TJob>                        JobListType;
+  typedef std::function<void(TJob &)>              StageFunctionType;
+  typedef std::function<void(TJob &, unsigned int)> RunFunctionType;
+  typedef std::function<void()>                    ProgressFunctionType;
+
+  JobsProcessor(StageFunctionType fill, RunFunctionType run, StageFunctionType copy, ProgressFunctionType progress);
+  virtual ~JobsProcessor() {};
+
+  // Process the jobs one after another, on the runner #0
+  void ProcessSequentially(JobListType & jobs);
+
+  // Process the jobs with one thread per stage, connected with bounded queues of the given depth
+  void ProcessPipelined(JobListType & jobs, unsigned int depth);
+
+  // Process the jobs with one thread per runner, each taking the next job as soon as it is done
+  void ProcessOnRunners(JobListType & jobs, unsigned int nRunners);
+
+private:
+
+  StageFunctionType          m_Fill;
+  RunFunctionType            m_Run;
+  StageFunctionType          m_Copy;
+  ProgressFunctionType       m_Progress;
+
+};
+
+} // end namespace tf
+} // end namespace otb
+
+#include "otbTensorflowJobsProcessor.hxx"
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWJOBSPROCESSOR_H_ */
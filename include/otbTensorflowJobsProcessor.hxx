@@ -0,0 +1,218 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWJOBSPROCESSOR_HXX_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWJOBSPROCESSOR_HXX_
+
+#include "otbTensorflowJobsProcessor.h"
+
+namespace otb {
+namespace tf {
+
+template<class TJob>
+JobsProcessor<TJob>::JobsProcessor(StageFunctionType fill, RunFunctionType run, StageFunctionType copy,
+    ProgressFunctionType progress)
+: m_Fill(fill), m_Run(run), m_Copy(copy), m_Progress(progress)
+{
+}
+
+//
+// Process the jobs one after another
+//
+template<class TJob>
+void
+JobsProcessor<TJob>::ProcessSequentially(JobListType & jobs)
+{
+  for (auto& job: jobs)
+  {
+    m_Fill(job);
+    m_Run(job, 0);
+    m_Copy(job);
+
+    // Release the tensors
+    job = TJob();
+
+    m_Progress();
+  }
+}
+
+//
+// Process the jobs with a three stages pipeline:
+// (1) a thread prepares the inputs of the next jobs,
+// (2) a thread runs the current job,
+// (3) the calling thread writes the outputs of the previous jobs.
+//
+template<class TJob>
+void
+JobsProcessor<TJob>::ProcessPipelined(JobListType & jobs, unsigned int depth)
+{
+  BoundedQueue<TJob> inputsQueue(depth);
+  BoundedQueue<TJob> outputsQueue(depth);
+
+  // The first error raised in one stage stops the whole pipeline
+  std::exception_ptr error = nullptr;
+  std::mutex errorMutex;
+  auto abort = [&](std::exception_ptr e)
+  {
+    std::lock_guard<std::mutex> lock(errorMutex);
+    if (!error)
+      error = e;
+    inputsQueue.Close();
+    outputsQueue.Close();
+  };
+
+  // Stage 1: inputs preparation
+  std::thread producer([&]()
+  {
+    try
+    {
+      for (auto& listedJob: jobs)
+      {
+        TJob job = std::move(listedJob);
+        m_Fill(job);
+        if (!inputsQueue.Push(std::move(job)))
+          break;
+      }
+    }
+    catch(...)
+    {
+      abort(std::current_exception());
+    }
+    inputsQueue.Close();
+  });
+
+  // Stage 2: run
+  std::thread runner([&]()
+  {
+    try
+    {
+      TJob job;
+      while (inputsQueue.Pop(job))
+      {
+        m_Run(job, 0);
+        if (!outputsQueue.Push(std::move(job)))
+          break;
+      }
+    }
+    catch(...)
+    {
+      abort(std::current_exception());
+    }
+    outputsQueue.Close();
+  });
+
+  // Stage 3: outputs copy
+  try
+  {
+    TJob job;
+    while (outputsQueue.Pop(job))
+    {
+      m_Copy(job);
+      job = TJob();
+      m_Progress();
+    }
+  }
+  catch(...)
+  {
+    abort(std::current_exception());
+  }
+
+  producer.join();
+  runner.join();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+//
+// Process the jobs over multiple runners.
+// One thread per runner takes the next job, prepares its inputs, runs it and
+// writes its outputs: a runner takes a new job as soon as it is done with the
+// previous one. The outputs of the jobs must be independent.
+//
+template<class TJob>
+void
+JobsProcessor<TJob>::ProcessOnRunners(JobListType & jobs, unsigned int nRunners)
+{
+  std::atomic<std::size_t> nextJob(0);
+  std::size_t nDone = 0;
+  std::mutex doneMutex;
+  std::condition_variable doneCondition;
+
+  // The first error raised by one runner stops all the workers
+  std::exception_ptr error = nullptr;
+  std::atomic<bool> failed(false);
+
+  std::vector<std::thread> workers;
+  for (unsigned int runnerIndex = 0 ; runnerIndex < nRunners ; runnerIndex++)
+  {
+    workers.push_back(std::thread([&, runnerIndex]()
+    {
+      try
+      {
+        for (std::size_t k = nextJob++ ; k < jobs.size() && !failed ; k = nextJob++)
+        {
+          TJob & job = jobs[k];
+          m_Fill(job);
+          m_Run(job, runnerIndex);
+          m_Copy(job);
+          job = TJob();
+
+          std::lock_guard<std::mutex> lock(doneMutex);
+          nDone++;
+          doneCondition.notify_one();
+        }
+      }
+      catch(...)
+      {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        if (!error)
+          error = std::current_exception();
+        failed = true;
+        doneCondition.notify_one();
+      }
+    }));
+  }
+
+  // Report the progress from the calling thread
+  try
+  {
+    std::size_t nReported = 0;
+    while (nReported < jobs.size())
+    {
+      std::unique_lock<std::mutex> lock(doneMutex);
+      doneCondition.wait(lock, [&]{ return failed || nDone > nReported; });
+      if (failed)
+        break;
+      const std::size_t n = nDone;
+      lock.unlock();
+      for ( ; nReported < n ; nReported++)
+        m_Progress();
+    }
+  }
+  catch(...)
+  {
+    std::lock_guard<std::mutex> lock(doneMutex);
+    if (!error)
+      error = std::current_exception();
+    failed = true;
+  }
+
+  for (auto& worker: workers)
+    worker.join();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+} // end namespace tf
+} // end namespace otb
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWJOBSPROCESSOR_HXX_ */
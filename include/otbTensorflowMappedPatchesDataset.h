@@ -0,0 +1,62 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWMAPPEDPATCHESDATASET_H_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWMAPPEDPATCHESDATASET_H_
+
+// Dataset
+#include "otbTensorflowPatchesDataset.h"
+
+// Tensorflow (memory-mapped files)
+#include "tensorflow/core/platform/env.h"
+
+// STD
+#include <memory>
+
+namespace otb {
+namespace tf {
+
+/*
+ * This is a samples dataset read from a memory-mapped file.
+ * The file is mapped with the tensorflow environment, and stays mapped as
+ * long as the dataset lives.
+ */
+template<class TImage>
+class MappedPatchesDataset : public PatchesDataset<TImage>
+{
+public:
+
+  MappedPatchesDataset() {};
+  virtual ~MappedPatchesDataset() {};
+
+  // Open (memory-map) a dataset file
+  void Open(const std::string & fileName)
+  {
+    tensorflow::Status status =
+        tensorflow::Env::Default()->NewReadOnlyMemoryRegionFromFile(fileName, &m_Region);
+    if (!status.ok())
+    {
+      itkGenericExceptionMacro("Unable to map the dataset file " << fileName << ": " << status.ToString());
+    }
+    this->SetData(static_cast<const char*>(m_Region->data()), m_Region->length(), fileName);
+  }
+
+private:
+  MappedPatchesDataset(const MappedPatchesDataset&); //purposely not implemented
+  void operator=(const MappedPatchesDataset&); //purposely not implemented
+
+  std::unique_ptr<tensorflow::ReadOnlyMemoryRegion> m_Region; // Mapped file
+
+};
+
+} // end namespace tf
+} // end namespace otb
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWMAPPEDPATCHESDATASET_H_ */
@@ -0,0 +1,119 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include "otbTensorflowModelRegistry.h"
+
+// STD
+#include <sstream>
+
+namespace otb {
+namespace tf {
+
+//
+// The registry of the process
+//
+ModelRegistry & ModelRegistry::GetInstance()
+{
+  static ModelRegistry registry;
+  return registry;
+}
+
+//
+// Key of a model: the sessions of two configurations differ, so they
+// are different models
+//
+ModelRegistry::KeyType ModelRegistry::CreateKey(const std::string & path, const SessionConfig & config)
+{
+  std::stringstream ss;
+  ss << config.m_IntraOpThreads << "," << config.m_InterOpThreads << "," << config.m_AllowGrowth << "," <<
+      config.m_MemoryFraction << "," << config.m_XLA << "," << config.m_OptimizerLevel << "," << config.m_Trace << "," <<
+      config.m_VisibleDevices;
+  return KeyType(tensorflow::io::CleanPath(path), ss.str());
+}
+
+//
+// Get a model, loading it if it is not resident.
+// The lock is kept during the loading, so that a model requested by two
+// threads is loaded once.
+//
+ModelRegistry::ModelPointerType ModelRegistry::Get(const std::string & path, const SessionConfig & config)
+{
+  const KeyType key = CreateKey(path, config);
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto it = m_Models.find(key);
+  if (it != m_Models.end())
+    return it->second;
+
+  ModelPointerType model = std::make_shared<ModelType>();
+  LoadModel(key.first, model->m_Bundle, config);
+  model->m_Index = IndexNodes(model->m_Bundle.meta_graph_def.graph_def());
+  m_Models[key] = model;
+  return model;
+}
+
+//
+// Get the session of a model on a device.
+// The session is created once (restoring the variables of the model on the
+// device), and kept with the model.
+//
+tensorflow::Session * ModelRegistry::GetSession(const std::string & path, const std::string & device,
+    const SessionConfig & config)
+{
+  ModelPointerType model = Get(path, config);
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::unique_ptr<tensorflow::Session> & session = model->m_DevicesSessions[device];
+  if (!session)
+    CreateSessionOnDevice(CreateKey(path, config).first, model->m_Bundle, device, session, config);
+  return session.get();
+}
+
+//
+// Check if a model is resident
+//
+bool ModelRegistry::IsResident(const std::string & path, const SessionConfig & config) const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Models.count(CreateKey(path, config)) > 0;
+}
+
+//
+// Release a model
+//
+void ModelRegistry::Release(const std::string & path, const SessionConfig & config)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Models.erase(CreateKey(path, config));
+}
+
+//
+// Release all the models
+//
+void ModelRegistry::Clear()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Models.clear();
+}
+
+//
+// Directories of the resident models
+//
+std::vector<std::string> ModelRegistry::GetResidentModels() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::vector<std::string> paths;
+  for (auto const& entry: m_Models)
+    paths.push_back(entry.first.first);
+  return paths;
+}
+
+} // end namespace tf
+} // end namespace otb
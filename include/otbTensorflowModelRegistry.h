@@ -0,0 +1,94 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWMODELREGISTRY_H_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWMODELREGISTRY_H_
+
+// Tensorflow helpers
+#include "otbTensorflowGraphOperations.h"
+
+// STD
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace otb {
+namespace tf {
+
+/*
+ * This class keeps the SavedModel bundles resident in the process, keyed by
+ * model directory and session configuration.
+ * The first request of a model loads it (LoadModel()) and indexes the nodes
+ * of its graph. The next requests (e.g. successive executions of the
+ * applications from python, or chained applications) get the same bundle,
+ * without loading the model again.
+ * The sessions of a model on the devices (CreateSessionOnDevice()) are kept
+ * with the model, so that they are created once too.
+ * The models stay loaded until they are released (Release() or Clear()), or
+ * until the end of the process. The sessions can be run concurrently.
+ * All the methods are thread safe.
+ */
+class ModelRegistry
+{
+public:
+
+  /* A resident model */
+  struct ModelType
+  {
+    tensorflow::SavedModelBundle m_Bundle;  // Session and graph
+    NodesIndexType               m_Index;   // Index of the nodes of the graph
+    std::map<std::string, std::unique_ptr<tensorflow::Session>> m_DevicesSessions; // Sessions on the devices
+  };
+  typedef std::shared_ptr<ModelType> ModelPointerType;
+
+  // The registry of the process
+  static ModelRegistry & GetInstance();
+
+  // Get a model, loading it if it is not resident
+  ModelPointerType Get(const std::string & path, const SessionConfig & config = SessionConfig());
+
+  // Get the session of a model on a device, loading the model and creating the session if needed
+  tensorflow::Session * GetSession(const std::string & path, const std::string & device,
+      const SessionConfig & config = SessionConfig());
+
+  // Check if a model is resident
+  bool IsResident(const std::string & path, const SessionConfig & config = SessionConfig()) const;
+
+  // Release a model (it is unloaded once no one uses it anymore)
+  void Release(const std::string & path, const SessionConfig & config = SessionConfig());
+
+  // Release all the models
+  void Clear();
+
+  // Directories of the resident models
+  std::vector<std::string> GetResidentModels() const;
+
+private:
+  ModelRegistry() {};
+  ModelRegistry(const ModelRegistry&); //purposely not implemented
+  void operator=(const ModelRegistry&); //purposely not implemented
+
+  // Key of a model: its directory and its session configuration
+  typedef std::pair<std::string, std::string> KeyType;
+  static KeyType CreateKey(const std::string & path, const SessionConfig & config);
+
+  mutable std::mutex                   m_Mutex;
+  std::map<KeyType, ModelPointerType>  m_Models;   // Resident models
+
+};
+
+} // end namespace tf
+} // end namespace otb
+
+#include "otbTensorflowModelRegistry.cxx"
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWMODELREGISTRY_H_ */
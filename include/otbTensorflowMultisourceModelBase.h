@@ -24,6 +24,10 @@
 #include "otbTensorflowDataTypeBridge.h"
 #include "otbTensorflowCopyUtils.h"
 #include "otbTensorflowCommon.h"
+#include "otbTensorflowProfiler.h"
+
+// STD
+#include <functional>
 
 namespace otb
 {
@@ -36,6 +40,11 @@ namespace otb
  * Names of input placeholders must be specified using the
  * SetInputPlaceholdersNames method
  *
+ * The timings of the processing stages can be collected with a profiler
+ * (see SetProfiler()). The step stats of each session run can be collected
+ * with a callback (see SetRunMetadataCallback()): the sessions are then run
+ * with a full trace, which slows them down.
+ *
  *
  * \ingroup OTBTensorflow
  */
@@ -76,9 +85,10 @@ public:
   typedef std::vector<tensorflow::DataType>          DataTypeListType;
   typedef std::vector<tensorflow::TensorShapeProto>  TensorShapeProtoList;
   typedef std::vector<tensorflow::Tensor>            TensorListType;
+  typedef std::function<void(const tensorflow::RunMetadata &)> RunMetadataCallbackType;
 
   /** Set and Get the Tensorflow session and graph */
-  void SetGraph(tensorflow::GraphDef graph)      { m_Graph = graph;     }
+  void SetGraph(const tensorflow::GraphDef & graph) { m_Graph = graph; m_NodesIndex = tf::IndexNodes(m_Graph); }
   tensorflow::GraphDef GetGraph()                { return m_Graph ;     }
   void SetSession(tensorflow::Session * session) { m_Session = session; }
   tensorflow::Session * GetSession()             { return m_Session;    }
@@ -96,6 +106,11 @@ public:
   itkSetMacro(TargetNodesNames, StringList);
   itkGetMacro(TargetNodesNames, StringList);
 
+  /** Instrumentation */
+  void SetProfiler(tf::Profiler * profiler)   { m_Profiler = profiler; }
+  tf::Profiler * GetProfiler() const          { return m_Profiler; }
+  void SetRunMetadataCallback(RunMetadataCallbackType callback) { m_RunMetadataCallback = callback; }
+
   /** Read only methods */
   itkGetMacro(InputTensorsDataTypes, DataTypeListType);
   itkGetMacro(OutputTensorsDataTypes, DataTypeListType);
@@ -109,6 +124,7 @@ protected:
   virtual ~TensorflowMultisourceModelBase() {};
 
   virtual void RunSession(DictListType & inputs, TensorListType & outputs);
+  virtual void RunSession(DictListType & inputs, TensorListType & outputs, tensorflow::Session * session);
 
 private:
   TensorflowMultisourceModelBase(const Self&); //purposely not implemented
@@ -116,6 +132,7 @@ private:
 
   // Tensorflow graph and session
   tensorflow::GraphDef       m_Graph;                   // The tensorflow graph
+  tf::NodesIndexType         m_NodesIndex;              // Index of the nodes of the graph
   tensorflow::Session *      m_Session;                 // The tensorflow session
 
   // Model parameters
@@ -125,6 +142,10 @@ private:
   StringList                 m_OutputTensorsNames;      // User tensors
   StringList                 m_TargetNodesNames;        // User target tensors
 
+  // Instrumentation
+  tf::Profiler *             m_Profiler;                // Stages timings (can be null)
+  RunMetadataCallbackType    m_RunMetadataCallback;     // Called with the metadata of each run (can be empty)
+
   // Read-only
   DataTypeListType           m_InputTensorsDataTypes;   // Input tensors datatype
   DataTypeListType           m_OutputTensorsDataTypes;  // Output tensors datatype
@@ -20,6 +20,7 @@ template <class TInputImage, class TOutputImage>
 TensorflowMultisourceModelBase<TInputImage, TOutputImage>
 ::TensorflowMultisourceModelBase()
  {
+  m_Profiler = nullptr;
  }
 
 template <class TInputImage, class TOutputImage>
@@ -36,6 +37,17 @@ template <class TInputImage, class TOutputImage>
 void
 TensorflowMultisourceModelBase<TInputImage, TOutputImage>
 ::RunSession(DictListType & inputs, TensorListType & outputs)
+ {
+  RunSession(inputs, outputs, this->GetSession());
+ }
+
+/*
+ * Run the given session (which must be a session of the graph of the filter)
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelBase<TInputImage, TOutputImage>
+::RunSession(DictListType & inputs, TensorListType & outputs, tensorflow::Session * session)
  {
 
   // Add the user's placeholders
@@ -48,7 +60,23 @@ TensorflowMultisourceModelBase<TInputImage, TOutputImage>
   // The session will initialize the outputs
 
   // Run the session, evaluating our output tensors from the graph
-  auto status = this->GetSession()->Run(inputs, m_OutputTensorsNames, m_TargetNodesNames, &outputs);
+  tensorflow::Status status;
+  if (m_RunMetadataCallback)
+    {
+    // Collect the step stats of the run
+    tensorflow::RunOptions runOptions;
+    runOptions.set_trace_level(tensorflow::RunOptions_TraceLevel_FULL_TRACE);
+    tensorflow::RunMetadata runMetadata;
+    status = session->Run(runOptions, inputs, m_OutputTensorsNames, m_TargetNodesNames, &outputs, &runMetadata);
+    if (status.ok())
+      {
+      m_RunMetadataCallback(runMetadata);
+      }
+    }
+  else
+    {
+    status = session->Run(inputs, m_OutputTensorsNames, m_TargetNodesNames, &outputs);
+    }
   if (!status.ok()) {
 
     // Create a debug report
@@ -108,8 +136,9 @@ TensorflowMultisourceModelBase<TInputImage, TOutputImage>
   //////////////////////////////////////////////////////////////////////////////////////////
 
   // Get input and output tensors datatypes and shapes
-  tf::GetTensorAttributes(m_Graph, m_InputPlaceholdersNames, m_InputTensorsShapes, m_InputTensorsDataTypes);
-  tf::GetTensorAttributes(m_Graph, m_OutputTensorsNames, m_OutputTensorsShapes, m_OutputTensorsDataTypes);
+  // (the nodes are indexed once, when the graph is set)
+  tf::GetTensorAttributes(m_Graph, m_NodesIndex, m_InputPlaceholdersNames, m_InputTensorsShapes, m_InputTensorsDataTypes);
+  tf::GetTensorAttributes(m_Graph, m_NodesIndex, m_OutputTensorsNames, m_OutputTensorsShapes, m_OutputTensorsDataTypes);
 
  }
 
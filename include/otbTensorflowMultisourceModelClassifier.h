@@ -0,0 +1,123 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTensorflowMultisourceModelClassifier_h
+#define otbTensorflowMultisourceModelClassifier_h
+
+// Model filter
+#include "otbTensorflowMultisourceModelFilter.h"
+
+// Machine learning model
+#include "otbMachineLearningModel.h"
+
+// STD
+#include <vector>
+
+namespace otb
+{
+
+/**
+ * \class TensorflowMultisourceModelClassifier
+ * \brief This filter classifies the deep features of a TensorFlow model with
+ * an OTB machine learning model, in one single pass.
+ *
+ * The filter runs the TensorFlow model like the
+ * TensorflowMultisourceModelFilter. The values of the output tensors of each
+ * tile job are the features of the pixels: they are gathered from the tensors
+ * buffers, normalized (see SetFeaturesShifts() and SetFeaturesScales(), the
+ * features are (x - shift) / scale), and predicted in batch by the machine
+ * learning model. The features image is never produced.
+ *
+ * The output image has one component (the label), and a second one with the
+ * confidence of the prediction when SetComputeConfidence() is on.
+ *
+ * \ingroup OTBTensorflow
+ */
+template <class TInputImage, class TOutputImage=TInputImage>
+class ITK_EXPORT TensorflowMultisourceModelClassifier :
+public TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+{
+
+public:
+
+  /** Standard class typedefs. */
+  typedef TensorflowMultisourceModelClassifier                        Self;
+  typedef TensorflowMultisourceModelFilter<TInputImage, TOutputImage> Superclass;
+  typedef itk::SmartPointer<Self>                                     Pointer;
+  typedef itk::SmartPointer<const Self>                               ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(TensorflowMultisourceModelClassifier, TensorflowMultisourceModelFilter);
+
+  /** Images typedefs */
+  typedef typename Superclass::RegionType          RegionType;
+  typedef typename Superclass::SizeType            SizeType;
+  typedef typename Superclass::IndexType           IndexType;
+  typedef typename Superclass::IndexValueType      IndexValueType;
+  typedef typename Superclass::OutputImageType     OutputImageType;
+  typedef typename Superclass::OutputInternalPixelType OutputInternalPixelType;
+  typedef typename Superclass::TileJob             TileJob;
+
+  /** Machine learning model typedefs */
+  typedef float                                          ValueType;
+  typedef unsigned int                                   LabelType;
+  typedef otb::MachineLearningModel<ValueType, LabelType> ModelType;
+  typedef typename ModelType::Pointer                    ModelPointerType;
+  typedef typename ModelType::InputSampleType            SampleType;
+  typedef typename ModelType::InputListSampleType        ListSampleType;
+  typedef typename ModelType::TargetListSampleType       LabelListSampleType;
+  typedef typename ModelType::ConfidenceListSampleType   ConfidenceListSampleType;
+
+  /** Machine learning model */
+  itkSetObjectMacro(Model, ModelType);
+  itkGetObjectMacro(Model, ModelType);
+
+  /** Normalization of the features (empty: no normalization) */
+  void SetFeaturesShifts(const SampleType & shifts) { m_FeaturesShifts = shifts; this->Modified(); }
+  void SetFeaturesScales(const SampleType & scales) { m_FeaturesScales = scales; this->Modified(); }
+
+  /** Add the confidence of the prediction as a second output component */
+  itkSetMacro(ComputeConfidence, bool);
+  itkGetMacro(ComputeConfidence, bool);
+
+  /** Number of features (i.e. number of values of the output tensors for one pixel) */
+  itkGetMacro(NumberOfFeatures, unsigned int);
+
+protected:
+  TensorflowMultisourceModelClassifier();
+  virtual ~TensorflowMultisourceModelClassifier() {};
+
+  virtual void GenerateOutputInformation(void);
+
+  virtual void CopyOutputTensors(TileJob &job);
+  virtual void GatherFeatures(const TileJob &job, const RegionType &bufferRegion, tensorflow::int64 bufferOffset,
+      const RegionType &outputRegion, ListSampleType * samples);
+
+private:
+  TensorflowMultisourceModelClassifier(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  ModelPointerType           m_Model;              // Machine learning model
+  SampleType                 m_FeaturesShifts;     // Features shifts (e.g. mean)
+  SampleType                 m_FeaturesScales;     // Features scales (e.g. standard deviation)
+  bool                       m_ComputeConfidence;  // Second output component: confidence
+  unsigned int               m_NumberOfFeatures;   // Number of values of the output tensors for one pixel
+
+}; // end class
+
+
+} // end namespace otb
+
+#include "otbTensorflowMultisourceModelClassifier.hxx"
+
+#endif
@@ -0,0 +1,198 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTensorflowMultisourceModelClassifier_txx
+#define otbTensorflowMultisourceModelClassifier_txx
+
+#include "otbTensorflowMultisourceModelClassifier.h"
+
+namespace otb
+{
+
+template <class TInputImage, class TOutputImage>
+TensorflowMultisourceModelClassifier<TInputImage, TOutputImage>
+::TensorflowMultisourceModelClassifier()
+ {
+  m_ComputeConfidence = false;
+  m_NumberOfFeatures = 0;
+ }
+
+/*
+ * The output tensors give the features. The output image only has the
+ * label (and the confidence).
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelClassifier<TInputImage, TOutputImage>
+::GenerateOutputInformation()
+ {
+  Superclass::GenerateOutputInformation();
+
+  if (m_Model.IsNull())
+    {
+    itkExceptionMacro("No machine learning model is set");
+    }
+
+  OutputImageType * outputPtr = this->GetOutput();
+  m_NumberOfFeatures = outputPtr->GetNumberOfComponentsPerPixel();
+  if (m_FeaturesShifts.Size() > 0 && m_FeaturesShifts.Size() != m_NumberOfFeatures)
+    {
+    itkExceptionMacro("The model produces " << m_NumberOfFeatures << " features, but there are " <<
+                      m_FeaturesShifts.Size() << " features shifts");
+    }
+  if (m_FeaturesScales.Size() > 0 && m_FeaturesScales.Size() != m_NumberOfFeatures)
+    {
+    itkExceptionMacro("The model produces " << m_NumberOfFeatures << " features, but there are " <<
+                      m_FeaturesScales.Size() << " features scales");
+    }
+
+  outputPtr->SetNumberOfComponentsPerPixel(m_ComputeConfidence ? 2 : 1);
+ }
+
+/*
+ * Gather the features of the pixels of the output region from the output
+ * tensors of the job. The buffer region starts at the bufferOffset-th
+ * element of the tensors (a pixel, or a block in patch-based mode).
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelClassifier<TInputImage, TOutputImage>
+::GatherFeatures(const TileJob &job, const RegionType &bufferRegion, tensorflow::int64 bufferOffset,
+    const RegionType &outputRegion, ListSampleType * samples)
+ {
+  const SizeType blockSize = this->GetPatchesBlockSize();
+  const tensorflow::int64 nBlockCols = bufferRegion.GetSize(0) / blockSize[0];
+  const tensorflow::int64 blockPixels = blockSize[0] * blockSize[1];
+
+  // Position of the pixels of the output region in the tensors (in pixels)
+  std::vector<tensorflow::int64> pixels;
+  pixels.reserve(outputRegion.GetNumberOfPixels());
+  const IndexType start = outputRegion.GetIndex();
+  for (IndexValueType y = start[1] ; y < start[1] + (IndexValueType) outputRegion.GetSize(1) ; y++)
+    {
+    const tensorflow::int64 by = y - bufferRegion.GetIndex(1);
+    for (IndexValueType x = start[0] ; x < start[0] + (IndexValueType) outputRegion.GetSize(0) ; x++)
+      {
+      const tensorflow::int64 bx = x - bufferRegion.GetIndex(0);
+      const tensorflow::int64 block = bufferOffset + (by / blockSize[1]) * nBlockCols + bx / blockSize[0];
+      pixels.push_back(block * blockPixels + (by % blockSize[1]) * blockSize[0] + bx % blockSize[0]);
+      }
+    }
+
+  // Features of the pixels, one pixel after another
+  std::vector<float> features(pixels.size() * m_NumberOfFeatures);
+  std::size_t featureOffset = 0;
+  for (auto const& output: job.m_Outputs)
+    {
+    tf::GatherPixelsValues(output, pixels, features.data() + featureOffset, m_NumberOfFeatures);
+    featureOffset += tf::GetNumberOfChannelsForOutputTensor(output);
+    }
+
+  // Samples
+  samples->SetMeasurementVectorSize(m_NumberOfFeatures);
+  SampleType sample(m_NumberOfFeatures);
+  for (std::size_t k = 0 ; k < pixels.size() ; k++)
+    {
+    const float * values = features.data() + k * m_NumberOfFeatures;
+    for (unsigned int f = 0 ; f < m_NumberOfFeatures ; f++)
+      {
+      ValueType value = values[f];
+      if (m_FeaturesShifts.Size() > 0)
+        value -= m_FeaturesShifts[f];
+      if (m_FeaturesScales.Size() > 0 && m_FeaturesScales[f] != 0)
+        value /= m_FeaturesScales[f];
+      sample[f] = value;
+      }
+    samples->PushBack(sample);
+    }
+ }
+
+/*
+ * Classify the features of the output tensors of the job, and write the
+ * labels (and the confidences) in the output image
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelClassifier<TInputImage, TOutputImage>
+::CopyOutputTensors(TileJob &job)
+ {
+  // Output pointer and requested region
+  typename TOutputImage::Pointer outputPtr = this->GetOutput();
+  const RegionType outputReqRegion = outputPtr->GetRequestedRegion();
+
+  tf::ScopedStageTimer timer(this->GetProfiler(), "classify", job.m_Index);
+  tensorflow::uint64 nBytes = 0;
+  for (auto const& output: job.m_Outputs)
+    nBytes += output.TotalBytes();
+  timer.SetBytes(nBytes);
+
+  // Check the output tensors sizes
+  tensorflow::int64 nPixels = 0;
+  for (auto const& region: job.m_Regions)
+    nPixels += region.GetNumberOfPixels();
+  for (auto const& output: job.m_Outputs)
+    {
+    std::stringstream description;
+    description << "Batch of " << job.m_Regions.size() << " tile(s). First buffer region:\n" << job.m_Regions[0];
+    tf::CheckTensorNumberOfElements(output, nPixels, description.str());
+    }
+
+  // Gather the features of all the tiles, to predict them in one batch
+  const SizeType blockSize = this->GetPatchesBlockSize();
+  typename ListSampleType::Pointer samples = ListSampleType::New();
+  std::vector<RegionType> outputRegions;
+  tensorflow::int64 bufferOffset = 0;
+  for (auto const& region: job.m_Regions)
+    {
+    RegionType outputRegion(region);
+    if (outputRegion.Crop(outputReqRegion))
+      {
+      GatherFeatures(job, region, bufferOffset, outputRegion, samples.GetPointer());
+      outputRegions.push_back(outputRegion);
+      }
+    bufferOffset += region.GetNumberOfPixels() / (blockSize[0] * blockSize[1]);
+    }
+  if (samples->Size() == 0)
+    return;
+
+  // Predict
+  typename ConfidenceListSampleType::Pointer confidences;
+  if (m_ComputeConfidence)
+    {
+    confidences = ConfidenceListSampleType::New();
+    }
+  typename LabelListSampleType::Pointer labels = m_Model->PredictBatch(samples, confidences.GetPointer());
+
+  // Write the labels and the confidences
+  typename ListSampleType::InstanceIdentifier sampleId = 0;
+  for (auto const& outputRegion: outputRegions)
+    {
+    itk::ImageRegionIterator<TOutputImage> outIt(outputPtr, outputRegion);
+    for (outIt.GoToBegin(); !outIt.IsAtEnd(); ++outIt, ++sampleId)
+      {
+      outIt.Get()[0] = static_cast<OutputInternalPixelType>(labels->GetMeasurementVector(sampleId)[0]);
+      if (m_ComputeConfidence)
+        outIt.Get()[1] = static_cast<OutputInternalPixelType>(confidences->GetMeasurementVector(sampleId)[0]);
+      }
+    if (this->IsMaskingEnabled())
+      {
+      this->FillExcludedPixels(outputRegion);
+      }
+    if (this->GetProfiler())
+      {
+      this->GetProfiler()->AddPixels(outputRegion.GetNumberOfPixels());
+      }
+    }
+ }
+
+} // end namespace otb
+
+
+#endif
@@ -20,6 +20,19 @@
 #include "otbTensorflowGraphOperations.h"
 #include "otbTensorflowDataTypeBridge.h"
 #include "otbTensorflowCopyUtils.h"
+#include "otbTensorflowHaloCache.h"
+
+// Processing of the tile jobs
+#include "otbTensorflowJobsProcessor.h"
+
+// Patches extraction graph
+#include "tensorflow/cc/framework/scope.h"
+#include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/core/framework/tensor_util.h"
+#include <memory>
+
+// Masking
+#include <map>
 
 namespace otb
 {
@@ -82,6 +95,8 @@ public:
   typedef typename Superclass::PointType           PointType;
   typedef typename Superclass::SizeType            SizeType;
   typedef typename SizeType::SizeValueType         SizeValueType;
+  typedef typename ImageType::OffsetType           OffsetType;
+  typedef typename OffsetType::OffsetValueType     OffsetValueType;
   typedef typename Superclass::SpacingType         SpacingType;
   typedef typename Superclass::RegionType          RegionType;
 
@@ -100,7 +115,12 @@ public:
   typedef typename Superclass::DictListType        DictListType;
   typedef typename Superclass::TensorListType      TensorListType;
   typedef std::vector<float>                       ScaleListType;
+  typedef std::vector<RegionType>                  RegionListType;
+  typedef std::vector<IndexValueType>              IndexListType;
+  typedef std::vector<tensorflow::Session*>        SessionListType;
+  typedef std::map<unsigned int, double>           NoDataMapType;
 
+  /** Output field of expression (FOE). In patch-based mode, each patch produces one FOE block. */
   itkSetMacro(OutputFOESize, SizeType);
   itkGetMacro(OutputFOESize, SizeType);
   itkSetMacro(OutputGridSize, SizeType);
@@ -112,7 +132,76 @@ public:
   itkSetMacro(OutputSpacingScale, float);
   itkGetMacro(OutputSpacingScale, float);
 
+  /** Size of the tiles processed in GenerateData (0: no split), and depth of the tiles pipeline (0: sequential) */
+  itkSetMacro(InternalTileSize, SizeType);
+  itkGetMacro(InternalTileSize, SizeType);
+  itkSetMacro(PipelineDepth, unsigned int);
+  itkGetMacro(PipelineDepth, unsigned int);
+
+  /** Max. number of elements, and max. size (MB) of the input tensors, of a batch of tiles (0: no limit) */
+  itkSetMacro(TargetBatchSize, unsigned int);
+  itkGetMacro(TargetBatchSize, unsigned int);
+  itkSetMacro(BatchMemoryBudget, unsigned int);
+  itkGetMacro(BatchMemoryBudget, unsigned int);
+
+  /** Extract the patches with an ExtractImagePatches graph (patch-based mode) */
+  itkSetMacro(InGraphPatchExtraction, bool);
+  itkGetMacro(InGraphPatchExtraction, bool);
+
+  /** Reuse the input halos of the previous output regions (requested in raster order) */
+  itkSetMacro(HaloCache, bool);
+  itkGetMacro(HaloCache, bool);
+
+  /** Value of the output pixels excluded by the mask or by the nodata values */
+  itkSetMacro(FillValue, OutputInternalPixelType);
+  itkGetMacro(FillValue, OutputInternalPixelType);
+
+  /** Quantization of the output values: out = in * scale + shift, rounded and clamped */
+  itkSetMacro(OutputScale, double);
+  itkGetMacro(OutputScale, double);
+  itkSetMacro(OutputShift, double);
+  itkGetMacro(OutputShift, double);
+  itkSetMacro(OutputRound, bool);
+  itkGetMacro(OutputRound, bool);
+  itkSetMacro(OutputMinimum, double);
+  itkGetMacro(OutputMinimum, double);
+  itkSetMacro(OutputMaximum, double);
+  itkGetMacro(OutputMaximum, double);
+
+  /** Mask of the output pixels to process (the pixels where the mask is 0 are excluded) */
+  void SetMask(ImageType * mask)              { m_Mask = mask; this->Modified(); }
+  ImageType * GetMask()                       { return m_Mask.GetPointer(); }
+
+  /** Nodata values of the inputs */
+  void SetInputNoData(unsigned int inputIndex, double value) { m_InputsNoData[inputIndex] = value; this->Modified(); }
+  void ClearInputsNoData()                    { m_InputsNoData.clear(); this->Modified(); }
+  NoDataMapType GetInputsNoData() const       { return m_InputsNoData; }
+
+  /** Sessions used to process the tiles concurrently (e.g. one per device) */
+  void SetSessions(const SessionListType & sessions) { m_Sessions = sessions; this->Modified(); }
+  SessionListType GetSessions() const                { return m_Sessions; }
+
+  /** Number of tiles of the given size that are grouped into one batch */
+  virtual unsigned int GetNumberOfTilesPerBatch(const SizeType &tileSize);
+
+  /** Largest squared tile, aligned on the output grid, whose tensors fit in the memory budget (MB) */
+  virtual SizeType ComputeTileSizeFromMemoryBudget(unsigned int memoryBudget);
+
 protected:
+
+  /** One unit of work: a batch of aligned output regions, and the related tensors */
+  struct TileJob
+  {
+    tensorflow::uint64       m_Index;   // Index of the job (for the profiler)
+    RegionListType           m_Regions; // Aligned output regions
+    DictListType             m_Inputs;  // Input tensors
+    TensorListType           m_Outputs; // Output tensors
+  };
+  typedef std::vector<TileJob>                     TileJobListType;
+
+  /** Cached input halos of one input image */
+  typedef tf::HaloCache<TInputImage>               HaloCacheType;
+
   TensorflowMultisourceModelFilter();
   virtual ~TensorflowMultisourceModelFilter() {};
 
@@ -121,11 +210,44 @@ protected:
   virtual void ImageToExtent(ImageType* image, PointType &extentInf, PointType &extentSup, SizeType &patchSize);
   virtual bool OutputRegionToInputRegion(const RegionType &outputRegion, RegionType &inputRegion, ImageType* &inputImage);
   virtual void EnlargeToAlignedRegion(RegionType& region);
+  virtual void ComputeInputRegion(unsigned int inputIndex, const RegionType &outputAlignedRegion, RegionType &inputRegion);
+  virtual void SplitAlignedRegion(const RegionType &alignedRegion, RegionListType &tiles);
+  virtual void ComputeTileCost(const RegionType &tile, tensorflow::uint64 &nElements, tensorflow::uint64 &nBytes);
+  virtual tensorflow::uint64 ComputeTileMemoryFootprint(const RegionType &tile);
+  virtual void GroupTilesIntoJobs(const RegionListType &tiles, TileJobListType &jobs);
+
+  virtual bool IsMaskingEnabled() const;
+  virtual void MapOutputAxisToInput(const RegionType &outputRegion, const ImageType * inputImage, unsigned int dim,
+      IndexListType &centers, IndexListType &first, IndexListType &last);
+  virtual void ComputeValidPixels(const RegionType &outputAlignedRegion);
+  virtual tensorflow::uint64 CountValidPixels(const RegionType &region) const;
+  virtual void MaskTiles(RegionListType &tiles);
+  virtual void FillExcludedPixels(const RegionType &outputRegion);
+
+  virtual tf::QuantizationType GetOutputQuantization() const;
+
+  virtual SizeType GetPatchesBlockSize();
+  virtual OffsetType ComputePatchOffset(unsigned int inputIndex);
+  virtual void CreatePatchesExtractionSession();
+  virtual bool ExtractPatches(unsigned int inputIndex, const TileJob &job, tensorflow::Tensor &patches);
+
+  virtual itk::ModifiedTimeType GetHaloModifiedTime(unsigned int inputIndex);
+  virtual void ComputeHaloStrips(unsigned int inputIndex, const RegionType &outputAlignedRegion,
+      const RegionType &inputRegion, RegionType &rightStrip, RegionType &bottomStrip);
+  virtual void PrepareInputs(const RegionType &outputAlignedRegion);
+
+  /** Processing of the tile jobs (timed as "fill", "run" and "copy" stages when a profiler is set) */
+  virtual void FillInputTensors(TileJob &job);
+  virtual void RunJob(TileJob &job, tensorflow::Session * session);
+  virtual void CopyOutputTensors(TileJob &job);
+  virtual void ProcessJobs(TileJobListType &jobs);
 
   virtual void GenerateOutputInformation(void);
 
   virtual void GenerateInputRequestedRegion(void);
 
+  virtual void UpdateOutputData(itk::DataObject *output);
+
   virtual void GenerateData();
 
 private:
@@ -137,12 +259,43 @@ private:
   bool                       m_ForceOutputGridSize;  // Force output grid size
   bool                       m_FullyConvolutional;   // Convolution mode
   float                      m_OutputSpacingScale;   // scaling of the output spacings
+  SizeType                   m_InternalTileSize;     // Size of the tiles processed in GenerateData (0: no split)
+  unsigned int               m_PipelineDepth;        // Depth of the tiles pipeline (0: sequential processing)
+  unsigned int               m_TargetBatchSize;      // Max. number of elements in a batch of tiles (0: no limit)
+  unsigned int               m_BatchMemoryBudget;    // Max. size (MB) of the input tensors of a batch (0: no limit)
+  bool                       m_InGraphPatchExtraction; // Extract the patches with tensorflow (patch-based mode)
+  SessionListType            m_Sessions;             // Sessions used to process the tiles (multiple devices)
+  bool                       m_HaloCache;            // Reuse the input halos of the previous output regions
+  ImagePointerType           m_Mask;                 // Mask of the output pixels to process (can be null)
+  NoDataMapType              m_InputsNoData;         // Nodata values of the inputs
+  OutputInternalPixelType    m_FillValue;            // Value of the excluded output pixels
+  double                     m_OutputScale;          // Quantization of the output values: scale
+  double                     m_OutputShift;          // Quantization of the output values: shift
+  bool                       m_OutputRound;          // Quantization of the output values: rounding
+  double                     m_OutputMinimum;        // Quantization of the output values: lower bound
+  double                     m_OutputMaximum;        // Quantization of the output values: upper bound
 
   // Internal
   SpacingType                m_OutputSpacing;     // Output image spacing
   PointType                  m_OutputOrigin;      // Output image origin
   SizeType                   m_OutputSize;        // Output image size
 
+  // Patches extraction
+  std::unique_ptr<tensorflow::Session> m_PatchesSession; // Session of the patches extraction graph
+  SizeListType               m_PatchesStrides;    // Strides of the patches, for each input (0: no in-graph extraction)
+
+  // Masking
+  RegionType                 m_ValidRegion;       // Region of m_ValidPixels
+  std::vector<char>          m_ValidPixels;       // Output pixels to process, over m_ValidRegion
+
+  // Halo cache
+  std::vector<HaloCacheType>    m_HaloCaches;      // Pieces of the input regions, for each input
+
+  // Instrumentation
+  tf::Profiler::TimePointType m_UpdateStartTime;  // Start of the upstream pipeline update
+  tensorflow::uint64         m_NumberOfRegions;   // Number of regions generated so far
+  tensorflow::uint64         m_NumberOfJobs;      // Number of jobs processed so far
+
 }; // end class
 
 
@@ -30,6 +30,22 @@ TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
 
   m_OutputSpacingScale = 1.0f;
 
+  m_InternalTileSize.Fill(0);
+  m_PipelineDepth = 0;
+  m_TargetBatchSize = 0;
+  m_BatchMemoryBudget = 0;
+  m_InGraphPatchExtraction = false;
+  m_HaloCache = false;
+  m_FillValue = 0;
+  m_OutputScale = 1.0;
+  m_OutputShift = 0.0;
+  m_OutputRound = false;
+  m_OutputMinimum = -itk::NumericTraits<double>::infinity();
+  m_OutputMaximum = itk::NumericTraits<double>::infinity();
+
+  m_NumberOfRegions = 0;
+  m_NumberOfJobs = 0;
+
   Superclass::SetCoordinateTolerance(itk::NumericTraits<double>::max() );
   Superclass::SetDirectionTolerance(itk::NumericTraits<double>::max() );
  }
@@ -247,6 +263,17 @@ TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
     m_OutputSize[dim] -= m_OutputSize[dim] % m_OutputGridSize[dim];
     }
 
+  // In patch-based mode, each patch produces one FOE block of the output:
+  // the output grid must be made of whole blocks
+  const SizeType blockSize = GetPatchesBlockSize();
+  const bool blocks = (blockSize[0] > 1 || blockSize[1] > 1);
+  for(unsigned int dim = 0; dim<ImageType::ImageDimension; ++dim)
+    {
+    if (m_OutputGridSize[dim] % blockSize[dim] != 0)
+      itkExceptionMacro("Output grid size " << m_OutputGridSize <<
+                        " is not a multiple of the output field of expression " << m_OutputFOESize);
+    }
+
   // Set the largest possible region
   RegionType largestPossibleRegion;
   largestPossibleRegion.SetSize(m_OutputSize);
@@ -289,6 +316,11 @@ TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
       {
       itkExceptionMacro("Dim_size=" << dim_size << " currently not supported.");
       }
+    if (blocks && dim_size != 4)
+      {
+      itkExceptionMacro("In patch-based mode with an output field of expression of " << m_OutputFOESize <<
+                        ", the output tensors must have the shape {n, foe_y, foe_x, c}");
+      }
     outputPixelSize += nComponents;
     }
 
@@ -297,13 +329,642 @@ TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
   const std::string projectionRef = inputImage->GetProjectionRef();
 
   // Set output image origin/spacing/size/projection
-  ImageType * outputPtr = this->GetOutput();
+  OutputImageType * outputPtr = this->GetOutput();
   outputPtr->SetNumberOfComponentsPerPixel(outputPixelSize);
   outputPtr->SetProjectionRef        ( projectionRef      );
   outputPtr->SetOrigin               ( m_OutputOrigin       );
   outputPtr->SetSignedSpacing        ( m_OutputSpacing      );
   outputPtr->SetLargestPossibleRegion( largestPossibleRegion);
 
+  // Mask
+  if (m_Mask.IsNotNull())
+    {
+    m_Mask->UpdateOutputInformation();
+    }
+
+  // Reset the halo cache
+  m_HaloCaches.assign(this->GetNumberOfInputs(), HaloCacheType());
+
+  // Build the patches extraction graph
+  m_PatchesSession.reset();
+  m_PatchesStrides.clear();
+  if (m_InGraphPatchExtraction && !m_FullyConvolutional)
+    {
+    CreatePatchesExtractionSession();
+    }
+
+ }
+
+/*
+ * Return true if some output pixels can be excluded (mask or nodata values)
+ */
+template <class TInputImage, class TOutputImage>
+bool
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::IsMaskingEnabled() const
+ {
+  return m_Mask.IsNotNull() || !m_InputsNoData.empty();
+ }
+
+/*
+ * Map the output pixels of the region to the pixels of the input image along
+ * one axis: the output pixel #k is centered on the input pixel centers[k],
+ * and covers the input pixels first[k] to last[k], whose centers lie in it
+ * (at least the input pixel under its center). The continuous input index
+ * grows by the ratio of the spacings from one output pixel to the next one.
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::MapOutputAxisToInput(const RegionType &outputRegion, const ImageType * inputImage, unsigned int dim,
+    IndexListType &centers, IndexListType &first, IndexListType &last)
+ {
+  typename TOutputImage::Pointer outputPtr = this->GetOutput();
+  PointType point;
+  outputPtr->TransformIndexToPhysicalPoint(outputRegion.GetIndex(), point);
+  itk::ContinuousIndex<double, ImageType::ImageDimension> start;
+  inputImage->TransformPhysicalPointToContinuousIndex(point, start);
+  const double step = outputPtr->GetSignedSpacing()[dim] / inputImage->GetSignedSpacing()[dim];
+  const double halfWidth = 0.5 * std::abs(step);
+
+  const SizeValueType n = outputRegion.GetSize(dim);
+  centers.resize(n);
+  first.resize(n);
+  last.resize(n);
+  for (SizeValueType k = 0 ; k < n ; k++)
+    {
+    const double center = start[dim] + k * step;
+    centers[k] = static_cast<IndexValueType>(std::floor(center + 0.5));
+    first[k] = static_cast<IndexValueType>(std::ceil(center - halfWidth));
+    last[k] = static_cast<IndexValueType>(std::ceil(center + halfWidth)) - 1;
+    if (last[k] < first[k])
+      first[k] = last[k] = centers[k];
+    }
+ }
+
+/*
+ * Compute which pixels of the aligned output region have to be processed.
+ * A pixel is excluded when the mask is 0 at its center (or when its center
+ * lies outside of the mask), or when, for an input with a nodata value, all
+ * the bands of all the input pixels of its footprint are nodata. The
+ * footprint of an output pixel is the set of input pixels whose centers lie
+ * in it (at least the input pixel under its center). The nodata footprints
+ * are tested with a summed area table of the valid input pixels. The inputs
+ * must be up to date.
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::ComputeValidPixels(const RegionType &outputAlignedRegion)
+ {
+  m_ValidRegion = outputAlignedRegion;
+  m_ValidPixels.assign(outputAlignedRegion.GetNumberOfPixels(), 1);
+
+  const SizeValueType width = outputAlignedRegion.GetSize(0);
+  const SizeValueType height = outputAlignedRegion.GetSize(1);
+  IndexListType centersX, firstX, lastX, centersY, firstY, lastY;
+
+  // Update the part of the mask which covers the output region
+  if (m_Mask.IsNotNull())
+    {
+    ImageType * maskImage = m_Mask.GetPointer();
+    RegionType maskRegion;
+    if (OutputRegionToInputRegion(outputAlignedRegion, maskRegion, maskImage))
+      {
+      maskRegion.PadByRadius(1);
+      maskRegion.Crop(m_Mask->GetLargestPossibleRegion());
+      tf::PropagateRequestedRegion<TInputImage>(m_Mask, maskRegion);
+      }
+    else
+      {
+      // The mask does not cover the output region
+      m_ValidPixels.assign(m_ValidPixels.size(), 0);
+      return;
+      }
+
+    // Mask value at the center of the output pixels
+    MapOutputAxisToInput(outputAlignedRegion, maskImage, 0, centersX, firstX, lastX);
+    MapOutputAxisToInput(outputAlignedRegion, maskImage, 1, centersY, firstY, lastY);
+    const RegionType maskBufferedRegion = m_Mask->GetBufferedRegion();
+    const IndexValueType maskWidth = maskBufferedRegion.GetSize(0);
+    const IndexValueType maskHeight = maskBufferedRegion.GetSize(1);
+    const unsigned int maskComponents = m_Mask->GetNumberOfComponentsPerPixel();
+    const typename TInputImage::InternalPixelType * maskBuffer = m_Mask->GetBufferPointer();
+    std::size_t pos = 0;
+    for (SizeValueType y = 0 ; y < height ; y++)
+      {
+      const IndexValueType maskY = centersY[y] - maskBufferedRegion.GetIndex(1);
+      for (SizeValueType x = 0 ; x < width ; x++, pos++)
+        {
+        const IndexValueType maskX = centersX[x] - maskBufferedRegion.GetIndex(0);
+        if (maskY < 0 || maskY >= maskHeight || maskX < 0 || maskX >= maskWidth ||
+            maskBuffer[(maskY * maskWidth + maskX) * maskComponents] == 0)
+          m_ValidPixels[pos] = 0;
+        }
+      }
+    }
+
+  // Nodata values
+  for (auto const& entry: m_InputsNoData)
+    {
+    const HaloCacheType & input = m_HaloCaches[entry.first];
+    MapOutputAxisToInput(outputAlignedRegion, input.GetInput(), 0, centersX, firstX, lastX);
+    MapOutputAxisToInput(outputAlignedRegion, input.GetInput(), 1, centersY, firstY, lastY);
+
+    // Input region covered by the footprints (the mappings are monotonic)
+    RegionType footprintRegion;
+    footprintRegion.SetIndex(0, std::min(firstX.front(), firstX.back()));
+    footprintRegion.SetIndex(1, std::min(firstY.front(), firstY.back()));
+    footprintRegion.SetSize(0, std::max(lastX.front(), lastX.back()) - footprintRegion.GetIndex(0) + 1);
+    footprintRegion.SetSize(1, std::max(lastY.front(), lastY.back()) - footprintRegion.GetIndex(1) + 1);
+
+    // Summed area table of the valid input pixels (the pixels which are not
+    // in the cached pieces are considered as valid)
+    std::vector<char> nodata;
+    input.ComputeNoDataFlags(footprintRegion, entry.second, nodata);
+    const SizeValueType tableWidth = footprintRegion.GetSize(0) + 1;
+    std::vector<tensorflow::uint32> table(tableWidth * (footprintRegion.GetSize(1) + 1), 0);
+    for (SizeValueType y = 0 ; y < footprintRegion.GetSize(1) ; y++)
+      {
+      tensorflow::uint32 rowSum = 0;
+      for (SizeValueType x = 0 ; x < footprintRegion.GetSize(0) ; x++)
+        {
+        rowSum += (nodata[y * footprintRegion.GetSize(0) + x] == 0);
+        table[(y + 1) * tableWidth + x + 1] = table[y * tableWidth + x + 1] + rowSum;
+        }
+      }
+
+    // Exclude the output pixels whose footprint has no valid input pixel
+    std::size_t pos = 0;
+    for (SizeValueType y = 0 ; y < height ; y++)
+      {
+      const SizeValueType y0 = firstY[y] - footprintRegion.GetIndex(1);
+      const SizeValueType y1 = lastY[y] - footprintRegion.GetIndex(1) + 1;
+      for (SizeValueType x = 0 ; x < width ; x++, pos++)
+        {
+        if (m_ValidPixels[pos] == 0)
+          continue;
+        const SizeValueType x0 = firstX[x] - footprintRegion.GetIndex(0);
+        const SizeValueType x1 = lastX[x] - footprintRegion.GetIndex(0) + 1;
+        if (table[y1 * tableWidth + x1] + table[y0 * tableWidth + x0] ==
+            table[y0 * tableWidth + x1] + table[y1 * tableWidth + x0])
+          m_ValidPixels[pos] = 0;
+        }
+      }
+    }
+ }
+
+/*
+ * Count the pixels of the region which have to be processed
+ */
+template <class TInputImage, class TOutputImage>
+tensorflow::uint64
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::CountValidPixels(const RegionType &region) const
+ {
+  tensorflow::uint64 count = 0;
+  const IndexType start = region.GetIndex();
+  for (IndexValueType y = start[1] ; y < start[1] + (IndexValueType) region.GetSize(1) ; y++)
+    {
+    const char * row = m_ValidPixels.data() +
+        (y - m_ValidRegion.GetIndex(1)) * m_ValidRegion.GetSize(0) + (start[0] - m_ValidRegion.GetIndex(0));
+    for (SizeValueType x = 0 ; x < region.GetSize(0) ; x++)
+      count += row[x];
+    }
+  return count;
+ }
+
+/*
+ * Remove the tiles whose pixels are all excluded (they keep the fill value).
+ * In patch-based mode, a partially excluded tile is replaced by its blocks
+ * which have at least one pixel to process, so that the patches of the
+ * excluded blocks are not run in the session.
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::MaskTiles(RegionListType &tiles)
+ {
+  const SizeType blockSize = GetPatchesBlockSize();
+  const tensorflow::uint64 nPixelsBefore = m_ValidRegion.GetNumberOfPixels();
+
+  RegionListType maskedTiles;
+  for (auto const& tile: tiles)
+    {
+    const tensorflow::uint64 nValid = CountValidPixels(tile);
+    if (nValid == 0)
+      continue;
+    if (m_FullyConvolutional || nValid == tile.GetNumberOfPixels())
+      {
+      maskedTiles.push_back(tile);
+      continue;
+      }
+    IndexType blockIndex;
+    for (blockIndex[1] = tile.GetIndex(1) ; blockIndex[1] <= tile.GetUpperIndex()[1] ; blockIndex[1] += blockSize[1])
+      {
+      for (blockIndex[0] = tile.GetIndex(0) ; blockIndex[0] <= tile.GetUpperIndex()[0] ; blockIndex[0] += blockSize[0])
+        {
+        RegionType block(blockIndex, blockSize);
+        if (CountValidPixels(block) > 0)
+          maskedTiles.push_back(block);
+        }
+      }
+    }
+
+  tensorflow::uint64 nPixelsAfter = 0;
+  for (auto const& tile: maskedTiles)
+    nPixelsAfter += tile.GetNumberOfPixels();
+  itkDebugMacro("Masking: " << nPixelsAfter << " pixels to process out of " << nPixelsBefore <<
+                " (" << tiles.size() << " tiles before, " << maskedTiles.size() << " regions after)");
+  tiles.swap(maskedTiles);
+ }
+
+/*
+ * Set the excluded pixels of the output region to the fill value
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::FillExcludedPixels(const RegionType &outputRegion)
+ {
+  typename TOutputImage::Pointer outputPtr = this->GetOutput();
+  const unsigned int nComponents = outputPtr->GetNumberOfComponentsPerPixel();
+  itk::ImageRegionIterator<TOutputImage> outIt(outputPtr, outputRegion);
+  for (outIt.GoToBegin(); !outIt.IsAtEnd(); ++outIt)
+    {
+    const IndexType index = outIt.GetIndex();
+    const std::size_t pos = (index[1] - m_ValidRegion.GetIndex(1)) * m_ValidRegion.GetSize(0) +
+        (index[0] - m_ValidRegion.GetIndex(0));
+    if (m_ValidPixels[pos] == 0)
+      {
+      for (unsigned int c = 0 ; c < nComponents ; c++)
+        outIt.Get()[c] = m_FillValue;
+      }
+    }
+ }
+
+/*
+ * Return the quantization of the output values. Integer output pixels are
+ * always rounded and clamped to the range of their type.
+ */
+template <class TInputImage, class TOutputImage>
+tf::QuantizationType
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::GetOutputQuantization() const
+ {
+  tf::QuantizationType quantization;
+  quantization.m_Scale = m_OutputScale;
+  quantization.m_Shift = m_OutputShift;
+  quantization.m_Round = m_OutputRound;
+  quantization.m_Minimum = m_OutputMinimum;
+  quantization.m_Maximum = m_OutputMaximum;
+  if (std::numeric_limits<OutputInternalPixelType>::is_integer)
+    {
+    quantization.m_Round = true;
+    quantization.m_Minimum = vnl_math_max(quantization.m_Minimum,
+        static_cast<double>(itk::NumericTraits<OutputInternalPixelType>::NonpositiveMin()));
+    quantization.m_Maximum = vnl_math_min(quantization.m_Maximum,
+        static_cast<double>(itk::NumericTraits<OutputInternalPixelType>::max()));
+    }
+  return quantization;
+ }
+
+/*
+ * Return the size of the output block produced by one patch: the output
+ * field of expression in patch-based mode, one pixel else.
+ */
+template <class TInputImage, class TOutputImage>
+typename TensorflowMultisourceModelFilter<TInputImage, TOutputImage>::SizeType
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::GetPatchesBlockSize()
+ {
+  SizeType blockSize;
+  blockSize.Fill(1);
+  if (!m_FullyConvolutional)
+    {
+    blockSize = m_OutputFOESize;
+    }
+  return blockSize;
+ }
+
+/*
+ * Compute the offset of the patches of the input #inputIndex, from the input
+ * pixel of the first pixel of their output block. The patch of a block is
+ * padded like the input region of the block (see ComputeInputRegion), so
+ * that for a block of one pixel, the patch is centered on it.
+ */
+template <class TInputImage, class TOutputImage>
+typename TensorflowMultisourceModelFilter<TInputImage, TOutputImage>::OffsetType
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::ComputePatchOffset(unsigned int inputIndex)
+ {
+  const SizeType blockSize = GetPatchesBlockSize();
+  const SizeType inputPatchSize = this->GetInputFOVSizes().at(inputIndex);
+  OffsetType offset;
+  for (unsigned int dim = 0 ; dim < ImageType::ImageDimension ; dim++)
+    {
+    const SizeValueType psz = inputPatchSize[dim] - (1 + (blockSize[dim] - 1) * m_OutputSpacingScale);
+    const SizeValueType rval = 0.5 * psz;
+    const SizeValueType lval = psz - rval;
+    offset[dim] = - static_cast<OffsetValueType>(lval);
+    }
+  return offset;
+ }
+
+/*
+ * Create the session of the patches extraction graph.
+ * For each input image, the graph takes the input region of a tile
+ * ("otbtf_patches_input_<i>", shape {1, y, x, c}) and produces the batch of
+ * patches ("otbtf_patches_output_<i>", shape {n, fov_y, fov_x, c}).
+ * In-graph extraction is possible only when the output spacing is a multiple
+ * of the input image spacing, the patches centers being then regularly
+ * spaced in the input image. With FOE blocks, the patches are strided by
+ * the block size.
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::CreatePatchesExtractionSession()
+ {
+  tensorflow::Scope root = tensorflow::Scope::NewRootScope().WithDevice("/cpu:0");
+  bool hasNodes = false;
+
+  for (unsigned int i = 0 ; i < this->GetNumberOfInputs() ; i++)
+    {
+    const ImageType * inputImage = this->GetInput(i);
+    const SizeType inputPatchSize = this->GetInputFOVSizes().at(i);
+
+    // Strides of the patches, in input image pixels
+    const SizeType blockSize = GetPatchesBlockSize();
+    SizeType strides;
+    strides.Fill(0);
+    bool integerStrides = true;
+    for (unsigned int dim = 0 ; dim < ImageType::ImageDimension ; dim++)
+      {
+      const double ratio = m_OutputSpacing[dim] / inputImage->GetSignedSpacing()[dim];
+      const double rounded = vcl_floor(ratio + 0.5);
+      if (rounded < 1 || vcl_abs(ratio - rounded) > 1e-6)
+        integerStrides = false;
+      else
+        strides[dim] = rounded * blockSize[dim];
+      }
+    if (!integerStrides)
+      {
+      itkWarningMacro("Output spacing is not a multiple of the spacing of input #" << i <<
+                      ": its patches will be sampled without tensorflow.");
+      strides.Fill(0);
+      m_PatchesStrides.push_back(strides);
+      continue;
+      }
+    m_PatchesStrides.push_back(strides);
+
+    // Nodes
+    const int sz_y = inputPatchSize[1];
+    const int sz_x = inputPatchSize[0];
+    const int sz_c = inputImage->GetNumberOfComponentsPerPixel();
+    std::stringstream inputName, outputName;
+    inputName << "otbtf_patches_input_" << i;
+    outputName << "otbtf_patches_output_" << i;
+    auto input = tensorflow::ops::Placeholder(root.WithOpName(inputName.str()), this->GetInputTensorsDataTypes()[i]);
+    auto patches = tensorflow::ops::ExtractImagePatches(root, input,
+        {1, sz_y, sz_x, 1}, {1, (int) strides[1], (int) strides[0], 1}, {1, 1, 1, 1}, "VALID");
+    tensorflow::ops::Reshape(root.WithOpName(outputName.str()), patches, {-1, sz_y, sz_x, sz_c});
+    hasNodes = true;
+    }
+
+  if (!hasNodes)
+    return;
+
+  tensorflow::GraphDef graphDef;
+  auto status = root.ToGraphDef(&graphDef);
+  if (!status.ok())
+    {
+    itkExceptionMacro("Can't build the patches extraction graph: " << status.ToString() );
+    }
+
+  m_PatchesSession.reset(tensorflow::NewSession(tensorflow::SessionOptions()));
+  status = m_PatchesSession->Create(graphDef);
+  if (!status.ok())
+    {
+    m_PatchesSession.reset();
+    itkExceptionMacro("Can't create the patches extraction session: " << status.ToString() );
+    }
+ }
+
+/*
+ * Extract the patches of the input #inputIndex for all the tiles of the job,
+ * using the patches extraction graph.
+ * Returns false if the patches can't be extracted this way (in this case,
+ * they must be sampled with SampleCenteredPatch).
+ */
+template <class TInputImage, class TOutputImage>
+bool
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::ExtractPatches(unsigned int inputIndex, const TileJob &job, tensorflow::Tensor &patches)
+ {
+  if (!m_PatchesSession || m_PatchesStrides.size() <= inputIndex || m_PatchesStrides[inputIndex][0] == 0)
+    return false;
+
+  // The single blocks (i.e. the remaining blocks of partially excluded
+  // tiles) are sampled patch by patch, instead of running the patches
+  // extraction graph for each of them
+  if (job.m_Regions.size() > 1)
+    {
+    for (auto const& region: job.m_Regions)
+      if (region.GetSize() == GetPatchesBlockSize())
+        return false;
+    }
+
+  // Output pointer
+  typename TOutputImage::Pointer outputPtr = this->GetOutput();
+
+  // Input image pointer
+  const HaloCacheType & input = m_HaloCaches[inputIndex];
+  const ImagePointerType inputPtr = input.GetInput();
+  const SizeType inputPatchSize = this->GetInputFOVSizes().at(inputIndex);
+  const SizeType strides = m_PatchesStrides[inputIndex];
+  const SizeType blockSize = GetPatchesBlockSize();
+  const OffsetType patchOffset = ComputePatchOffset(inputIndex);
+  const tensorflow::DataType dt = this->GetInputTensorsDataTypes()[inputIndex];
+
+  std::stringstream inputName, outputName;
+  inputName << "otbtf_patches_input_" << inputIndex;
+  outputName << "otbtf_patches_output_" << inputIndex;
+
+  std::vector<tensorflow::Tensor> tilesPatches;
+  for (auto const& region: job.m_Regions)
+    {
+    // First pixels of the first and the last blocks of the tile, in the input image
+    SizeType nBlocks;
+    IndexType firstIndex = region.GetIndex();
+    IndexType lastIndex;
+    for (unsigned int dim = 0 ; dim < ImageType::ImageDimension ; dim++)
+      {
+      nBlocks[dim] = region.GetSize(dim) / blockSize[dim];
+      lastIndex[dim] = firstIndex[dim] + (nBlocks[dim] - 1) * blockSize[dim];
+      }
+    PointType firstPoint, lastPoint;
+    outputPtr->TransformIndexToPhysicalPoint(firstIndex, firstPoint);
+    outputPtr->TransformIndexToPhysicalPoint(lastIndex, lastPoint);
+    IndexType firstCenter, lastCenter;
+    inputPtr->TransformPhysicalPointToIndex(firstPoint, firstCenter);
+    inputPtr->TransformPhysicalPointToIndex(lastPoint, lastCenter);
+
+    // The input region covering all the patches of the tile
+    RegionType inputRegion;
+    for (unsigned int dim = 0 ; dim < ImageType::ImageDimension ; dim++)
+      {
+      // The patches must lie on the regular grid
+      if (lastCenter[dim] - firstCenter[dim] != (IndexValueType) ((nBlocks[dim] - 1) * strides[dim]))
+        return false;
+      inputRegion.SetIndex(dim, firstCenter[dim] + patchOffset[dim]);
+      inputRegion.SetSize(dim, (nBlocks[dim] - 1) * strides[dim] + inputPatchSize[dim]);
+      }
+    if (!input.IsInside(inputRegion))
+      return false;
+
+    // Copy the input region once
+    tensorflow::Tensor inputTensor;
+    if (!tf::WrapImageRegionIntoTensor<TInputImage>(inputPtr, inputRegion, dt, inputTensor))
+      {
+      tensorflow::TensorShape inputTensorShape({1, inputRegion.GetSize(1), inputRegion.GetSize(0),
+        inputPtr->GetNumberOfComponentsPerPixel()});
+      inputTensor = tensorflow::Tensor(dt, inputTensorShape);
+      input.RecopyRegionToTensor(inputRegion, inputTensor, 0);
+      }
+
+    // Extract the patches
+    std::vector<tensorflow::Tensor> outputs;
+    auto status = m_PatchesSession->Run({{inputName.str(), inputTensor}}, {outputName.str()}, {}, &outputs);
+    if (!status.ok())
+      {
+      itkExceptionMacro("Can't extract the patches of input #" << inputIndex << " over region:\n" <<
+                        inputRegion << "Tensorflow error message:\n" << status.ToString() );
+      }
+    tilesPatches.push_back(outputs[0]);
+    }
+
+  // Stack the patches of the tiles
+  if (tilesPatches.size() == 1)
+    {
+    patches = tilesPatches[0];
+    }
+  else
+    {
+    auto status = tensorflow::tensor::Concat(tilesPatches, &patches);
+    if (!status.ok())
+      {
+      itkExceptionMacro("Can't concatenate the patches of input #" << inputIndex << ": " << status.ToString() );
+      }
+    }
+
+  return true;
+ }
+
+/*
+ * Compute the region of the input image #inputIndex which is needed to
+ * produce the given aligned output region
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::ComputeInputRegion(unsigned int inputIndex, const RegionType &outputAlignedRegion, RegionType &inputRegion)
+ {
+  ImageType * inputImage = static_cast<ImageType * >( Superclass::ProcessObject::GetInput(inputIndex) );
+
+  // Compute the requested region
+  if (!OutputRegionToInputRegion(outputAlignedRegion, inputRegion, inputImage) )
+    {
+    // Image does not overlap requested region: set requested region to null
+    itkDebugMacro( <<  "Image #" << inputIndex << " :\n" << inputRegion << " is outside the requested region");
+    inputRegion.GetModifiableIndex().Fill(0);
+    inputRegion.GetModifiableSize().Fill(0);
+    }
+
+  // Compute the FOV-scale*FOE radius to pad
+  SizeType toPad(this->GetInputFOVSizes().at(inputIndex));
+  toPad[0] -= 1 + (m_OutputFOESize[0] - 1) * m_OutputSpacingScale;
+  toPad[1] -= 1 + (m_OutputFOESize[1] - 1) * m_OutputSpacingScale;
+
+  // Pad with radius
+  SmartPad(inputRegion, toPad);
+
+  // We need to avoid some extrapolation when mode is patch-based.
+  // The reason is that, when some input have a lower spacing than the
+  // reference image, the requested region of this lower res input image
+  // can be one pixel larger when the input image regions are not physicaly
+  // aligned.
+  if (!m_FullyConvolutional)
+    {
+    inputRegion.PadByRadius(1);
+    }
+
+  inputRegion.Crop(inputImage->GetLargestPossibleRegion());
+
+ }
+
+/*
+ * Split the given aligned region into aligned tiles, in raster order.
+ * The tiles size is the internal tile size, enlarged to the output grid.
+ * If no internal tile size is set, the region is not split.
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::SplitAlignedRegion(const RegionType &alignedRegion, RegionListType &tiles)
+ {
+  tiles.clear();
+
+  // Compute the tiles size
+  SizeType tileSize;
+  for(unsigned int dim = 0; dim<OutputImageType::ImageDimension; ++dim)
+    {
+    if (m_InternalTileSize[dim] == 0)
+      {
+      tileSize[dim] = alignedRegion.GetSize(dim);
+      }
+    else
+      {
+      const SizeValueType grid = m_OutputGridSize[dim];
+      tileSize[dim] = grid * ((m_InternalTileSize[dim] + grid - 1) / grid);
+      }
+    if (tileSize[dim] == 0)
+      {
+      return;
+      }
+    }
+
+  // With multiple sessions, the tiles are shrunk (down to the output grid)
+  // until each session gets one
+  auto countTiles = [&]()
+    {
+    return ((alignedRegion.GetSize(0) + tileSize[0] - 1) / tileSize[0]) *
+        ((alignedRegion.GetSize(1) + tileSize[1] - 1) / tileSize[1]);
+    };
+  while (m_Sessions.size() > 1 && countTiles() < m_Sessions.size())
+    {
+    const unsigned int dim = (tileSize[0] / m_OutputGridSize[0] >= tileSize[1] / m_OutputGridSize[1] ? 0 : 1);
+    const SizeValueType nCells = tileSize[dim] / m_OutputGridSize[dim];
+    if (nCells <= 1)
+      break;
+    tileSize[dim] = m_OutputGridSize[dim] * ((nCells + 1) / 2);
+    }
+
+  // Produce the tiles (the last tiles of each row/column can be smaller)
+  const IndexType start = alignedRegion.GetIndex();
+  const IndexType end = alignedRegion.GetUpperIndex();
+  for (IndexValueType y = start[1] ; y <= end[1] ; y += tileSize[1])
+    {
+    for (IndexValueType x = start[0] ; x <= end[0] ; x += tileSize[0])
+      {
+      RegionType tile;
+      tile.SetIndex(0, x);
+      tile.SetIndex(1, y);
+      tile.SetSize(0, vnl_math_min(static_cast<IndexValueType>(tileSize[0]), end[0] - x + 1));
+      tile.SetSize(1, vnl_math_min(static_cast<IndexValueType>(tileSize[1]), end[1] - y + 1));
+      tiles.push_back(tile);
+      }
+    }
  }
 
 template <class TInputImage, class TOutputImage>
@@ -319,6 +980,11 @@ TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
   // First, align the output region
   EnlargeToAlignedRegion(requestedRegion);
 
+  if (m_HaloCaches.size() != this->GetNumberOfInputs())
+    {
+    m_HaloCaches.assign(this->GetNumberOfInputs(), HaloCacheType());
+    }
+
   // For each image, get the requested region
   for(unsigned int i = 0; i < this->GetNumberOfInputs(); ++i)
     {
@@ -326,157 +992,647 @@ TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
 
     // Compute the requested region
     RegionType inRegion;
-    if (!OutputRegionToInputRegion(requestedRegion, inRegion, inputImage) )
+    ComputeInputRegion(i, requestedRegion, inRegion);
+
+    // Update the requested region, without the part in the halo cache
+    // (the cache is only modified when the region is generated)
+    if (m_HaloCache)
       {
-      // Image does not overlap requested region: set requested region to null
-      itkDebugMacro( <<  "Image #" << i << " :\n" << inRegion << " is outside the requested region");
-      inRegion.GetModifiableIndex().Fill(0);
-      inRegion.GetModifiableSize().Fill(0);
+      inRegion = m_HaloCaches[i].Plan(requestedRegion, inRegion, GetHaloModifiedTime(i)).m_RequestedRegion;
       }
+    inputImage->SetRequestedRegion(inRegion);
+
+    } // next image
+
+ }
+
+/*
+ * Modification time of the pipeline of the input #inputIndex: the halo cache
+ * is cleared when it changes
+ */
+template <class TInputImage, class TOutputImage>
+itk::ModifiedTimeType
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::GetHaloModifiedTime(unsigned int inputIndex)
+ {
+  const ImageType * inputImage = static_cast<ImageType * >( Superclass::ProcessObject::GetInput(inputIndex) );
+  return vnl_math_max(inputImage->GetPipelineMTime(), this->GetMTime());
+ }
 
-    // Compute the FOV-scale*FOE radius to pad
-    SizeType toPad(this->GetInputFOVSizes().at(i));
-    toPad[0] -= 1 + (m_OutputFOESize[0] - 1) * m_OutputSpacingScale;
-    toPad[1] -= 1 + (m_OutputFOESize[1] - 1) * m_OutputSpacingScale;
+/*
+ * Compute the strips of the input region of the input #inputIndex which
+ * overlap the input regions of the next output region of the row (right
+ * strip) and of the output region below (bottom strip). The strips are
+ * empty when there is no such output region, or no overlap.
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::ComputeHaloStrips(unsigned int inputIndex, const RegionType &outputAlignedRegion, const RegionType &inputRegion,
+    RegionType &rightStrip, RegionType &bottomStrip)
+ {
+  rightStrip = RegionType();
+  bottomStrip = RegionType();
+  if (inputRegion.GetNumberOfPixels() == 0)
+    return;
 
-    // Pad with radius
-    SmartPad(inRegion, toPad);
+  const RegionType largestRegion = this->GetOutput()->GetLargestPossibleRegion();
+  for (unsigned int dim = 0 ; dim < ImageType::ImageDimension ; dim++)
+    {
+    // Next output region along dim
+    RegionType next(outputAlignedRegion);
+    next.SetIndex(dim, outputAlignedRegion.GetUpperIndex()[dim] + 1);
+    next.SetSize(dim, m_OutputGridSize[dim]);
+    if (!largestRegion.IsInside(next))
+      continue;
+    RegionType nextInput;
+    ComputeInputRegion(inputIndex, next, nextInput);
+    const IndexValueType stripFirst = nextInput.GetIndex(dim);
+    const IndexValueType regionLast = inputRegion.GetUpperIndex()[dim];
+    if (nextInput.GetNumberOfPixels() == 0 || stripFirst <= inputRegion.GetIndex(dim) || stripFirst > regionLast)
+      continue;
+
+    RegionType & strip = (dim == 0 ? rightStrip : bottomStrip);
+    strip = inputRegion;
+    strip.SetIndex(dim, stripFirst);
+    strip.SetSize(dim, regionLast - stripFirst + 1);
+    }
+ }
+
+/*
+ * Set the pieces of the input regions used to fill the tensors. With the halo
+ * cache, the plan is computed again from the generated region and applied
+ * here: if the upstream buffer does not hold the requested part (e.g. the
+ * pipeline was modified since the requested regions were propagated), the
+ * cache of the input is cleared and its whole input region is updated.
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::PrepareInputs(const RegionType &outputAlignedRegion)
+ {
+  if (m_HaloCaches.size() != this->GetNumberOfInputs())
+    {
+    m_HaloCaches.assign(this->GetNumberOfInputs(), HaloCacheType());
+    }
 
-    // We need to avoid some extrapolation when mode is patch-based.
-    // The reason is that, when some input have a lower spacing than the
-    // reference image, the requested region of this lower res input image
-    // can be one pixel larger when the input image regions are not physicaly
-    // aligned.
-    if (!m_FullyConvolutional)
+  for (unsigned int i = 0 ; i < this->GetNumberOfInputs() ; i++)
+    {
+    ImagePointerType inputImage = static_cast<ImageType * >( Superclass::ProcessObject::GetInput(i) );
+    HaloCacheType & cache = m_HaloCaches[i];
+    if (!m_HaloCache)
       {
-      inRegion.PadByRadius(1);
+      cache.Bypass(inputImage);
+      continue;
       }
 
-    inRegion.Crop(inputImage->GetLargestPossibleRegion());
+    RegionType inputRegion;
+    ComputeInputRegion(i, outputAlignedRegion, inputRegion);
+    typename HaloCacheType::PlanType plan = cache.Plan(outputAlignedRegion, inputRegion, GetHaloModifiedTime(i));
+    if (!inputImage->GetBufferedRegion().IsInside(plan.m_RequestedRegion))
+      {
+      cache.Reset();
+      plan = cache.Plan(outputAlignedRegion, inputRegion, plan.m_ModifiedTime);
+      if (!inputImage->GetBufferedRegion().IsInside(plan.m_RequestedRegion))
+        tf::PropagateRequestedRegion<TInputImage>(inputImage, plan.m_RequestedRegion);
+      }
 
-    // Update the requested region
-    inputImage->SetRequestedRegion(inRegion);
+    RegionType rightStrip, bottomStrip;
+    ComputeHaloStrips(i, outputAlignedRegion, inputRegion, rightStrip, bottomStrip);
+    cache.Apply(plan, inputImage, rightStrip, bottomStrip);
+    }
+ }
 
-    //    std::cout << "Input #" << i << " region starts at " << inRegion.GetIndex() << " with size " << inRegion.GetSize() << std::endl;
+/*
+ * Compute the cost of one tile in a batch:
+ * -the number of elements it adds along the first dimension of the tensors
+ * -the number of bytes it adds to the input tensors
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::ComputeTileCost(const RegionType &tile, tensorflow::uint64 &nElements, tensorflow::uint64 &nBytes)
+ {
+  const SizeType blockSize = GetPatchesBlockSize();
+  nElements = (m_FullyConvolutional ? 1 : tile.GetNumberOfPixels() / (blockSize[0] * blockSize[1]));
+  nBytes = 0;
+  for (unsigned int i = 0 ; i < this->GetNumberOfInputs() ; i++)
+    {
+    const tensorflow::uint64 nBands = this->GetInput(i)->GetNumberOfComponentsPerPixel();
+    const tensorflow::uint64 valueSize = tensorflow::DataTypeSize(this->GetInputTensorsDataTypes()[i]);
+    tensorflow::uint64 nPixels = 0;
+    if (m_FullyConvolutional)
+      {
+      RegionType inRegion;
+      ComputeInputRegion(i, tile, inRegion);
+      nPixels = inRegion.GetNumberOfPixels();
+      }
+    else
+      {
+      const SizeType inputPatchSize = this->GetInputFOVSizes().at(i);
+      nPixels = nElements * inputPatchSize[0] * inputPatchSize[1];
+      }
+    nBytes += nPixels * nBands * valueSize;
+    }
+ }
 
-    } // next image
+/*
+ * Group the tiles into jobs.
+ * Without batch size or memory budget, each job processes one single tile.
+ * Else, consecutive tiles are appended to the current job until the target
+ * batch size or the memory budget is reached. In fully convolutional mode,
+ * only tiles leading to the same input tensors shapes are batched together.
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::GroupTilesIntoJobs(const RegionListType &tiles, TileJobListType &jobs)
+ {
+  jobs.clear();
+
+  const bool batching = (m_TargetBatchSize > 0 || m_BatchMemoryBudget > 0);
+  const tensorflow::uint64 budget = static_cast<tensorflow::uint64>(m_BatchMemoryBudget) * 1024 * 1024;
+
+  // Return true if the two tiles lead to the same input tensors shapes
+  auto haveSameShapes = [this](const RegionType & tile1, const RegionType & tile2)
+    {
+    if (tile1.GetSize() != tile2.GetSize())
+      return false;
+    for (unsigned int i = 0 ; i < this->GetNumberOfInputs() ; i++)
+      {
+      RegionType inRegion1, inRegion2;
+      this->ComputeInputRegion(i, tile1, inRegion1);
+      this->ComputeInputRegion(i, tile2, inRegion2);
+      if (inRegion1.GetSize() != inRegion2.GetSize())
+        return false;
+      }
+    return true;
+    };
+
+  // With multiple sessions, the batches are kept small enough to give one
+  // job to each session
+  const std::size_t nSessions = vnl_math_max(static_cast<std::size_t>(1), m_Sessions.size());
+  const std::size_t maxTilesPerJob = (tiles.size() + nSessions - 1) / nSessions;
+
+  tensorflow::uint64 jobElements = 0;
+  tensorflow::uint64 jobBytes = 0;
+  for (auto const& tile: tiles)
+    {
+    tensorflow::uint64 nElements, nBytes;
+    ComputeTileCost(tile, nElements, nBytes);
+
+    bool newJob = jobs.empty() || !batching;
+    if (!newJob)
+      {
+      if (jobs.back().m_Regions.size() >= maxTilesPerJob)
+        newJob = true;
+      else if (m_TargetBatchSize > 0 && jobElements + nElements > m_TargetBatchSize)
+        newJob = true;
+      else if (budget > 0 && jobBytes + nBytes > budget)
+        newJob = true;
+      else if (m_FullyConvolutional && !haveSameShapes(jobs.back().m_Regions.front(), tile))
+        newJob = true;
+      }
+
+    if (newJob)
+      {
+      jobs.push_back(TileJob());
+      jobs.back().m_Index = m_NumberOfJobs + jobs.size() - 1;
+      jobElements = 0;
+      jobBytes = 0;
+      }
+    jobs.back().m_Regions.push_back(tile);
+    jobElements += nElements;
+    jobBytes += nBytes;
+    }
+ }
+
+/*
+ * Return the number of tiles of the given size that are grouped into one batch
+ * (the output information must be up to date)
+ */
+template <class TInputImage, class TOutputImage>
+unsigned int
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::GetNumberOfTilesPerBatch(const SizeType &tileSize)
+ {
+  if (m_TargetBatchSize == 0 && m_BatchMemoryBudget == 0)
+    {
+    return 1;
+    }
+
+  // A tile at the origin of the output image
+  RegionType tile(this->GetOutput()->GetLargestPossibleRegion().GetIndex(), tileSize);
+  tile.Crop(this->GetOutput()->GetLargestPossibleRegion());
+
+  tensorflow::uint64 nElements, nBytes;
+  ComputeTileCost(tile, nElements, nBytes);
+
+  tensorflow::uint64 nTiles = itk::NumericTraits<unsigned int>::max();
+  if (m_TargetBatchSize > 0 && nElements > 0)
+    {
+    nTiles = vnl_math_min(nTiles, m_TargetBatchSize / nElements);
+    }
+  if (m_BatchMemoryBudget > 0 && nBytes > 0)
+    {
+    const tensorflow::uint64 budget = static_cast<tensorflow::uint64>(m_BatchMemoryBudget) * 1024 * 1024;
+    nTiles = vnl_math_min(nTiles, budget / nBytes);
+    }
+
+  return static_cast<unsigned int>(vnl_math_max(nTiles, static_cast<tensorflow::uint64>(1)));
+ }
+
+/*
+ * Compute the memory needed to process one tile: the input tensors, the
+ * input regions copied for the in-graph patches extraction, the output
+ * tensors and the output buffer.
+ */
+template <class TInputImage, class TOutputImage>
+tensorflow::uint64
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::ComputeTileMemoryFootprint(const RegionType &tile)
+ {
+  tensorflow::uint64 nElements, nBytes;
+  ComputeTileCost(tile, nElements, nBytes);
+
+  // Input regions of the patches extraction graph
+  if (m_InGraphPatchExtraction && !m_FullyConvolutional)
+    {
+    for (unsigned int i = 0 ; i < this->GetNumberOfInputs() ; i++)
+      {
+      RegionType inRegion;
+      ComputeInputRegion(i, tile, inRegion);
+      nBytes += inRegion.GetNumberOfPixels() * this->GetInput(i)->GetNumberOfComponentsPerPixel() *
+          tensorflow::DataTypeSize(this->GetInputTensorsDataTypes()[i]);
+      }
+    }
+
+  // Output tensors and output buffer
+  tensorflow::uint64 outputValueSize = 0;
+  for (auto const& dt: this->GetOutputTensorsDataTypes())
+    outputValueSize = vnl_math_max(outputValueSize, static_cast<tensorflow::uint64>(tensorflow::DataTypeSize(dt)));
+  const tensorflow::uint64 nOutputValues = tile.GetNumberOfPixels() * this->GetOutput()->GetNumberOfComponentsPerPixel();
+  nBytes += nOutputValues * (outputValueSize + sizeof(OutputInternalPixelType));
+
+  return nBytes;
+ }
+
+/*
+ * Return the largest squared tile, aligned on the output grid, which can be
+ * processed within the given memory budget (in MB).
+ * The memory footprint of a tile grows with its size, so the size is found
+ * with a binary search. The output information must be up to date.
+ */
+template <class TInputImage, class TOutputImage>
+typename TensorflowMultisourceModelFilter<TInputImage, TOutputImage>::SizeType
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::ComputeTileSizeFromMemoryBudget(unsigned int memoryBudget)
+ {
+  const RegionType largestRegion = this->GetOutput()->GetLargestPossibleRegion();
+  const tensorflow::uint64 budget = static_cast<tensorflow::uint64>(memoryBudget) * 1024 * 1024;
+
+  // Tile of side "side", enlarged to the output grid
+  auto makeTile = [&](SizeValueType side)
+    {
+    SizeType size;
+    for(unsigned int dim = 0; dim<OutputImageType::ImageDimension; ++dim)
+      {
+      const SizeValueType grid = m_OutputGridSize[dim];
+      size[dim] = grid * ((side + grid - 1) / grid);
+      }
+    RegionType tile(largestRegion.GetIndex(), size);
+    tile.Crop(largestRegion);
+    return tile;
+    };
+
+  SizeValueType lower = 1;
+  SizeValueType upper = vnl_math_max(largestRegion.GetSize(0), largestRegion.GetSize(1));
+  if (ComputeTileMemoryFootprint(makeTile(lower)) > budget)
+    {
+    itkWarningMacro("The smallest tile does not fit in the memory budget of " << memoryBudget << " MB");
+    return makeTile(lower).GetSize();
+    }
+  while (lower < upper)
+    {
+    const SizeValueType side = lower + (upper - lower + 1) / 2;
+    if (ComputeTileMemoryFootprint(makeTile(side)) <= budget)
+      lower = side;
+    else
+      upper = side - 1;
+    }
 
+  // Enlarge to the output grid (the grid-enlarged tile is the one which has been evaluated)
+  SizeType tileSize;
+  for(unsigned int dim = 0; dim<OutputImageType::ImageDimension; ++dim)
+    {
+    const SizeValueType grid = m_OutputGridSize[dim];
+    tileSize[dim] = grid * ((lower + grid - 1) / grid);
+    }
+  return tileSize;
  }
 
 /**
- * Compute the output image
+ * Prepare the input tensors of the given tile job
  */
 template <class TInputImage, class TOutputImage>
 void
 TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
-::GenerateData()
+::FillInputTensors(TileJob &job)
  {
-  // Output pointer and requested region
+  // Output pointer
   typename TOutputImage::Pointer outputPtr = this->GetOutput();
-  const RegionType outputReqRegion = outputPtr->GetRequestedRegion();
-
-  // Get the aligned output requested region
-  RegionType outputAlignedReqRegion(outputReqRegion);
-  EnlargeToAlignedRegion(outputAlignedReqRegion);
-
-  // Add a progress reporter
-  itk::ProgressReporter progress(this, 0, outputReqRegion.GetNumberOfPixels());
 
   const unsigned int nInputs = this->GetNumberOfInputs();
 
-  // Create input tensors list
-  DictListType inputs;
+  tf::ScopedStageTimer timer(this->GetProfiler(), "fill", job.m_Index);
 
   // Populate input tensors
+  job.m_Inputs.clear();
   for (unsigned int i = 0 ; i < nInputs ; i++)
     {
     // Input image pointer
-    const ImagePointerType inputPtr = const_cast<TInputImage*>(this->GetInput(i));
+    const HaloCacheType & input = m_HaloCaches[i];
+    const ImagePointerType inputPtr = input.GetInput();
 
     // Patch size of tensor #i
     const SizeType inputPatchSize = this->GetInputFOVSizes().at(i);
 
-    // Input image requested region
-    const RegionType reqRegion = inputPtr->GetRequestedRegion();
-
     if (m_FullyConvolutional)
       {
+      // Input image regions needed by the tiles (they all have the same size)
+      RegionListType reqRegions;
+      for (auto const& region: job.m_Regions)
+        {
+        RegionType reqRegion;
+        ComputeInputRegion(i, region, reqRegion);
+        reqRegions.push_back(reqRegion);
+        }
+
+      // When the job has a single tile, the input tensor is created over the
+      // image buffer if possible (no copy)
+      tensorflow::Tensor inputTensor;
+      if (reqRegions.size() == 1 &&
+          tf::WrapImageRegionIntoTensor<TInputImage>(inputPtr, reqRegions[0], this->GetInputTensorsDataTypes()[i], inputTensor))
+        {
+        DictType input1 = { this->GetInputPlaceholdersNames()[i], inputTensor };
+        job.m_Inputs.push_back(input1);
+        continue;
+        }
+
       // Shape of input tensor #i
-      tensorflow::int64 sz_n = 1;
-      tensorflow::int64 sz_y = reqRegion.GetSize(1);
-      tensorflow::int64 sz_x = reqRegion.GetSize(0);
+      tensorflow::int64 sz_n = reqRegions.size();
+      tensorflow::int64 sz_y = reqRegions[0].GetSize(1);
+      tensorflow::int64 sz_x = reqRegions[0].GetSize(0);
       tensorflow::int64 sz_c = inputPtr->GetNumberOfComponentsPerPixel();
       tensorflow::TensorShape inputTensorShape({sz_n, sz_y, sz_x, sz_c});
 
       // Create the input tensor
-      tensorflow::Tensor inputTensor(this->GetInputTensorsDataTypes()[i], inputTensorShape);
+      inputTensor = tensorflow::Tensor(this->GetInputTensorsDataTypes()[i], inputTensorShape);
 
-      // Recopy the whole input
-      tf::RecopyImageRegionToTensorWithCast<TInputImage>(inputPtr, reqRegion, inputTensor, 0);
+      // Recopy the whole input of each tile
+      for (unsigned int elemIndex = 0 ; elemIndex < reqRegions.size() ; elemIndex++)
+        {
+        input.RecopyRegionToTensor(reqRegions[elemIndex], inputTensor, elemIndex);
+        }
 
       // Input #1 : the tensor of patches (aka the batch)
       DictType input1 = { this->GetInputPlaceholdersNames()[i], inputTensor };
-      inputs.push_back(input1);
+      job.m_Inputs.push_back(input1);
       }
     else
       {
+      // Extract the patches with tensorflow when possible
+      tensorflow::Tensor inputTensor;
+      if (m_InGraphPatchExtraction && ExtractPatches(i, job, inputTensor))
+        {
+        DictType input1 = { this->GetInputPlaceholdersNames()[i], inputTensor };
+        job.m_Inputs.push_back(input1);
+        continue;
+        }
+
       // Preparing patches (not very optimized ! )
-      // It would be better to perform the loop inside the TF session using TF operators
-      // Shape of input tensor #i
-      tensorflow::int64 sz_n = outputReqRegion.GetNumberOfPixels();
+      // Shape of input tensor #i (one patch per output block)
+      const SizeType blockSize = GetPatchesBlockSize();
+      tensorflow::int64 sz_n = 0;
+      for (auto const& region: job.m_Regions)
+        sz_n += region.GetNumberOfPixels() / (blockSize[0] * blockSize[1]);
       tensorflow::int64 sz_y = inputPatchSize[1];
       tensorflow::int64 sz_x = inputPatchSize[0];
       tensorflow::int64 sz_c = inputPtr->GetNumberOfComponentsPerPixel();
       tensorflow::TensorShape inputTensorShape({sz_n, sz_y, sz_x, sz_c});
 
       // Create the input tensor
-      tensorflow::Tensor inputTensor(this->GetInputTensorsDataTypes()[i], inputTensorShape);
-
-      // Fill the input tensor.
-      // We iterate over points which are located from the index iterator
-      // moving through the output image requested region
-      unsigned int elemIndex = 0;
-      IndexIteratorType idxIt(outputPtr, outputReqRegion);
-      for (idxIt.GoToBegin(); !idxIt.IsAtEnd(); ++idxIt)
-        {
-        // Get the coordinates of the current output pixel
-        PointType point;
-        outputPtr->TransformIndexToPhysicalPoint(idxIt.GetIndex(), point);
+      inputTensor = tensorflow::Tensor(this->GetInputTensorsDataTypes()[i], inputTensorShape);
 
-        // Sample the i-th input patch centered on the point
-        tf::SampleCenteredPatch<TInputImage>(inputPtr, point, inputPatchSize, inputTensor, elemIndex);
-        elemIndex++;
-        }
+      // Fill the input tensor with the patches of the blocks of the output
+      // image tiles (centered on their pixels when the blocks are single pixels)
+      input.SampleBlocksPatches(outputPtr.GetPointer(), job.m_Regions, inputPatchSize, blockSize,
+          ComputePatchOffset(i), inputTensor);
 
       // Input #1 : the tensor of patches (aka the batch)
       DictType input1 = { this->GetInputPlaceholdersNames()[i], inputTensor };
-      inputs.push_back(input1);
+      job.m_Inputs.push_back(input1);
       } // mode is not full convolutional
 
     } // next input tensor
 
-  // Run session
-  TensorListType outputs;
-  this->RunSession(inputs, outputs);
+  tensorflow::uint64 nBytes = 0;
+  for (auto const& input: job.m_Inputs)
+    nBytes += input.second.TotalBytes();
+  timer.SetBytes(nBytes);
+ }
+
+/**
+ * Run the session over the input tensors of the given tile job
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::RunJob(TileJob &job, tensorflow::Session * session)
+ {
+  tf::ScopedStageTimer timer(this->GetProfiler(), "run", job.m_Index);
+  this->RunSession(job.m_Inputs, job.m_Outputs, session);
+ }
+
+/**
+ * Copy the output tensors of the given tile job into the output image
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::CopyOutputTensors(TileJob &job)
+ {
+  // Output pointer and requested region
+  typename TOutputImage::Pointer outputPtr = this->GetOutput();
+  const RegionType outputReqRegion = outputPtr->GetRequestedRegion();
+
+  tf::ScopedStageTimer timer(this->GetProfiler(), "copy", job.m_Index);
+  tensorflow::uint64 nBytes = 0;
+  for (auto const& output: job.m_Outputs)
+    nBytes += output.TotalBytes();
+  timer.SetBytes(nBytes);
+
+  // Check the output tensors sizes
+  tensorflow::int64 nPixels = 0;
+  for (auto const& region: job.m_Regions)
+    nPixels += region.GetNumberOfPixels();
+  for (auto const& output: job.m_Outputs)
+    {
+    std::stringstream description;
+    description << "Batch of " << job.m_Regions.size() << " tile(s). First buffer region:\n" << job.m_Regions[0];
+    tf::CheckTensorNumberOfElements(output, nPixels, description.str());
+    }
 
-  // Fill the output buffer with zero value
+  // Scatter the outputs of each tile
+  // With FOE blocks (patch-based mode), each element of the output tensors
+  // is one block, and the buffer offset counts blocks
+  const SizeType blockSize = GetPatchesBlockSize();
+  const bool blocks = (blockSize[0] > 1 || blockSize[1] > 1);
+  const tf::QuantizationType quantization = GetOutputQuantization();
+  tensorflow::int64 bufferOffset = 0;
+  for (auto const& region: job.m_Regions)
+    {
+    // Part of the tile which lies inside the output requested region
+    RegionType outputRegion(region);
+    if (outputRegion.Crop(outputReqRegion))
+      {
+      // Get output tensors
+      int bandOffset = 0;
+      for (unsigned int i = 0 ; i < job.m_Outputs.size() ; i++)
+        {
+        // The offset (i.e. the starting index of the channel for the output tensor) is updated
+        // during this call
+        if (blocks)
+          tf::CopyBlocksTensorToImageRegion<TOutputImage> (job.m_Outputs[i], region, blockSize, outputPtr, outputRegion,
+              bandOffset, bufferOffset, quantization);
+        else
+          tf::CopyTensorToImageRegion<TOutputImage> (job.m_Outputs[i], region, outputPtr, outputRegion, bandOffset,
+              bufferOffset, quantization);
+        }
+
+      // The partially excluded tiles (fully convolutional mode) and blocks
+      // (patch-based mode) are run as a whole
+      if (IsMaskingEnabled())
+        {
+        FillExcludedPixels(outputRegion);
+        }
+      if (this->GetProfiler())
+        {
+        this->GetProfiler()->AddPixels(outputRegion.GetNumberOfPixels());
+        }
+      }
+    bufferOffset += region.GetNumberOfPixels() / (blockSize[0] * blockSize[1]);
+    }
+ }
+
+/**
+ * Process the jobs: over the sessions, with the tiles pipeline, or one after
+ * another
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::ProcessJobs(TileJobListType &jobs)
+ {
+  // Add a progress reporter
+  itk::ProgressReporter progress(this, 0, jobs.size());
+
+  const bool onSessions = m_Sessions.size() > 1 && jobs.size() > 1;
+  tf::JobsProcessor<TileJob> processor(
+      [this](TileJob & job) { this->FillInputTensors(job); },
+      [this, onSessions](TileJob & job, unsigned int k) { this->RunJob(job, onSessions ? m_Sessions[k] : this->GetSession()); },
+      [this](TileJob & job) { this->CopyOutputTensors(job); },
+      [&progress]() { progress.CompletedPixel(); });
+
+  if (onSessions)
+    {
+    processor.ProcessOnRunners(jobs, m_Sessions.size());
+    }
+  else if (m_PipelineDepth > 0 && jobs.size() > 1)
+    {
+    processor.ProcessPipelined(jobs, m_PipelineDepth);
+    }
+  else
+    {
+    processor.ProcessSequentially(jobs);
+    }
+ }
+
+/**
+ * Update the output data. The upstream pipeline is updated before
+ * GenerateData() is called: its start time is kept for the profiler.
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::UpdateOutputData(itk::DataObject *output)
+ {
+  m_UpdateStartTime = tf::Profiler::Now();
+  Superclass::UpdateOutputData(output);
+ }
+
+/**
+ * Compute the output image
+ */
+template <class TInputImage, class TOutputImage>
+void
+TensorflowMultisourceModelFilter<TInputImage, TOutputImage>
+::GenerateData()
+ {
+  // Upstream pipeline update
+  const tensorflow::uint64 regionIndex = m_NumberOfRegions++;
+  if (this->GetProfiler())
+    {
+    this->GetProfiler()->AddStage("update", regionIndex, m_UpdateStartTime, tf::Profiler::Now());
+    }
+
+  // Output pointer and requested region
+  typename TOutputImage::Pointer outputPtr = this->GetOutput();
+  const RegionType outputReqRegion = outputPtr->GetRequestedRegion();
+
+  // Get the aligned output requested region
+  RegionType outputAlignedReqRegion(outputReqRegion);
+  EnlargeToAlignedRegion(outputAlignedReqRegion);
+
+  // Allocate the output buffer
+  // The tiles cover the whole aligned region, so every output pixel is
+  // written. The buffer is filled only when some pixels can be excluded.
   outputPtr->SetBufferedRegion(outputReqRegion);
   outputPtr->Allocate();
-  OutputPixelType nullpix;
-  nullpix.SetSize(outputPtr->GetNumberOfComponentsPerPixel());
-  nullpix.Fill(0);
-  outputPtr->FillBuffer(nullpix);
+  if (IsMaskingEnabled())
+    {
+    OutputPixelType nullpix;
+    nullpix.SetSize(outputPtr->GetNumberOfComponentsPerPixel());
+    nullpix.Fill(m_FillValue);
+    outputPtr->FillBuffer(nullpix);
+    }
+
+  // Pieces of the input regions (upstream buffers and halo cache)
+  {
+    tf::ScopedStageTimer timer(m_HaloCache ? this->GetProfiler() : nullptr, "halo", regionIndex);
+    PrepareInputs(outputAlignedReqRegion);
+  }
 
-  // Get output tensors
-  int bandOffset = 0;
-  for (unsigned int i = 0 ; i < outputs.size() ; i++)
+  // Split the aligned output requested region into tiles
+  RegionListType tiles;
+  SplitAlignedRegion(outputAlignedReqRegion, tiles);
+
+  // Skip the excluded pixels
+  if (IsMaskingEnabled())
     {
-    // The offset (i.e. the starting index of the channel for the output tensor) is updated
-    // during this call
-    // TODO: implement a generic strategy enabling FOE copy in patch-based mode (see tf::CopyTensorToImageRegion)
-    tf::CopyTensorToImageRegion<TOutputImage> (outputs[i], outputAlignedReqRegion, outputPtr, outputReqRegion, bandOffset);
+    tf::ScopedStageTimer timer(this->GetProfiler(), "mask", regionIndex);
+    ComputeValidPixels(outputAlignedReqRegion);
+    MaskTiles(tiles);
     }
 
+  // Group the tiles into batches
+  TileJobListType jobs;
+  GroupTilesIntoJobs(tiles, jobs);
+  m_NumberOfJobs += jobs.size();
+
+  // Process the jobs
+  ProcessJobs(jobs);
+
  }
 
 
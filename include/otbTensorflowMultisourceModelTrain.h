@@ -22,6 +22,16 @@
 #include <random>
 #include <algorithm>
 #include <iterator>
+#include <numeric>
+
+// Prefetching
+#include "otbTensorflowBatchLoader.h"
+
+// Patches cache
+#include "otbTensorflowPatchesCache.h"
+#include <thread>
+#include <atomic>
+#include <exception>
 
 namespace otb
 {
@@ -34,6 +44,30 @@ namespace otb
  * Names of input placeholders must be specified using the
  * SetInputPlaceholdersNames method
  *
+ * Batches can be prepared in the background while the session runs: a set
+ * of loader threads (see SetNumberOfLoaders()) builds the next batches and
+ * pushes them in a queue of the given depth (see SetPrefetchQueueDepth()).
+ * Since the upstream pipeline is not thread-safe, the reads of the input
+ * images are serialized between the loaders.
+ *
+ * A patches cache can be set (see SetPatchesCache()): the input patches
+ * images are then read only once (at the first update), and the batches are
+ * built from the cache afterwards.
+ *
+ * The samples are shuffled at each update. They can be shuffled by chunks of
+ * contiguous samples (see SetShuffleChunkSize()), then mixed by a shuffle
+ * buffer of a given number of samples (see SetShuffleBufferSize()), so that
+ * the samples of a batch come from a few areas of the patches images.
+ * The samples of a batch are read in the order of their rows, and each run
+ * of contiguous samples is read at once, so that the blocks of the patches
+ * images are decoded once. Runs separated by a few samples can be read at
+ * once too, with the rows between them, as long as the region read stays
+ * within a given height (see SetReadBlockHeight(), e.g. the height of the
+ * blocks of the patches images).
+ *
+ * When a profiler is set, the reads of the input images ("update"), the
+ * copies of the patches in the tensors ("fill") and the session runs
+ * ("run") of each batch are timed.
  *
  * \ingroup OTBTensorflow
  */
@@ -72,6 +106,21 @@ public:
   itkSetMacro(BatchSize, unsigned int);
   itkGetMacro(BatchSize, unsigned int);
   itkGetMacro(NumberOfSamples, unsigned int);
+  itkSetMacro(PrefetchQueueDepth, unsigned int);
+  itkGetMacro(PrefetchQueueDepth, unsigned int);
+  itkSetMacro(NumberOfLoaders, unsigned int);
+  itkGetMacro(NumberOfLoaders, unsigned int);
+  itkSetMacro(ShuffleChunkSize, unsigned int);
+  itkGetMacro(ShuffleChunkSize, unsigned int);
+  itkSetMacro(ShuffleBufferSize, unsigned int);
+  itkGetMacro(ShuffleBufferSize, unsigned int);
+  itkSetMacro(ReadBlockHeight, unsigned int);
+  itkGetMacro(ReadBlockHeight, unsigned int);
+
+  /** Patches cache */
+  typedef tf::PatchesCache<TInputImage>              PatchesCacheType;
+  void SetPatchesCache(PatchesCacheType * cache) { m_PatchesCache = cache; }
+  PatchesCacheType * GetPatchesCache()           { return m_PatchesCache; }
 
   virtual void GenerateOutputInformation(void);
 
@@ -83,11 +132,36 @@ protected:
   TensorflowMultisourceModelTrain();
   virtual ~TensorflowMultisourceModelTrain() {};
 
+  /** Samples order */
+  typedef std::vector<tensorflow::uint64>             SampleIndexListType;
+
+  /** A batch ready to be fed to the session */
+  struct BatchType
+  {
+    tensorflow::uint64       m_Index;   // Batch number
+    DictListType             m_Inputs;  // Input tensors
+  };
+
+  virtual void ShuffleSamples(SampleIndexListType & samples);
+  virtual void FillBatch(const SampleIndexListType & samples, tensorflow::uint64 batch, DictListType & inputs);
+  virtual void TrainBatch(DictListType & inputs, tensorflow::uint64 batch);
+  virtual void ProcessBatchesSequentially(const SampleIndexListType & samples);
+  virtual void ProcessBatchesPrefetched(const SampleIndexListType & samples);
+
+  tensorflow::uint64 GetNumberOfBatches();
+
 private:
   TensorflowMultisourceModelTrain(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
 
   unsigned int               m_BatchSize;               // Batch size
+  unsigned int               m_PrefetchQueueDepth;      // Number of batches prepared in advance (0: no prefetching)
+  unsigned int               m_NumberOfLoaders;         // Number of threads preparing the batches
+  unsigned int               m_ShuffleChunkSize;        // Number of contiguous samples shuffled together (1: samples shuffle)
+  unsigned int               m_ShuffleBufferSize;       // Number of samples of the shuffle buffer (0: no shuffle buffer)
+  unsigned int               m_ReadBlockHeight;         // Max. height of the regions read with the gaps between samples (0: no gap)
+  std::mutex                 m_PipelineMutex;           // Serialize the reads of the input images
+  PatchesCacheType *         m_PatchesCache;            // Patches cache (can be null)
 
   // Read only
   unsigned int               m_NumberOfSamples;         // Number of samples
@@ -21,6 +21,12 @@ TensorflowMultisourceModelTrain<TInputImage>
 ::TensorflowMultisourceModelTrain()
  {
   m_BatchSize = 100;
+  m_PrefetchQueueDepth = 0;
+  m_NumberOfLoaders = 1;
+  m_ShuffleChunkSize = 1;
+  m_ShuffleBufferSize = 0;
+  m_ReadBlockHeight = 0;
+  m_PatchesCache = nullptr;
  }
 
 
@@ -107,90 +113,281 @@ TensorflowMultisourceModelTrain<TInputImage>
  }
 
 /**
- *
+ * Number of batches (the last batch can be smaller than the batch size)
  */
 template <class TInputImage>
-void
+tensorflow::uint64
 TensorflowMultisourceModelTrain<TInputImage>
-::GenerateData()
+::GetNumberOfBatches()
  {
+  return (m_NumberOfSamples + m_BatchSize - 1) / m_BatchSize;
+ }
 
-  // Random sequence
-  std::vector<int> v(m_NumberOfSamples) ;
-  std::iota (std::begin(v), std::end(v), 0);
-
-  // Shuffle
+/**
+ * Shuffle the samples.
+ * The chunks of m_ShuffleChunkSize contiguous samples are shuffled, then
+ * the samples go through a shuffle buffer of m_ShuffleBufferSize samples:
+ * each sample is swapped with a random sample of the buffer.
+ */
+template <class TInputImage>
+void
+TensorflowMultisourceModelTrain<TInputImage>
+::ShuffleSamples(SampleIndexListType & samples)
+ {
   std::random_device rd;
   std::mt19937 g(rd());
-  std::shuffle(v.begin(), v.end(), g);
 
-  // Batches loop
-  const tensorflow::uint64 nBatches = vcl_ceil(m_NumberOfSamples / m_BatchSize);
-  const tensorflow::uint64 rest = m_NumberOfSamples % m_BatchSize;
-  itk::ProgressReporter progress(this, 0, nBatches);
-  for (tensorflow::uint64 batch = 0 ; batch < nBatches ; batch++)
+  // Shuffle the chunks
+  const tensorflow::uint64 chunkSize = std::max(1u, m_ShuffleChunkSize);
+  const tensorflow::uint64 nChunks = (samples.size() + chunkSize - 1) / chunkSize;
+  SampleIndexListType chunks(nChunks);
+  std::iota(chunks.begin(), chunks.end(), 0);
+  std::shuffle(chunks.begin(), chunks.end(), g);
+  SampleIndexListType order;
+  order.reserve(samples.size());
+  for (auto const& chunk: chunks)
     {
-    // Update progress
-    this->UpdateProgress((float) batch / (float) nBatches);
-
-    // Create input tensors list
-    DictListType inputs;
+    const tensorflow::uint64 end = std::min<tensorflow::uint64>(samples.size(), (chunk + 1) * chunkSize);
+    for (tensorflow::uint64 k = chunk * chunkSize ; k < end ; k++)
+      order.push_back(samples[k]);
+    }
 
-    // Batch start and size
-    const tensorflow::uint64 sampleStart = batch * m_BatchSize;
-    tensorflow::uint64 batchSize = m_BatchSize;
-    if (rest != 0)
+  // Shuffle buffer
+  if (m_ShuffleBufferSize > 1)
+    {
+    const tensorflow::uint64 bufferSize = std::min<tensorflow::uint64>(m_ShuffleBufferSize, order.size());
+    std::uniform_int_distribution<tensorflow::uint64> distribution(0, bufferSize - 1);
+    SampleIndexListType buffer(order.begin(), order.begin() + bufferSize);
+    samples.clear();
+    for (tensorflow::uint64 k = bufferSize ; k < order.size() ; k++)
+      {
+      tensorflow::uint64 & slot = buffer[distribution(g)];
+      samples.push_back(slot);
+      slot = order[k];
+      }
+    std::shuffle(buffer.begin(), buffer.end(), g);
+    samples.insert(samples.end(), buffer.begin(), buffer.end());
+    }
+  else
     {
-      batchSize = rest;
+    samples.swap(order);
     }
+ }
 
-    // Populate input tensors
-    for (unsigned int i = 0 ; i < this->GetNumberOfInputs() ; i++)
-      {
-      // Input image pointer
-      ImagePointerType inputPtr = const_cast<ImageType*>(this->GetInput(i));
+/**
+ * Create the input tensors of the given batch
+ */
+template <class TInputImage>
+void
+TensorflowMultisourceModelTrain<TInputImage>
+::FillBatch(const SampleIndexListType & samples, tensorflow::uint64 batch, DictListType & inputs)
+ {
+  // Batch start and size
+  const tensorflow::uint64 sampleStart = batch * m_BatchSize;
+  const tensorflow::uint64 batchSize = std::min<tensorflow::uint64>(m_BatchSize, m_NumberOfSamples - sampleStart);
 
-      // Patch size of tensor #i
-      const SizeType inputPatchSize = this->GetInputFOVSizes().at(i);
+  // Time spent in the upstream pipeline (the remaining time is spent in the copies)
+  const tf::Profiler::TimePointType fillStart = tf::Profiler::Now();
+  tf::Profiler::ClockType::duration updateDuration(0);
+  tensorflow::uint64 nBytes = 0;
 
-      // Create the tensor for the batch
-      const tensorflow::int64 sz_n = batchSize;
-      const tensorflow::int64 sz_y = inputPatchSize[1];
-      const tensorflow::int64 sz_x = inputPatchSize[0];
-      const tensorflow::int64 sz_c = inputPtr->GetNumberOfComponentsPerPixel();
-      const tensorflow::TensorShape inputTensorShape({sz_n, sz_y, sz_x, sz_c});
-      tensorflow::Tensor inputTensor(this->GetInputTensorsDataTypes()[i], inputTensorShape);
+  // Populate input tensors
+  inputs.clear();
+  for (unsigned int i = 0 ; i < this->GetNumberOfInputs() ; i++)
+    {
+    // Input image pointer
+    ImagePointerType inputPtr = const_cast<ImageType*>(this->GetInput(i));
 
-      // Populate the tensor
+    // Patch size of tensor #i
+    const SizeType inputPatchSize = this->GetInputFOVSizes().at(i);
+
+    // Create the tensor for the batch
+    const tensorflow::int64 sz_n = batchSize;
+    const tensorflow::int64 sz_y = inputPatchSize[1];
+    const tensorflow::int64 sz_x = inputPatchSize[0];
+    const tensorflow::int64 sz_c = inputPtr->GetNumberOfComponentsPerPixel();
+    const tensorflow::TensorShape inputTensorShape({sz_n, sz_y, sz_x, sz_c});
+    tensorflow::Tensor inputTensor(this->GetInputTensorsDataTypes()[i], inputTensorShape);
+
+    // Populate the tensor
+    if (m_PatchesCache)
+      {
+      for (tensorflow::uint64 elem = 0 ; elem < batchSize ; elem++)
+        {
+        m_PatchesCache->CopyPatchToTensor(inputPtr, samples[sampleStart + elem], inputTensor, elem);
+        }
+      }
+    else
+      {
+      // Read the samples in the order of their rows: each run of contiguous
+      // samples is read with one single request. The next sample joins the
+      // run when it is contiguous, or when the run, with the rows between
+      // its samples, still fits in the read block height
+      std::vector<std::pair<tensorflow::uint64, tensorflow::uint64>> sortedSamples; // (sample, element)
+      sortedSamples.reserve(batchSize);
       for (tensorflow::uint64 elem = 0 ; elem < batchSize ; elem++)
         {
-        const tensorflow::uint64 samplePos = sampleStart + elem;
-        const tensorflow::uint64 randPos = v[samplePos];
+        sortedSamples.push_back(std::make_pair(samples[sampleStart + elem], elem));
+        }
+      std::sort(sortedSamples.begin(), sortedSamples.end());
+
+      for (tensorflow::uint64 first = 0 ; first < batchSize ; )
+        {
+        tensorflow::uint64 last = first;
+        while (last + 1 < batchSize &&
+            (sortedSamples[last + 1].first <= sortedSamples[last].first + 1 ||
+            (sortedSamples[last + 1].first - sortedSamples[first].first + 1) * sz_y <= m_ReadBlockHeight))
+          last++;
+
+        // Region of the run of samples
         IndexType start;
         start[0] = 0;
-        start[1] = randPos * sz_y;
-        RegionType patchRegion(start, inputPatchSize);
-        tf::PropagateRequestedRegion<TInputImage>(inputPtr, patchRegion);
-        tf::RecopyImageRegionToTensorWithCast<TInputImage>(inputPtr, patchRegion, inputTensor, elem );
+        start[1] = sortedSamples[first].first * sz_y;
+        SizeType runSize(inputPatchSize);
+        runSize[1] = (sortedSamples[last].first - sortedSamples[first].first + 1) * sz_y;
+        RegionType runRegion(start, runSize);
+
+        std::lock_guard<std::mutex> lock(m_PipelineMutex);
+        const tf::Profiler::TimePointType updateStart = tf::Profiler::Now();
+        tf::PropagateRequestedRegion<TInputImage>(inputPtr, runRegion);
+        updateDuration += tf::Profiler::Now() - updateStart;
+        for (tensorflow::uint64 k = first ; k <= last ; k++)
+          {
+          IndexType patchStart(start);
+          patchStart[1] = sortedSamples[k].first * sz_y;
+          RegionType patchRegion(patchStart, inputPatchSize);
+          tf::RecopyImageRegionToTensorWithCast<TInputImage>(inputPtr, patchRegion, inputTensor, sortedSamples[k].second);
+          }
+        first = last + 1;
         }
+      }
+
+    // Input #i : the tensor of patches (aka the batch)
+    DictType input1 = { this->GetInputPlaceholdersNames()[i], inputTensor };
+    inputs.push_back(input1);
+    nBytes += inputTensor.TotalBytes();
+    } // next input tensor
 
-      // Input #i : the tensor of patches (aka the batch)
-      DictType input1 = { this->GetInputPlaceholdersNames()[i], inputTensor };
-      inputs.push_back(input1);
-      } // next input tensor
+  if (this->GetProfiler())
+    {
+    const tf::Profiler::TimePointType fillEnd = tf::Profiler::Now();
+    if (updateDuration.count() > 0)
+      this->GetProfiler()->AddStage("update", batch, fillStart, fillStart + updateDuration);
+    this->GetProfiler()->AddStage("fill", batch, fillStart + updateDuration, fillEnd, nBytes);
+    }
+ }
+
+/**
+ * Run the session over one batch
+ */
+template <class TInputImage>
+void
+TensorflowMultisourceModelTrain<TInputImage>
+::TrainBatch(DictListType & inputs, tensorflow::uint64 batch)
+ {
+  const tensorflow::uint64 batchSize = inputs.empty() ? 0 : inputs[0].second.dim_size(0);
 
-    // Run the TF session here
-    TensorListType outputs;
+  // Run the TF session here
+  TensorListType outputs;
+  {
+    tf::ScopedStageTimer timer(this->GetProfiler(), "run", batch);
     this->RunSession(inputs, outputs);
+  }
+  if (this->GetProfiler())
+    {
+    this->GetProfiler()->AddSamples(batchSize);
+    }
 
-    // Get output tensors
-    for (auto& output: outputs)
-      {
-      std::cout << tf::PrintTensorInfos(output) << std::endl;
-      }
+  // Get output tensors
+  for (auto& output: outputs)
+    {
+    std::cout << tf::PrintTensorInfos(output) << std::endl;
+    }
+ }
+
+/**
+ * Prepare each batch then train it
+ */
+template <class TInputImage>
+void
+TensorflowMultisourceModelTrain<TInputImage>
+::ProcessBatchesSequentially(const SampleIndexListType & samples)
+ {
+  const tensorflow::uint64 nBatches = GetNumberOfBatches();
+  itk::ProgressReporter progress(this, 0, nBatches);
+  for (tensorflow::uint64 batch = 0 ; batch < nBatches ; batch++)
+    {
+    DictListType inputs;
+    FillBatch(samples, batch, inputs);
+    TrainBatch(inputs, batch);
 
     progress.CompletedPixel();
     } // Next batch
+ }
+
+/**
+ * Loader threads prepare the next batches while the calling thread trains
+ * the current one. Batches are pushed in a bounded queue of depth
+ * m_PrefetchQueueDepth. With multiple loaders, batches can be trained in a
+ * slightly different order than their number.
+ */
+template <class TInputImage>
+void
+TensorflowMultisourceModelTrain<TInputImage>
+::ProcessBatchesPrefetched(const SampleIndexListType & samples)
+ {
+  const tensorflow::uint64 nBatches = GetNumberOfBatches();
+  itk::ProgressReporter progress(this, 0, nBatches);
+
+  tf::ProcessPrefetchedBatches<BatchType>(nBatches, m_PrefetchQueueDepth, m_NumberOfLoaders, 1,
+      [&](tensorflow::uint64 batch, BatchType & newBatch)
+      {
+        newBatch.m_Index = batch;
+        FillBatch(samples, batch, newBatch.m_Inputs);
+      },
+      [&](BatchType & batch, unsigned int)
+      {
+        TrainBatch(batch.m_Inputs, batch.m_Index);
+        progress.CompletedPixel();
+      });
+ }
+
+/**
+ *
+ */
+template <class TInputImage>
+void
+TensorflowMultisourceModelTrain<TInputImage>
+::GenerateData()
+ {
+
+  // Random sequence
+  SampleIndexListType v(m_NumberOfSamples) ;
+  std::iota (std::begin(v), std::end(v), 0);
+
+  // Shuffle
+  ShuffleSamples(v);
+
+  // Fill the cache (first update only)
+  if (m_PatchesCache)
+    {
+    tf::ScopedStageTimer timer(this->GetProfiler(), "cache", 0);
+    for (unsigned int i = 0 ; i < this->GetNumberOfInputs() ; i++)
+      {
+      ImagePointerType inputPtr = const_cast<ImageType*>(this->GetInput(i));
+      m_PatchesCache->Add(inputPtr, this->GetInputFOVSizes().at(i));
+      }
+    }
+
+  // Batches loop
+  if (m_PrefetchQueueDepth > 0 && GetNumberOfBatches() > 1)
+    {
+    ProcessBatchesPrefetched(v);
+    }
+  else
+    {
+    ProcessBatchesSequentially(v);
+    }
 
  }
 
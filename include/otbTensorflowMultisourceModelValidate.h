@@ -25,6 +25,20 @@
 // Matrix
 #include "itkVariableSizeMatrix.h"
 
+// Patches cache
+#include "otbTensorflowPatchesCache.h"
+
+// Prefetching
+#include "otbTensorflowBatchLoader.h"
+
+// STD
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <vector>
+
 namespace otb
 {
 
@@ -36,6 +50,19 @@ namespace otb
  * Names of input placeholders must be specified using the
  * SetInputPlaceholdersNames method
  *
+ * A patches cache can be set (see SetPatchesCache()): the input patches
+ * images and the references are then read only once, and the batches are
+ * built from the cache.
+ *
+ * Like in the TensorflowMultisourceModelTrain, the batches can be prepared
+ * in the background by a set of loader threads (see SetPrefetchQueueDepth()
+ * and SetNumberOfLoaders()). The prefetched batches are then evaluated by
+ * a set of threads (see SetNumberOfEvaluators()), each one accumulating its
+ * own confusion matrices, which are summed at the end.
+ *
+ * The validation can be performed on a fixed random subset of the samples
+ * (see SetNumberOfSubsetSamples()): the subset only depends on the seed, so
+ * that successive validations use the same samples.
  *
  * \ingroup OTBTensorflow
  */
@@ -85,6 +112,21 @@ public:
   itkSetMacro(BatchSize, unsigned int);
   itkGetMacro(BatchSize, unsigned int);
   itkGetMacro(NumberOfSamples, unsigned int);
+  itkSetMacro(PrefetchQueueDepth, unsigned int);
+  itkGetMacro(PrefetchQueueDepth, unsigned int);
+  itkSetMacro(NumberOfLoaders, unsigned int);
+  itkGetMacro(NumberOfLoaders, unsigned int);
+  itkSetMacro(NumberOfEvaluators, unsigned int);
+  itkGetMacro(NumberOfEvaluators, unsigned int);
+  itkSetMacro(NumberOfSubsetSamples, unsigned int);
+  itkGetMacro(NumberOfSubsetSamples, unsigned int);
+  itkSetMacro(SubsetSeed, unsigned int);
+  itkGetMacro(SubsetSeed, unsigned int);
+
+  /** Patches cache */
+  typedef tf::PatchesCache<TInputImage>              PatchesCacheType;
+  void SetPatchesCache(PatchesCacheType * cache) { m_PatchesCache = cache; }
+  PatchesCacheType * GetPatchesCache()           { return m_PatchesCache; }
 
   virtual void GenerateOutputInformation(void);
 
@@ -103,13 +145,136 @@ protected:
   TensorflowMultisourceModelValidate();
   virtual ~TensorflowMultisourceModelValidate() {};
 
+  /** Samples to evaluate */
+  typedef std::vector<tensorflow::uint64>             SampleIndexListType;
+  typedef std::vector<LabelValueType>                 LabelListType;
+
+  /** A batch ready to be evaluated */
+  struct BatchType
+  {
+    tensorflow::uint64       m_Index;       // Batch number
+    DictListType             m_Inputs;      // Input tensors
+    std::vector<LabelListType> m_References; // Reference values of each target
+  };
+
+  /** Confusion matrix, dense over the range of the labels, which grows with
+   * the new labels. When the range becomes too large (e.g. sparse labels), the
+   * counts are moved to a map. */
+  struct DenseConfMatType
+  {
+    LabelValueType              m_First  = 0;      // First label of the range
+    LabelValueType              m_Size   = 0;      // Number of labels of the range
+    std::vector<CountValueType> m_Counts;          // Counts (row: reference label, column: predicted label)
+    bool                        m_Sparse = false;  // The counts are in the map
+    MatMapType                  m_SparseCounts;    // Counts, when the range is too large
+
+    void Add(LabelValueType classRef, LabelValueType classIn, CountValueType count = 1)
+    {
+      if (!m_Sparse && !(InRange(classRef) && InRange(classIn)))
+        Grow(std::min(classRef, classIn), std::max(classRef, classIn));
+      if (m_Sparse)
+        m_SparseCounts[classRef][classIn] += count;
+      else
+        m_Counts[(classRef - m_First) * m_Size + classIn - m_First] += count;
+    }
+
+    void Merge(const DenseConfMatType & other)
+    {
+      if (other.m_Sparse)
+        {
+        for (auto const& ref: other.m_SparseCounts)
+          for (auto const& in: ref.second)
+            Add(ref.first, in.first, in.second);
+        return;
+        }
+      if (other.m_Size == 0)
+        return;
+      if (!m_Sparse)
+        Grow(other.m_First, other.m_First + other.m_Size - 1);
+      for (LabelValueType r = 0 ; r < other.m_Size ; r++)
+        for (LabelValueType c = 0 ; c < other.m_Size ; c++)
+          if (other.m_Counts[r * other.m_Size + c] > 0)
+            Add(other.m_First + r, other.m_First + c, other.m_Counts[r * other.m_Size + c]);
+    }
+
+    // The range is computed in 64 bits, since the labels can be any int
+    bool InRange(LabelValueType label) const
+    {
+      return label >= m_First && static_cast<std::int64_t>(label) < static_cast<std::int64_t>(m_First) + m_Size;
+    }
+
+    void Grow(LabelValueType first, LabelValueType last)
+    {
+      const std::int64_t newFirst = (m_Size > 0 ? std::min(first, m_First) : first);
+      const std::int64_t newLast = (m_Size > 0 ?
+          std::max<std::int64_t>(last, static_cast<std::int64_t>(m_First) + m_Size - 1) : last);
+      if (newLast - newFirst >= MaximumNumberOfLabels)
+        {
+        ToSparse();
+        return;
+        }
+      if (m_Size > 0 && newFirst == m_First && newLast == static_cast<std::int64_t>(m_First) + m_Size - 1)
+        return;
+      const LabelValueType newSize = newLast - newFirst + 1;
+      std::vector<CountValueType> counts(newSize * newSize, 0);
+      for (LabelValueType r = 0 ; r < m_Size ; r++)
+        for (LabelValueType c = 0 ; c < m_Size ; c++)
+          counts[(m_First + r - newFirst) * newSize + m_First + c - newFirst] = m_Counts[r * m_Size + c];
+      m_First = newFirst;
+      m_Size = newSize;
+      m_Counts.swap(counts);
+    }
+
+    void ToSparse()
+    {
+      for (LabelValueType r = 0 ; r < m_Size ; r++)
+        for (LabelValueType c = 0 ; c < m_Size ; c++)
+          if (m_Counts[r * m_Size + c] > 0)
+            m_SparseCounts[m_First + r][m_First + c] += m_Counts[r * m_Size + c];
+      m_Sparse = true;
+      m_First = 0;
+      m_Size = 0;
+      std::vector<CountValueType>().swap(m_Counts);
+    }
+
+    // Non-zero counts
+    MatMapType GetCounts() const
+    {
+      if (m_Sparse)
+        return m_SparseCounts;
+      MatMapType counts;
+      for (LabelValueType r = 0 ; r < m_Size ; r++)
+        for (LabelValueType c = 0 ; c < m_Size ; c++)
+          if (m_Counts[r * m_Size + c] > 0)
+            counts[m_First + r][m_First + c] = m_Counts[r * m_Size + c];
+      return counts;
+    }
+  };
+  typedef std::vector<DenseConfMatType>               DenseConfMatListType;
+
+  /** Maximum size of the range of the labels of a dense confusion matrix */
+  static const LabelValueType MaximumNumberOfLabels = 1024;
+
+  virtual void FillBatch(tensorflow::uint64 batch, BatchType & newBatch);
+  virtual void EvaluateBatch(BatchType & batch, DenseConfMatListType & matrices);
+
+  tensorflow::uint64 GetNumberOfBatches();
+
 private:
   TensorflowMultisourceModelValidate(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
 
   unsigned int               m_BatchSize;               // Batch size
+  unsigned int               m_PrefetchQueueDepth;      // Number of batches prepared in advance (0: no prefetching)
+  unsigned int               m_NumberOfLoaders;         // Number of threads preparing the batches
+  unsigned int               m_NumberOfEvaluators;      // Number of threads evaluating the batches
+  unsigned int               m_NumberOfSubsetSamples;   // Number of samples of the subset (0: all the samples)
+  unsigned int               m_SubsetSeed;              // Seed of the random subset
   SizeListType               m_OutputFOESizes;          // Output tensors field of expression (FOE) sizes
   std::vector<ImageType *>   m_References;              // The references images
+  PatchesCacheType *         m_PatchesCache;            // Patches cache (can be null)
+  std::mutex                 m_PipelineMutex;           // Serialize the reads of the input images
+  SampleIndexListType        m_Samples;                 // Samples to evaluate
 
   // Read only
   unsigned int               m_NumberOfSamples;         // Number of samples
@@ -21,6 +21,12 @@ TensorflowMultisourceModelValidate<TInputImage>
 ::TensorflowMultisourceModelValidate()
  {
   m_BatchSize = 100;
+  m_PrefetchQueueDepth = 0;
+  m_NumberOfLoaders = 1;
+  m_NumberOfEvaluators = 1;
+  m_NumberOfSubsetSamples = 0;
+  m_SubsetSeed = 0;
+  m_PatchesCache = nullptr;
  }
 
 
@@ -154,7 +160,7 @@ const TInputImage*
 TensorflowMultisourceModelValidate<TInputImage>
 ::GetInputReference(unsigned int index)
  {
-  if (m_References.size <= index || !m_References[index])
+  if (m_References.size() <= index || !m_References[index])
     {
     itkExceptionMacro("There is no input reference #" << index);
     }
@@ -172,178 +178,270 @@ TensorflowMultisourceModelValidate<TInputImage>
  }
 
 /**
- * Perform the validation
+ * Number of batches (the last batch can be smaller than the batch size)
  */
 template <class TInputImage>
-void
+tensorflow::uint64
 TensorflowMultisourceModelValidate<TInputImage>
-::GenerateData()
+::GetNumberOfBatches()
  {
+  return (m_Samples.size() + m_BatchSize - 1) / m_BatchSize;
+ }
 
-  // Temporary images for outputs
-  m_ConfusionMatrices.clear();
-  m_MapsOfClasses.clear();
-  std::vector<MatMapType> confMatMaps;
-  for (auto const& ref: m_References)
+/**
+ * Create the input tensors of the given batch, and read its reference values
+ */
+template <class TInputImage>
+void
+TensorflowMultisourceModelValidate<TInputImage>
+::FillBatch(tensorflow::uint64 batch, BatchType & newBatch)
+ {
+  // Batch start and size
+  const tensorflow::uint64 sampleStart = batch * m_BatchSize;
+  const tensorflow::uint64 batchSize = std::min<tensorflow::uint64>(m_BatchSize, m_Samples.size() - sampleStart);
+  newBatch.m_Index = batch;
+
+  // Time spent in the upstream pipeline (the remaining time is spent in the copies)
+  const tf::Profiler::TimePointType fillStart = tf::Profiler::Now();
+  tf::Profiler::ClockType::duration updateDuration(0);
+  tensorflow::uint64 nBytes = 0;
+
+  // Populate input tensors
+  newBatch.m_Inputs.clear();
+  for (unsigned int i = 0 ; i < this->GetNumberOfInputs() ; i++)
     {
-    (void) ref;
+    // Input image pointer
+    ImagePointerType inputPtr = const_cast<ImageType*>(this->GetInput(i));
+
+    // Patch size of tensor #i
+    const SizeType inputPatchSize = this->GetInputFOVSizes().at(i);
+
+    // Create the tensor for the batch
+    const tensorflow::int64 sz_n = batchSize;
+    const tensorflow::int64 sz_y = inputPatchSize[1];
+    const tensorflow::int64 sz_x = inputPatchSize[0];
+    const tensorflow::int64 sz_c = inputPtr->GetNumberOfComponentsPerPixel();
+    const tensorflow::TensorShape inputTensorShape({sz_n, sz_y, sz_x, sz_c});
+    tensorflow::Tensor inputTensor(this->GetInputTensorsDataTypes()[i], inputTensorShape);
+
+    // Populate the tensor
+    for (tensorflow::uint64 elem = 0 ; elem < batchSize ; elem++)
+      {
+      const tensorflow::uint64 samplePos = m_Samples[sampleStart + elem];
+      IndexType start;
+      start[0] = 0;
+      start[1] = samplePos * sz_y;
+      RegionType patchRegion(start, inputPatchSize);
+      if (m_PatchesCache)
+        {
+        m_PatchesCache->CopyPatchToTensor(inputPtr, samplePos, inputTensor, elem);
+        continue;
+        }
+      std::lock_guard<std::mutex> lock(m_PipelineMutex);
+      const tf::Profiler::TimePointType updateStart = tf::Profiler::Now();
+      tf::PropagateRequestedRegion<TInputImage>(inputPtr, patchRegion);
+      updateDuration += tf::Profiler::Now() - updateStart;
+      tf::RecopyImageRegionToTensorWithCast<TInputImage>(inputPtr, patchRegion, inputTensor, elem );
+      }
+
+    // Input #i : the tensor of patches (aka the batch)
+    DictType input1 = { this->GetInputPlaceholdersNames()[i], inputTensor };
+    newBatch.m_Inputs.push_back(input1);
+    nBytes += inputTensor.TotalBytes();
+    } // next input tensor
 
-    // New confusion matrix
-    MatMapType mat;
-    confMatMaps.push_back(mat);
+  // Retrieve the reference values
+  newBatch.m_References.resize(m_References.size());
+  for (unsigned int refIdx = 0 ; refIdx < m_References.size() ; refIdx++)
+    {
+    const SizeType outputFOESize = m_OutputFOESizes[refIdx];
+    const unsigned int nRefComponents = m_References[refIdx]->GetNumberOfComponentsPerPixel();
+    LabelListType & refLabels = newBatch.m_References[refIdx];
+    refLabels.clear();
+    refLabels.reserve(batchSize * outputFOESize[0] * outputFOESize[1]);
+    for (tensorflow::uint64 elem = 0 ; elem < batchSize ; elem++)
+      {
+      const tensorflow::uint64 samplePos = m_Samples[sampleStart + elem];
+      if (m_PatchesCache)
+        {
+        const typename PatchesCacheType::ValueType * refValues = m_PatchesCache->GetPatch(m_References[refIdx], samplePos);
+        for (unsigned long k = 0 ; k < outputFOESize[0] * outputFOESize[1] ; k++)
+          refLabels.push_back(static_cast<LabelValueType>(refValues[k * nRefComponents]));
+        continue;
+        }
+      IndexType start;
+      start[0] = 0;
+      start[1] = samplePos * outputFOESize[1];
+      RegionType refRegion(start, outputFOESize);
+      std::lock_guard<std::mutex> lock(m_PipelineMutex);
+      const tf::Profiler::TimePointType updateStart = tf::Profiler::Now();
+      tf::PropagateRequestedRegion<TInputImage>(m_References[refIdx], refRegion);
+      updateDuration += tf::Profiler::Now() - updateStart;
+      IteratorType refIt(m_References[refIdx], refRegion);
+      for (refIt.GoToBegin(); !refIt.IsAtEnd(); ++refIt)
+        refLabels.push_back(static_cast<LabelValueType>(refIt.Get()[0]));
+      }
     }
 
-  // Batches loop
-  const tensorflow::uint64 nBatches = vcl_ceil(m_NumberOfSamples / m_BatchSize);
-  const tensorflow::uint64 rest = m_NumberOfSamples % m_BatchSize;
-  itk::ProgressReporter progress(this, 0, nBatches);
-  for (tensorflow::uint64 batch = 0 ; batch < nBatches ; batch++)
+  if (this->GetProfiler())
     {
-    // Update progress
-    this->UpdateProgress((float) batch / (float) nBatches);
+    const tf::Profiler::TimePointType fillEnd = tf::Profiler::Now();
+    if (updateDuration.count() > 0)
+      this->GetProfiler()->AddStage("update", batch, fillStart, fillStart + updateDuration);
+    this->GetProfiler()->AddStage("fill", batch, fillStart + updateDuration, fillEnd, nBytes);
+    }
+ }
 
-    // Sample start of this batch
-    const tensorflow::uint64 sampleStart = batch * m_BatchSize;
-    tensorflow::uint64 batchSize = m_BatchSize;
-    if (rest != 0)
+/**
+ * Run the session over one batch, and update the confusion matrices
+ */
+template <class TInputImage>
+void
+TensorflowMultisourceModelValidate<TInputImage>
+::EvaluateBatch(BatchType & batch, DenseConfMatListType & matrices)
+ {
+  const tensorflow::uint64 batchSize = batch.m_Inputs.empty() ? 0 : batch.m_Inputs[0].second.dim_size(0);
+
+  // Run the TF session here
+  TensorListType outputs;
+  {
+    tf::ScopedStageTimer timer(this->GetProfiler(), "run", batch.m_Index);
+    this->RunSession(batch.m_Inputs, outputs);
+  }
+  if (this->GetProfiler())
     {
-      batchSize = rest;
+    this->GetProfiler()->AddSamples(batchSize);
     }
+  tf::ScopedStageTimer metricsTimer(this->GetProfiler(), "metrics", batch.m_Index);
 
-    // Create input tensors list
-    DictListType inputs;
+  // Perform the validation
+  if (outputs.size() != m_References.size())
+    {
+    itkWarningMacro("There is " << outputs.size() << " outputs returned after session run, " <<
+                    "but only " << m_References.size() << " reference(s) set");
+    }
 
-    // Populate input tensors
-    for (unsigned int i = 0 ; i < this->GetNumberOfInputs() ; i++)
+  const unsigned int nTargets = std::min<std::size_t>(outputs.size(), m_References.size());
+  for (unsigned int refIdx = 0 ; refIdx < nTargets ; refIdx++)
+    {
+    // Predicted values (first channel of the output tensor)
+    const LabelListType & refLabels = batch.m_References[refIdx];
+    const tensorflow::int64 nPixels = refLabels.size();
+    tf::CheckTensorNumberOfElements(outputs[refIdx], nPixels, "Batch #" + std::to_string(batch.m_Index));
+    const tensorflow::int64 nChannels = tf::GetNumberOfChannelsForOutputTensor(outputs[refIdx]);
+    std::vector<tensorflow::int64> pixels(nPixels);
+    std::iota(pixels.begin(), pixels.end(), 0);
+    std::vector<float> values(nPixels * nChannels);
+    tf::GatherPixelsValues(outputs[refIdx], pixels, values.data(), nChannels);
+
+    // Update the confusion matrix
+    DenseConfMatType & matrix = matrices[refIdx];
+    for (tensorflow::int64 pos = 0 ; pos < nPixels ; pos++)
       {
-      // Input image pointer
-      ImagePointerType inputPtr = const_cast<ImageType*>(this->GetInput(i));
-
-      // Patch size of tensor #i
-      const SizeType inputPatchSize = this->GetInputFOVSizes().at(i);
-
-      // Create the tensor for the batch
-      const tensorflow::int64 sz_n = batchSize;
-      const tensorflow::int64 sz_y = inputPatchSize[1];
-      const tensorflow::int64 sz_x = inputPatchSize[0];
-      const tensorflow::int64 sz_c = inputPtr->GetNumberOfComponentsPerPixel();
-      const tensorflow::TensorShape inputTensorShape({sz_n, sz_y, sz_x, sz_c});
-      tensorflow::Tensor inputTensor(this->GetInputTensorsDataTypes()[i], inputTensorShape);
-
-      // Populate the tensor
-      for (tensorflow::uint64 elem = 0 ; elem < batchSize ; elem++)
-        {
-        const tensorflow::uint64 samplePos = sampleStart + elem;
-        IndexType start;
-        start[0] = 0;
-        start[1] = samplePos * sz_y;
-        RegionType patchRegion(start, inputPatchSize);
-        tf::PropagateRequestedRegion<TInputImage>(inputPtr, patchRegion);
-        tf::RecopyImageRegionToTensorWithCast<TInputImage>(inputPtr, patchRegion, inputTensor, elem );
-        }
+      matrix.Add(refLabels[pos], static_cast<LabelValueType>(values[pos * nChannels]));
+      }
+    }
+ }
 
-      // Input #i : the tensor of patches (aka the batch)
-      DictType input1 = { this->GetInputPlaceholdersNames()[i], inputTensor };
-      inputs.push_back(input1);
-      } // next input tensor
+/**
+ * Perform the validation
+ */
+template <class TInputImage>
+void
+TensorflowMultisourceModelValidate<TInputImage>
+::GenerateData()
+ {
 
-    // Run the TF session here
-    TensorListType outputs;
-    this->RunSession(inputs, outputs);
+  // Samples to evaluate: all of them, or a fixed random subset
+  m_Samples.resize(m_NumberOfSamples);
+  std::iota(m_Samples.begin(), m_Samples.end(), 0);
+  if (m_NumberOfSubsetSamples > 0 && m_NumberOfSubsetSamples < m_NumberOfSamples)
+    {
+    std::mt19937 g(m_SubsetSeed);
+    std::shuffle(m_Samples.begin(), m_Samples.end(), g);
+    m_Samples.resize(m_NumberOfSubsetSamples);
+    std::sort(m_Samples.begin(), m_Samples.end()); // read the samples in order
+    }
 
-    // Perform the validation
-    if (outputs.size() != m_References.size())
+  // Fill the cache
+  if (m_PatchesCache)
+    {
+    tf::ScopedStageTimer timer(this->GetProfiler(), "cache", 0);
+    for (unsigned int i = 0 ; i < this->GetNumberOfInputs() ; i++)
       {
-      itkWarningMacro("There is " << outputs.size() << " outputs returned after session run, " <<
-                      "but only " << m_References.size() << " reference(s) set");
+      ImagePointerType inputPtr = const_cast<ImageType*>(this->GetInput(i));
+      m_PatchesCache->Add(inputPtr, this->GetInputFOVSizes().at(i));
       }
-
-    for (unsigned int refIdx = 0 ; refIdx < outputs.size() ; refIdx++)
+    for (unsigned int refIdx = 0 ; refIdx < m_References.size() ; refIdx++)
       {
-      // Recopy the chunk
-      const SizeType outputFOESize = m_OutputFOESizes[refIdx];
-      IndexType cpyStart;
-      cpyStart.Fill(0);
-      IndexType refRegStart;
-      refRegStart.Fill(0);
-      refRegStart[1] = outputFOESize[1] * sampleStart;
-      SizeType cpySize;
-      cpySize[0] = outputFOESize[0];
-      cpySize[1] = outputFOESize[1] * batchSize;
-      RegionType cpyRegion(cpyStart, cpySize);
-      RegionType refRegion(refRegStart, cpySize);
-
-      // Allocate a temporary image
-      ImagePointerType img = ImageType::New();
-      img->SetRegions(cpyRegion);
-      img->SetNumberOfComponentsPerPixel(1);
-      img->Allocate();
-
-      int co = 0;
-      tf::CopyTensorToImageRegion<TInputImage>(outputs[refIdx], cpyRegion, img, cpyRegion, co);
-
-      // Retrieve the reference image region
-      tf::PropagateRequestedRegion<TInputImage>(m_References[refIdx], refRegion);
+      m_PatchesCache->Add(m_References[refIdx], m_OutputFOESizes[refIdx]);
+      }
+    }
 
-      // Update the confusion matrices
-      IteratorType inIt(img, cpyRegion);
-      IteratorType refIt(m_References[refIdx], refRegion);
-      for (inIt.GoToBegin(), refIt.GoToBegin(); !inIt.IsAtEnd(); ++inIt, ++refIt)
+  // Batches loop
+  // Each evaluator accumulates its own confusion matrices
+  const tensorflow::uint64 nBatches = GetNumberOfBatches();
+  itk::ProgressReporter progress(this, 0, nBatches);
+  std::vector<DenseConfMatListType> matrices;
+  if (m_PrefetchQueueDepth > 0 && nBatches > 1)
+    {
+    matrices.resize(std::max(1u, m_NumberOfEvaluators), DenseConfMatListType(m_References.size()));
+    std::mutex progressMutex;
+    tf::ProcessPrefetchedBatches<BatchType>(nBatches, m_PrefetchQueueDepth, m_NumberOfLoaders, matrices.size(),
+        [&](tensorflow::uint64 batch, BatchType & newBatch)
         {
-        const int classIn = static_cast<LabelValueType>(inIt.Get()[0]);
-        const int classRef = static_cast<LabelValueType>(refIt.Get()[0]);
-
-        if (confMatMaps[refIdx].count(classRef) == 0)
-          {
-          MapType newMap;
-          newMap[classIn] = 1;
-          confMatMaps[refIdx][classRef] = newMap;
-          }
-        else
-          {
-          if (confMatMaps[refIdx][classRef].count(classIn) == 0)
-            {
-            confMatMaps[refIdx][classRef][classIn] = 1;
-            }
-          else
-            {
-            confMatMaps[refIdx][classRef][classIn]++;
-            }
-          }
-        }
-      }
-    progress.CompletedPixel();
-    } // Next batch
+          FillBatch(batch, newBatch);
+        },
+        [&](BatchType & batch, unsigned int evaluator)
+        {
+          EvaluateBatch(batch, matrices[evaluator]);
+          std::lock_guard<std::mutex> lock(progressMutex);
+          progress.CompletedPixel();
+        });
+    }
+  else
+    {
+    matrices.resize(1, DenseConfMatListType(m_References.size()));
+    for (tensorflow::uint64 batch = 0 ; batch < nBatches ; batch++)
+      {
+      BatchType newBatch;
+      FillBatch(batch, newBatch);
+      EvaluateBatch(newBatch, matrices[0]);
+      progress.CompletedPixel();
+      } // Next batch
+    }
 
   // Compute confusion matrices
-  for (unsigned int i = 0 ; i < confMatMaps.size() ; i++)
+  m_ConfusionMatrices.clear();
+  m_MapsOfClasses.clear();
+  for (unsigned int refIdx = 0 ; refIdx < m_References.size() ; refIdx++)
     {
-    // Confusion matrix (map) for current target
-    MatMapType mat = confMatMaps[i];
+    // Sum the confusion matrices of the evaluators
+    DenseConfMatType mat;
+    for (auto const& evaluatorMatrices: matrices)
+      mat.Merge(evaluatorMatrices[refIdx]);
 
-    // List all values
+    // List all values (labels which are in a reference or in a prediction)
+    const MatMapType counts = mat.GetCounts();
     MapOfClassesType values;
-    LabelValueType curVal = 0;
-    for (auto const& ref: mat)
+    for (auto const& ref: counts)
       {
-      if (values.count(ref.first) == 0)
-        {
-        values[ref.first] = curVal;
-        curVal++;
-        }
+      values[ref.first] = 0;
       for (auto const& in: ref.second)
-        if (values.count(in.first) == 0)
-          {
-          values[in.first] = curVal;
-          curVal++;
-          }
+        values[in.first] = 0;
+      }
+    LabelValueType curVal = 0;
+    for (auto& value: values)
+      {
+      value.second = curVal;
+      curVal++;
       }
 
     // Build the confusion matrix
     const LabelValueType nValues = values.size();
     ConfMatType matrix(nValues, nValues);
     matrix.Fill(0);
-    for (auto const& ref: mat)
+    for (auto const& ref: counts)
       for (auto const& in: ref.second)
         matrix[values[ref.first]][values[in.first]] = in.second;
 
@@ -0,0 +1,122 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWPATCHESCACHE_H_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWPATCHESCACHE_H_
+
+// ITK exception
+#include "itkMacro.h"
+
+// Tensorflow
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/env.h"
+
+// Tensorflow helpers
+#include "otbTensorflowCommon.h"
+#include "otbTensorflowCopyUtils.h"
+
+// STD
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <fstream>
+
+namespace otb {
+namespace tf {
+
+/*
+ * This is a cache for the patches images used to train or validate models.
+ * A patches image (patches of size {x, y} stacked in the y dimension) is read
+ * once and its pixels are kept in one contiguous array, which is also the
+ * {n, y, x, c} layout of a batch. Then, the patches are copied into the
+ * tensors straight from the cache, and the patches images are not read
+ * anymore (e.g. at the next epochs, or for the validation).
+ * The same cache can be shared between multiple filters (e.g. the training
+ * and the test of a model, which use the same patches images).
+ *
+ * The arrays are allocated in memory, or, when a directory is set (see
+ * SetDirectory()), written in files which are then memory-mapped: this
+ * enables to cache patches sets that do not fit in memory. The files are
+ * removed when the cache is destroyed.
+ *
+ * Images are identified with their pointer: images must remain the same
+ * during the life of the cache.
+ */
+template<class TImage>
+class PatchesCache
+{
+public:
+
+  typedef typename TImage::Pointer                 ImagePointerType;
+  typedef typename TImage::InternalPixelType       ValueType;
+  typedef typename TImage::RegionType              RegionType;
+  typedef typename TImage::SizeType                SizeType;
+  typedef typename TImage::IndexType               IndexType;
+
+  PatchesCache();
+  virtual ~PatchesCache ();
+
+  // Directory used to store the memory-mapped files (empty: in-memory cache)
+  void SetDirectory(const std::string & directory) { m_Directory = directory; }
+  std::string GetDirectory() const { return m_Directory; }
+
+  // Number of rows of patches read at once when caching an image
+  void SetNumberOfSamplesPerRead(unsigned int n) { m_NumberOfSamplesPerRead = n; }
+
+  // Return true if the patches image is in the cache
+  bool Contains(const TImage * image);
+
+  // Read the patches image, and put it in the cache (if it's not already in)
+  void Add(ImagePointerType image, const SizeType & patchSize);
+
+  // Put in the cache the patches of the image, which are already stored in a contiguous array
+  // (e.g. a memory-mapped samples dataset). The array must be alive during the life of the cache.
+  void AddExternal(const TImage * image, const ValueType * values, tensorflow::uint64 nSamples);
+
+  // Copy the patch #sample of the image into the element #elemIdx of the tensor
+  void CopyPatchToTensor(const TImage * image, tensorflow::uint64 sample, tensorflow::Tensor & tensor, tensorflow::uint64 elemIdx);
+
+  // Get the values of the patch #sample of the image
+  const ValueType * GetPatch(const TImage * image, tensorflow::uint64 sample);
+
+  // Number of values in one patch of the image
+  tensorflow::uint64 GetPatchNumberOfValues(const TImage * image);
+
+private:
+  PatchesCache(const PatchesCache&); //purposely not implemented
+  void operator=(const PatchesCache&); //purposely not implemented
+
+  /* One cached patches image */
+  struct EntryType
+  {
+    tensorflow::uint64                                   m_NumberOfSamples;  // Number of patches
+    tensorflow::uint64                                   m_PatchSize;        // Number of values in one patch
+    std::vector<ValueType>                               m_Values;           // In-memory values
+    std::unique_ptr<tensorflow::ReadOnlyMemoryRegion>    m_MappedValues;     // Memory-mapped values
+    const ValueType *                                    m_Data;             // Pointer to the values
+    std::string                                          m_FileName;         // Memory-mapped file
+  };
+
+  const EntryType & GetEntry(const TImage * image);
+
+  std::string                                         m_Directory;              // Directory of the memory-mapped files
+  unsigned int                                        m_NumberOfSamplesPerRead; // Number of patches read at once
+  std::map<const TImage *, std::unique_ptr<EntryType>> m_Entries;               // Cached images
+  std::mutex                                          m_Mutex;
+
+};
+
+} // end namespace tf
+} // end namespace otb
+
+#include "otbTensorflowPatchesCache.hxx"
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWPATCHESCACHE_H_ */
@@ -0,0 +1,228 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWPATCHESCACHE_HXX_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWPATCHESCACHE_HXX_
+
+#include "otbTensorflowPatchesCache.h"
+
+// std::remove
+#include <cstdio>
+
+namespace otb {
+namespace tf {
+
+template<class TImage>
+PatchesCache<TImage>::PatchesCache()
+{
+  m_NumberOfSamplesPerRead = 1000;
+}
+
+template<class TImage>
+PatchesCache<TImage>::~PatchesCache()
+{
+  // Unmap and remove the files
+  for (auto & entry: m_Entries)
+  {
+    entry.second->m_MappedValues.reset();
+    if (!entry.second->m_FileName.empty())
+      std::remove(entry.second->m_FileName.c_str());
+  }
+}
+
+//
+// Return true if the patches image is in the cache
+//
+template<class TImage>
+bool
+PatchesCache<TImage>::Contains(const TImage * image)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Entries.count(image) > 0;
+}
+
+//
+// Read the patches image, and put it in the cache
+// The image is read by strips of m_NumberOfSamplesPerRead patches.
+//
+template<class TImage>
+void
+PatchesCache<TImage>::Add(ImagePointerType image, const SizeType & patchSize)
+{
+  if (Contains(image))
+    return;
+
+  image->UpdateOutputInformation();
+  const RegionType largestRegion = image->GetLargestPossibleRegion();
+  if (largestRegion.GetSize(0) != patchSize[0] || largestRegion.GetSize(1) % patchSize[1] != 0)
+  {
+    itkGenericExceptionMacro("Patches image of size " << largestRegion.GetSize() <<
+        " is not consistent with the patch size " << patchSize);
+  }
+
+  std::unique_ptr<EntryType> entry(new EntryType());
+  entry->m_NumberOfSamples = largestRegion.GetSize(1) / patchSize[1];
+  entry->m_PatchSize = patchSize[0] * patchSize[1] * image->GetNumberOfComponentsPerPixel();
+
+  // Output file (memory-mapped cache)
+  std::string fileName;
+  std::ofstream file;
+  if (!m_Directory.empty())
+  {
+    std::stringstream ss;
+    ss << m_Directory << "/otbtf_cache_" << m_Entries.size() << "_" << static_cast<const void*>(image.GetPointer()) << ".bin";
+    fileName = ss.str();
+    file.open(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+      itkGenericExceptionMacro("Unable to open the cache file " << fileName);
+    }
+  }
+  else
+  {
+    entry->m_Values.resize(entry->m_NumberOfSamples * entry->m_PatchSize);
+  }
+
+  // Read the image by strips
+  const tensorflow::uint64 nSamplesPerRead = std::max(1u, m_NumberOfSamplesPerRead);
+  for (tensorflow::uint64 first = 0 ; first < entry->m_NumberOfSamples ; first += nSamplesPerRead)
+  {
+    const tensorflow::uint64 n = std::min(nSamplesPerRead, entry->m_NumberOfSamples - first);
+    IndexType start;
+    start[0] = 0;
+    start[1] = first * patchSize[1];
+    SizeType size;
+    size[0] = patchSize[0];
+    size[1] = n * patchSize[1];
+    RegionType region(start, size);
+    PropagateRequestedRegion<TImage>(image, region);
+
+    // The strip is contiguous in the image buffer
+    const RegionType bufferedRegion = image->GetBufferedRegion();
+    const ValueType * values = image->GetBufferPointer() +
+        (start[1] - bufferedRegion.GetIndex(1)) * bufferedRegion.GetSize(0) * image->GetNumberOfComponentsPerPixel();
+    if (file.is_open())
+    {
+      file.write(reinterpret_cast<const char*>(values), n * entry->m_PatchSize * sizeof(ValueType));
+    }
+    else
+    {
+      std::copy_n(values, n * entry->m_PatchSize, entry->m_Values.data() + first * entry->m_PatchSize);
+    }
+  }
+
+  // Map the file
+  if (file.is_open())
+  {
+    file.close();
+    auto status = tensorflow::Env::Default()->NewReadOnlyMemoryRegionFromFile(fileName, &entry->m_MappedValues);
+    if (!status.ok())
+    {
+      itkGenericExceptionMacro("Unable to map the cache file " << fileName << ": " << status.ToString());
+    }
+    entry->m_Data = static_cast<const ValueType*>(entry->m_MappedValues->data());
+    entry->m_FileName = fileName;
+  }
+  else
+  {
+    entry->m_Data = entry->m_Values.data();
+  }
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Entries[image.GetPointer()] = std::move(entry);
+}
+
+//
+// Put in the cache the patches of the image, stored in an external array
+//
+template<class TImage>
+void
+PatchesCache<TImage>::AddExternal(const TImage * image, const ValueType * values, tensorflow::uint64 nSamples)
+{
+  const SizeType size = image->GetLargestPossibleRegion().GetSize();
+  if (nSamples == 0 || size[1] % nSamples != 0)
+  {
+    itkGenericExceptionMacro("Patches image of size " << size << " is not consistent with " << nSamples << " samples");
+  }
+
+  std::unique_ptr<EntryType> entry(new EntryType());
+  entry->m_NumberOfSamples = nSamples;
+  entry->m_PatchSize = size[0] * (size[1] / nSamples) * image->GetNumberOfComponentsPerPixel();
+  entry->m_Data = values;
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Entries[image] = std::move(entry);
+}
+
+//
+// Get the cache entry of an image
+//
+template<class TImage>
+const typename PatchesCache<TImage>::EntryType &
+PatchesCache<TImage>::GetEntry(const TImage * image)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto it = m_Entries.find(image);
+  if (it == m_Entries.end())
+  {
+    itkGenericExceptionMacro("The patches image is not in the cache");
+  }
+  return *(it->second);
+}
+
+//
+// Get the values of the patch #sample of the image
+//
+template<class TImage>
+const typename PatchesCache<TImage>::ValueType *
+PatchesCache<TImage>::GetPatch(const TImage * image, tensorflow::uint64 sample)
+{
+  const EntryType & entry = GetEntry(image);
+  if (sample >= entry.m_NumberOfSamples)
+  {
+    itkGenericExceptionMacro("Patch #" << sample << " is out of the cache (" << entry.m_NumberOfSamples << " patches)");
+  }
+  return entry.m_Data + sample * entry.m_PatchSize;
+}
+
+//
+// Number of values in one patch of the image
+//
+template<class TImage>
+tensorflow::uint64
+PatchesCache<TImage>::GetPatchNumberOfValues(const TImage * image)
+{
+  return GetEntry(image).m_PatchSize;
+}
+
+//
+// Copy the patch #sample of the image into the element #elemIdx of the tensor
+//
+template<class TImage>
+void
+PatchesCache<TImage>::CopyPatchToTensor(const TImage * image, tensorflow::uint64 sample,
+    tensorflow::Tensor & tensor, tensorflow::uint64 elemIdx)
+{
+  const ValueType * values = GetPatch(image, sample);
+  const tensorflow::uint64 n = GetPatchNumberOfValues(image);
+  if (tensor.dims() == 0 || tensor.dim_size(0) <= (tensorflow::int64) elemIdx ||
+      (tensorflow::uint64) tensor.NumElements() != n * tensor.dim_size(0))
+  {
+    itkGenericExceptionMacro("Cached patches of " << n << " values can't be copied in the tensor of shape " <<
+        PrintTensorShape(tensor.shape()));
+  }
+
+  DispatchDataType<ConvertValuesToTensorFunctor>(tensor.dtype(), values, tensor, elemIdx * n, n);
+}
+
+} // end namespace tf
+} // end namespace otb
+
+#endif
@@ -0,0 +1,115 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWPATCHESDATASET_H_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWPATCHESDATASET_H_
+
+// ITK exception
+#include "itkMacro.h"
+
+// Tensorflow helpers (patches images)
+#include "otbTensorflowCommon.h"
+
+// STD
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace otb {
+namespace tf {
+
+/*
+ * This is a samples dataset file, which stores the patches of multiple
+ * sources (and the labels) as contiguous {n, y, x, c} arrays.
+ *
+ * Layout of the file:
+ * -a header of DATASET_ALIGNMENT bytes: the magic string, the version, the
+ *  number of arrays, the number of samples, then for each array: its
+ *  value type (see GetValueTypeCode()), y, x, c, and its offset in the file,
+ * -the arrays, each one starting at an offset which is a multiple of
+ *  DATASET_ALIGNMENT. A batch of consecutive samples is a single slice of
+ *  an array.
+ * Values are stored in the native byte order.
+ *
+ * This class does not depend on tensorflow, so that the dataset can be
+ * written by any application. The dataset is read from a memory-mapped file
+ * (see MappedPatchesDataset): opening a dataset does not depend on its size,
+ * and samples are read from the pages on demand.
+ */
+template<class TImage>
+class PatchesDataset
+{
+public:
+
+  typedef typename TImage::Pointer                 ImagePointerType;
+  typedef typename TImage::InternalPixelType       ValueType;
+  typedef typename TImage::RegionType              RegionType;
+  typedef typename TImage::SizeType                SizeType;
+  typedef typename TImage::IndexType               IndexType;
+  typedef std::vector<ImagePointerType>            ImagePointerListType;
+  typedef std::vector<SizeType>                    SizeListType;
+  typedef std::uint64_t                            UInt64Type;
+
+  PatchesDataset();
+  virtual ~PatchesDataset() {};
+
+  // Write the patches images (one array per image) in a dataset file
+  static void Write(const std::string & fileName, const ImagePointerListType & images,
+      const SizeListType & patchSizes, unsigned int nSamplesPerRead = 1000);
+
+  // Read the dataset stored in the given buffer (e.g. a memory-mapped file)
+  void SetData(const char * data, UInt64Type length, const std::string & name);
+
+  // Dataset infos
+  unsigned int GetNumberOfArrays() const         { return m_Arrays.size(); }
+  UInt64Type GetNumberOfSamples() const          { return m_NumberOfSamples; }
+  SizeType GetPatchSize(unsigned int array) const;
+  unsigned int GetNumberOfComponents(unsigned int array) const;
+
+  // Values of the array #array
+  const ValueType * GetArray(unsigned int array) const;
+
+  // Code of the type of the values
+  static UInt64Type GetValueTypeCode();
+
+private:
+  PatchesDataset(const PatchesDataset&); //purposely not implemented
+  void operator=(const PatchesDataset&); //purposely not implemented
+
+  /* Description of one array */
+  struct ArrayType
+  {
+    UInt64Type m_ValueType;
+    UInt64Type m_SizeY;
+    UInt64Type m_SizeX;
+    UInt64Type m_NumberOfComponents;
+    UInt64Type m_Offset;
+  };
+
+  static const char *       DATASET_MAGIC;
+  static const UInt64Type   DATASET_VERSION   = 1;
+  static const UInt64Type   DATASET_ALIGNMENT = 4096;
+
+  std::string               m_Name;            // Name of the dataset (for messages)
+  const char *              m_Data;            // Dataset buffer
+  UInt64Type                m_NumberOfSamples; // Number of samples
+  std::vector<ArrayType>    m_Arrays;          // Arrays description
+
+};
+
+} // end namespace tf
+} // end namespace otb
+
+#include "otbTensorflowPatchesDataset.hxx"
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWPATCHESDATASET_H_ */
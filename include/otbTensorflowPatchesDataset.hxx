@@ -0,0 +1,256 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWPATCHESDATASET_HXX_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWPATCHESDATASET_HXX_
+
+#include "otbTensorflowPatchesDataset.h"
+
+namespace otb {
+namespace tf {
+
+template<class TImage>
+const char * PatchesDataset<TImage>::DATASET_MAGIC = "OTBTFPDS";
+
+template<class TImage>
+PatchesDataset<TImage>::PatchesDataset()
+{
+  m_Data = nullptr;
+  m_NumberOfSamples = 0;
+}
+
+//
+// Code of the type of the values: size (in bytes), signedness, and
+// floating point flag
+//
+template<class TImage>
+typename PatchesDataset<TImage>::UInt64Type
+PatchesDataset<TImage>::GetValueTypeCode()
+{
+  return sizeof(ValueType) |
+      (std::is_signed<ValueType>::value ? 1 << 8 : 0) |
+      (std::is_floating_point<ValueType>::value ? 1 << 9 : 0);
+}
+
+//
+// Write the patches images in a dataset file
+// Each image has the usual patches image layout (patches stacked in y) and
+// is read by strips of nSamplesPerRead patches.
+//
+template<class TImage>
+void
+PatchesDataset<TImage>::Write(const std::string & fileName, const ImagePointerListType & images,
+    const SizeListType & patchSizes, unsigned int nSamplesPerRead)
+{
+  if (images.size() != patchSizes.size() || images.empty())
+  {
+    itkGenericExceptionMacro("Number of images and patches sizes are not the same");
+  }
+
+  // Arrays description
+  UInt64Type nSamples = 0;
+  std::vector<ArrayType> arrays;
+  UInt64Type offset = DATASET_ALIGNMENT;
+  for (unsigned int i = 0 ; i < images.size() ; i++)
+  {
+    images[i]->UpdateOutputInformation();
+    const RegionType largestRegion = images[i]->GetLargestPossibleRegion();
+    if (largestRegion.GetSize(0) != patchSizes[i][0] || largestRegion.GetSize(1) % patchSizes[i][1] != 0)
+    {
+      itkGenericExceptionMacro("Patches image #" << i << " of size " << largestRegion.GetSize() <<
+          " is not consistent with the patch size " << patchSizes[i]);
+    }
+    const UInt64Type n = largestRegion.GetSize(1) / patchSizes[i][1];
+    if (i == 0)
+      nSamples = n;
+    else if (n != nSamples)
+    {
+      itkGenericExceptionMacro("Patches image #" << i << " has " << n << " samples but previous ones have " << nSamples);
+    }
+
+    ArrayType array;
+    array.m_ValueType = GetValueTypeCode();
+    array.m_SizeY = patchSizes[i][1];
+    array.m_SizeX = patchSizes[i][0];
+    array.m_NumberOfComponents = images[i]->GetNumberOfComponentsPerPixel();
+    array.m_Offset = offset;
+    arrays.push_back(array);
+
+    const UInt64Type nBytes = n * array.m_SizeY * array.m_SizeX * array.m_NumberOfComponents * sizeof(ValueType);
+    offset += ((nBytes + DATASET_ALIGNMENT - 1) / DATASET_ALIGNMENT) * DATASET_ALIGNMENT;
+  }
+
+  // Header
+  std::vector<char> header(DATASET_ALIGNMENT, 0);
+  std::vector<UInt64Type> fields;
+  fields.push_back(DATASET_VERSION);
+  fields.push_back(arrays.size());
+  fields.push_back(nSamples);
+  for (auto const& array: arrays)
+  {
+    fields.push_back(array.m_ValueType);
+    fields.push_back(array.m_SizeY);
+    fields.push_back(array.m_SizeX);
+    fields.push_back(array.m_NumberOfComponents);
+    fields.push_back(array.m_Offset);
+  }
+  if (8 + fields.size() * sizeof(UInt64Type) > DATASET_ALIGNMENT)
+  {
+    itkGenericExceptionMacro("Too many arrays in the dataset");
+  }
+  std::memcpy(header.data(), DATASET_MAGIC, 8);
+  std::memcpy(header.data() + 8, fields.data(), fields.size() * sizeof(UInt64Type));
+
+  std::ofstream file(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+  {
+    itkGenericExceptionMacro("Unable to open the dataset file " << fileName);
+  }
+  file.write(header.data(), header.size());
+
+  // Arrays
+  const UInt64Type nPerRead = std::max(1u, nSamplesPerRead);
+  for (unsigned int i = 0 ; i < images.size() ; i++)
+  {
+    file.seekp(arrays[i].m_Offset);
+    const unsigned int nComponents = arrays[i].m_NumberOfComponents;
+    for (UInt64Type first = 0 ; first < nSamples ; first += nPerRead)
+    {
+      const UInt64Type n = std::min(nPerRead, nSamples - first);
+      IndexType start;
+      start[0] = 0;
+      start[1] = first * patchSizes[i][1];
+      SizeType size;
+      size[0] = patchSizes[i][0];
+      size[1] = n * patchSizes[i][1];
+      RegionType region(start, size);
+      PropagateRequestedRegion<TImage>(images[i], region);
+
+      // The strip is contiguous in the image buffer
+      const RegionType bufferedRegion = images[i]->GetBufferedRegion();
+      const ValueType * values = images[i]->GetBufferPointer() +
+          (start[1] - bufferedRegion.GetIndex(1)) * bufferedRegion.GetSize(0) * nComponents;
+      file.write(reinterpret_cast<const char*>(values), size[0] * size[1] * nComponents * sizeof(ValueType));
+    }
+  }
+
+  // Pad the end of the last array
+  file.seekp(offset - 1);
+  file.put(0);
+  if (!file.good())
+  {
+    itkGenericExceptionMacro("Error while writing the dataset file " << fileName);
+  }
+}
+
+//
+// Read the dataset stored in the given buffer
+//
+template<class TImage>
+void
+PatchesDataset<TImage>::SetData(const char * data, UInt64Type length, const std::string & name)
+{
+  m_Name = name;
+  m_Data = data;
+  m_Arrays.clear();
+  m_NumberOfSamples = 0;
+
+  // Check the header
+  if (length < DATASET_ALIGNMENT || std::memcmp(data, DATASET_MAGIC, 8) != 0)
+  {
+    itkGenericExceptionMacro("File " << name << " is not a samples dataset");
+  }
+  std::vector<UInt64Type> fields((DATASET_ALIGNMENT - 8) / sizeof(UInt64Type));
+  std::memcpy(fields.data(), data + 8, fields.size() * sizeof(UInt64Type));
+  if (fields[0] != DATASET_VERSION)
+  {
+    itkGenericExceptionMacro("Dataset " << name << " has version " << fields[0] <<
+        " but only version " << DATASET_VERSION << " is supported");
+  }
+  const UInt64Type nArrays = fields[1];
+  if (3 + 5 * nArrays > fields.size())
+  {
+    itkGenericExceptionMacro("Dataset " << name << " header is corrupted");
+  }
+  m_NumberOfSamples = fields[2];
+
+  // Arrays
+  for (UInt64Type i = 0 ; i < nArrays ; i++)
+  {
+    ArrayType array;
+    array.m_ValueType          = fields[3 + 5 * i];
+    array.m_SizeY              = fields[4 + 5 * i];
+    array.m_SizeX              = fields[5 + 5 * i];
+    array.m_NumberOfComponents = fields[6 + 5 * i];
+    array.m_Offset             = fields[7 + 5 * i];
+    if (array.m_ValueType != GetValueTypeCode())
+    {
+      itkGenericExceptionMacro("Array #" << i << " of dataset " << name << " has value type " <<
+          array.m_ValueType << " but " << GetValueTypeCode() << " is expected");
+    }
+    const UInt64Type nBytes = m_NumberOfSamples * array.m_SizeY * array.m_SizeX *
+        array.m_NumberOfComponents * sizeof(ValueType);
+    if (array.m_Offset + nBytes > length)
+    {
+      itkGenericExceptionMacro("Array #" << i << " of dataset " << name << " is truncated");
+    }
+    m_Arrays.push_back(array);
+  }
+}
+
+//
+// Patch size of an array
+//
+template<class TImage>
+typename PatchesDataset<TImage>::SizeType
+PatchesDataset<TImage>::GetPatchSize(unsigned int array) const
+{
+  if (array >= m_Arrays.size())
+  {
+    itkGenericExceptionMacro("There is no array #" << array << " in dataset " << m_Name);
+  }
+  SizeType size;
+  size[0] = m_Arrays[array].m_SizeX;
+  size[1] = m_Arrays[array].m_SizeY;
+  return size;
+}
+
+//
+// Number of components of an array
+//
+template<class TImage>
+unsigned int
+PatchesDataset<TImage>::GetNumberOfComponents(unsigned int array) const
+{
+  if (array >= m_Arrays.size())
+  {
+    itkGenericExceptionMacro("There is no array #" << array << " in dataset " << m_Name);
+  }
+  return m_Arrays[array].m_NumberOfComponents;
+}
+
+//
+// Values of an array
+//
+template<class TImage>
+const typename PatchesDataset<TImage>::ValueType *
+PatchesDataset<TImage>::GetArray(unsigned int array) const
+{
+  if (array >= m_Arrays.size())
+  {
+    itkGenericExceptionMacro("There is no array #" << array << " in dataset " << m_Name);
+  }
+  return reinterpret_cast<const ValueType*>(m_Data + m_Arrays[array].m_Offset);
+}
+
+} // end namespace tf
+} // end namespace otb
+
+#endif
@@ -0,0 +1,85 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTensorflowPatchesDatasetSource_h
+#define otbTensorflowPatchesDatasetSource_h
+
+#include "itkImageSource.h"
+
+// Dataset
+#include "otbTensorflowPatchesDataset.h"
+
+namespace otb
+{
+
+/**
+ * \class TensorflowPatchesDatasetSource
+ * \brief This source produces the patches image of one array of a samples dataset.
+ *
+ * The output image has the usual patches image layout (patches are stacked
+ * in the y dimension) so that it can be used as an input of the training or
+ * validation filters. The dataset must be alive during the life of the
+ * source.
+ *
+ * \ingroup OTBTensorflow
+ */
+template <class TImage>
+class ITK_EXPORT TensorflowPatchesDatasetSource :
+public itk::ImageSource<TImage>
+{
+public:
+
+  /** Standard class typedefs. */
+  typedef TensorflowPatchesDatasetSource          Self;
+  typedef itk::ImageSource<TImage>                Superclass;
+  typedef itk::SmartPointer<Self>                 Pointer;
+  typedef itk::SmartPointer<const Self>           ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(TensorflowPatchesDatasetSource, itk::ImageSource);
+
+  /** Images typedefs */
+  typedef TImage                                  ImageType;
+  typedef typename TImage::RegionType             RegionType;
+  typedef typename TImage::SizeType               SizeType;
+  typedef typename TImage::InternalPixelType      ValueType;
+  typedef tf::PatchesDataset<TImage>              DatasetType;
+
+  /** Parameters */
+  void SetDataset(const DatasetType * dataset)    { m_Dataset = dataset; this->Modified(); }
+  const DatasetType * GetDataset() const          { return m_Dataset; }
+  itkSetMacro(ArrayIndex, unsigned int);
+  itkGetMacro(ArrayIndex, unsigned int);
+
+protected:
+  TensorflowPatchesDatasetSource();
+  virtual ~TensorflowPatchesDatasetSource() {};
+
+  virtual void GenerateOutputInformation();
+
+  virtual void GenerateData();
+
+private:
+  TensorflowPatchesDatasetSource(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  const DatasetType *  m_Dataset;    // The samples dataset
+  unsigned int         m_ArrayIndex; // The array of the dataset
+
+}; // end class
+
+} // end namespace otb
+
+#include "otbTensorflowPatchesDatasetSource.hxx"
+
+#endif
@@ -0,0 +1,74 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTensorflowPatchesDatasetSource_txx
+#define otbTensorflowPatchesDatasetSource_txx
+
+#include "otbTensorflowPatchesDatasetSource.h"
+
+namespace otb
+{
+
+template <class TImage>
+TensorflowPatchesDatasetSource<TImage>
+::TensorflowPatchesDatasetSource()
+ {
+  m_Dataset = nullptr;
+  m_ArrayIndex = 0;
+ }
+
+template <class TImage>
+void
+TensorflowPatchesDatasetSource<TImage>
+::GenerateOutputInformation()
+ {
+  if (!m_Dataset)
+    {
+    itkExceptionMacro("Dataset not set");
+    }
+
+  const SizeType patchSize = m_Dataset->GetPatchSize(m_ArrayIndex);
+  RegionType region;
+  region.SetSize(0, patchSize[0]);
+  region.SetSize(1, patchSize[1] * m_Dataset->GetNumberOfSamples());
+
+  ImageType * outputPtr = this->GetOutput();
+  outputPtr->SetLargestPossibleRegion(region);
+  outputPtr->SetNumberOfComponentsPerPixel(m_Dataset->GetNumberOfComponents(m_ArrayIndex));
+ }
+
+/**
+ * Copy the rows of the requested region from the dataset
+ */
+template <class TImage>
+void
+TensorflowPatchesDatasetSource<TImage>
+::GenerateData()
+ {
+  ImageType * outputPtr = this->GetOutput();
+  const RegionType region = outputPtr->GetRequestedRegion();
+  outputPtr->SetBufferedRegion(region);
+  outputPtr->Allocate();
+
+  const unsigned int nComponents = outputPtr->GetNumberOfComponentsPerPixel();
+  const tensorflow::uint64 width = outputPtr->GetLargestPossibleRegion().GetSize(0);
+  const ValueType * values = m_Dataset->GetArray(m_ArrayIndex);
+  ValueType * outPtr = outputPtr->GetBufferPointer();
+  for (unsigned int y = 0 ; y < region.GetSize(1) ; y++)
+    {
+    const ValueType * inPtr = values + ((region.GetIndex(1) + y) * width + region.GetIndex(0)) * nComponents;
+    std::copy_n(inPtr, region.GetSize(0) * nComponents, outPtr);
+    outPtr += region.GetSize(0) * nComponents;
+    }
+ }
+
+} // end namespace otb
+
+#endif
@@ -0,0 +1,164 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include "otbTensorflowProfiler.h"
+
+namespace otb {
+namespace tf {
+
+Profiler::Profiler()
+{
+  Reset();
+}
+
+//
+// Clear all the timings
+//
+void Profiler::Reset()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Start = Now();
+  m_Order.clear();
+  m_Stages.clear();
+  m_Records.clear();
+  m_Pixels = 0;
+  m_Samples = 0;
+}
+
+//
+// Add a call of a stage
+//
+void Profiler::AddStage(const std::string & stage, std::uint64_t unit, TimePointType start, TimePointType end,
+    std::uint64_t bytes)
+{
+  const double seconds = std::chrono::duration<double>(end - start).count();
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (m_Stages.count(stage) == 0)
+    m_Order.push_back(stage);
+  StageType & entry = m_Stages[stage];
+  entry.m_Seconds += seconds;
+  entry.m_Calls++;
+  entry.m_Bytes += bytes;
+
+  RecordType record;
+  record.m_Stage = stage;
+  record.m_Unit = unit;
+  record.m_Start = std::chrono::duration<double>(start - m_Start).count();
+  record.m_Seconds = seconds;
+  record.m_Bytes = bytes;
+  m_Records.push_back(record);
+}
+
+//
+// Count the processed pixels
+//
+void Profiler::AddPixels(std::uint64_t n)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Pixels += n;
+}
+
+//
+// Count the processed samples
+//
+void Profiler::AddSamples(std::uint64_t n)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Samples += n;
+}
+
+//
+// Print a summary of the timings.
+// Stages can overlap (e.g. in the asynchronous tiles pipeline), so their
+// cumulative times are compared to the wall time.
+//
+void Profiler::Report(std::ostream & os) const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  const double wallTime = std::chrono::duration<double>(Now() - m_Start).count();
+
+  os << "Wall time: " << wallTime << " s\n";
+  for (auto const& name: m_Order)
+    {
+    const StageType & stage = m_Stages.at(name);
+    os << "Stage \"" << name << "\": " << stage.m_Seconds << " s (" <<
+        (wallTime > 0 ? 100.0 * stage.m_Seconds / wallTime : 0) << "% of the wall time), " <<
+        stage.m_Calls << " call(s), " <<
+        (stage.m_Calls > 0 ? 1000.0 * stage.m_Seconds / stage.m_Calls : 0) << " ms per call";
+    if (stage.m_Bytes > 0)
+      {
+      const double megaBytes = stage.m_Bytes / (1024.0 * 1024.0);
+      os << ", " << megaBytes << " MB (" << (stage.m_Seconds > 0 ? megaBytes / stage.m_Seconds : 0) << " MB/s)";
+      }
+    os << "\n";
+    }
+  if (m_Pixels > 0)
+    os << "Pixels: " << m_Pixels << " (" << (wallTime > 0 ? m_Pixels / wallTime : 0) << " pixels/s)\n";
+  if (m_Samples > 0)
+    os << "Samples: " << m_Samples << " (" << (wallTime > 0 ? m_Samples / wallTime : 0) << " samples/s)\n";
+}
+
+//
+// Write the records in a profile file
+//
+void Profiler::Write(const std::string & fileName) const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+
+  std::ofstream file(fileName);
+  if (!file.is_open())
+    {
+    itkGenericExceptionMacro("Unable to open the profile file " << fileName);
+    }
+
+  const std::string ext = ".json";
+  const bool json = fileName.size() >= ext.size() &&
+      fileName.compare(fileName.size() - ext.size(), ext.size(), ext) == 0;
+  const double wallTime = std::chrono::duration<double>(Now() - m_Start).count();
+
+  if (json)
+    {
+    file << "{\n  \"wall_time\": " << wallTime << ",\n  \"pixels\": " << m_Pixels <<
+        ",\n  \"samples\": " << m_Samples << ",\n  \"stages\": {";
+    for (unsigned int i = 0 ; i < m_Order.size() ; i++)
+      {
+      const StageType & stage = m_Stages.at(m_Order[i]);
+      file << (i > 0 ? "," : "") << "\n    \"" << m_Order[i] << "\": {\"seconds\": " << stage.m_Seconds <<
+          ", \"calls\": " << stage.m_Calls << ", \"bytes\": " << stage.m_Bytes << "}";
+      }
+    file << "\n  },\n  \"records\": [";
+    for (std::size_t i = 0 ; i < m_Records.size() ; i++)
+      {
+      const RecordType & record = m_Records[i];
+      file << (i > 0 ? "," : "") << "\n    {\"stage\": \"" << record.m_Stage << "\", \"unit\": " << record.m_Unit <<
+          ", \"start\": " << record.m_Start << ", \"seconds\": " << record.m_Seconds <<
+          ", \"bytes\": " << record.m_Bytes << "}";
+      }
+    file << "\n  ]\n}\n";
+    }
+  else
+    {
+    file << "stage,unit,start,seconds,bytes\n";
+    for (auto const& record: m_Records)
+      {
+      file << record.m_Stage << "," << record.m_Unit << "," << record.m_Start << "," <<
+          record.m_Seconds << "," << record.m_Bytes << "\n";
+      }
+    }
+
+  if (!file.good())
+    {
+    itkGenericExceptionMacro("Error while writing the profile file " << fileName);
+    }
+}
+
+} // end namespace tf
+} // end namespace otb
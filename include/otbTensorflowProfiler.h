@@ -0,0 +1,134 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWPROFILER_H_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWPROFILER_H_
+
+// ITK exception
+#include "itkMacro.h"
+
+// STD
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace otb {
+namespace tf {
+
+/*
+ * This class accumulates the timings of the processing stages of the
+ * filters (e.g. "update", "fill", "run", "copy").
+ * For each stage, it keeps the cumulative time, the number of calls and the
+ * number of bytes moved. Each call is also kept as a record (unit, stage,
+ * start time, duration, bytes), so that the timings of each tile or batch can
+ * be written in a profile file (JSON or CSV).
+ * The numbers of processed pixels and samples give the throughput.
+ * All the methods are thread safe.
+ */
+class Profiler
+{
+public:
+
+  typedef std::chrono::steady_clock ClockType;
+  typedef ClockType::time_point     TimePointType;
+
+  Profiler();
+  virtual ~Profiler() {};
+
+  // Clear all the timings, and restart the wall clock
+  void Reset();
+
+  // Add a call of the stage. The unit is the index of the tile/batch which is processed.
+  void AddStage(const std::string & stage, std::uint64_t unit, TimePointType start, TimePointType end,
+      std::uint64_t bytes = 0);
+
+  // Count the processed pixels and samples
+  void AddPixels(std::uint64_t n);
+  void AddSamples(std::uint64_t n);
+
+  // Print a summary of the timings
+  void Report(std::ostream & os) const;
+
+  // Write the records in a profile file (JSON if the extension is ".json", CSV else)
+  void Write(const std::string & fileName) const;
+
+  // Current time
+  static TimePointType Now() { return ClockType::now(); }
+
+private:
+  Profiler(const Profiler&); //purposely not implemented
+  void operator=(const Profiler&); //purposely not implemented
+
+  /* Cumulative timings of one stage */
+  struct StageType
+  {
+    double        m_Seconds = 0;
+    std::uint64_t m_Calls   = 0;
+    std::uint64_t m_Bytes   = 0;
+  };
+
+  /* One call of one stage */
+  struct RecordType
+  {
+    std::string   m_Stage;
+    std::uint64_t m_Unit;
+    double        m_Start;    // seconds since Reset()
+    double        m_Seconds;
+    std::uint64_t m_Bytes;
+  };
+
+  mutable std::mutex               m_Mutex;
+  TimePointType                    m_Start;     // Time of the last Reset()
+  std::vector<std::string>         m_Order;     // Stages, in the order of their first call
+  std::map<std::string, StageType> m_Stages;    // Cumulative timings
+  std::vector<RecordType>          m_Records;   // All the calls
+  std::uint64_t                    m_Pixels;    // Number of processed pixels
+  std::uint64_t                    m_Samples;   // Number of processed samples
+
+};
+
+/*
+ * Helper which adds the time spent in a scope to a stage of a profiler
+ * (does nothing if the profiler is null)
+ */
+class ScopedStageTimer
+{
+public:
+  ScopedStageTimer(Profiler * profiler, const std::string & stage, std::uint64_t unit, std::uint64_t bytes = 0)
+  : m_Profiler(profiler), m_Stage(stage), m_Unit(unit), m_Bytes(bytes), m_Start(Profiler::Now()) {}
+
+  ~ScopedStageTimer()
+  {
+    if (m_Profiler)
+      m_Profiler->AddStage(m_Stage, m_Unit, m_Start, Profiler::Now(), m_Bytes);
+  }
+
+  // Set the number of bytes moved during the scope
+  void SetBytes(std::uint64_t bytes) { m_Bytes = bytes; }
+
+private:
+  Profiler *              m_Profiler;
+  std::string             m_Stage;
+  std::uint64_t           m_Unit;
+  std::uint64_t           m_Bytes;
+  Profiler::TimePointType m_Start;
+};
+
+} // end namespace tf
+} // end namespace otb
+
+#include "otbTensorflowProfiler.cxx"
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWPROFILER_H_ */
@@ -0,0 +1,95 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTensorflowSampledPatchesFilter_h
+#define otbTensorflowSampledPatchesFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+
+namespace otb
+{
+
+/**
+ * \class TensorflowSampledPatchesFilter
+ * \brief This filter produces the image of patches sampled in an input image.
+ *
+ * Patches are concatenated in y dimension: the patch #k occupies the rows
+ * [k * patchSize[1], (k+1) * patchSize[1]) of the output image.
+ * The start index of each patch in the input image is given with
+ * SetPatchesIndices().
+ *
+ * Unlike TensorflowSampler, the patches image is produced on demand: the
+ * filter is streamable, and the input requested region covers only the
+ * patches that intersect the output requested region. Hence, patches should
+ * be spatially sorted (e.g. by tiles) to keep the input requested regions
+ * small.
+ *
+ * \ingroup OTBTensorflow
+ */
+template <class TImage>
+class ITK_EXPORT TensorflowSampledPatchesFilter :
+public itk::ImageToImageFilter<TImage, TImage>
+{
+public:
+
+  /** Standard class typedefs. */
+  typedef TensorflowSampledPatchesFilter          Self;
+  typedef itk::ImageToImageFilter<TImage, TImage> Superclass;
+  typedef itk::SmartPointer<Self>                 Pointer;
+  typedef itk::SmartPointer<const Self>           ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(TensorflowSampledPatchesFilter, itk::ImageToImageFilter);
+
+  /** Images typedefs */
+  typedef TImage                                  ImageType;
+  typedef typename TImage::Pointer                ImagePointerType;
+  typedef typename TImage::RegionType             RegionType;
+  typedef typename TImage::PointType              PointType;
+  typedef typename TImage::SpacingType            SpacingType;
+  typedef typename TImage::SizeType               SizeType;
+  typedef typename TImage::IndexType              IndexType;
+  typedef std::vector<IndexType>                  IndexListType;
+
+  /** Parameters */
+  itkSetMacro(PatchSize, SizeType);
+  itkGetMacro(PatchSize, SizeType);
+  void SetPatchesIndices(const IndexListType & indices) { m_PatchesIndices = indices; this->Modified(); }
+  const IndexListType & GetPatchesIndices() const { return m_PatchesIndices; }
+
+protected:
+  TensorflowSampledPatchesFilter();
+  virtual ~TensorflowSampledPatchesFilter() {};
+
+  virtual void GenerateOutputInformation();
+
+  virtual void GenerateInputRequestedRegion();
+
+  virtual void ThreadedGenerateData(const RegionType& outputRegionForThread, itk::ThreadIdType threadId);
+
+private:
+  TensorflowSampledPatchesFilter(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  SizeType             m_PatchSize;      // Patches size
+  IndexListType        m_PatchesIndices; // Start index of the patches in the input image
+
+}; // end class
+
+} // end namespace otb
+
+#include "otbTensorflowSampledPatchesFilter.hxx"
+
+#endif
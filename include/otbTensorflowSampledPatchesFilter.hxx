@@ -0,0 +1,131 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTensorflowSampledPatchesFilter_txx
+#define otbTensorflowSampledPatchesFilter_txx
+
+#include "otbTensorflowSampledPatchesFilter.h"
+
+namespace otb
+{
+
+template <class TImage>
+TensorflowSampledPatchesFilter<TImage>
+::TensorflowSampledPatchesFilter()
+ {
+  m_PatchSize.Fill(1);
+ }
+
+/**
+ * The output image is a stack of patches, with no geographic information
+ * (like the in-memory patches images of TensorflowSampler)
+ */
+template <class TImage>
+void
+TensorflowSampledPatchesFilter<TImage>
+::GenerateOutputInformation()
+ {
+  const ImageType * inputPtr = this->GetInput();
+  ImageType * outputPtr = this->GetOutput();
+
+  RegionType region;
+  region.SetSize(0, m_PatchSize[0]);
+  region.SetSize(1, m_PatchSize[1] * m_PatchesIndices.size());
+
+  PointType origin;
+  origin.Fill(0);
+  SpacingType spacing;
+  spacing.Fill(1);
+
+  outputPtr->SetLargestPossibleRegion(region);
+  outputPtr->SetOrigin(origin);
+  outputPtr->SetSignedSpacing(spacing);
+  outputPtr->SetNumberOfComponentsPerPixel(inputPtr->GetNumberOfComponentsPerPixel());
+ }
+
+/**
+ * The input requested region is the union of the patches which intersect
+ * the output requested region
+ */
+template <class TImage>
+void
+TensorflowSampledPatchesFilter<TImage>
+::GenerateInputRequestedRegion()
+ {
+  Superclass::GenerateInputRequestedRegion();
+
+  ImageType * inputPtr = const_cast<ImageType *>(this->GetInput());
+  const RegionType outputReqRegion = this->GetOutput()->GetRequestedRegion();
+  if (m_PatchesIndices.empty() || outputReqRegion.GetNumberOfPixels() == 0)
+    {
+    return;
+    }
+
+  // Range of the patches
+  const unsigned long first = outputReqRegion.GetIndex(1) / m_PatchSize[1];
+  const unsigned long last = outputReqRegion.GetUpperIndex()[1] / m_PatchSize[1];
+
+  RegionType inputReqRegion(m_PatchesIndices[first], m_PatchSize);
+  for (unsigned long k = first + 1 ; k <= last ; k++)
+    {
+    const RegionType patchRegion(m_PatchesIndices[k], m_PatchSize);
+    IndexType start, end;
+    for (unsigned int dim = 0; dim < ImageType::ImageDimension; ++dim)
+      {
+      start[dim] = std::min(inputReqRegion.GetIndex(dim), patchRegion.GetIndex(dim));
+      end[dim] = std::max(inputReqRegion.GetUpperIndex()[dim], patchRegion.GetUpperIndex()[dim]);
+      }
+    inputReqRegion.SetIndex(start);
+    inputReqRegion.SetUpperIndex(end);
+    }
+
+  if (!inputReqRegion.Crop(inputPtr->GetLargestPossibleRegion()))
+    {
+    itkExceptionMacro("Patches are outside the input image");
+    }
+  inputPtr->SetRequestedRegion(inputReqRegion);
+ }
+
+/**
+ * Copy the rows of the patches
+ */
+template <class TImage>
+void
+TensorflowSampledPatchesFilter<TImage>
+::ThreadedGenerateData(const RegionType& outputRegionForThread, itk::ThreadIdType itkNotUsed(threadId))
+ {
+  const ImageType * inputPtr = this->GetInput();
+  ImageType * outputPtr = this->GetOutput();
+
+  RegionType outputRowRegion(outputRegionForThread);
+  outputRowRegion.SetSize(1, 1);
+  for (unsigned int y = 0 ; y < outputRegionForThread.GetSize(1) ; y++)
+    {
+    const unsigned long row = outputRegionForThread.GetIndex(1) + y;
+    const IndexType & patchIndex = m_PatchesIndices[row / m_PatchSize[1]];
+
+    // Row of the patch in the input image
+    RegionType inputRowRegion(outputRowRegion);
+    inputRowRegion.SetIndex(0, patchIndex[0] + outputRegionForThread.GetIndex(0));
+    inputRowRegion.SetIndex(1, patchIndex[1] + row % m_PatchSize[1]);
+    outputRowRegion.SetIndex(1, row);
+
+    itk::ImageRegionConstIterator<ImageType> inIt(inputPtr, inputRowRegion);
+    itk::ImageRegionIterator<ImageType> outIt(outputPtr, outputRowRegion);
+    for (inIt.GoToBegin(), outIt.GoToBegin(); !inIt.IsAtEnd(); ++inIt, ++outIt)
+      {
+      outIt.Set(inIt.Get());
+      }
+    }
+ }
+
+} // end namespace otb
+
+#endif
@@ -21,6 +21,13 @@
 // TF common
 #include "otbTensorflowCommon.h"
 
+// Streamed patches
+#include "otbTensorflowSampledPatchesFilter.h"
+
+// Parallel sampling
+#include <thread>
+#include <map>
+
 namespace otb
 {
 
@@ -34,13 +41,24 @@ namespace otb
  * Label image is also created from the value of the m_Field field of the
  * input vector data
  *
+ * The samples which can be extracted are determined first, from their
+ * location only: the number of accepted and rejected samples, and the order
+ * of the samples in the output images (the order of the vector data) are
+ * the same whatever the number of threads.
+ * Then, samples are grouped by tiles of the first input image (see
+ * SetTileSize()). For each tile, the region of each input image covering
+ * the patches of the tile is requested once, and the patches are copied
+ * in the output images by multiple threads (see SetNumberOfThreads()).
+ *
+ * When streaming is enabled (see SetStreaming()), the patches images are not
+ * computed in memory: Update() only computes the samples, and the patches
+ * images are the outputs of TensorflowSampledPatchesFilter instances, which
+ * produce the patches on demand (e.g. when the images are written with a
+ * streaming writer). In this mode, samples are sorted by tiles, in raster
+ * order, so that the input requested regions stay small.
+ *
  * TODO:
  * -must inherit from itk::imageToImageFilter
- * -implement streaming mechanism : the input requested region of
- *  image should be computed from the output requested region of the patches
- *  This would allow to compute huge patches images and speed up the whole
- *  process. This might be achieved using indexation structure like RTree
- *  on the samples pos (in image coordinates)
  *
  * \ingroup OTBTensorflow
  */
@@ -77,6 +95,11 @@ public:
                                                   ExtractROIMultiFilterPointerType;
   typedef typename std::vector<ImagePointerType>  ImagePointerListType;
   typedef typename std::vector<SizeType>          SizeListType;
+  typedef TensorflowSampledPatchesFilter<TInputImage>
+                                                  PatchesFilterType;
+  typedef typename PatchesFilterType::Pointer     PatchesFilterPointerType;
+  typedef typename PatchesFilterType::IndexListType
+                                                  IndexListType;
 
   /** Vector data typedefs */
   typedef TVectorData                             VectorDataType;
@@ -92,6 +115,11 @@ public:
   /** Set / get parameters */
   itkSetMacro(Field, std::string);
   itkGetMacro(Field, std::string);
+  itkSetMacro(TileSize, SizeType);
+  itkGetMacro(TileSize, SizeType);
+  itkSetMacro(Streaming, bool);
+  itkGetMacro(Streaming, bool);
+  itkBooleanMacro(Streaming);
 
   /** Set / get vector data */
   itkSetMacro(InputVectorData, VectorDataPointer);
@@ -111,11 +139,24 @@ public:
   itkGetMacro(NumberOfRejectedSamples, unsigned long);
 
 protected:
+
+  /** A sample: the start index of its patches, its label, and its row in the outputs */
+  struct SampleType
+  {
+    std::vector<IndexType> m_PatchIndices; // Start index of the patch, for each input
+    InternalPixelType      m_Label;        // Label value
+    unsigned long          m_Row;          // Position in the output images
+  };
+  typedef std::vector<SampleType>                 SampleListType;
+  typedef std::vector<unsigned long>              SampleIndexListType;
+
   TensorflowSampler();
   virtual ~TensorflowSampler() {};
 
-  virtual void ResizeImage(ImagePointerType & image, SizeType & patchSize, unsigned int nbSamples);
   virtual void AllocateImage(ImagePointerType & image, SizeType & patchSize, unsigned int nbSamples, unsigned int nbComponents);
+  virtual bool ComputeSample(const PointType & point, SampleType & sample);
+  virtual void GroupSamples(const SampleListType & samples, std::vector<SampleIndexListType> & groups);
+  virtual void SampleGroup(const SampleListType & samples, const SampleIndexListType & group);
 
 private:
   TensorflowSampler(const Self&); //purposely not implemented
@@ -123,10 +164,13 @@ private:
 
   std::string          m_Field;
   SizeListType         m_PatchSizes;
+  SizeType             m_TileSize;
+  bool                 m_Streaming;
   VectorDataPointer    m_InputVectorData;
 
   // Read only
   ImagePointerListType m_OutputPatchImages;
+  std::vector<PatchesFilterPointerType> m_PatchesFilters;
   ImagePointerType     m_OutputLabelImage;
   unsigned long        m_NumberOfAcceptedSamples;
   unsigned long        m_NumberOfRejectedSamples;
@@ -20,6 +20,8 @@ template <class TInputImage, class TVectorData>
 TensorflowSampler<TInputImage, TVectorData>
 ::TensorflowSampler()
  {
+  m_TileSize.Fill(512);
+  m_Streaming = false;
  }
 
 template <class TInputImage, class TVectorData>
@@ -46,46 +48,154 @@ TensorflowSampler<TInputImage, TVectorData>
 
 
 /**
- * Resize an image given a patch size and a number of samples
+ * Allocate an image given a patch size and a number of samples
  */
 template <class TInputImage, class TVectorData>
 void
 TensorflowSampler<TInputImage, TVectorData>
-::ResizeImage(ImagePointerType & image, SizeType & patchSize, unsigned int nbSamples)
+::AllocateImage(ImagePointerType & image, SizeType & patchSize, unsigned int nbSamples, unsigned int nbComponents)
  {
-  // New image region
+  // Image region
   RegionType region;
   region.SetSize(0, patchSize[0]);
   region.SetSize(1, patchSize[1] * nbSamples);
 
-  // Resize
-  ExtractROIMultiFilterPointerType resizer = ExtractROIMultiFilterType::New();
-  resizer->SetInput(image);
-  resizer->SetExtractionRegion(region);
-  resizer->Update();
+  // Allocate label image
+  image = ImageType::New();
+  image->SetNumberOfComponentsPerPixel(nbComponents);
+  image->SetRegions(region);
+  image->Allocate();
+ }
 
-  // Assign
-  image = resizer->GetOutput();
+/**
+ * Compute the start index of the patches of a sample located at the given point.
+ * Returns false if the sample can't be extracted from all input images.
+ */
+template <class TInputImage, class TVectorData>
+bool
+TensorflowSampler<TInputImage, TVectorData>
+::ComputeSample(const PointType & point, SampleType & sample)
+ {
+  const unsigned int nbInputs = this->GetNumberOfInputs();
+  sample.m_PatchIndices.resize(nbInputs);
+  for (unsigned int i = 0 ; i < nbInputs ; i++)
+  {
+    const ImageType * inputPtr = this->GetInput(i);
+    IndexType index;
+    if (!inputPtr->TransformPhysicalPointToIndex(point, index))
+    {
+      return false;
+    }
+    index[0] -= m_PatchSizes[i][0] / 2;
+    index[1] -= m_PatchSizes[i][1] / 2;
+    RegionType inPatchRegion(index, m_PatchSizes[i]);
+    if (!inputPtr->GetLargestPossibleRegion().IsInside(inPatchRegion))
+    {
+      return false;
+    }
+    sample.m_PatchIndices[i] = index;
+  }
+  return true;
  }
 
 /**
- * Allocate an image given a patch size and a number of samples
+ * Group the samples by tiles of the first input image.
+ * Groups are sorted in raster order of the tiles.
  */
 template <class TInputImage, class TVectorData>
 void
 TensorflowSampler<TInputImage, TVectorData>
-::AllocateImage(ImagePointerType & image, SizeType & patchSize, unsigned int nbSamples, unsigned int nbComponents)
+::GroupSamples(const SampleListType & samples, std::vector<SampleIndexListType> & groups)
  {
-  // Image region
-  RegionType region;
-  region.SetSize(0, patchSize[0]);
-  region.SetSize(1, patchSize[1] * nbSamples);
+  std::map<std::pair<long, long>, SampleIndexListType> tiles;
+  const IndexType origin = this->GetInput(0)->GetLargestPossibleRegion().GetIndex();
+  for (unsigned long k = 0 ; k < samples.size() ; k++)
+  {
+    const IndexType & index = samples[k].m_PatchIndices[0];
+    const long tx = (index[0] - origin[0]) / static_cast<long>(m_TileSize[0]);
+    const long ty = (index[1] - origin[1]) / static_cast<long>(m_TileSize[1]);
+    tiles[std::make_pair(ty, tx)].push_back(k);
+  }
 
-  // Allocate label image
-  image = ImageType::New();
-  image->SetNumberOfComponentsPerPixel(nbComponents);
-  image->SetRegions(region);
-  image->Allocate();
+  groups.clear();
+  groups.reserve(tiles.size());
+  for (auto & tile: tiles)
+  {
+    groups.push_back(std::move(tile.second));
+  }
+ }
+
+/**
+ * Copy the patches of a group of samples in the output images.
+ * The regions of the input images covering the group are requested once,
+ * then the patches are copied by multiple threads (each sample has its own
+ * rows in the output images).
+ */
+template <class TInputImage, class TVectorData>
+void
+TensorflowSampler<TInputImage, TVectorData>
+::SampleGroup(const SampleListType & samples, const SampleIndexListType & group)
+ {
+  const unsigned int nbInputs = this->GetNumberOfInputs();
+
+  // Request the regions of the input images
+  ImagePointerListType inputs;
+  for (unsigned int i = 0 ; i < nbInputs ; i++)
+  {
+    RegionType region(samples[group[0]].m_PatchIndices[i], m_PatchSizes[i]);
+    for (auto const& k: group)
+    {
+      RegionType patchRegion(samples[k].m_PatchIndices[i], m_PatchSizes[i]);
+      IndexType start, end;
+      for (unsigned int dim = 0; dim < ImageType::ImageDimension; ++dim)
+      {
+        start[dim] = std::min(region.GetIndex(dim), patchRegion.GetIndex(dim));
+        end[dim] = std::max(region.GetUpperIndex()[dim], patchRegion.GetUpperIndex()[dim]);
+      }
+      region.SetIndex(start);
+      region.SetUpperIndex(end);
+    }
+
+    ImagePointerType inputPtr = const_cast<ImageType *>(this->GetInput(i));
+    tf::PropagateRequestedRegion<ImageType>(inputPtr, region);
+    inputs.push_back(inputPtr);
+  }
+
+  // Copy the patches
+  auto copySamples = [&](unsigned int threadId, unsigned int nThreads)
+  {
+    PixelType labelPix;
+    labelPix.SetSize(1);
+    IndexType labelIndex;
+    labelIndex[0] = 0;
+    for (unsigned long k = threadId ; k < group.size() ; k += nThreads)
+    {
+      const SampleType & sample = samples[group[k]];
+      for (unsigned int i = 0 ; i < nbInputs ; i++)
+      {
+        IndexType inIndex = sample.m_PatchIndices[i];
+        IndexType outIndex;
+        outIndex[0] = 0;
+        outIndex[1] = sample.m_Row * m_PatchSizes[i][1];
+        tf::CopyPatch<ImageType>(inputs[i], inIndex, m_OutputPatchImages[i], outIndex, m_PatchSizes[i]);
+      }
+      labelIndex[1] = sample.m_Row;
+      labelPix[0] = sample.m_Label;
+      m_OutputLabelImage->SetPixel(labelIndex, labelPix);
+    }
+  };
+
+  const unsigned int nThreads = std::max(1u, std::min<unsigned int>(this->GetNumberOfThreads(), group.size()));
+  std::vector<std::thread> threads;
+  for (unsigned int t = 1 ; t < nThreads ; t++)
+  {
+    threads.push_back(std::thread(copySamples, t, nThreads));
+  }
+  copySamples(0, nThreads);
+  for (auto & thread: threads)
+  {
+    thread.join();
+  }
  }
 
 /**
@@ -103,9 +213,19 @@ TensorflowSampler<TInputImage, TVectorData>
     itkExceptionMacro("Number of inputs and patches sizes are not the same");
   }
 
-  // Count points
+  // Update inputs information
+  const unsigned int nbInputs = this->GetNumberOfInputs();
+  for (unsigned int i = 0 ; i < nbInputs ; i++)
+  {
+    const_cast<ImageType *>(this->GetInput(i))->UpdateOutputInformation();
+  }
+
+  // Compute the samples
+  // (rows of the output images are given in the order of the vector data)
+  SampleListType samples;
   unsigned int nTotal = 0;
   unsigned int geomId = 0;
+  unsigned long rejected = 0;
   TreeIteratorType itVector(m_InputVectorData->GetDataTree());
   itVector.GoToBegin();
   while (!itVector.IsAtEnd())
@@ -120,6 +240,18 @@ TensorflowSampler<TInputImage, TVectorData>
       else
       {
         nTotal++;
+
+        SampleType sample;
+        if (ComputeSample(currentGeometry->GetPoint(), sample))
+        {
+          sample.m_Label = static_cast<InternalPixelType>(currentGeometry->GetFieldAsInt(m_Field));
+          sample.m_Row = samples.size();
+          samples.push_back(sample);
+        }
+        else
+        {
+          rejected++;
+        }
       }
       geomId++;
     }
@@ -133,81 +265,82 @@ TensorflowSampler<TInputImage, TVectorData>
   }
 
   // Allocate label image
+  const unsigned long count = samples.size();
   SizeType labelPatchSize;
   labelPatchSize.Fill(1);
-  AllocateImage(m_OutputLabelImage, labelPatchSize, nTotal, 1);
+  AllocateImage(m_OutputLabelImage, labelPatchSize, count, 1);
 
-  // Allocate patches image
-  const unsigned int nbInputs = this->GetNumberOfInputs();
-  m_OutputPatchImages.clear();
-  m_OutputPatchImages.reserve(nbInputs);
-  for (unsigned int i = 0 ; i < nbInputs ; i++)
-  {
-    ImagePointerType newImage;
-    AllocateImage(newImage, m_PatchSizes[i], nTotal, GetInput(i)->GetNumberOfComponentsPerPixel());
-    m_OutputPatchImages.push_back(newImage);
-  }
+  // Group samples by tiles
+  std::vector<SampleIndexListType> groups;
+  GroupSamples(samples, groups);
 
-  itk::ProgressReporter progess(this, 0, nTotal);
-
-  // Iterate on the vector data
-  itVector.GoToBegin();
-  unsigned long count = 0;
-  unsigned long rejected = 0;
-  IndexType labelIndex;
-  labelIndex[0] = 0;
-  PixelType labelPix;
-  labelPix.SetSize(1);
-  while (!itVector.IsAtEnd())
+  m_OutputPatchImages.clear();
+  m_PatchesFilters.clear();
+  if (m_Streaming)
   {
-    if (!itVector.Get()->IsRoot() && !itVector.Get()->IsDocument() && !itVector.Get()->IsFolder())
+    // Samples are sorted by tiles
+    unsigned long row = 0;
+    for (auto const& group: groups)
     {
-      DataNodePointer currentGeometry = itVector.Get();
-      PointType point = currentGeometry->GetPoint();
-
-      // Get the label value
-      labelPix[0] = static_cast<InternalPixelType>(currentGeometry->GetFieldAsInt(m_Field));
-
-      bool hasBeenSampled = true;
-      for (unsigned int i = 0 ; i < nbInputs ; i++)
+      for (auto const& k: group)
       {
-        // Get input
-        ImagePointerType inputPtr = const_cast<ImageType *>(this->GetInput(i));
+        samples[k].m_Row = row;
+        row++;
+      }
+    }
 
-        // Try to sample the image
-        if (!tf::SampleImage<ImageType>(inputPtr, m_OutputPatchImages[i], point, count, m_PatchSizes[i]))
-        {
-          // If not, reject this sample
-          hasBeenSampled = false;
-        }
-      } // Next input
-      if (hasBeenSampled)
-      {
-        // Fill label
-        labelIndex[1] = count;
-        m_OutputLabelImage->SetPixel(labelIndex, labelPix);
+    // Fill the label image
+    PixelType labelPix;
+    labelPix.SetSize(1);
+    IndexType labelIndex;
+    labelIndex[0] = 0;
+    for (auto const& sample: samples)
+    {
+      labelIndex[1] = sample.m_Row;
+      labelPix[0] = sample.m_Label;
+      m_OutputLabelImage->SetPixel(labelIndex, labelPix);
+    }
 
-        // update count
-        count++;
-      }
-      else
+    // Patches images are produced on demand
+    for (unsigned int i = 0 ; i < nbInputs ; i++)
+    {
+      IndexListType indices(count);
+      for (auto const& sample: samples)
       {
-        rejected++;
+        indices[sample.m_Row] = sample.m_PatchIndices[i];
       }
-
-      // Update progres
-      progess.CompletedPixel();
-
+      PatchesFilterPointerType filter = PatchesFilterType::New();
+      filter->SetInput(this->GetInput(i));
+      filter->SetPatchSize(m_PatchSizes[i]);
+      filter->SetPatchesIndices(indices);
+      m_PatchesFilters.push_back(filter);
+      m_OutputPatchImages.push_back(filter->GetOutput());
     }
 
-    ++itVector;
-  } // next feature
+    m_NumberOfAcceptedSamples = count;
+    m_NumberOfRejectedSamples = rejected;
+    return;
+  }
 
-  // Resize output images
-  ResizeImage(m_OutputLabelImage, labelPatchSize, count);
+  // Allocate patches image
+  m_OutputPatchImages.reserve(nbInputs);
   for (unsigned int i = 0 ; i < nbInputs ; i++)
   {
-    ResizeImage(m_OutputPatchImages[i], m_PatchSizes[i], count);
+    ImagePointerType newImage;
+    AllocateImage(newImage, m_PatchSizes[i], count, GetInput(i)->GetNumberOfComponentsPerPixel());
+    m_OutputPatchImages.push_back(newImage);
+  }
+
+  itk::ProgressReporter progess(this, 0, count);
+
+  // Sample the images, tile by tile
+  for (auto const& group: groups)
+  {
+    SampleGroup(samples, group);
+
+    // Update progress
+    for (unsigned long k = 0 ; k < group.size() ; k++)
+      progess.CompletedPixel();
   }
 
   // Update number of samples produced
@@ -12,12 +12,13 @@
 #define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWSOURCE_H_
 
 #include "otbImage.h"
-#include "otbImageListToVectorImageFilter.h"
-#include "otbMultiToMonoChannelExtractROI.h"
-#include "otbImageList.h"
+#include "otbObjectList.h"
 #include "otbMultiChannelExtractROI.h"
 #include "otbExtractROI.h"
 
+// Images stacking
+#include "otbTensorflowImagesStackFilter.h"
+
 #include "otbTensorflowCommon.h"
 
 namespace otb
@@ -27,6 +28,8 @@ namespace otb
  * This is a simple helper to create images concatenation.
  * Images must have the same size.
  * This is basically the common input type used in every OTB-TF applications.
+ * The channels of the images are stacked in one single pass with the
+ * TensorflowImagesStackFilter. A single image is used as is.
  */
 template<class TImage>
 class TensorflowSource
@@ -40,15 +43,8 @@ public:
   typedef typename FloatImageType::SizeType                 SizeType;
 
   /** Typedefs for image concatenation */
-  typedef otb::ImageList<FloatImageType>                    ImageListType;
-  typedef typename ImageListType::Pointer                   ImageListPointer;
-  typedef ImageListToVectorImageFilter<ImageListType,
-      FloatVectorImageType>                                 ListConcatenerFilterType;
-  typedef typename ListConcatenerFilterType::Pointer        ListConcatenerFilterPointer;
-  typedef MultiToMonoChannelExtractROI<InternalPixelType,
-      InternalPixelType>                                    MultiToMonoChannelFilterType;
-  typedef ObjectList<MultiToMonoChannelFilterType>          ExtractROIFilterListType;
-  typedef typename ExtractROIFilterListType::Pointer        ExtractROIFilterListPointer;
+  typedef TensorflowImagesStackFilter<FloatVectorImageType> StackFilterType;
+  typedef typename StackFilterType::Pointer                 StackFilterPointer;
   typedef otb::MultiChannelExtractROI<InternalPixelType,
       InternalPixelType>                                    ExtractFilterType;
   typedef otb::ObjectList<FloatVectorImageType>             FloatVectorImageListType;
@@ -63,9 +59,8 @@ public:
   virtual ~TensorflowSource (){};
 
 private:
-  ListConcatenerFilterPointer m_Concatener;    // Mono-images stacker
-  ImageListPointer            m_List;          // List of mono-images
-  ExtractROIFilterListPointer m_ExtractorList; // Mono-images extractors
+  StackFilterPointer          m_Stacker;       // Images stacker
+  FloatVectorImagePointerType m_Output;        // Stack of the images
 
 };
 
@@ -23,13 +23,7 @@ template <class TImage>
 void
 TensorflowSource<TImage>::Set(FloatVectorImageListType * inputList)
 {
-  // Create one stack for input images list
-  m_Concatener    = ListConcatenerFilterType::New();
-  m_List          = ImageListType::New();
-  m_ExtractorList = ExtractROIFilterListType::New();
-
-  // Split each input vector image into image
-  // and generate an mono channel image list
+  // Check the images sizes
   inputList->GetNthElement(0)->UpdateOutputInformation();
   SizeType size = inputList->GetNthElement(0)->GetLargestPossibleRegion().GetSize();
   for( unsigned int i = 0; i < inputList->Size(); i++ )
@@ -40,19 +34,24 @@ TensorflowSource<TImage>::Set(FloatVectorImageListType * inputList)
     {
       itkGenericExceptionMacro("Input image size number " << i << " mismatch");
     }
+  }
 
-    for( unsigned int j = 0; j < vectIm->GetNumberOfComponentsPerPixel(); j++)
-    {
-      typename MultiToMonoChannelFilterType::Pointer extractor = MultiToMonoChannelFilterType::New();
-      extractor->SetInput( vectIm );
-      extractor->SetChannel( j+1 );
-      extractor->UpdateOutputInformation();
-      m_ExtractorList->PushBack( extractor );
-      m_List->PushBack( extractor->GetOutput() );
-    }
+  // A single image needs no stacking
+  m_Stacker = StackFilterPointer();
+  if (inputList->Size() == 1)
+  {
+    m_Output = inputList->GetNthElement(0);
+    return;
+  }
+
+  // Stack the channels of all the images
+  m_Stacker = StackFilterType::New();
+  for( unsigned int i = 0; i < inputList->Size(); i++ )
+  {
+    m_Stacker->PushBackInput( inputList->GetNthElement(i) );
   }
-  m_Concatener->SetInput( m_List );
-  m_Concatener->UpdateOutputInformation();
+  m_Stacker->UpdateOutputInformation();
+  m_Output = m_Stacker->GetOutput();
 
 }
 
@@ -63,7 +62,7 @@ template <class TImage>
 typename TImage::Pointer
 TensorflowSource<TImage>::Get()
 {
-  return m_Concatener->GetOutput();
+  return m_Output;
 }
 
 } // end namespace otb
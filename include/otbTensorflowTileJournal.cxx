@@ -0,0 +1,105 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include "otbTensorflowTileJournal.h"
+
+namespace otb {
+namespace tf {
+
+//
+// Open the journal of this node. When resuming, the journals of all the nodes
+// of the same run are read. Else, only the journal of this node is truncated,
+// and the node of rank 0 removes the journals of the ranks which are not part
+// of this run.
+//
+void TileJournal::Open(const std::string & outputFileName, unsigned int rank, unsigned int nNodes,
+    bool resume, const std::string & runId)
+{
+  m_Directory = itksys::SystemTools::GetFilenamePath(outputFileName);
+  if (m_Directory.empty())
+    m_Directory = ".";
+  m_Prefix = itksys::SystemTools::GetFilenameName(outputFileName) + ".journal.";
+  std::stringstream fileName;
+  fileName << m_Directory << "/" << m_Prefix << rank;
+  m_FileName = fileName.str();
+
+  // Read the recorded tiles
+  m_Tiles.clear();
+  m_NumberOfStaleJournals = 0;
+  bool append = false;
+  itksys::Directory directory;
+  if (directory.Load(m_Directory))
+    {
+    for (unsigned long k = 0 ; k < directory.GetNumberOfFiles() ; k++)
+      {
+      const std::string name = directory.GetFile(k);
+      if (name.compare(0, m_Prefix.size(), m_Prefix) != 0)
+        continue;
+      if (!resume)
+        {
+        // Stale journal of a rank beyond the number of nodes
+        std::stringstream suffix(name.substr(m_Prefix.size()));
+        unsigned int otherRank;
+        if (rank == 0 && suffix >> otherRank && suffix.eof() && otherRank >= nNodes)
+          itksys::SystemTools::RemoveFile(m_Directory + "/" + name);
+        continue;
+        }
+      std::ifstream file(m_Directory + "/" + name);
+      std::string header;
+      if (!std::getline(file, header) || header != "run " + runId)
+        {
+        m_NumberOfStaleJournals++;
+        continue;
+        }
+      if (m_Directory + "/" + name == m_FileName)
+        append = true;
+      std::size_t tileIndex;
+      RegionType region;
+      while (file >> tileIndex >> region.GetModifiableIndex()[0] >> region.GetModifiableIndex()[1] >>
+          region.GetModifiableSize()[0] >> region.GetModifiableSize()[1])
+        {
+        m_Tiles[tileIndex] = region;
+        }
+      }
+    }
+
+  // Journal of this node
+  m_File.close();
+  m_File.open(m_FileName, append ? std::ios::app : std::ios::trunc);
+  if (!m_File.is_open())
+    {
+    itkGenericExceptionMacro("Unable to open the journal file " << m_FileName);
+    }
+  if (!append)
+    m_File << "run " << runId << std::endl;
+}
+
+bool TileJournal::IsDone(std::size_t tileIndex, const RegionType & region) const
+{
+  auto it = m_Tiles.find(tileIndex);
+  return it != m_Tiles.end() && it->second == region;
+}
+
+//
+// Record a tile (the line is flushed, so that it survives an interruption)
+//
+void TileJournal::MarkDone(std::size_t tileIndex, const RegionType & region)
+{
+  m_File << tileIndex << " " << region.GetIndex(0) << " " << region.GetIndex(1) << " " <<
+      region.GetSize(0) << " " << region.GetSize(1) << std::endl;
+  if (!m_File.good())
+    {
+    itkGenericExceptionMacro("Error while writing the journal file " << m_FileName);
+    }
+  m_Tiles[tileIndex] = region;
+}
+
+} // end namespace tf
+} // end namespace otb
@@ -0,0 +1,93 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWTILEJOURNAL_H_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWTILEJOURNAL_H_
+
+// ITK
+#include "itkImageRegion.h"
+#include "itkMacro.h"
+#include "itksys/Directory.hxx"
+#include "itksys/SystemTools.hxx"
+
+// STD
+#include <cstddef>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace otb {
+namespace tf {
+
+/*
+ * This class records the tiles of an output image which have been written,
+ * so that an interrupted processing can be resumed.
+ * The journal of an output is a set of sidecar text files (one per node,
+ * "<output>.journal.<rank>"), where each line is a completed tile: its index
+ * and its region. A tile is recorded once it has been written: a tile which
+ * was being written when the processing stopped is not recorded.
+ * When the journal is opened to resume a processing, the tiles recorded by
+ * all the nodes are read. Else, each node only truncates its own journal, so
+ * that the nodes do not have to be synchronized. The journals of the ranks
+ * beyond the number of nodes (left by a previous run with more nodes) are
+ * removed by the node of rank 0: no node of the current run opens them.
+ * The first line of each journal file is the identifier of the run which
+ * wrote it (e.g. a digest of the model, of the output grid and of the tile
+ * size). When resuming, the journals of another run are ignored, and the
+ * journal of this node is truncated if it is one of them. A recorded tile is
+ * also only considered as done if its region is the same.
+ */
+class TileJournal
+{
+public:
+
+  typedef itk::ImageRegion<2> RegionType;
+
+  TileJournal() : m_NumberOfStaleJournals(0) {};
+  virtual ~TileJournal() {};
+
+  // Open the journal of this node, for the run runId. When resuming, the
+  // tiles recorded by all the nodes of the same run are read, else the
+  // journal of this node is truncated
+  void Open(const std::string & outputFileName, unsigned int rank, unsigned int nNodes, bool resume,
+      const std::string & runId);
+
+  // Check if a tile has been recorded
+  bool IsDone(std::size_t tileIndex, const RegionType & region) const;
+
+  // Record a tile
+  void MarkDone(std::size_t tileIndex, const RegionType & region);
+
+  // Number of recorded tiles
+  std::size_t GetNumberOfDoneTiles() const { return m_Tiles.size(); }
+
+  // Number of journals ignored when resuming, because they were written by another run
+  unsigned int GetNumberOfStaleJournals() const { return m_NumberOfStaleJournals; }
+
+private:
+  TileJournal(const TileJournal&); //purposely not implemented
+  void operator=(const TileJournal&); //purposely not implemented
+
+  std::string                         m_Directory;  // Directory of the journal files
+  std::string                         m_Prefix;     // Name of the journal files, without the rank
+  std::string                         m_FileName;   // Journal file of this node
+  std::ofstream                       m_File;       // Journal of this node
+  std::map<std::size_t, RegionType>   m_Tiles;      // Recorded tiles
+  unsigned int                        m_NumberOfStaleJournals; // Journals of another run
+
+};
+
+} // end namespace tf
+} // end namespace otb
+
+#include "otbTensorflowTileJournal.cxx"
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWTILEJOURNAL_H_ */
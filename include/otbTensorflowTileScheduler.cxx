@@ -0,0 +1,207 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include "otbTensorflowTileScheduler.h"
+
+namespace otb {
+namespace tf {
+
+TileScheduler::TileScheduler()
+{
+  m_Rank = 0;
+  m_NumberOfNodes = 1;
+  m_Next = 0;
+}
+
+//
+// Split the region in tiles, in raster order
+//
+void TileScheduler::SetTiles(const RegionType & region, const SizeType & tileSize)
+{
+  if (tileSize[0] == 0 || tileSize[1] == 0)
+    {
+    itkGenericExceptionMacro("The tile size must be positive (" << tileSize << ")");
+    }
+
+  m_Tiles.clear();
+  for (SizeType::SizeValueType y = 0 ; y < region.GetSize(1) ; y += tileSize[1])
+    {
+    for (SizeType::SizeValueType x = 0 ; x < region.GetSize(0) ; x += tileSize[0])
+      {
+      IndexType index;
+      index[0] = region.GetIndex(0) + x;
+      index[1] = region.GetIndex(1) + y;
+      RegionType tile(index, tileSize);
+      tile.Crop(region);
+      m_Tiles.push_back(tile);
+      }
+    }
+  m_Done.assign(m_Tiles.size(), false);
+  m_Next = m_Rank;
+}
+
+void TileScheduler::SetDoneTiles(const std::vector<bool> & done)
+{
+  if (done.size() != m_Tiles.size())
+    {
+    itkGenericExceptionMacro("There is " << done.size() << " flags but " << m_Tiles.size() << " tiles");
+    }
+  m_Done = done;
+}
+
+std::size_t TileScheduler::GetNumberOfPendingTiles() const
+{
+  return std::count(m_Done.begin(), m_Done.end(), false);
+}
+
+//
+// Interleaved tiles: k % nNodes == rank
+//
+void TileScheduler::SetNode(unsigned int rank, unsigned int nNodes)
+{
+  if (nNodes == 0 || rank >= nNodes)
+    {
+    itkGenericExceptionMacro("Wrong rank (" << rank << ") or number of nodes (" << nNodes << ")");
+    }
+  m_Rank = rank;
+  m_NumberOfNodes = nNodes;
+  m_Next = m_Rank;
+}
+
+bool TileScheduler::Next(std::size_t & tileIndex)
+{
+  while (m_Next < m_Tiles.size() && m_Done[m_Next])
+    m_Next += m_NumberOfNodes;
+
+  if (m_Next >= m_Tiles.size())
+    return false;
+
+  tileIndex = m_Next;
+  m_Next += m_NumberOfNodes;
+  return true;
+}
+
+ClaimTileScheduler::ClaimTileScheduler(const std::string & directory)
+: m_Directory(directory), m_Count(0)
+{
+}
+
+//
+// Claim the next tile which is not done, and not claimed by another node.
+// Each node starts from the tile rank * nTiles / nNodes, and goes through
+// all the tiles once.
+//
+bool ClaimTileScheduler::Next(std::size_t & tileIndex)
+{
+  if (m_Count == 0 && !itksys::SystemTools::MakeDirectory(m_Directory))
+    {
+    itkGenericExceptionMacro("Unable to create the claims directory " << m_Directory);
+    }
+
+  const std::size_t first = static_cast<std::size_t>(m_Rank) * m_Tiles.size() / m_NumberOfNodes;
+  while (m_Count < m_Tiles.size())
+    {
+    const std::size_t k = (first + m_Count) % m_Tiles.size();
+    m_Count++;
+    if (m_Done[k])
+      continue;
+
+    std::stringstream claimFileName;
+    claimFileName << m_Directory << "/" << k;
+    FILE * claimFile = std::fopen(claimFileName.str().c_str(), "wx");
+    if (claimFile != NULL)
+      {
+      std::fclose(claimFile);
+      tileIndex = k;
+      return true;
+      }
+    if (errno != EEXIST)
+      {
+      itkGenericExceptionMacro("Unable to create the claim file " << claimFileName.str());
+      }
+    }
+  return false;
+}
+
+#ifdef OTB_USE_MPI
+MPITileScheduler::MPITileScheduler()
+{
+  m_Counter = 0;
+  const int rank = otb::MPIConfig::Instance()->GetMyRank();
+  m_Rank = rank;
+  m_NumberOfNodes = otb::MPIConfig::Instance()->GetNbProcs();
+  if (MPI_Win_create(rank == 0 ? &m_Counter : NULL, rank == 0 ? sizeof(long) : 0, sizeof(long),
+      MPI_INFO_NULL, MPI_COMM_WORLD, &m_Window) != MPI_SUCCESS)
+    {
+    itkGenericExceptionMacro("Unable to create the MPI window of the tiles counter");
+    }
+}
+
+MPITileScheduler::~MPITileScheduler()
+{
+  MPI_Win_free(&m_Window);
+}
+
+void MPITileScheduler::SetNode(unsigned int rank, unsigned int nNodes)
+{
+  if (rank != m_Rank || nNodes != m_NumberOfNodes)
+    {
+    itkGenericExceptionMacro("The rank and the number of nodes are the ones of the MPI processes (rank " <<
+        m_Rank << " of " << m_NumberOfNodes << ")");
+    }
+}
+
+//
+// All the processes get the done tiles of the process of rank 0, so that
+// they share the same list of tiles to process
+//
+void MPITileScheduler::SetDoneTiles(const std::vector<bool> & done)
+{
+  std::vector<char> flags(done.begin(), done.end());
+  unsigned long nTiles = flags.size();
+  MPI_Bcast(&nTiles, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+  flags.resize(nTiles);
+  MPI_Bcast(flags.data(), nTiles, MPI_CHAR, 0, MPI_COMM_WORLD);
+  TileScheduler::SetDoneTiles(std::vector<bool>(flags.begin(), flags.end()));
+
+  m_Pending.clear();
+  for (std::size_t k = 0 ; k < m_Done.size() ; k++)
+    if (!m_Done[k])
+      m_Pending.push_back(k);
+}
+
+//
+// Take the next tile from the counter of the process of rank 0
+//
+bool MPITileScheduler::Next(std::size_t & tileIndex)
+{
+  // No done tile was set: all the tiles are pending
+  if (m_Pending.empty() && !m_Tiles.empty() && GetNumberOfPendingTiles() == m_Tiles.size())
+    {
+    m_Pending.resize(m_Tiles.size());
+    std::iota(m_Pending.begin(), m_Pending.end(), 0);
+    }
+
+  const long one = 1;
+  long value = 0;
+  MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, m_Window);
+  MPI_Fetch_and_op(&one, &value, MPI_LONG, 0, 0, MPI_SUM, m_Window);
+  MPI_Win_unlock(0, m_Window);
+
+  if (value < 0 || static_cast<std::size_t>(value) >= m_Pending.size())
+    return false;
+
+  tileIndex = m_Pending[value];
+  return true;
+}
+#endif
+
+} // end namespace tf
+} // end namespace otb
@@ -0,0 +1,165 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWTILESCHEDULER_H_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWTILESCHEDULER_H_
+
+// OTB configuration (OTB_USE_MPI)
+#include "otbConfigure.h"
+
+// ITK
+#include "itkImageRegion.h"
+#include "itkMacro.h"
+#include "itksys/SystemTools.hxx"
+
+#ifdef OTB_USE_MPI
+#include "otbMPIConfig.h"
+#include <mpi.h>
+#endif
+
+// STD
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace otb {
+namespace tf {
+
+/*
+ * This class hands the tiles of an output region to the nodes of a
+ * distributed processing.
+ * The region is split in tiles of the same size, in raster order. When it is
+ * aligned on the output grid of the model filter, and the tile size is a
+ * multiple of the grid, the tiles do not overlap and do not need any halo
+ * besides the receptive field of the model.
+ * Each node gets the tiles k such as k % nNodes == rank: the nodes do not
+ * need to communicate (e.g. the tasks of a job array). Since the tiles are
+ * interleaved, a dense (or masked) area is shared among the nodes. The
+ * subclasses hand the tiles dynamically.
+ * Some tiles can be marked as done (e.g. tiles written by a previous
+ * processing): they are skipped, and the other tiles keep their node.
+ */
+class TileScheduler
+{
+public:
+
+  typedef itk::ImageRegion<2>     RegionType;
+  typedef RegionType::SizeType    SizeType;
+  typedef RegionType::IndexType   IndexType;
+  typedef std::vector<RegionType> RegionListType;
+
+  TileScheduler();
+  virtual ~TileScheduler() {};
+
+  // Split the region in tiles (the last tiles of each row/column are cropped)
+  void SetTiles(const RegionType & region, const SizeType & tileSize);
+  const RegionListType & GetTiles() const { return m_Tiles; }
+
+  // Tiles to skip (one flag per tile)
+  virtual void SetDoneTiles(const std::vector<bool> & done);
+
+  // Number of tiles to process (by all the nodes)
+  std::size_t GetNumberOfPendingTiles() const;
+
+  // Rank of this node, and number of nodes
+  virtual void SetNode(unsigned int rank, unsigned int nNodes);
+  unsigned int GetRank() const            { return m_Rank; }
+  unsigned int GetNumberOfNodes() const   { return m_NumberOfNodes; }
+
+  // Get the index of the next tile of this node. Returns false when there is
+  // no more tile to process.
+  virtual bool Next(std::size_t & tileIndex);
+
+protected:
+  RegionListType m_Tiles;         // All the tiles
+  std::vector<bool> m_Done;       // Tiles to skip
+  unsigned int   m_Rank;          // Rank of this node
+  unsigned int   m_NumberOfNodes; // Number of nodes
+  std::size_t    m_Next;          // Next tile of this node
+
+private:
+  TileScheduler(const TileScheduler&); //purposely not implemented
+  void operator=(const TileScheduler&); //purposely not implemented
+
+};
+
+/*
+ * This scheduler hands the tiles dynamically to nodes which do not
+ * communicate (e.g. the tasks of a job array): a node takes a tile by
+ * creating its claim file in a directory shared by the nodes, which fails
+ * when another node already took it. A node which is done with a tile takes
+ * the next unclaimed one, starting from its own part of the grid, so that
+ * the nodes which get cheap tiles (e.g. nodata, or masked) process more
+ * tiles.
+ * The claims directory belongs to one run: the tiles claimed in the
+ * directory are skipped, even if they were not written.
+ */
+class ClaimTileScheduler : public TileScheduler
+{
+public:
+
+  ClaimTileScheduler(const std::string & directory);
+  virtual ~ClaimTileScheduler() {};
+
+  virtual bool Next(std::size_t & tileIndex);
+
+private:
+  ClaimTileScheduler(const ClaimTileScheduler&); //purposely not implemented
+  void operator=(const ClaimTileScheduler&); //purposely not implemented
+
+  std::string m_Directory;  // Claims directory
+  std::size_t m_Count;      // Number of tiles looked at by this node
+};
+
+#ifdef OTB_USE_MPI
+/*
+ * This scheduler hands the tiles to the MPI processes dynamically: the next
+ * tile is taken from a counter held by the process of rank 0 (one-sided
+ * atomic fetch-and-add). A process which is done with a tile takes the next
+ * one, so that the processes which get cheap tiles (e.g. nodata, or masked)
+ * process more tiles.
+ * The constructor, the destructor and SetDoneTiles() are collective
+ * operations (the done tiles are the ones of the process of rank 0).
+ */
+class MPITileScheduler : public TileScheduler
+{
+public:
+
+  MPITileScheduler();
+  virtual ~MPITileScheduler();
+
+  // The rank and the number of nodes are the ones of MPI_COMM_WORLD
+  virtual void SetNode(unsigned int rank, unsigned int nNodes);
+
+  virtual void SetDoneTiles(const std::vector<bool> & done);
+
+  virtual bool Next(std::size_t & tileIndex);
+
+private:
+  MPITileScheduler(const MPITileScheduler&); //purposely not implemented
+  void operator=(const MPITileScheduler&); //purposely not implemented
+
+  long    m_Counter;  // Next tile to process (only used on the process of rank 0)
+  std::vector<std::size_t> m_Pending; // Tiles to process
+  MPI_Win m_Window;   // Window exposing m_Counter
+};
+#endif
+
+} // end namespace tf
+} // end namespace otb
+
+#include "otbTensorflowTileScheduler.cxx"
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWTILESCHEDULER_H_ */
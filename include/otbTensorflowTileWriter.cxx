@@ -0,0 +1,188 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include "otbTensorflowTileWriter.h"
+
+namespace otb {
+namespace tf {
+
+TileWriter::TileWriter()
+{
+  m_Dataset = NULL;
+  m_NumberOfBands = 0;
+}
+
+TileWriter::~TileWriter()
+{
+  Close();
+}
+
+//
+// Check if the file has the layout (size, bands, pixel type, blocks)
+//
+bool TileWriter::HasLayout(GDALDataset * dataset, const LayoutType & layout)
+{
+  if (static_cast<unsigned int>(dataset->GetRasterXSize()) != layout.m_Size[0] ||
+      static_cast<unsigned int>(dataset->GetRasterYSize()) != layout.m_Size[1] ||
+      static_cast<unsigned int>(dataset->GetRasterCount()) != layout.m_NumberOfBands)
+    return false;
+
+  for (unsigned int band = 1 ; band <= layout.m_NumberOfBands ; band++)
+    {
+    int blockX, blockY;
+    dataset->GetRasterBand(band)->GetBlockSize(&blockX, &blockY);
+    if (dataset->GetRasterBand(band)->GetRasterDataType() != layout.m_DataType ||
+        static_cast<unsigned int>(blockX) != layout.m_BlockSize ||
+        static_cast<unsigned int>(blockY) != layout.m_BlockSize)
+      return false;
+    }
+  return true;
+}
+
+//
+// Create the file. The blocks which are not written are filled with zeros
+// when the file is closed (SPARSE_OK=FALSE), so that all the blocks have
+// their place in the file.
+//
+void TileWriter::Create(const std::string & fileName, const LayoutType & layout)
+{
+  GDALDriver * driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+  if (driver == NULL)
+    {
+    itkGenericExceptionMacro("The GTiff driver of GDAL is not available");
+    }
+
+  const std::string blockSize = std::to_string(layout.m_BlockSize);
+  char ** options = NULL;
+  options = CSLSetNameValue(options, "TILED", "YES");
+  options = CSLSetNameValue(options, "BLOCKXSIZE", blockSize.c_str());
+  options = CSLSetNameValue(options, "BLOCKYSIZE", blockSize.c_str());
+  options = CSLSetNameValue(options, "SPARSE_OK", "FALSE");
+  options = CSLSetNameValue(options, "BIGTIFF", "IF_SAFER");
+  GDALDataset * dataset = driver->Create(fileName.c_str(), layout.m_Size[0], layout.m_Size[1],
+      layout.m_NumberOfBands, layout.m_DataType, options);
+  CSLDestroy(options);
+  if (dataset == NULL)
+    {
+    itkGenericExceptionMacro("Unable to create the output file " << fileName << ": " << CPLGetLastErrorMsg());
+    }
+
+  double geoTransform[6];
+  std::copy(layout.m_GeoTransform, layout.m_GeoTransform + 6, geoTransform);
+  dataset->SetGeoTransform(geoTransform);
+  if (!layout.m_Projection.empty())
+    dataset->SetProjection(layout.m_Projection.c_str());
+  GDALClose(dataset);
+}
+
+//
+// Open the output file. The file is checked, and created if needed, by one
+// node at a time (the lock file is created exclusively).
+//
+void TileWriter::Open(const std::string & fileName, const LayoutType & layout, bool create)
+{
+  Close();
+  GDALAllRegister();
+  m_FileName = fileName;
+  m_NumberOfBands = layout.m_NumberOfBands;
+
+  const std::string lockFileName = fileName + ".lock";
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  FILE * lockFile = NULL;
+  while ((lockFile = std::fopen(lockFileName.c_str(), "wx")) == NULL)
+    {
+    if (errno != EEXIST)
+      {
+      itkGenericExceptionMacro("Unable to create the lock file " << lockFileName);
+      }
+    if (std::chrono::steady_clock::now() - start > std::chrono::minutes(10))
+      {
+      itkGenericExceptionMacro("The lock file " << lockFileName << " is held for more than 10 minutes " <<
+          "(remove it if no node is running)");
+      }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  std::fclose(lockFile);
+
+  // Check the layout of the existing file
+  bool hasLayout = false;
+  if (itksys::SystemTools::FileExists(fileName))
+    {
+    CPLPushErrorHandler(CPLQuietErrorHandler);
+    GDALDataset * dataset = static_cast<GDALDataset *>(GDALOpen(fileName.c_str(), GA_ReadOnly));
+    CPLPopErrorHandler();
+    if (dataset != NULL)
+      {
+      hasLayout = HasLayout(dataset, layout);
+      GDALClose(dataset);
+      }
+    }
+
+  try
+    {
+    if (!hasLayout)
+      {
+      if (!create)
+        {
+        itkGenericExceptionMacro("The output file " << fileName << " does not exist, or does not have the " <<
+            "layout of the output image");
+        }
+      Create(fileName, layout);
+      }
+    }
+  catch(...)
+    {
+    itksys::SystemTools::RemoveFile(lockFileName);
+    throw;
+    }
+  itksys::SystemTools::RemoveFile(lockFileName);
+
+  m_Dataset = static_cast<GDALDataset *>(GDALOpen(fileName.c_str(), GA_Update));
+  if (m_Dataset == NULL)
+    {
+    itkGenericExceptionMacro("Unable to open the output file " << fileName << " in update mode");
+    }
+}
+
+//
+// Write a tile, and flush it, so that it is in the file once it is recorded
+// as written
+//
+void TileWriter::Write(const RegionType & region, const void * buffer, GDALDataType bufferType)
+{
+  if (m_Dataset == NULL)
+    {
+    itkGenericExceptionMacro("The output file is not opened");
+    }
+
+  const GSpacing valueSize = GDALGetDataTypeSizeBytes(bufferType);
+  const GSpacing pixelSpace = valueSize * m_NumberOfBands;
+  const CPLErr error = m_Dataset->RasterIO(GF_Write, region.GetIndex(0), region.GetIndex(1),
+      region.GetSize(0), region.GetSize(1), const_cast<void *>(buffer), region.GetSize(0), region.GetSize(1),
+      bufferType, m_NumberOfBands, NULL, pixelSpace, pixelSpace * region.GetSize(0), valueSize);
+  m_Dataset->FlushCache();
+  if (error != CE_None)
+    {
+    itkGenericExceptionMacro("Error while writing the tile " << region.GetIndex() << ", " << region.GetSize() <<
+        " in " << m_FileName << ": " << CPLGetLastErrorMsg());
+    }
+}
+
+void TileWriter::Close()
+{
+  if (m_Dataset != NULL)
+    {
+    GDALClose(m_Dataset);
+    m_Dataset = NULL;
+    }
+}
+
+} // end namespace tf
+} // end namespace otb
@@ -0,0 +1,95 @@
+/*=========================================================================
+
+  Copyright (c) Remi Cresson (IRSTEA). All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWTILEWRITER_H_
+#define MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWTILEWRITER_H_
+
+// ITK
+#include "itkImageRegion.h"
+#include "itkMacro.h"
+#include "itksys/SystemTools.hxx"
+
+// GDAL
+#include "gdal_priv.h"
+#include "cpl_error.h"
+
+// STD
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+namespace otb {
+namespace tf {
+
+/*
+ * This class writes the tiles of an output image in place, in one GeoTIFF
+ * file shared by the nodes of a distributed processing.
+ * The file is uncompressed and tiled, and all its blocks are allocated when
+ * it is created: writing a block does not move the other ones. The tiles
+ * written by the nodes must be aligned on the blocks, so that two nodes
+ * never write in the same block.
+ * The file is created by the first node which opens it (under a lock file),
+ * unless it already exists with the same layout.
+ */
+class TileWriter
+{
+public:
+
+  typedef itk::ImageRegion<2>   RegionType;
+  typedef RegionType::SizeType  SizeType;
+
+  /* Layout of the output file */
+  struct LayoutType
+  {
+    SizeType                 m_Size;
+    unsigned int             m_NumberOfBands = 0;
+    GDALDataType             m_DataType = GDT_Float32;
+    unsigned int             m_BlockSize = 256;
+    double                   m_GeoTransform[6];
+    std::string              m_Projection;
+  };
+
+  TileWriter();
+  virtual ~TileWriter();
+
+  // Open the output file in update mode. When create is true, the file is
+  // created if it does not exist, or if its layout differs. Else, it must
+  // exist with the same layout.
+  void Open(const std::string & fileName, const LayoutType & layout, bool create);
+
+  // Write the pixel interleaved values of a tile (the region is relative to
+  // the first pixel of the file), and flush them to the file
+  void Write(const RegionType & region, const void * buffer, GDALDataType bufferType);
+
+  // Close the output file
+  void Close();
+
+private:
+  TileWriter(const TileWriter&); //purposely not implemented
+  void operator=(const TileWriter&); //purposely not implemented
+
+  static bool HasLayout(GDALDataset * dataset, const LayoutType & layout);
+  static void Create(const std::string & fileName, const LayoutType & layout);
+
+  std::string                m_FileName;  // Output file
+  GDALDataset *              m_Dataset;   // Output file, opened in update mode
+  unsigned int               m_NumberOfBands;
+
+};
+
+} // end namespace tf
+} // end namespace otb
+
+#include "otbTensorflowTileWriter.cxx"
+
+#endif /* MODULES_REMOTE_OTBTENSOFLOW_INCLUDE_OTBTENSORFLOWTILEWRITER_H_ */
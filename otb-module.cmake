@@ -8,7 +8,13 @@ otb_module(OTBTensorflow
 		OTBStreaming
 		OTBExtendedFilename
 		OTBImageIO
+		OTBGdalAdapters
 		OTBSupervised
+		OTBIOXML
+		OTBProjection
+		OTBConversion
+	OPTIONAL_DEPENDS
+		OTBMPIConfig
 	TEST_DEPENDS
 		OTBTestKernel
 		OTBCommandLine